@@ -1,78 +1,201 @@
 /** \file
  * \brief Example code for Simple Open EtherCAT master with Synapticon SOMANET servo drive
  *
- * Usage : CSV_test_SOMANET_v42 [ifname1]
+ * Usage : CSV_test_SOMANET_v42 [ifname1] [-t] [-b] [-i] [-s] [-a] [-p] [-c] [-d] [-n] [-m] [-r] [-j] [-o]
  * ifname is NIC interface, f.e. eth0
+ * -t sends the process data with cached frames (ecframe.c)
+ * -b benchmarks the standard against the cached send path before the cyclic loop
+ * -i identifies the frequency response from VelocityOffset to VelocityValue while
+ *    running at 100RPM and writes it to IDENT_FILE (somanet_ident.c)
+ * -s replaces the constant 100RPM by a repeating bidirectional velocity profile
+ *    from the master-side signal generator (somanet_siggen.c)
+ * -a drives every slave at 100RPM, directly on the process data of every slave
+ *    (somanet_axes.c), not combined with -i and -s. The cycle of -a, -p and -c is the
+ *    engine of somanet_engine.c, which somanet_simulate runs offline against a drive model.
+ *    The engine disables an axis for good when it breaks its velocity, position or
+ *    following error limit
+ * -p like -a, but in profile position mode: every slave follows a stream of queued
+ *    targets, a triangle of ENGINE_PP_STEPS steps around its start position (somanet_pp.c)
+ * -c like -a, but in cyclic synchronous position: a producer thread buffers a sine
+ *    around the start position of every slave as setpoints ENGINE_IP_PERIOD_US apart, the
+ *    cycle interpolates between them (somanet_ip.c)
+ * -d records the inputs of all slaves every cycle, compressed, to PDO_FILE (ecpack.c),
+ *    read it with ecpack_decode (built from ecpack_decode.c and ecpack_read.c). Records
+ *    carry the DC time mapped to CLOCK_TAI (ectai.c), so recordings of several lines
+ *    merge on one timeline with ecpack_merge
+ * -n backs IOmap, log rings and capture buffers with normal pages instead of huge
+ *    pages where they are large enough (echuge.c), to compare against
+ * -m logs the dTLB/iTLB misses of every cycle and prints their maximum and mean
+ * -r records working counter losses and the steps of ecatcheck with their time to
+ *    RECOVERY_FILE (ecrecovery.c), for recovery_report of the line emulator
+ * -j hot-connects slaves plugged in at the end of the line while running: the check
+ *    thread brings them to OP in group HOT_GROUP, mapped behind the configured slaves
+ *    in the IOmap, and the cycle exchanges their process data in a frame of its own
+ *    (echotconnect.c). ecatcheck supervises and recovers them like the configured ones
+ * -o routes process data between slaves in the master with one cycle latency, as
+ *    listed in pdoroutes: PositionValue of slave 1 to UserMOSI of slave 2 and the
+ *    digital inputs of slave 2 to the digital outputs of slave 1 (ecroute.c)
  *
  * This is a minimal test, programmed based on the simple_test of SOEM, driving a motor with SOMANET (v4.2 firmware) in CSV mode at 100RPM.
  *
+ * Build together with eclog.c, ecframe.c, somanet_ident.c, somanet_siggen.c, somanet_axes.c, somanet_axes_slaves.c, somanet_pp.c, somanet_ip.c, somanet_engine.c, echuge.c, ecrecovery.c, ecpack.c, ecpack_read.c, ectai.c, ecstate.c, ecsegment.c, echotconnect.c and ecroute.c. Cyclic and error messages go to the binary log ECLOG_FILE,
+ * read it with eclog_decode (built from eclog_decode.c).
+ *
  * Chencheng Tang 2019
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <inttypes.h>
+#include <math.h>
 
 #include "ethercat.h"
+#include "eclog.h"
+#include "ecframe.h"
+#include "echuge.h"
+#include "ecrecovery.h"
+#include "ecpack.h"
+#include "ectai.h"
+#include "ecstate.h"
+#include "ecsegment.h"
+#include "echotconnect.h"
+#include "ecroute.h"
+#include "somanet_42.h"
+#include "somanet_ident.h"
+#include "somanet_siggen.h"
+#include "somanet_engine.h"
 
 #define EC_TIMEOUTMON 500
+#define ECLOG_FILE "CSV_test_SOMANET_v42.eclog"
+#define IDENT_FILE "CSV_test_SOMANET_v42_ident.csv"
+#define RECOVERY_FILE "CSV_test_SOMANET_v42_recovery.csv"
+#define PDO_FILE "CSV_test_SOMANET_v42.ecpack"
+#define PDO_BLOCK 1000
+#define CYCLETIME_US 5000
+#define IOMAP_SIZE 4096
+#define HOT_GROUP 1
+/* passes of the check thread between two counts of the slaves on the line */
+#define HOT_PERIOD 100
 
-char IOmap[4096];
+char *IOmap;
 OSAL_THREAD_HANDLE thread1;
 int expectedWKC;
-boolean needlf;
 volatile int wkc;
 boolean inOP;
 uint8 currentgroup = 0;
+boolean useframecache = FALSE;
+boolean runbench = FALSE;
+ecframe_templatet frametemplate;
+boolean runident = FALSE;
+ident_axist identaxis;
+boolean runsiggen = FALSE;
+siggen_t siggen;
+boolean runaxes = FALSE;
+engine_t engine;
+boolean runpp = FALSE;
+boolean runip = FALSE;
+OSAL_THREAD_HANDLE ipthread;
+volatile int iprunning;
+boolean measuretlb = FALSE;
+boolean recordpdo = FALSE;
+ecpack_t pdorec;
+ectai_t pdotai;
+ecstate_snapshott slavestates;
+boolean recordrecovery = FALSE;
+boolean hotconnect = FALSE;
+echot_t hot;
+boolean routepdo = FALSE;
+ecroute_t route;
+
+#define PDO_ROUTE(src, infield, dst, outfield) \
+   ECROUTE_FIELD(src, in_somanet_42t, infield, dst, out_somanet_42t, outfield)
 
-/* define pointer structure */
-typedef struct PACKED
+/* routes of -o, compiled into one copy of the position and one of the four digital
+   inputs */
+const ecroute_entryt pdoroutes[] =
 {
-  int16 Statusword;
-  int8  OpModeDisplay;
-  int32 PositionValue;
-  int32 VelocityValue;
-  int16 TorqueValue;
-  int32 SecPositionValue;
-  int32 SecVelocityValue;
-  int16 AnalogInput1;
-  int16 AnalogInput2;
-  int16 AnalogInput3;
-  int16 AnalogInput4;
-  int32 TuningStatus;
-  int8  DigitalInput1;
-  int8  DigitalInput2;
-  int8  DigitalInput3;
-  int8  DigitalInput4;
-  int32 UserMISO;
-  int32 Timestamp;
-  int32 PositionDemandInternalValue;
-  int32 VelocityDemandValue;
-  int16 TorqueDemand;
-} in_somanet_42t;
-
-typedef struct PACKED
+   PDO_ROUTE(1, PositionValue, 2, UserMOSI),
+   PDO_ROUTE(2, DigitalInput1, 1, DigitalOutput1),
+   PDO_ROUTE(2, DigitalInput2, 1, DigitalOutput2),
+   PDO_ROUTE(2, DigitalInput3, 1, DigitalOutput3),
+   PDO_ROUTE(2, DigitalInput4, 1, DigitalOutput4)
+};
+
+
+/* Setpoint producer of -c on its own thread. Marks iprunning -1 when it has stopped. */
+OSAL_THREAD_FUNC ipproducer(void *ptr)
 {
-  int16 Controlword;
-  int8  OpMode;
-  int16 TargetTorque;
-  int32 TargetPosition;
-  int32 TargetVelocity;
-  int16 TorqueOffset;
-  int32 TuningCommand;
-  int8  DigitalOutput1;
-  int8  DigitalOutput2;
-  int8  DigitalOutput3;
-  int8  DigitalOutput4;
-  int32 UserMOSI;
-  int32 VelocityOffset;
-} out_somanet_42t;
+   (void)ptr;                  /* Not used */
+
+   while (iprunning)
+   {
+      engine_produce(&engine);
+      osal_usleep(ENGINE_IP_PERIOD_US / 2);
+   }
+   __atomic_store_n(&iprunning, -1, __ATOMIC_RELEASE);
+}
 
+/* Inputs of every SOMANET slave as recorded by -d: bit fields XOR coded, positions and
+   counters against their rate of change, the rest against the previous cycle. */
+#define PDO_FIELDS(X) \
+   X(Statusword, ECPACK_XOR) \
+   X(OpModeDisplay, ECPACK_XOR) \
+   X(PositionValue, ECPACK_DELTA2) \
+   X(VelocityValue, ECPACK_DELTA) \
+   X(TorqueValue, ECPACK_DELTA) \
+   X(SecPositionValue, ECPACK_DELTA2) \
+   X(SecVelocityValue, ECPACK_DELTA) \
+   X(AnalogInput1, ECPACK_DELTA) \
+   X(AnalogInput2, ECPACK_DELTA) \
+   X(AnalogInput3, ECPACK_DELTA) \
+   X(AnalogInput4, ECPACK_DELTA) \
+   X(TuningStatus, ECPACK_XOR) \
+   X(DigitalInput1, ECPACK_XOR) \
+   X(DigitalInput2, ECPACK_XOR) \
+   X(DigitalInput3, ECPACK_XOR) \
+   X(DigitalInput4, ECPACK_XOR) \
+   X(UserMISO, ECPACK_XOR) \
+   X(Timestamp, ECPACK_DELTA2) \
+   X(PositionDemandInternalValue, ECPACK_DELTA2) \
+   X(VelocityDemandValue, ECPACK_DELTA) \
+   X(TorqueDemand, ECPACK_DELTA)
+
+/* open the recording of -d over the inputs of group 0 */
+boolean pdorecord_open(void)
+{
+   static const ecpack_fieldt base[] =
+   {
+#define PDO_FIELD(name, kind) { #name, offsetof(in_somanet_42t, name), sizeof(((in_somanet_42t *)0)->name), kind },
+      PDO_FIELDS(PDO_FIELD)
+#undef PDO_FIELD
+   };
+   int nbase = sizeof(base) / sizeof(base[0]), slave, i, n = 0;
+   ecpack_fieldt *fields = malloc(ec_slavecount * sizeof(base));
+   boolean ok;
+
+   for (slave = 1; fields && (slave <= ec_slavecount); slave++)
+   {
+      if (!ec_slave[slave].inputs || (ec_slave[slave].Ibytes < sizeof(in_somanet_42t)))
+         continue;
+      for (i = 0; i < nbase; i++, n++)
+      {
+         fields[n] = base[i];
+         fields[n].offset += (uint32)(ec_slave[slave].inputs - ec_slave[0].inputs);
+         snprintf(fields[n].name, sizeof(fields[n].name), "s%d.%.24s", slave, base[i].name);
+      }
+   }
+   ok = fields && ecpack_open(&pdorec, PDO_FILE, fields, n, ec_slave[0].Ibytes, PDO_BLOCK);
+   free(fields);
+   return ok;
+}
 
 void simpletest(char *ifname)
 {
-    int i, j, chk;
-    needlf = FALSE;
+    int i, j, n, chk;
+    echuge_tlbt tlb;
+    uint64 dtlb, itlb, dtlbmax = 0, itlbmax = 0, dtlbsum = 0, itlbsum = 0;
     inOP = FALSE;
 
    printf("Starting simple test\n");
@@ -88,7 +211,9 @@ void simpletest(char *ifname)
       {
          printf("%d slaves found and configured.\n",ec_slavecount);
 
-         ec_config_map(&IOmap);
+         n = ec_config_map(IOmap);
+         if (hotconnect)
+            echot_init(&hot, (uint8 *)IOmap + n, IOMAP_SIZE - n, HOT_GROUP);
 
          ec_configdc();
 
@@ -121,8 +246,94 @@ void simpletest(char *ifname)
             printf("Operational state reached for all slaves.\n");
             inOP = TRUE;
 
+            /* lay out the process data frames once, the mapping is fixed from here on */
+            if ((useframecache || runbench) && !ecframe_build(&frametemplate, 0))
+            {
+               printf("Group 0 can not use cached frames, using ec_send_processdata.\n");
+               useframecache = FALSE;
+               runbench = FALSE;
+            }
+            if (runbench)
+               ecframe_bench(&frametemplate, 1000);
+            if (recordpdo && !pdorecord_open())
+            {
+               printf("Can not open process data recording %s\n", PDO_FILE);
+               recordpdo = FALSE;
+            }
+            ectai_init(&pdotai);
+            if (routepdo && !ecroute_compile(&route, (uint8 *)IOmap, pdoroutes,
+                                             sizeof(pdoroutes) / sizeof(pdoroutes[0])))
+            {
+               printf("Process data route %d does not fit the slaves, not routing.\n", route.error);
+               routepdo = FALSE;
+            }
+
+            if (runaxes)
+            {
+               if (!axes_setup_slaves(&engine.axes, 1, ec_slavecount) ||
+                   !engine_setup(&engine, runpp ? ENGINE_PP : runip ? ENGINE_IP : ENGINE_CSV, ec_DCtime))
+               {
+                  printf("Slaves can not be driven as axes, driving slave 1 only.\n");
+                  runaxes = runpp = runip = FALSE;
+               }
+               else
+               {
+                  if (runip)
+                  {
+                     iprunning = 1;
+                     if (!osal_thread_create(&ipthread, 128000, &ipproducer, NULL))
+                     {
+                        /* stopped from the start, the cycle produces the setpoints */
+                        iprunning = -1;
+                        printf("Setpoint producer thread can not be started, producing in the cycle.\n");
+                     }
+                  }
+               }
+            }
+
+            if (runsiggen)
+            {
+               siggen_configt siggencfg;
+
+               memset(&siggencfg, 0, sizeof(siggencfg));
+               siggencfg.profile = SIGGEN_VELOCITY_BIDIRECTIONAL;
+               siggencfg.target = 100;
+               siggencfg.acceleration = 200;
+               siggencfg.deceleration = 200;
+               siggencfg.sustain_time = 2.0;
+               siggencfg.repeat = TRUE;
+               siggen_setup(&siggen, &siggencfg);
+            }
+
+            if (runident)
+            {
+               ident_configt identcfg;
+
+               identcfg.excitation = IDENT_MULTISINE;
+               identcfg.input = IDENT_VELOCITY_OFFSET;
+               identcfg.amplitude = 50;
+               identcfg.f0 = 0.5;
+               identcfg.f1 = 0.45 * 1e6 / CYCLETIME_US;
+               identcfg.cycletime = CYCLETIME_US * 1e-6;
+               identcfg.segment = 512;
+               identcfg.averages = 4;
+               if (!ident_setup(&identaxis, &identcfg) || !ident_start_workers(1))
+               {
+                  printf("Frequency response identification can not be set up.\n");
+                  ident_free(&identaxis);
+                  runident = FALSE;
+               }
+            }
+
             // initialize counter j
             j = 0;
+            eclog_thread_init();
+            echuge_report();
+            if (measuretlb && !echuge_tlb_open(&tlb))
+            {
+               printf("TLB miss counters not available (PMU or perf_event_paranoid).\n");
+               measuretlb = FALSE;
+            }
                 /* create and connect struture pointers to I/O */
             in_somanet_42t* in_somanet_1;
             in_somanet_1 = (in_somanet_42t*) ec_slave[0].inputs;
@@ -132,10 +343,35 @@ void simpletest(char *ifname)
                 /* cyclic loop */
             for(i = 1; i <= 10000; i++)
             { 
-               ec_send_processdata();
-               wkc = ec_receive_processdata(EC_TIMEOUTRET);
+               if (useframecache)
+               {
+                  ecframe_send_processdata(&frametemplate);
+                  wkc = ecframe_receive_processdata(&frametemplate, EC_TIMEOUTRET);
+               }
+               else
+               {
+                  ec_send_processdata();
+                  wkc = ec_receive_processdata(EC_TIMEOUTRET);
+               }
+               ecrec_wkc(wkc, expectedWKC);
+               if (hotconnect)
+                  echot_cycle(&hot);
+               if (recordpdo)
+               {
+                  ectai_sample(&pdotai, ec_DCtime);
+                  ecpack_write(&pdorec, ectai_time(&pdotai, ec_DCtime), ec_slave[0].inputs);
+               }
 
-                   if(wkc >= expectedWKC)
+                   if((wkc >= expectedWKC) && runaxes)
+                    {
+                        /* all axes at once */
+                        if (runip && (__atomic_load_n(&iprunning, __ATOMIC_ACQUIRE) == -1))
+                           engine_produce(&engine);
+                        engine_cycle(&engine, ec_DCtime);
+                        ECLOG("Processdata cycle %4d , WKC %d , Statusword: %X , ActualVel: %" PRId32 " , T:%" PRId64,
+                              i, wkc, engine.axes.in[0]->Statusword, engine.axes.in[0]->VelocityValue, ec_DCtime);
+                    }
+                   else if(wkc >= expectedWKC)
                     {
                         j++;
 
@@ -173,27 +409,66 @@ void simpletest(char *ifname)
                            
                            // Sending velocity command
                         else if ((in_somanet_1->Statusword & 0b0000000001101111) == 0b0000000000100111)
-			                  out_somanet_1->TargetVelocity = 100;
+                        {
+                           if (!runsiggen)
+                              out_somanet_1->TargetVelocity = 100;
+                           else
+                           {
+                              if (!siggen.active)
+                                 siggen_start(&siggen, in_somanet_1, i);
+                              siggen_cycle(&siggen, &out_somanet_1, 1, i, CYCLETIME_US * 1e-6);
+                           }
+                              // Excite the velocity loop on top of the command, once
+                           if (runident && (identaxis.state == IDENT_IDLE))
+                              ident_start(&identaxis);
+                           ident_cycle(&identaxis, in_somanet_1, out_somanet_1);
+                        }
+                           // A capture the axis drops out of is abandoned with its offset
+                        if ((in_somanet_1->Statusword & 0b0000000001101111) != 0b0000000000100111)
+                           ident_abort(&identaxis, out_somanet_1);
                         
 
-                        printf("Processdata cycle %4d , WKC %d ,", i, wkc);
-                          // print statusword
-                        printf(" Statusword: %X ,", in_somanet_1->Statusword);
-                          // print opmode display
-                        printf(" Op Mode Display: %d ,", in_somanet_1->OpModeDisplay);
-                          // print actual position value
-                        printf(" ActualPos: %" PRId32 " ,", in_somanet_1->PositionValue);
-                          // print actual velocity value
-                        printf(" ActualVel: %" PRId32 " ,", in_somanet_1->VelocityValue);
-                          // print demand velocity value
-                        printf(" DemandVel: %" PRId32 " ,", in_somanet_1->VelocityDemandValue);
-
-                        printf(" T:%" PRId64 "\r",ec_DCtime);
-                        needlf = TRUE;
+                          // log cycle, WKC, statusword, opmode display, actual position,
+                          // actual velocity, demand velocity and DC time
+                        ECLOG("Processdata cycle %4d , WKC %d , Statusword: %X , Op Mode Display: %d ,"
+                              " ActualPos: %" PRId32 " , ActualVel: %" PRId32 " , DemandVel: %" PRId32 " ,"
+                              " T:%" PRId64,
+                              i, wkc, in_somanet_1->Statusword, in_somanet_1->OpModeDisplay,
+                              in_somanet_1->PositionValue, in_somanet_1->VelocityValue,
+                              in_somanet_1->VelocityDemandValue, ec_DCtime);
+                    }
+                    /* after the application, the routes own their outputs */
+                    if (routepdo && (wkc >= expectedWKC))
+                       ecroute_run(&route);
+                    if (measuretlb && echuge_tlb_read(&tlb, &dtlb, &itlb))
+                    {
+                       ECLOG("TLB misses cycle %4d , dTLB %" PRIu64 " , iTLB %" PRIu64, i, dtlb, itlb);
+                       dtlbmax = (dtlb > dtlbmax) ? dtlb : dtlbmax;
+                       itlbmax = (itlb > itlbmax) ? itlb : itlbmax;
+                       dtlbsum += dtlb;
+                       itlbsum += itlb;
                     }
-                    osal_usleep(5000);
+                    osal_usleep(CYCLETIME_US);
                 }
                 inOP = FALSE;
+                if (measuretlb)
+                {
+                    printf("TLB misses per cycle: dTLB max %" PRIu64 " mean %.1f, iTLB max %" PRIu64 " mean %.1f\n",
+                           dtlbmax, dtlbsum / 10000.0, itlbmax, itlbsum / 10000.0);
+                    echuge_tlb_close(&tlb);
+                }
+                if (runident)
+                {
+                    /* the workers need a few ms after the capture completes */
+                    for (i = 0; (i < 1000) && (identaxis.state >= IDENT_CAPTURED) && (identaxis.state < IDENT_DONE); i++)
+                        osal_usleep(1000);
+                    if (ident_write_csv(&identaxis, IDENT_FILE))
+                        printf("Frequency response written to %s\n", IDENT_FILE);
+                    else
+                        printf("Frequency response identification did not complete.\n");
+                }
+                if (eclog_dropped())
+                    printf("%u log records dropped\n", eclog_dropped());
             }
             else
             {
@@ -227,78 +502,147 @@ void simpletest(char *ifname)
     }
 }
 
+/* Supervise the slaves of one group after a working counter loss or a failed check:
+   acknowledge errors, return to OP, reconfigure and recover lost slaves. */
+void ecatcheck_group(uint8 group)
+{
+    int slave;
+    uint16 segfirst, seglast;
+
+    /* one ore more slaves are not responding */
+    ecrec_event(ECREC_CHECK, 0);
+    ec_group[group].docheckstate = FALSE;
+    ec_readstate();
+    /* a run of slaves without state is a segment that lost power, it is
+       brought back as a whole instead of slave by slave */
+    segfirst = seglast = 0;
+    if (ecseg_find(group, &segfirst, &seglast))
+    {
+       for (slave = segfirst; slave <= seglast; slave++)
+       {
+          if (!ec_slave[slave].islost)
+          {
+             ec_slave[slave].islost = TRUE;
+             ECLOG("ERROR : slave %d lost\n",slave);
+             ecrec_event(ECREC_LOST, slave);
+             ecstate_event(slave, ECSTATE_LOSSES);
+          }
+       }
+       if (ecseg_recover(segfirst, seglast, EC_TIMEOUTSTATE) < seglast - segfirst + 1)
+          ec_group[group].docheckstate = TRUE;
+       for (slave = segfirst; slave <= seglast; slave++)
+       {
+          if (ec_slave[slave].state == EC_STATE_OPERATIONAL)
+          {
+             ec_slave[slave].islost = FALSE;
+             ECLOG("MESSAGE : slave %d recovered\n",slave);
+             ecrec_event(ECREC_RECOVERED, slave);
+             ecstate_event(slave, ECSTATE_RECOVERIES);
+          }
+       }
+    }
+    for (slave = 1; slave <= ec_slavecount; slave++)
+    {
+       if ((slave >= segfirst) && (slave <= seglast))
+          continue;
+       if ((ec_slave[slave].group == group) && (ec_slave[slave].state != EC_STATE_OPERATIONAL))
+       {
+          ec_group[group].docheckstate = TRUE;
+          if (ec_slave[slave].state == (EC_STATE_SAFE_OP + EC_STATE_ERROR))
+          {
+             ECLOG("ERROR : slave %d is in SAFE_OP + ERROR, attempting ack.\n", slave);
+             ecrec_event(ECREC_ACK, slave);
+             ecstate_event(slave, ECSTATE_ACKS);
+             ec_slave[slave].state = (EC_STATE_SAFE_OP + EC_STATE_ACK);
+             ec_writestate(slave);
+          }
+          else if(ec_slave[slave].state == EC_STATE_SAFE_OP)
+          {
+             ECLOG("WARNING : slave %d is in SAFE_OP, change to OPERATIONAL.\n", slave);
+             ecrec_event(ECREC_SAFEOP_TO_OP, slave);
+             ec_slave[slave].state = EC_STATE_OPERATIONAL;
+             ec_writestate(slave);
+          }
+          else if(ec_slave[slave].state > EC_STATE_NONE)
+          {
+             if (ec_reconfig_slave(slave, EC_TIMEOUTMON))
+             {
+                ec_slave[slave].islost = FALSE;
+                ECLOG("MESSAGE : slave %d reconfigured\n",slave);
+                ecrec_event(ECREC_RECONFIG, slave);
+                ecstate_event(slave, ECSTATE_RECONFIGS);
+             }
+          }
+          else if(!ec_slave[slave].islost)
+          {
+             /* re-check state */
+             ec_statecheck(slave, EC_STATE_OPERATIONAL, EC_TIMEOUTRET);
+             if (ec_slave[slave].state == EC_STATE_NONE)
+             {
+                ec_slave[slave].islost = TRUE;
+                ECLOG("ERROR : slave %d lost\n",slave);
+                ecrec_event(ECREC_LOST, slave);
+                ecstate_event(slave, ECSTATE_LOSSES);
+             }
+          }
+       }
+       if (ec_slave[slave].islost)
+       {
+          if(ec_slave[slave].state == EC_STATE_NONE)
+          {
+             if (ec_recover_slave(slave, EC_TIMEOUTMON))
+             {
+                ec_slave[slave].islost = FALSE;
+                ECLOG("MESSAGE : slave %d recovered\n",slave);
+                ecrec_event(ECREC_RECOVERED, slave);
+                ecstate_event(slave, ECSTATE_RECOVERIES);
+             }
+          }
+          else
+          {
+             ec_slave[slave].islost = FALSE;
+             ECLOG("MESSAGE : slave %d found\n",slave);
+             ecrec_event(ECREC_FOUND, slave);
+          }
+       }
+    }
+    if(!ec_group[group].docheckstate)
+    {
+       ECLOG("OK : all slaves resumed OPERATIONAL.\n");
+       ecrec_event(ECREC_RESUMED, 0);
+    }
+}
+
 OSAL_THREAD_FUNC ecatcheck( void *ptr )
 {
     int slave;
+    uint8 group;
+    uint32 passes = 0;
+    int found;
     (void)ptr;                  /* Not used */
 
+    eclog_thread_init();
     while(1)
     {
         if( inOP && ((wkc < expectedWKC) || ec_group[currentgroup].docheckstate))
+            ecatcheck_group(currentgroup);
+        /* the hot-connected groups are supervised the same way */
+        else if (inOP && hotconnect && ((group = echot_check(&hot)) != 0))
+            ecatcheck_group(group);
+        else if (inOP && hotconnect && !(++passes % HOT_PERIOD) && ((found = echot_detect(&hot)) > 0))
         {
-            if (needlf)
-            {
-               needlf = FALSE;
-               printf("\n");
-            }
-            /* one ore more slaves are not responding */
-            ec_group[currentgroup].docheckstate = FALSE;
-            ec_readstate();
-            for (slave = 1; slave <= ec_slavecount; slave++)
-            {
-               if ((ec_slave[slave].group == currentgroup) && (ec_slave[slave].state != EC_STATE_OPERATIONAL))
-               {
-                  ec_group[currentgroup].docheckstate = TRUE;
-                  if (ec_slave[slave].state == (EC_STATE_SAFE_OP + EC_STATE_ERROR))
-                  {
-                     printf("ERROR : slave %d is in SAFE_OP + ERROR, attempting ack.\n", slave);
-                     ec_slave[slave].state = (EC_STATE_SAFE_OP + EC_STATE_ACK);
-                     ec_writestate(slave);
-                  }
-                  else if(ec_slave[slave].state == EC_STATE_SAFE_OP)
-                  {
-                     printf("WARNING : slave %d is in SAFE_OP, change to OPERATIONAL.\n", slave);
-                     ec_slave[slave].state = EC_STATE_OPERATIONAL;
-                     ec_writestate(slave);
-                  }
-                  else if(ec_slave[slave].state > EC_STATE_NONE)
-                  {
-                     if (ec_reconfig_slave(slave, EC_TIMEOUTMON))
-                     {
-                        ec_slave[slave].islost = FALSE;
-                        printf("MESSAGE : slave %d reconfigured\n",slave);
-                     }
-                  }
-                  else if(!ec_slave[slave].islost)
-                  {
-                     /* re-check state */
-                     ec_statecheck(slave, EC_STATE_OPERATIONAL, EC_TIMEOUTRET);
-                     if (ec_slave[slave].state == EC_STATE_NONE)
-                     {
-                        ec_slave[slave].islost = TRUE;
-                        printf("ERROR : slave %d lost\n",slave);
-                     }
-                  }
-               }
-               if (ec_slave[slave].islost)
-               {
-                  if(ec_slave[slave].state == EC_STATE_NONE)
-                  {
-                     if (ec_recover_slave(slave, EC_TIMEOUTMON))
-                     {
-                        ec_slave[slave].islost = FALSE;
-                        printf("MESSAGE : slave %d recovered\n",slave);
-                     }
-                  }
-                  else
-                  {
-                     ec_slave[slave].islost = FALSE;
-                     printf("MESSAGE : slave %d found\n",slave);
-                  }
-               }
-            }
-            if(!ec_group[currentgroup].docheckstate)
-               printf("OK : all slaves resumed OPERATIONAL.\n");
+            slave = ec_slavecount;
+            ECLOG("MESSAGE : %d new slaves at the end of the line\n", found);
+            if (echot_connect(&hot, EC_TIMEOUTSTATE))
+               ECLOG("MESSAGE : slaves %d..%d connected in group %d\n", slave + 1, ec_slavecount, hot.nextgroup - 1);
+            else
+               ECLOG("ERROR : new slaves behind slave %d can not be connected\n", slave);
+        }
+        /* after the cyclic loop the file belongs to main */
+        if (inOP)
+        {
+            ecstate_publish(currentgroup, wkc, expectedWKC);
+            ecrec_flush();
         }
         osal_usleep(10000);
     }
@@ -306,19 +650,144 @@ OSAL_THREAD_FUNC ecatcheck( void *ptr )
 
 int main(int argc, char *argv[])
 {
+   int i;
+
    printf("SOEM (Simple Open EtherCAT Master)\nSimple test\n");
 
    if (argc > 1)
    {
+      for (i = 2; i < argc; i++)
+      {
+         if (!strcmp(argv[i], "-t"))
+            useframecache = TRUE;
+         else if (!strcmp(argv[i], "-b"))
+            runbench = TRUE;
+         else if (!strcmp(argv[i], "-i"))
+            runident = TRUE;
+         else if (!strcmp(argv[i], "-s"))
+            runsiggen = TRUE;
+         else if (!strcmp(argv[i], "-a"))
+            runaxes = TRUE;
+         else if (!strcmp(argv[i], "-p"))
+            runaxes = runpp = TRUE;
+         else if (!strcmp(argv[i], "-c"))
+            runaxes = runip = TRUE;
+         else if (!strcmp(argv[i], "-d"))
+            recordpdo = TRUE;
+         else if (!strcmp(argv[i], "-n"))
+            echuge_setmode(ECHUGE_SMALL);
+         else if (!strcmp(argv[i], "-m"))
+            measuretlb = TRUE;
+         else if (!strcmp(argv[i], "-j"))
+            hotconnect = TRUE;
+         else if (!strcmp(argv[i], "-o"))
+            routepdo = TRUE;
+         else if (!strcmp(argv[i], "-r"))
+            recordrecovery = TRUE;
+      }
+      /* identification and signal generator work on slave 1 through its structs */
+      if (runaxes)
+         runident = runsiggen = FALSE;
+      IOmap = echuge_alloc(IOMAP_SIZE, "IOmap");
+      if (!IOmap)
+      {
+         printf("Can not allocate the IOmap\n");
+         return (1);
+      }
+      if (!eclog_init(ECLOG_FILE))
+         printf("Can not start the log %s\n", ECLOG_FILE);
+      if (recordrecovery && !ecrec_init(RECOVERY_FILE))
+         printf("Can not open recovery file %s\n", RECOVERY_FILE);
+      ecstate_init();
       /* create thread to handle slave error handling in OP */
 //      pthread_create( &thread1, NULL, (void *) &ecatcheck, (void*) &ctime);
       osal_thread_create(&thread1, 128000, &ecatcheck, (void*) &ctime);
       /* start cyclic part */
       simpletest(argv[1]);
+      /* as any observer would, from the snapshot of the check thread */
+      if (ecstate_read(&slavestates))
+      {
+         for (i = 1; i <= slavestates.slavecount; i++)
+         {
+            ecstate_slavet *s = &slavestates.slave[i];
+            printf("Slave %d: state 0x%02X, AL status 0x%04X%s, %u %s, %u %s, %u %s, %u %s\n",
+                   i, s->state, s->alstatuscode, s->islost ? ", lost" : "",
+                   s->count[ECSTATE_ACKS], ecstate_counter_name[ECSTATE_ACKS],
+                   s->count[ECSTATE_RECONFIGS], ecstate_counter_name[ECSTATE_RECONFIGS],
+                   s->count[ECSTATE_LOSSES], ecstate_counter_name[ECSTATE_LOSSES],
+                   s->count[ECSTATE_RECOVERIES], ecstate_counter_name[ECSTATE_RECOVERIES]);
+         }
+      }
+      if (hotconnect)
+      {
+         for (i = HOT_GROUP; i < hot.nextgroup; i++)
+            printf("Hot-connected group %d: WKC %d of %d\n", i, hot.wkc[i], hot.expectedwkc[i]);
+      }
+      if (routepdo)
+         ecroute_free(&route);
+      if (runpp)
+      {
+         for (i = 0; i < engine.pp.naxes; i++)
+            printf("Slave %d: %u set-points acknowledged, %u cycles waiting for the drive\n",
+                   i + 1, engine.pp.acked[i], engine.pp.waits[i]);
+      }
+      if (runip)
+      {
+         /* no wait for a producer that never started */
+         if (__atomic_load_n(&iprunning, __ATOMIC_ACQUIRE) != -1)
+         {
+            iprunning = 0;
+            while (__atomic_load_n(&iprunning, __ATOMIC_ACQUIRE) != -1)
+               osal_usleep(1000);
+         }
+         for (i = 0; i < engine.ip.naxes; i++)
+            printf("Slave %d: buffer level min %u, %u underrun cycles in %u episodes\n",
+                   i + 1, engine.ip.minlevel[i], engine.ip.underruns[i], engine.ip.starved[i]);
+      }
+      if (runaxes)
+      {
+         for (i = 0; i < engine.axes.naxes; i++)
+         {
+            if (engine.trip[i])
+               printf("Slave %d: disabled by the limits, trip 0x%2.2x\n", i + 1, engine.trip[i]);
+         }
+         engine_free(&engine);
+      }
+      if (runident)
+      {
+         ident_stop_workers();
+         ident_free(&identaxis);
+      }
+      if (recordpdo)
+      {
+         if (ecpack_dropped(&pdorec))
+            printf("%u process data records dropped\n", ecpack_dropped(&pdorec));
+         printf("DC time to CLOCK_TAI drift %.3f ppm\n", pdotai.drift * 1e6);
+         ecpack_close(&pdorec);
+      }
+      if (recordrecovery)
+      {
+         if (ecrec_dropped())
+            printf("%u working counter transitions dropped\n", ecrec_dropped());
+         ecrec_close();
+      }
+      eclog_close();
+      echuge_free(IOmap);
    }
    else
    {
-      printf("Usage: simple_test ifname1\nifname = eth0 for example\n");
+      printf("Usage: simple_test ifname1 [-t] [-b] [-i] [-s] [-a] [-p] [-c] [-d] [-n] [-m] [-r] [-j] [-o]\nifname = eth0 for example\n"
+             "-t = cached process data frames, -b = benchmark send paths\n"
+             "-i = identify the velocity loop frequency response\n"
+             "-s = bidirectional velocity profile from the signal generator\n"
+             "-a = drive all slaves at 100RPM\n"
+             "-p = as -a, streaming profile position targets to all slaves\n"
+             "-c = as -a, cyclic synchronous position from buffered setpoints\n"
+             "-d = record the inputs of all slaves, compressed\n"
+             "-n = normal pages instead of huge pages, -m = TLB misses per cycle\n"
+             "-r = record working counter losses and recovery steps\n"
+             "-j = hot-connect slaves plugged in at the end of the line\n"
+             "-o = route process data between slaves as in pdoroutes\n");
    }
 
    printf("End program\n");
@@ -0,0 +1,208 @@
+/** \file
+ * \brief Cached process data frames
+ *
+ * The frame layout reproduces ecx_main_send_processdata() of SOEM for LRW groups:
+ * one frame per IO segment, the first one carrying an FRMW datagram on the DC
+ * system time of the reference clock when the group has DC slaves.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "ethercat.h"
+#include "ecframe.h"
+
+/** Lay out the process data frames of a group once.
+ *
+ * Call after ec_config_map() and ec_configdc(), and again after the mapping changed.
+ *
+ * @param[out] tpl   = template to fill
+ * @param[in]  group = group number
+ * @return number of frames, 0 if the group can not be cached
+ */
+int ecframe_build(ecframe_templatet *tpl, uint8 group)
+{
+   ecx_portt *port = ecx_context.port;
+   ec_groupt *grp = &ec_group[group];
+   ecframe_segmentt *seg;
+   uint8 *data;
+   uint32 length, LogAdr, sublength;
+   uint16 DCO;
+   int idx, currentsegment = 0;
+   boolean first = grp->hasdc;
+
+   memset(tpl, 0, sizeof(*tpl));
+   tpl->group = group;
+   if (grp->blockLRW)
+      return 0;
+
+   length = grp->Obytes + grp->Ibytes;
+   LogAdr = grp->logstartaddr;
+   data = grp->Obytes ? grp->outputs : grp->inputs;
+   while (length && (currentsegment < grp->nsegments))
+   {
+      seg = &tpl->segment[tpl->nframes++];
+      sublength = grp->IOsegment[currentsegment++];
+      if (sublength > length)
+         sublength = length;
+
+      /* let SOEM build the frame in a free buffer and keep a copy of it */
+      idx = ecx_getindex(port);
+      ecx_setupdatagram(port, &(port->txbuf[idx]), EC_CMD_LRW, (uint8)idx,
+                        LO_WORD(LogAdr), HI_WORD(LogAdr), (uint16)sublength, data);
+      seg->idxoffset[seg->nidx++] = ETH_HEADERSIZE + EC_CMDOFFSET + 1;
+      if (first)
+      {
+         DCO = ecx_adddatagram(port, &(port->txbuf[idx]), EC_CMD_FRMW, (uint8)idx, FALSE,
+                               ec_slave[grp->DCnext].configadr, ECT_REG_DCSYSTIME,
+                               sizeof(int64), &ec_DCtime);
+         seg->rxdcoffset = DCO;
+         seg->dcoffset = ETH_HEADERSIZE + DCO;
+         seg->idxoffset[seg->nidx++] = ETH_HEADERSIZE + DCO - (EC_HEADERSIZE - EC_ELENGTHSIZE) + 1;
+         first = FALSE;
+      }
+      seg->framelength = port->txbuflength[idx];
+      seg->dataoffset = ETH_HEADERSIZE + EC_HEADERSIZE;
+      seg->datalength = (int)sublength;
+      seg->data = data;
+      memcpy(seg->frame, &(port->txbuf[idx]), seg->framelength);
+      memset(&seg->frame[seg->dataoffset], 0, sublength);
+      ecx_setbufstat(port, idx, EC_BUF_EMPTY);
+
+      length -= sublength;
+      LogAdr += sublength;
+      data += sublength;
+   }
+   return tpl->nframes;
+}
+
+/** Send the process data of the group with the cached frames.
+ *
+ * Counterpart of ec_send_processdata_group().
+ *
+ * @param[in] tpl = template built by ecframe_build()
+ * @return >0 if processdata is transmitted
+ */
+int ecframe_send_processdata(ecframe_templatet *tpl)
+{
+   ecx_portt *port = ecx_context.port;
+   ecframe_segmentt *seg;
+   uint8 *buf;
+   int64 dctime;
+   int n, k, idx, tail;
+
+   for (n = 0; n < tpl->nframes; n++)
+   {
+      seg = &tpl->segment[n];
+      idx = ecx_getindex(port);
+      buf = port->txbuf[idx];
+      tail = seg->dataoffset + seg->datalength;
+      memcpy(buf, seg->frame, seg->dataoffset);
+      memcpy(&buf[seg->dataoffset], seg->data, seg->datalength);
+      memcpy(&buf[tail], &seg->frame[tail], seg->framelength - tail);
+      for (k = 0; k < seg->nidx; k++)
+         buf[seg->idxoffset[k]] = (uint8)idx;
+      if (seg->dcoffset)
+      {
+         dctime = htoell(ec_DCtime);
+         memcpy(&buf[seg->dcoffset], &dctime, sizeof(dctime));
+      }
+      port->txbuflength[idx] = seg->framelength;
+      ecx_outframe_red(port, idx);
+      seg->idx = idx;
+   }
+   return tpl->nframes;
+}
+
+/** Receive the frames sent by ecframe_send_processdata().
+ *
+ * Counterpart of ec_receive_processdata_group(), copies the data back into the IOmap
+ * and updates ec_DCtime.
+ *
+ * @param[in] tpl     = template built by ecframe_build()
+ * @param[in] timeout = timeout per frame in us
+ * @return working counter, EC_NOFRAME if no frame came back
+ */
+int ecframe_receive_processdata(ecframe_templatet *tpl, int timeout)
+{
+   ecx_portt *port = ecx_context.port;
+   ecframe_segmentt *seg;
+   uint8 *rx;
+   uint16 le_wkc;
+   int64 le_DCtime;
+   int n, wkc = EC_NOFRAME;
+
+   for (n = 0; n < tpl->nframes; n++)
+   {
+      seg = &tpl->segment[n];
+      if (ecx_waitinframe(port, seg->idx, timeout) > EC_NOFRAME)
+      {
+         rx = port->rxbuf[seg->idx];
+         if (rx[EC_CMDOFFSET] == EC_CMD_LRW)
+         {
+            memcpy(seg->data, &rx[EC_HEADERSIZE], seg->datalength);
+            memcpy(&le_wkc, &rx[EC_HEADERSIZE + seg->datalength], EC_WKCSIZE);
+            if (wkc == EC_NOFRAME)
+               wkc = 0;
+            wkc += etohs(le_wkc);
+            if (seg->rxdcoffset)
+            {
+               memcpy(&le_DCtime, &rx[seg->rxdcoffset], sizeof(le_DCtime));
+               ec_DCtime = etohll(le_DCtime);
+            }
+         }
+      }
+      ecx_setbufstat(port, seg->idx, EC_BUF_EMPTY);
+   }
+   return wkc;
+}
+
+static int64 ecframe_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Compare the CPU time of the standard and the cached send path.
+ *
+ * Runs cycles with each path in OP and prints mean and worst send times.
+ * Only the send call is timed, the receive is the same in both paths.
+ *
+ * @param[in] tpl    = template built by ecframe_build()
+ * @param[in] cycles = number of cycles per path
+ */
+void ecframe_bench(ecframe_templatet *tpl, int cycles)
+{
+   int64 t0, dt, sum[2] = {0, 0}, worst[2] = {0, 0};
+   int i, path, wkc[2] = {0, 0};
+
+   for (path = 0; path < 2; path++)
+   {
+      for (i = 0; i < cycles; i++)
+      {
+         t0 = ecframe_ns();
+         if (path == 0)
+            ec_send_processdata_group(tpl->group);
+         else
+            ecframe_send_processdata(tpl);
+         dt = ecframe_ns() - t0;
+         if (path == 0)
+            wkc[path] = ec_receive_processdata_group(tpl->group, EC_TIMEOUTRET);
+         else
+            wkc[path] = ecframe_receive_processdata(tpl, EC_TIMEOUTRET);
+         sum[path] += dt;
+         if (dt > worst[path])
+            worst[path] = dt;
+         osal_usleep(1000);
+      }
+   }
+   printf("Send path over %d cycles, %d frames:\n", cycles, tpl->nframes);
+   printf("  ec_send_processdata      mean %6" PRId64 " ns  max %6" PRId64 " ns  WKC %d\n",
+          sum[0] / cycles, worst[0], wkc[0]);
+   printf("  ecframe_send_processdata mean %6" PRId64 " ns  max %6" PRId64 " ns  WKC %d\n",
+          sum[1] / cycles, worst[1], wkc[1]);
+}
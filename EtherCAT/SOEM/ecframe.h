@@ -0,0 +1,52 @@
+/** \file
+ * \brief Cached process data frames
+ *
+ * ec_send_processdata() sets up the LRW datagram (and the DC FRMW datagram in the
+ * first frame) of every IO segment again in each cycle, although only the output
+ * data, the datagram index and the DC time change. ecframe_build() lays out these
+ * frames once after ec_config_map()/ec_configdc(); ecframe_send_processdata() then
+ * only copies the cached header, patches index, output data and DC time and sends.
+ *
+ * Only LRW groups are cached. Groups of slaves with blockLRW are refused by
+ * ecframe_build() and have to use the standard path.
+ */
+
+#ifndef _ECFRAME_H
+#define _ECFRAME_H
+
+#include "ethercat.h"
+
+typedef struct
+{
+   /** ethernet and datagram headers as built by SOEM, data area zeroed */
+   uint8    frame[EC_BUFSIZE];
+   int      framelength;
+   /** tx offset and length of the LRW data */
+   int      dataoffset;
+   int      datalength;
+   /** tx offset of the DC datagram data, 0 if the frame carries none */
+   int      dcoffset;
+   /** rx offset of the DC datagram data */
+   int      rxdcoffset;
+   /** tx offsets of the datagram index bytes */
+   int      idxoffset[2];
+   int      nidx;
+   /** process data of this segment in the IOmap */
+   uint8    *data;
+   /** buffer index while the frame is in flight */
+   int      idx;
+} ecframe_segmentt;
+
+typedef struct
+{
+   uint8             group;
+   int               nframes;
+   ecframe_segmentt  segment[EC_MAXIOSEGMENTS];
+} ecframe_templatet;
+
+int ecframe_build(ecframe_templatet *tpl, uint8 group);
+int ecframe_send_processdata(ecframe_templatet *tpl);
+int ecframe_receive_processdata(ecframe_templatet *tpl, int timeout);
+void ecframe_bench(ecframe_templatet *tpl, int cycles);
+
+#endif
@@ -0,0 +1,236 @@
+/** \file
+ * \brief Hot-connect of slaves appearing at the end of the line
+ */
+
+#include <string.h>
+
+#include "ethercat.h"
+#include "ecsegment.h"
+#include "echotconnect.h"
+
+/** Set up hot-connect, call after ec_config_map().
+ *
+ * @param[in] h          = hot-connect state
+ * @param[in] iomap      = spare IOmap region behind the one of ec_config_map()
+ * @param[in] size       = size of the spare region
+ * @param[in] firstgroup = first group for connected slaves, not used by the configuration
+ */
+void echot_init(echot_t *h, uint8 *iomap, uint32 size, uint8 firstgroup)
+{
+   memset(h, 0, sizeof(*h));
+   h->iomap = iomap;
+   h->size = size;
+   h->firstgroup = firstgroup;
+   h->nextgroup = firstgroup;
+   h->seen = ec_slavecount;
+}
+
+/** Check thread: count the slaves on the line with a broadcast read.
+ *
+ * @return number of slaves behind the configured ones, 0 if none or already tried
+ */
+int echot_detect(echot_t *h)
+{
+   uint16 w = 0;
+   int wkc;
+
+   wkc = ec_BRD(0x0000, ECT_REG_TYPE, sizeof(w), &w, EC_TIMEOUTSAFE);
+   if (wkc <= ec_slavecount)
+   {
+      /* a slave unplugged again is tried once more when it comes back */
+      h->seen = ec_slavecount;
+      return 0;
+   }
+   return (wkc != h->seen) ? wkc - ec_slavecount : 0;
+}
+
+/* Configured slave with the identity of a new one, 0 if none */
+static uint16 echot_template(uint16 slave, uint16 configured)
+{
+   uint16 t;
+
+   for (t = 1; t <= configured; t++)
+   {
+      if ((ec_slave[t].eep_man == ec_slave[slave].eep_man) &&
+          (ec_slave[t].eep_id == ec_slave[slave].eep_id) &&
+          (ec_slave[t].eep_rev == ec_slave[slave].eep_rev))
+         return t;
+   }
+   return 0;
+}
+
+/* Give a new slave the configuration of its template, keep what belongs to the slave */
+static void echot_configure(uint16 slave, uint16 t, uint8 group)
+{
+   ec_slavet s = ec_slave[slave];
+
+   ec_slave[slave] = ec_slave[t];
+   ec_slave[slave].configadr = s.configadr;
+   ec_slave[slave].aliasadr = s.aliasadr;
+   ec_slave[slave].state = EC_STATE_INIT;
+   ec_slave[slave].ALstatuscode = 0;
+   ec_slave[slave].islost = FALSE;
+   ec_slave[slave].group = group;
+   ec_slave[slave].parent = slave - 1;
+   ec_slave[slave].mbx_cnt = 0;
+   /* filled by ec_config_map_group() */
+   ec_slave[slave].outputs = NULL;
+   ec_slave[slave].inputs = NULL;
+   ec_slave[slave].Ostartbit = 0;
+   ec_slave[slave].Istartbit = 0;
+   ec_slave[slave].FMMUunused = 0;
+   memset(ec_slave[slave].FMMU, 0, sizeof(ec_slave[slave].FMMU));
+   /* the running DC configuration is not touched, new slaves run without DC */
+   ec_slave[slave].DCactive = 0;
+   ec_slave[slave].DCnext = 0;
+   ec_slave[slave].DCprevious = 0;
+}
+
+/** Check thread: bring the slaves behind the configured ones to OP and into the
+ * process data of the next free group.
+ *
+ * @param[in] h       = hot-connect state
+ * @param[in] timeout = timeout of each state change in us, for all new slaves together
+ * @return number of connected slaves in OP
+ */
+int echot_connect(echot_t *h, int timeout)
+{
+   static const uint16 sii[3] = { ECT_SII_MANUF, ECT_SII_ID, ECT_SII_REV };
+   uint16 w = 0, slave, t, first, last, accepted;
+   uint32 data, need;
+   uint8 group = h->nextgroup;
+   int wkc, k, used;
+
+   wkc = ec_BRD(0x0000, ECT_REG_TYPE, sizeof(w), &w, EC_TIMEOUTSAFE);
+   first = (uint16)(ec_slavecount + 1);
+   last = (uint16)((wkc < EC_MAXSLAVE) ? wkc : EC_MAXSLAVE - 1);
+   h->seen = wkc;
+   if ((last < first) || (group >= EC_MAXGROUP))
+      return 0;
+   for (slave = first; slave <= last; slave++)
+   {
+      memset(&ec_slave[slave], 0, sizeof(ec_slave[slave]));
+      ec_slave[slave].configadr = (uint16)(EC_NODEOFFSET + slave);
+   }
+   if (!ecseg_begin(first, last))
+      return 0;
+
+   /* identity of all new slaves, EEPROM reads of all slaves in flight at once */
+   for (slave = first; slave <= last; slave++)
+   {
+      if (!ecseg_isactive(slave))
+         continue;
+      ec_slave[slave].aliasadr = etohs(ec_FPRDw(ec_slave[slave].configadr, ECT_REG_ALIAS, EC_TIMEOUTRET));
+      ec_eeprom2master(slave);
+   }
+   for (k = 0; k < 3; k++)
+   {
+      for (slave = first; slave <= last; slave++)
+      {
+         if (ecseg_isactive(slave))
+            ec_readeeprom1(slave, sii[k]);
+      }
+      for (slave = first; slave <= last; slave++)
+      {
+         if (!ecseg_isactive(slave))
+            continue;
+         data = etohl(ec_readeeprom2(slave, EC_TIMEOUTEEP));
+         if (k == 0)
+            ec_slave[slave].eep_man = data;
+         else if (k == 1)
+            ec_slave[slave].eep_id = data;
+         else
+            ec_slave[slave].eep_rev = data;
+      }
+   }
+
+   /* the group takes the slaves up to the first unknown one or the end of the spare
+      region, the ones behind stay unaddressed */
+   accepted = first - 1;
+   need = 0;
+   for (slave = first; slave <= last; slave++)
+   {
+      t = ((accepted == slave - 1) && ecseg_isactive(slave)) ? echot_template(slave, first - 1) : 0;
+      if (t && (need + ec_slave[t].Obytes + ec_slave[t].Ibytes <= h->size - h->used))
+      {
+         need += ec_slave[t].Obytes + ec_slave[t].Ibytes;
+         echot_configure(slave, t, group);
+         accepted = slave;
+      }
+      else if (ecseg_isactive(slave))
+         ecseg_drop(slave, TRUE);
+   }
+   if (accepted < first)
+      return 0;
+
+   for (slave = first; slave <= accepted; slave++)
+   {
+      if (ec_slave[slave].mbx_l)
+      {
+         ec_FPWR(ec_slave[slave].configadr, ECT_REG_SM0, sizeof(ec_smt), &ec_slave[slave].SM[0], EC_TIMEOUTRET);
+         ec_FPWR(ec_slave[slave].configadr, ECT_REG_SM0 + sizeof(ec_smt), sizeof(ec_smt),
+                 &ec_slave[slave].SM[1], EC_TIMEOUTRET);
+      }
+      ec_eeprom2pdi(slave);
+   }
+   ecseg_request(EC_STATE_PRE_OP);
+   if (ecseg_wait(EC_STATE_PRE_OP, timeout) < accepted - first + 1)
+      return 0;
+   ecseg_hooks();
+
+   /* the group is only mapped when all its slaves are, ec_config_map_group()
+      takes every slave of the group; other threads read the count with acquire */
+   __atomic_store_n(&ec_slavecount, accepted, __ATOMIC_RELEASE);
+   used = ec_config_map_group(h->iomap + h->used, group);
+   if ((used <= 0) || (h->used + used > h->size) ||
+       (ecseg_wait(EC_STATE_SAFE_OP, timeout) < accepted - first + 1))
+   {
+      for (slave = first; slave <= accepted; slave++)
+         ec_FPWRw(ec_slave[slave].configadr, ECT_REG_ALCTL, htoes(EC_STATE_INIT), EC_TIMEOUTRET);
+      __atomic_store_n(&ec_slavecount, first - 1, __ATOMIC_RELEASE);
+      return 0;
+   }
+   h->used += used;
+   h->expectedwkc[group] = (ec_group[group].outputsWKC * 2) + ec_group[group].inputsWKC;
+   /* valid outputs from the next cycle on, the slaves need them for OP */
+   __atomic_store_n(&h->nextgroup, group + 1, __ATOMIC_RELEASE);
+   ecseg_request(EC_STATE_OPERATIONAL);
+   return ecseg_wait(EC_STATE_OPERATIONAL, timeout);
+}
+
+/** Cyclic thread: exchange the process data of the connected groups, after group 0.
+ *
+ * @return 1 if all connected groups returned their expected working counter
+ */
+int echot_cycle(echot_t *h)
+{
+   uint8 group, next = __atomic_load_n(&h->nextgroup, __ATOMIC_ACQUIRE);
+   int wkc, ok = 1;
+
+   for (group = h->firstgroup; group < next; group++)
+   {
+      ec_send_processdata_group(group);
+      wkc = ec_receive_processdata_group(group, EC_TIMEOUTRET);
+      __atomic_store_n(&h->wkc[group], wkc, __ATOMIC_RELAXED);
+      ok &= (wkc >= h->expectedwkc[group]);
+   }
+   return ok;
+}
+
+/** Check thread: a connected group to supervise like group 0, after a working counter
+ * below the expected one in the last cycle or with docheckstate set.
+ *
+ * @return group, 0 if all connected groups are fine
+ */
+uint8 echot_check(echot_t *h)
+{
+   uint8 group, next = __atomic_load_n(&h->nextgroup, __ATOMIC_ACQUIRE);
+
+   for (group = h->firstgroup; group < next; group++)
+   {
+      if ((__atomic_load_n(&h->wkc[group], __ATOMIC_RELAXED) < h->expectedwkc[group]) ||
+          ec_group[group].docheckstate)
+         return group;
+   }
+   return 0;
+}
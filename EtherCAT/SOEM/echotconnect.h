@@ -0,0 +1,48 @@
+/** \file
+ * \brief Hot-connect of slaves appearing at the end of the line
+ *
+ * ec_config_init() resets and addresses the whole line, so it can not run again while
+ * the cycle does. New slaves are brought up as a batch with the steps of ecsegment.c
+ * instead: addressed at their positions behind the configured slaves, identified from
+ * their EEPROM and given the configuration of a configured slave with the same vendor,
+ * product and revision (mailbox, sync managers, PDO sizes, hooks). Then they are mapped
+ * with ec_config_map_group() into a group of their own, which lays their process data
+ * into a spare region of the IOmap at the logical addresses of that group.
+ *
+ * The cyclic thread exchanges every connected group with its own frame after the frame
+ * of group 0, so mapping and timing of the running slaves do not change. Each connect
+ * takes the next group up to EC_MAXGROUP - 1, slaves of an unknown type stay in INIT.
+ * The check thread supervises a connected group like group 0 when echot_check() names
+ * it. ec_slavecount is only written by the check thread, with release semantics, other
+ * threads read it with an acquire load.
+ */
+
+#ifndef _ECHOTCONNECT_H
+#define _ECHOTCONNECT_H
+
+#include "ethercat.h"
+
+typedef struct
+{
+   /* spare IOmap region, used from the start */
+   uint8    *iomap;
+   uint32   size;
+   uint32   used;
+   /* groups firstgroup..nextgroup - 1 are connected, nextgroup is published to the
+      cyclic thread once a group is mapped */
+   uint8    firstgroup;
+   uint8    nextgroup;
+   int      expectedwkc[EC_MAXGROUP];
+   /** last working counter per group, written by the cyclic thread */
+   int      wkc[EC_MAXGROUP];
+   /** slaves on the line at the last connect */
+   int      seen;
+} echot_t;
+
+void echot_init(echot_t *h, uint8 *iomap, uint32 size, uint8 firstgroup);
+int echot_detect(echot_t *h);
+int echot_connect(echot_t *h, int timeout);
+int echot_cycle(echot_t *h);
+uint8 echot_check(echot_t *h);
+
+#endif
@@ -0,0 +1,298 @@
+/** \file
+ * \brief Huge page backed, prefaulted and locked buffers
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "ethercat.h"
+#include "echuge.h"
+
+#define ECHUGE_DEFAULTSIZE (2 * 1024 * 1024)
+
+typedef struct
+{
+   void              *p;
+   void              *map;
+   size_t            mapsize;
+   size_t            size;
+   echuge_backingt   backing;
+   boolean           locked;
+   const char        *name;
+} echuge_regiont;
+
+static echuge_regiont echuge_region[ECHUGE_MAXREGIONS];
+static pthread_mutex_t echuge_mutex = PTHREAD_MUTEX_INITIALIZER;
+static echuge_modet echuge_mode = ECHUGE_AUTO;
+static size_t echuge_hugesize;
+
+static const char *echuge_name[] = { "4k pages", "transparent huge pages", "hugetlb" };
+
+/** Default huge page size from /proc/meminfo. */
+static size_t echuge_pagesize(void)
+{
+   FILE *f;
+   char line[128];
+   unsigned long kb;
+
+   if (echuge_hugesize)
+      return echuge_hugesize;
+   echuge_hugesize = ECHUGE_DEFAULTSIZE;
+   f = fopen("/proc/meminfo", "r");
+   if (f)
+   {
+      while (fgets(line, sizeof(line), f))
+      {
+         if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+         {
+            echuge_hugesize = (size_t)kb * 1024;
+            break;
+         }
+      }
+      fclose(f);
+   }
+   return echuge_hugesize;
+}
+
+static size_t echuge_roundup(size_t size, size_t align)
+{
+   return (size + align - 1) & ~(align - 1);
+}
+
+/** Anonymous mapping aligned to the huge page size, THP can back it from the start. */
+static void *echuge_map_aligned(size_t size, size_t hugesize, void **map, size_t *mapsize)
+{
+   uint8 *m, *p;
+   size_t lead, trail;
+
+   *mapsize = size + hugesize;
+   m = mmap(NULL, *mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (m == MAP_FAILED)
+      return NULL;
+   p = (uint8 *)echuge_roundup((uintptr_t)m, hugesize);
+   lead = p - m;
+   trail = *mapsize - lead - size;
+   if (lead)
+      munmap(m, lead);
+   if (trail)
+      munmap(p + size, trail);
+   *map = p;
+   *mapsize = size;
+   return p;
+}
+
+/** Allocate a zeroed, prefaulted and locked region.
+ *
+ * @param[in] size = size in bytes
+ * @param[in] name = name for echuge_report(), must stay valid
+ * @return region, NULL if out of memory or too many regions
+ */
+void *echuge_alloc(size_t size, const char *name)
+{
+   size_t hugesize = echuge_pagesize(), pagesize = (size_t)sysconf(_SC_PAGESIZE);
+   echuge_regiont *r = NULL;
+   void *p = NULL;
+   size_t off;
+   int i;
+
+   pthread_mutex_lock(&echuge_mutex);
+   for (i = 0; i < ECHUGE_MAXREGIONS; i++)
+   {
+      if (!echuge_region[i].p)
+      {
+         r = &echuge_region[i];
+         break;
+      }
+   }
+   if (!r || !size)
+   {
+      pthread_mutex_unlock(&echuge_mutex);
+      return NULL;
+   }
+   memset(r, 0, sizeof(*r));
+   if ((echuge_mode == ECHUGE_AUTO) && (size >= hugesize / 2))
+   {
+      r->mapsize = echuge_roundup(size, hugesize);
+      p = mmap(NULL, r->mapsize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED)
+      {
+         r->map = p;
+         r->backing = ECHUGE_HUGETLB;
+      }
+      else
+      {
+         /* no free pages in the hugetlbfs pool, ask for transparent huge pages */
+         p = echuge_map_aligned(r->mapsize, hugesize, &r->map, &r->mapsize);
+         if (p)
+         {
+            madvise(p, r->mapsize, MADV_HUGEPAGE);
+            r->backing = ECHUGE_THP;
+         }
+      }
+   }
+   else
+   {
+      r->mapsize = echuge_roundup(size, pagesize);
+      p = mmap(NULL, r->mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED)
+      {
+         r->map = p;
+         r->backing = ECHUGE_PAGES;
+      }
+      else
+         p = NULL;
+   }
+   if (p)
+   {
+      /* write every page, a read would only map the shared zero page */
+      for (off = 0; off < r->mapsize; off += pagesize)
+         ((volatile uint8 *)p)[off] = 0;
+      r->locked = (mlock(p, r->mapsize) == 0);
+      r->p = p;
+      r->size = size;
+      r->name = name;
+   }
+   pthread_mutex_unlock(&echuge_mutex);
+   return p;
+}
+
+void echuge_free(void *p)
+{
+   int i;
+
+   if (!p)
+      return;
+   pthread_mutex_lock(&echuge_mutex);
+   for (i = 0; i < ECHUGE_MAXREGIONS; i++)
+   {
+      if (echuge_region[i].p == p)
+      {
+         if (echuge_region[i].locked)
+            munlock(echuge_region[i].map, echuge_region[i].mapsize);
+         munmap(echuge_region[i].map, echuge_region[i].mapsize);
+         memset(&echuge_region[i], 0, sizeof(echuge_region[i]));
+         break;
+      }
+   }
+   pthread_mutex_unlock(&echuge_mutex);
+}
+
+/** Select huge pages (default) or normal pages for following allocations. */
+void echuge_setmode(echuge_modet mode)
+{
+   echuge_mode = mode;
+}
+
+echuge_backingt echuge_backing(const void *p)
+{
+   echuge_backingt backing = ECHUGE_PAGES;
+   int i;
+
+   pthread_mutex_lock(&echuge_mutex);
+   for (i = 0; i < ECHUGE_MAXREGIONS; i++)
+   {
+      if (echuge_region[i].p == p)
+         backing = echuge_region[i].backing;
+   }
+   pthread_mutex_unlock(&echuge_mutex);
+   return backing;
+}
+
+/** Print the backing of all regions. */
+void echuge_report(void)
+{
+   const echuge_regiont *r;
+   int i;
+
+   pthread_mutex_lock(&echuge_mutex);
+   for (i = 0; i < ECHUGE_MAXREGIONS; i++)
+   {
+      r = &echuge_region[i];
+      if (r->p)
+         printf("%-12s %8zu bytes, %s%s\n", r->name ? r->name : "?", r->size,
+                echuge_name[r->backing], r->locked ? ", locked" : ", NOT locked");
+   }
+   pthread_mutex_unlock(&echuge_mutex);
+}
+
+static int echuge_perf_open(uint64 cache, int group)
+{
+   struct perf_event_attr attr;
+
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = PERF_TYPE_HW_CACHE;
+   attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+   attr.read_format = PERF_FORMAT_GROUP;
+   attr.disabled = (group == -1);
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+   return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/** Start counting TLB misses of the calling thread.
+ *
+ * @param[out] tlb = counters
+ * @return number of counters, 0 if the PMU or perf_event_paranoid does not allow it
+ */
+int echuge_tlb_open(echuge_tlbt *tlb)
+{
+   memset(tlb, 0, sizeof(*tlb));
+   tlb->fd[1] = -1;
+   tlb->fd[0] = echuge_perf_open(PERF_COUNT_HW_CACHE_DTLB, -1);
+   if (tlb->fd[0] < 0)
+      return 0;
+   tlb->ncounters = 1;
+   /* iTLB is optional, several PMUs have no event for it */
+   tlb->fd[1] = echuge_perf_open(PERF_COUNT_HW_CACHE_ITLB, tlb->fd[0]);
+   if (tlb->fd[1] >= 0)
+      tlb->ncounters = 2;
+   ioctl(tlb->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+   echuge_tlb_read(tlb, NULL, NULL);
+   return tlb->ncounters;
+}
+
+/** Misses since the previous read.
+ *
+ * @param[in]  tlb  = counters
+ * @param[out] dtlb = dTLB load misses, may be NULL
+ * @param[out] itlb = iTLB load misses, 0 without counter, may be NULL
+ * @return 1 on success
+ */
+int echuge_tlb_read(echuge_tlbt *tlb, uint64 *dtlb, uint64 *itlb)
+{
+   uint64 v[3] = { 0, 0, 0 };
+   uint64 d, i;
+
+   if ((tlb->ncounters == 0) ||
+       (read(tlb->fd[0], v, sizeof(v)) < (ssize_t)((1 + tlb->ncounters) * sizeof(uint64))))
+      return 0;
+   d = v[1] - tlb->last[0];
+   i = (tlb->ncounters > 1) ? v[2] - tlb->last[1] : 0;
+   tlb->last[0] = v[1];
+   tlb->last[1] = v[2];
+   if (dtlb)
+      *dtlb = d;
+   if (itlb)
+      *itlb = i;
+   return 1;
+}
+
+void echuge_tlb_close(echuge_tlbt *tlb)
+{
+   if (tlb->ncounters > 1)
+      close(tlb->fd[1]);
+   if (tlb->ncounters > 0)
+      close(tlb->fd[0]);
+   tlb->ncounters = 0;
+}
@@ -0,0 +1,55 @@
+/** \file
+ * \brief Huge page backed, prefaulted and locked buffers
+ *
+ * Memory the cyclic loop touches (IOmap, log rings, capture buffers) is allocated
+ * with echuge_alloc(). Regions of at least half a huge page are mapped from the
+ * hugetlbfs pool (MAP_HUGETLB) if it has free pages, otherwise as anonymous memory
+ * aligned to the huge page size with MADV_HUGEPAGE, so transparent huge pages can
+ * back them. Smaller regions, and every region after echuge_setmode(ECHUGE_SMALL),
+ * use normal pages. All regions are written once to fault them in and locked with
+ * mlock(), so the cyclic loop never takes a page fault.
+ *
+ * echuge_tlb_open() counts the dTLB and iTLB load misses of the calling thread
+ * (user space only) with perf_event_open(), to make the effect visible per cycle.
+ */
+
+#ifndef _ECHUGE_H
+#define _ECHUGE_H
+
+#include "ethercat.h"
+
+#define ECHUGE_MAXREGIONS 32
+
+typedef enum
+{
+   /** huge pages where the region is large enough */
+   ECHUGE_AUTO = 0,
+   /** normal pages only, to compare against */
+   ECHUGE_SMALL
+} echuge_modet;
+
+typedef enum
+{
+   ECHUGE_PAGES = 0,
+   ECHUGE_THP,
+   ECHUGE_HUGETLB
+} echuge_backingt;
+
+typedef struct
+{
+   /** group leader (dTLB) and member (iTLB) */
+   int      fd[2];
+   int      ncounters;
+   uint64   last[2];
+} echuge_tlbt;
+
+void echuge_setmode(echuge_modet mode);
+void *echuge_alloc(size_t size, const char *name);
+void echuge_free(void *p);
+echuge_backingt echuge_backing(const void *p);
+void echuge_report(void);
+int echuge_tlb_open(echuge_tlbt *tlb);
+int echuge_tlb_read(echuge_tlbt *tlb, uint64 *dtlb, uint64 *itlb);
+void echuge_tlb_close(echuge_tlbt *tlb);
+
+#endif
@@ -0,0 +1,315 @@
+/** \file
+ * \brief Deferred-formatting binary event log, writer side
+ *
+ * Every logging thread owns a single-producer single-consumer byte ring. The hot path
+ * reserves space, copies the record and publishes the new head with a release store.
+ * When the ring is full the record is dropped and counted, the caller never waits.
+ *
+ * File layout
+ * -----------
+ * header     : magic[8], uint32 version, double ticks per second, uint64 tsc at start,
+ *              int64 CLOCK_REALTIME ns at start, uint32 number of formats
+ * formats    : per format uint16 id, int32 line, uint8 nargs, uint8 argtype[nargs],
+ *              uint16 len + file, uint16 len + format
+ * chunks     : uint16 thread, uint32 length, records
+ * record     : eclog_recordt, then per argument 8 bytes (int64/double) or
+ *              uint8 len + characters for strings
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ethercat.h"
+#include "eclog.h"
+#include "echuge.h"
+
+#define ECLOG_VERSION      1
+#define ECLOG_DRAINPERIOD  10000
+
+typedef struct
+{
+   uint8_t    data[ECLOG_BUFSIZE];
+   uint32_t   head;             /* written by producer only */
+   uint32_t   tail;             /* written by consumer only */
+   uint32_t   dropped;
+   uint16_t   thread;
+} eclog_buffert;
+
+/* linker generated bounds of the static call site table */
+extern const eclog_fmtt __start_eclog_fmt[];
+extern const eclog_fmtt __stop_eclog_fmt[];
+
+static __thread eclog_buffert *eclog_tls;
+static eclog_buffert *eclog_buffers[ECLOG_MAXTHREADS];
+static int eclog_nbuffers;
+static pthread_mutex_t eclog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *eclog_file;
+static OSAL_THREAD_HANDLE eclog_thread;
+static volatile int eclog_running;
+static volatile int eclog_stopped;
+
+static void eclog_put(FILE *f, const void *p, size_t size)
+{
+   fwrite(p, 1, size, f);
+}
+
+static void eclog_putstr(FILE *f, const char *s)
+{
+   uint16_t len = (uint16_t)strlen(s);
+   eclog_put(f, &len, sizeof(len));
+   eclog_put(f, s, len);
+}
+
+/** Measure the timestamp rate against CLOCK_MONOTONIC */
+static double eclog_calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   struct timespec t0, t1;
+   uint64_t c0, c1;
+   double ns;
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   c0 = eclog_now();
+   osal_usleep(20000);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   c1 = eclog_now();
+   ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+   return (double)(c1 - c0) * 1e9 / ns;
+#else
+   return 1e9;
+#endif
+}
+
+static void eclog_write_header(FILE *f)
+{
+   const eclog_fmtt *site;
+   struct timespec rt;
+   uint32_t version = ECLOG_VERSION;
+   uint32_t nfmt = (uint32_t)(__stop_eclog_fmt - __start_eclog_fmt);
+   double hz = eclog_calibrate();
+   uint64_t tsc = eclog_now();
+   int64_t realtime;
+
+   clock_gettime(CLOCK_REALTIME, &rt);
+   realtime = (int64_t)rt.tv_sec * 1000000000LL + rt.tv_nsec;
+
+   eclog_put(f, ECLOG_MAGIC, 8);
+   eclog_put(f, &version, sizeof(version));
+   eclog_put(f, &hz, sizeof(hz));
+   eclog_put(f, &tsc, sizeof(tsc));
+   eclog_put(f, &realtime, sizeof(realtime));
+   eclog_put(f, &nfmt, sizeof(nfmt));
+   for (site = __start_eclog_fmt; site < __stop_eclog_fmt; site++)
+   {
+      uint16_t id = (uint16_t)(site - __start_eclog_fmt);
+      eclog_put(f, &id, sizeof(id));
+      eclog_put(f, &site->line, sizeof(site->line));
+      eclog_put(f, &site->nargs, sizeof(site->nargs));
+      eclog_put(f, site->argtype, site->nargs);
+      eclog_putstr(f, site->file);
+      eclog_putstr(f, site->fmt);
+   }
+}
+
+/** Copy all published records of one ring into the file */
+static void eclog_drain(eclog_buffert *buf)
+{
+   uint32_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+   uint32_t tail = buf->tail;
+   uint32_t start, length;
+
+   while (head != tail)
+   {
+      start = tail & (ECLOG_BUFSIZE - 1);
+      /* records never wrap, padding fills the end of the ring */
+      length = (head - tail);
+      if (start + length > ECLOG_BUFSIZE)
+         length = ECLOG_BUFSIZE - start;
+      eclog_put(eclog_file, &buf->thread, sizeof(buf->thread));
+      eclog_put(eclog_file, &length, sizeof(length));
+      eclog_put(eclog_file, &buf->data[start], length);
+      tail += length;
+   }
+   __atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void eclog_drain_all(void)
+{
+   int i, n;
+
+   n = __atomic_load_n(&eclog_nbuffers, __ATOMIC_ACQUIRE);
+   for (i = 0; i < n; i++)
+      eclog_drain(eclog_buffers[i]);
+   fflush(eclog_file);
+}
+
+OSAL_THREAD_FUNC eclog_writer(void *ptr)
+{
+   (void)ptr;                  /* Not used */
+
+   while (eclog_running)
+   {
+      eclog_drain_all();
+      osal_usleep(ECLOG_DRAINPERIOD);
+   }
+   eclog_drain_all();
+   eclog_stopped = 1;
+}
+
+/** Open the log file and start the background writer.
+ *
+ * @param[in] filename = binary log file
+ * @return 1 on success, 0 if the file or the writer thread can not be created
+ */
+int eclog_init(const char *filename)
+{
+   eclog_file = fopen(filename, "wb");
+   if (!eclog_file)
+      return 0;
+   eclog_write_header(eclog_file);
+   eclog_running = 1;
+   eclog_stopped = 0;
+   if (osal_thread_create(&eclog_thread, 128000, &eclog_writer, NULL))
+      return 1;
+   /* no writer, eclog_close() must not wait for it */
+   eclog_running = 0;
+   fclose(eclog_file);
+   eclog_file = NULL;
+   remove(filename);
+   return 0;
+}
+
+/** Stop the writer after a final drain and close the file. */
+void eclog_close(void)
+{
+   /* also the case when eclog_init() failed and no writer is running */
+   if (!eclog_file)
+      return;
+   eclog_running = 0;
+   while (!eclog_stopped)
+      osal_usleep(1000);
+   fclose(eclog_file);
+   eclog_file = NULL;
+}
+
+/** Allocate the ring of the calling thread. Call once at thread start to keep
+ * the allocation out of the cyclic path; otherwise it happens on the first log.
+ *
+ * @return 1 on success, 0 if no more threads can be registered
+ */
+int eclog_thread_init(void)
+{
+   eclog_buffert *buf;
+
+   if (eclog_tls)
+      return 1;
+   pthread_mutex_lock(&eclog_mutex);
+   if (eclog_nbuffers >= ECLOG_MAXTHREADS)
+   {
+      pthread_mutex_unlock(&eclog_mutex);
+      return 0;
+   }
+   buf = echuge_alloc(sizeof(eclog_buffert), "eclog ring");
+   if (buf)
+   {
+      buf->thread = (uint16_t)eclog_nbuffers;
+      eclog_buffers[eclog_nbuffers] = buf;
+      __atomic_store_n(&eclog_nbuffers, eclog_nbuffers + 1, __ATOMIC_RELEASE);
+      eclog_tls = buf;
+   }
+   pthread_mutex_unlock(&eclog_mutex);
+   return buf != NULL;
+}
+
+/** Hot path of ECLOG(), copy the arguments of one call into the thread ring. */
+void eclog_write(const eclog_fmtt *site, const eclog_argt *args)
+{
+   eclog_buffert *buf = eclog_tls;
+   eclog_recordt rec;
+   uint32_t head, tail, start, length, space;
+   uint8_t *p;
+   uint8_t len;
+   int i;
+
+   if (!buf)
+   {
+      if (!eclog_thread_init())
+         return;
+      buf = eclog_tls;
+   }
+
+   length = sizeof(eclog_recordt);
+   for (i = 0; i < site->nargs; i++)
+   {
+      if (site->argtype[i] == ECLOG_ARG_STR)
+         length += 1 + (uint32_t)strnlen(args[i].s, ECLOG_MAXSTRLEN);
+      else
+         length += 8;
+   }
+
+   head = buf->head;
+   tail = __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE);
+   start = head & (ECLOG_BUFSIZE - 1);
+   space = ECLOG_BUFSIZE - (head - tail);
+   if (start + length > ECLOG_BUFSIZE)
+   {
+      /* not enough room before the end, pad and restart at the beginning */
+      if (space < (ECLOG_BUFSIZE - start) + length)
+      {
+         buf->dropped++;
+         return;
+      }
+      rec.tsc = 0;
+      rec.fmtid = ECLOG_PADDING;
+      rec.length = (uint16_t)(ECLOG_BUFSIZE - start);
+      if (rec.length >= sizeof(rec))
+         memcpy(&buf->data[start], &rec, sizeof(rec));
+      else
+         memset(&buf->data[start], 0xFF, rec.length);
+      head += ECLOG_BUFSIZE - start;
+      start = 0;
+   }
+   else if (space < length)
+   {
+      buf->dropped++;
+      return;
+   }
+
+   p = &buf->data[start];
+   rec.tsc = eclog_now();
+   rec.fmtid = (uint16_t)(site - __start_eclog_fmt);
+   rec.length = (uint16_t)length;
+   memcpy(p, &rec, sizeof(rec));
+   p += sizeof(rec);
+   for (i = 0; i < site->nargs; i++)
+   {
+      if (site->argtype[i] == ECLOG_ARG_STR)
+      {
+         len = (uint8_t)strnlen(args[i].s, ECLOG_MAXSTRLEN);
+         *p++ = len;
+         memcpy(p, args[i].s, len);
+         p += len;
+      }
+      else
+      {
+         memcpy(p, &args[i], 8);
+         p += 8;
+      }
+   }
+   __atomic_store_n(&buf->head, head + length, __ATOMIC_RELEASE);
+}
+
+/** Number of records dropped on full rings, over all threads. */
+uint32_t eclog_dropped(void)
+{
+   uint32_t dropped = 0;
+   int i, n;
+
+   n = __atomic_load_n(&eclog_nbuffers, __ATOMIC_ACQUIRE);
+   for (i = 0; i < n; i++)
+      dropped += eclog_buffers[i]->dropped;
+   return dropped;
+}
@@ -0,0 +1,124 @@
+/** \file
+ * \brief Deferred-formatting binary event log for the SOEM examples
+ *
+ * Call sites use ECLOG(format, args...) like printf. The format string, file, line and
+ * argument types are stored once at compile time in the "eclog_fmt" linker section, so
+ * the calling thread only copies a timestamp, a format id and the raw argument values
+ * into a lock-free per-thread ring. A background thread drains the rings into a binary
+ * file, and eclog_decode turns that file back into text offline.
+ *
+ * Supported arguments: any integer type, float/double and C strings (copied, max
+ * ECLOG_MAXSTRLEN bytes). At most ECLOG_MAXARGS arguments per call.
+ */
+
+#ifndef _ECLOG_H
+#define _ECLOG_H
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define ECLOG_MAXARGS     8
+#define ECLOG_MAXSTRLEN   63
+/** size of the ring of each logging thread, must be a power of two */
+#define ECLOG_BUFSIZE     (64 * 1024)
+#define ECLOG_MAXTHREADS  16
+#define ECLOG_MAGIC       "ECLOG001"
+
+typedef enum
+{
+   ECLOG_ARG_INT = 0,
+   ECLOG_ARG_DOUBLE = 1,
+   ECLOG_ARG_STR = 2
+} eclog_argtypet;
+
+/** static metadata of one call site, placed in the eclog_fmt section */
+typedef struct
+{
+   const char *fmt;
+   const char *file;
+   int32_t    line;
+   uint8_t    nargs;
+   uint8_t    argtype[ECLOG_MAXARGS + 1];
+} eclog_fmtt;
+
+typedef union
+{
+   int64_t    i;
+   double     d;
+   const char *s;
+} eclog_argt;
+
+/** record header in the ring and in the file, arguments follow */
+typedef struct __attribute__((__packed__))
+{
+   uint64_t   tsc;
+   uint16_t   fmtid;
+   uint16_t   length;
+} eclog_recordt;
+
+#define ECLOG_PADDING     0xFFFF
+
+/* Argument classification, selected at compile time per argument */
+#define ECLOG_ARGTYPE(x) _Generic((x), \
+   float: ECLOG_ARG_DOUBLE, double: ECLOG_ARG_DOUBLE, \
+   char *: ECLOG_ARG_STR, const char *: ECLOG_ARG_STR, \
+   default: ECLOG_ARG_INT),
+#define ECLOG_ARGVAL(x) _Generic((x), \
+   float: eclog_argd, double: eclog_argd, \
+   char *: eclog_args, const char *: eclog_args, \
+   default: eclog_argi)(x),
+
+static inline eclog_argt eclog_argi(int64_t v) { eclog_argt a; a.i = v; return a; }
+static inline eclog_argt eclog_argd(double v) { eclog_argt a; a.d = v; return a; }
+static inline eclog_argt eclog_args(const char *v) { eclog_argt a; a.s = v; return a; }
+
+#define ECLOG_NARGS(...) ECLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define ECLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+#define ECLOG_MAP_0(m)
+#define ECLOG_MAP_1(m, a) m(a)
+#define ECLOG_MAP_2(m, a, ...) m(a) ECLOG_MAP_1(m, __VA_ARGS__)
+#define ECLOG_MAP_3(m, a, ...) m(a) ECLOG_MAP_2(m, __VA_ARGS__)
+#define ECLOG_MAP_4(m, a, ...) m(a) ECLOG_MAP_3(m, __VA_ARGS__)
+#define ECLOG_MAP_5(m, a, ...) m(a) ECLOG_MAP_4(m, __VA_ARGS__)
+#define ECLOG_MAP_6(m, a, ...) m(a) ECLOG_MAP_5(m, __VA_ARGS__)
+#define ECLOG_MAP_7(m, a, ...) m(a) ECLOG_MAP_6(m, __VA_ARGS__)
+#define ECLOG_MAP_8(m, a, ...) m(a) ECLOG_MAP_7(m, __VA_ARGS__)
+#define ECLOG_MAP_N(n) ECLOG_MAP_##n
+#define ECLOG_MAP_(n, m, ...) ECLOG_MAP_N(n)(m, ##__VA_ARGS__)
+#define ECLOG_MAP(m, ...) ECLOG_MAP_(ECLOG_NARGS(__VA_ARGS__), m, ##__VA_ARGS__)
+
+/** Log an event. Usable from any thread, never blocks. */
+#define ECLOG(format, ...) do { \
+   static const eclog_fmtt eclog_site_ \
+      __attribute__((section("eclog_fmt"), used, aligned(sizeof(void *)))) = \
+      { format, __FILE__, __LINE__, ECLOG_NARGS(__VA_ARGS__), \
+        { ECLOG_MAP(ECLOG_ARGTYPE, ##__VA_ARGS__) 0 } }; \
+   eclog_argt eclog_args_[] = { ECLOG_MAP(ECLOG_ARGVAL, ##__VA_ARGS__) { 0 } }; \
+   eclog_write(&eclog_site_, eclog_args_); \
+} while (0)
+
+/** Timestamp of the log, raw TSC ticks on x86 and nanoseconds elsewhere */
+static inline uint64_t eclog_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return __rdtsc();
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+int eclog_init(const char *filename);
+void eclog_close(void);
+int eclog_thread_init(void);
+void eclog_write(const eclog_fmtt *site, const eclog_argt *args);
+uint32_t eclog_dropped(void);
+
+#endif
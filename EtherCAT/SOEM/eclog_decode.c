@@ -0,0 +1,268 @@
+/** \file
+ * \brief Offline decoder for binary logs written by eclog
+ *
+ * Usage : eclog_decode logfile [-a]
+ * Prints one line per record: time since log start (or wall clock with -a),
+ * logging thread and the formatted message.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "eclog.h"
+
+typedef struct
+{
+   int32_t    line;
+   uint8_t    nargs;
+   uint8_t    argtype[ECLOG_MAXARGS];
+   char       *file;
+   char       *fmt;
+} decode_fmtt;
+
+static decode_fmtt *fmts;
+static uint32_t nfmts;
+
+static int get(FILE *f, void *p, size_t size)
+{
+   return fread(p, 1, size, f) == size;
+}
+
+static char *getstr(FILE *f)
+{
+   uint16_t len;
+   char *s;
+
+   if (!get(f, &len, sizeof(len)))
+      return NULL;
+   s = malloc(len + 1);
+   if (!s || !get(f, s, len))
+   {
+      free(s);
+      return NULL;
+   }
+   s[len] = 0;
+   return s;
+}
+
+/** Format one conversion with the value narrowed as printf would have done. */
+static int format_arg(char *out, size_t size, const char *spec, size_t speclen,
+                      uint8_t type, const uint8_t *arg, uint8_t slen)
+{
+   char cspec[32], conv, str[ECLOG_MAXSTRLEN + 1];
+   const char *mod;
+   size_t n, base;
+   int64_t i;
+   double d;
+
+   conv = spec[speclen - 1];
+   /* strip the length modifier, it is re-applied below */
+   base = speclen - 1;
+   while (base > 1 && strchr("hlLqjzt", spec[base - 1]))
+      base--;
+   mod = spec + base;
+   n = base < sizeof(cspec) - 4 ? base : sizeof(cspec) - 4;
+   memcpy(cspec, spec, n);
+
+   if (type == ECLOG_ARG_STR)
+   {
+      memcpy(str, arg, slen);
+      str[slen] = 0;
+      cspec[n] = 's';
+      cspec[n + 1] = 0;
+      return snprintf(out, size, cspec, str);
+   }
+   if (type == ECLOG_ARG_DOUBLE)
+   {
+      memcpy(&d, arg, sizeof(d));
+      i = (int64_t)d;
+   }
+   else
+   {
+      memcpy(&i, arg, sizeof(i));
+      d = (double)i;
+   }
+
+   switch (conv)
+   {
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+         cspec[n] = conv;
+         cspec[n + 1] = 0;
+         return snprintf(out, size, cspec, d);
+      case 'c':
+         cspec[n] = 'c';
+         cspec[n + 1] = 0;
+         return snprintf(out, size, cspec, (int)(char)i);
+      case 'd': case 'i':
+         if (!strncmp(mod, "hh", 2))
+            i = (signed char)i;
+         else if (*mod == 'h')
+            i = (short)i;
+         else if (mod == spec + speclen - 1)
+            i = (int)i;
+         cspec[n] = 'l';
+         cspec[n + 1] = 'l';
+         cspec[n + 2] = conv;
+         cspec[n + 3] = 0;
+         return snprintf(out, size, cspec, (long long)i);
+      case 'u': case 'x': case 'X': case 'o':
+         if (!strncmp(mod, "hh", 2))
+            i = (unsigned char)i;
+         else if (*mod == 'h')
+            i = (unsigned short)i;
+         else if (mod == spec + speclen - 1)
+            i = (unsigned int)i;
+         cspec[n] = 'l';
+         cspec[n + 1] = 'l';
+         cspec[n + 2] = conv;
+         cspec[n + 3] = 0;
+         return snprintf(out, size, cspec, (unsigned long long)i);
+      case 'p':
+         return snprintf(out, size, "0x%" PRIx64, (uint64_t)i);
+      default:
+         return snprintf(out, size, "<%.*s?>", (int)speclen, spec);
+   }
+}
+
+/** Expand the format of one record into text. */
+static void format_record(char *out, size_t size, const decode_fmtt *fmt,
+                          const uint8_t *args, const uint8_t *end)
+{
+   const char *p = fmt->fmt, *spec;
+   size_t used = 0, speclen;
+   int argi = 0, n;
+   uint8_t slen;
+
+   while (*p && used + 1 < size)
+   {
+      if (*p != '%')
+      {
+         out[used++] = *p++;
+         continue;
+      }
+      if (p[1] == '%')
+      {
+         out[used++] = '%';
+         p += 2;
+         continue;
+      }
+      spec = p++;
+      while (*p && !strchr("diouxXeEfFgGaAcspn", *p))
+         p++;
+      if (!*p)
+         break;
+      speclen = (size_t)(++p - spec);
+      if (argi >= fmt->nargs || args >= end)
+         break;
+      slen = 0;
+      if (fmt->argtype[argi] == ECLOG_ARG_STR)
+         slen = *args++;
+      n = format_arg(out + used, size - used, spec, speclen, fmt->argtype[argi], args, slen);
+      args += fmt->argtype[argi] == ECLOG_ARG_STR ? slen : 8;
+      argi++;
+      if (n > 0)
+         used += (size_t)n < size - used ? (size_t)n : size - used - 1;
+   }
+   /* the console formats carry their own line control */
+   while (used && (out[used - 1] == '\n' || out[used - 1] == '\r'))
+      used--;
+   out[used] = 0;
+}
+
+int main(int argc, char *argv[])
+{
+   FILE *f;
+   char magic[8], text[1024];
+   uint32_t version, length, i;
+   double hz;
+   uint64_t tsc0;
+   int64_t realtime0;
+   uint16_t thread, id;
+   uint8_t *chunk = NULL;
+   size_t chunksize = 0, pos;
+   eclog_recordt rec;
+   int absolute = (argc > 2) && !strcmp(argv[2], "-a");
+
+   if (argc < 2)
+   {
+      printf("Usage: eclog_decode logfile [-a]\n-a prints wall clock time\n");
+      return 1;
+   }
+   f = fopen(argv[1], "rb");
+   if (!f)
+   {
+      printf("Can not open %s\n", argv[1]);
+      return 1;
+   }
+   if (!get(f, magic, 8) || memcmp(magic, ECLOG_MAGIC, 8) ||
+       !get(f, &version, sizeof(version)) || !get(f, &hz, sizeof(hz)) ||
+       !get(f, &tsc0, sizeof(tsc0)) || !get(f, &realtime0, sizeof(realtime0)) ||
+       !get(f, &nfmts, sizeof(nfmts)))
+   {
+      printf("%s is not an eclog file\n", argv[1]);
+      return 1;
+   }
+   fmts = calloc(nfmts ? nfmts : 1, sizeof(decode_fmtt));
+   for (i = 0; i < nfmts; i++)
+   {
+      decode_fmtt fmt;
+
+      if (!get(f, &id, sizeof(id)) || (id >= nfmts) || !get(f, &fmt.line, sizeof(fmt.line)) ||
+          !get(f, &fmt.nargs, sizeof(fmt.nargs)) || (fmt.nargs > ECLOG_MAXARGS) ||
+          !get(f, fmt.argtype, fmt.nargs) || !(fmt.file = getstr(f)) || !(fmt.fmt = getstr(f)))
+      {
+         printf("Corrupt format table\n");
+         return 1;
+      }
+      fmts[id] = fmt;
+   }
+
+   while (get(f, &thread, sizeof(thread)) && get(f, &length, sizeof(length)))
+   {
+      if (length > chunksize)
+      {
+         chunksize = length;
+         chunk = realloc(chunk, chunksize);
+      }
+      if (!get(f, chunk, length))
+         break;
+      pos = 0;
+      while (pos + sizeof(rec) <= length)
+      {
+         double t;
+
+         memcpy(&rec, &chunk[pos], sizeof(rec));
+         /* padding runs to the end of the chunk */
+         if ((rec.fmtid == ECLOG_PADDING) || (rec.length < sizeof(rec)) || (pos + rec.length > length))
+            break;
+         if (rec.fmtid < nfmts)
+         {
+            format_record(text, sizeof(text), &fmts[rec.fmtid],
+                          &chunk[pos + sizeof(rec)], &chunk[pos + rec.length]);
+            t = ((double)rec.tsc - (double)tsc0) / hz;
+            if (absolute)
+            {
+               time_t sec;
+               struct tm tm;
+               char stamp[32];
+               int64_t ns = realtime0 + (int64_t)(t * 1e9);
+
+               sec = (time_t)(ns / 1000000000LL);
+               localtime_r(&sec, &tm);
+               strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+               printf("%s.%06d T%u %s\n", stamp, (int)((ns % 1000000000LL) / 1000), thread, text);
+            }
+            else
+            {
+               printf("%14.6f T%u %s\n", t, thread, text);
+            }
+         }
+         pos += rec.length;
+      }
+   }
+   fclose(f);
+   return 0;
+}
@@ -0,0 +1,289 @@
+/** \file
+ * \brief Compressed per-cycle recording of process data, writer side
+ *
+ * The cyclic thread copies a record into a ring slot and publishes it with a release
+ * store; a full ring drops the record and counts it. The writer thread encodes the
+ * slots in two passes: a branch-free pass over all fields computes the residuals into
+ * an array, which the compiler vectorizes, then a byte pass writes the masks and the
+ * varints of the changed fields. Build together with ecpack_read.c, which holds the
+ * coding state shared with the reader.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethercat.h"
+#include "ecpack.h"
+#include "echuge.h"
+
+#define ECPACK_DRAINPERIOD  10000
+#define ECPACK_MAXBLOCKS    1024
+
+static uint8_t *ecpack_putvarint(uint8_t *out, uint64_t v)
+{
+   while (v >= 0x80)
+   {
+      *out++ = (uint8_t)(v | 0x80);
+      v >>= 7;
+   }
+   *out++ = (uint8_t)v;
+   return out;
+}
+
+/* Residuals of one slot into c->value, then the slot becomes the previous one */
+static void ecpack_residuals(ecpack_codect *c, const uint8_t *slot)
+{
+   int64_t *restrict value = c->value, *restrict prev = c->prev, *restrict prev2 = c->prev2;
+   const int64_t *restrict shift = c->shift, *restrict xormask = c->xormask, *restrict slope = c->slope;
+   int64_t v, z, first = -(int64_t)c->first;
+   uint64_t pred;
+   int i, n = c->nfields;
+
+   for (i = 0; i < n; i++)
+      value[i] = (int64_t)(ecpack_load(slot + c->offset[i], c->width[i]) << shift[i]) >> shift[i];
+   for (i = 0; i < n; i++)
+   {
+      v = value[i];
+      /* unsigned, wraps like the decoder does on extreme values */
+      pred = (uint64_t)prev[i] + (((uint64_t)prev[i] - (uint64_t)prev2[i]) & (uint64_t)slope[i]);
+      z = (int64_t)ecpack_zigzag((int64_t)((uint64_t)v - pred));
+      value[i] = ((v ^ prev[i]) & xormask[i]) | (z & ~xormask[i]);
+      prev2[i] = (prev[i] & ~first) | (v & first);
+      prev[i] = v;
+   }
+   c->first = 0;
+}
+
+/* Encode one slot, returns the end of the output */
+static uint8_t *ecpack_encode(ecpack_codect *c, const uint8_t *slot, uint8_t *out)
+{
+   int g, i, n = c->nfields, ngroups = (n + 7) / 8;
+   uint8_t *gmask = out, m;
+
+   ecpack_residuals(c, slot);
+   memset(gmask, 0, (ngroups + 7) / 8);
+   out += (ngroups + 7) / 8;
+   for (g = 0; g < ngroups; g++)
+   {
+      m = 0;
+      for (i = 8 * g; (i < n) && (i < 8 * g + 8); i++)
+         m |= (uint8_t)((c->value[i] != 0) << (i - 8 * g));
+      if (m)
+      {
+         gmask[g >> 3] |= (uint8_t)(1 << (g & 7));
+         *out++ = m;
+      }
+   }
+   for (i = 0; i < n; i++)
+   {
+      if (c->value[i])
+         out = ecpack_putvarint(out, (uint64_t)c->value[i]);
+   }
+   return out;
+}
+
+static void ecpack_flush_block(ecpack_t *p, uint8_t *end)
+{
+   ecpack_indext *index;
+
+   if (!p->blockheader.nrecords)
+      return;
+   p->blockheader.magic = ECPACK_BLOCKMAGIC;
+   p->blockheader.length = (uint32_t)(end - p->block);
+   if (p->nblocks == p->maxblocks)
+   {
+      index = realloc(p->index, 2 * p->maxblocks * sizeof(*index));
+      if (index)
+      {
+         p->index = index;
+         p->maxblocks *= 2;
+      }
+   }
+   if (p->nblocks < p->maxblocks)
+   {
+      p->index[p->nblocks].offset = (uint64_t)ftello(p->file);
+      p->index[p->nblocks].firsttime = p->blockheader.firsttime;
+      p->index[p->nblocks].lasttime = p->blockheader.lasttime;
+      p->nblocks++;
+   }
+   fwrite(&p->blockheader, sizeof(p->blockheader), 1, p->file);
+   fwrite(p->block, 1, p->blockheader.length, p->file);
+   p->blockheader.nrecords = 0;
+}
+
+/* Encode all published slots, returns the end of the current block payload */
+static uint8_t *ecpack_drain(ecpack_t *p, uint8_t *end)
+{
+   uint32_t head = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+   uint32_t tail = p->tail, dropped;
+   const uint8_t *slot;
+
+   while (head != tail)
+   {
+      slot = p->ring + (size_t)(tail & (ECPACK_RINGSIZE - 1)) * p->slotsize;
+      if (!p->blockheader.nrecords)
+      {
+         /* every block decodes on its own */
+         dropped = __atomic_load_n(&p->dropped, __ATOMIC_RELAXED);
+         p->blockheader.first = p->written + dropped;
+         memcpy(&p->blockheader.firsttime, slot, sizeof(int64_t));
+         p->codec.first = 1;
+         memset(p->codec.prev, 0, p->codec.nfields * sizeof(int64_t));
+         memset(p->codec.prev2, 0, p->codec.nfields * sizeof(int64_t));
+      }
+      memcpy(&p->blockheader.lasttime, slot, sizeof(int64_t));
+      end = ecpack_encode(&p->codec, slot, end);
+      p->blockheader.nrecords++;
+      p->written++;
+      tail++;
+      __atomic_store_n(&p->tail, tail, __ATOMIC_RELEASE);
+      if (p->blockheader.nrecords == p->blockrecords)
+      {
+         ecpack_flush_block(p, end);
+         end = p->block;
+      }
+   }
+   return end;
+}
+
+OSAL_THREAD_FUNC ecpack_writer(void *ptr)
+{
+   ecpack_t *p = ptr;
+   uint8_t *end = p->block;
+
+   while (p->running)
+   {
+      end = ecpack_drain(p, end);
+      osal_usleep(ECPACK_DRAINPERIOD);
+   }
+   end = ecpack_drain(p, end);
+   ecpack_flush_block(p, end);
+   p->stopped = 1;
+}
+
+/** Create the recording and start its writer thread.
+ *
+ * @param[out] p            = recording
+ * @param[in]  filename     = file to create
+ * @param[in]  fields       = fields of the record, parts of the record not covered
+ *                            by a field are not recorded
+ * @param[in]  nfields      = number of fields
+ * @param[in]  recsize      = bytes per record
+ * @param[in]  blockrecords = records per block, the unit of random access
+ * @return 1 on success
+ */
+int ecpack_open(ecpack_t *p, const char *filename, const ecpack_fieldt *fields, int nfields,
+                uint32_t recsize, uint32_t blockrecords)
+{
+   uint32_t version = ECPACK_VERSION, n = (uint32_t)nfields;
+   OSAL_THREAD_HANDLE thread;
+   uint8_t len;
+   int i;
+
+   memset(p, 0, sizeof(*p));
+   for (i = 0; i < nfields; i++)
+   {
+      if ((fields[i].width < 1) || (fields[i].width > 8) || (fields[i].offset + fields[i].width > recsize))
+         return 0;
+   }
+   p->recsize = recsize;
+   p->slotsize = (uint32_t)((8 + recsize + 7) & ~7u);
+   p->blockrecords = blockrecords ? blockrecords : 1;
+   /* worst case per record: both masks and a 10 byte varint per field */
+   p->blocksize = (size_t)p->blockrecords * ((nfields + 8) / 8 + (nfields + 64) / 64 + 10 * (nfields + 1));
+   p->ring = echuge_alloc((size_t)ECPACK_RINGSIZE * p->slotsize, "ecpack ring");
+   p->block = malloc(p->blocksize);
+   p->maxblocks = ECPACK_MAXBLOCKS;
+   p->index = malloc(p->maxblocks * sizeof(*p->index));
+   if (!p->ring || !p->block || !p->index || !ecpack_codec_init(&p->codec, fields, nfields))
+      goto fail;
+   p->file = fopen(filename, "wb");
+   if (!p->file)
+      goto fail;
+
+   fwrite(ECPACK_MAGIC, 1, 8, p->file);
+   fwrite(&version, sizeof(version), 1, p->file);
+   fwrite(&p->recsize, sizeof(p->recsize), 1, p->file);
+   fwrite(&p->blockrecords, sizeof(p->blockrecords), 1, p->file);
+   fwrite(&n, sizeof(n), 1, p->file);
+   for (i = 0; i < nfields; i++)
+   {
+      len = (uint8_t)strnlen(fields[i].name, ECPACK_MAXNAME);
+      fwrite(&fields[i].offset, sizeof(fields[i].offset), 1, p->file);
+      fwrite(&fields[i].width, 1, 1, p->file);
+      fwrite(&fields[i].kind, 1, 1, p->file);
+      fwrite(&len, 1, 1, p->file);
+      fwrite(fields[i].name, 1, len, p->file);
+   }
+   p->running = 1;
+   if (osal_thread_create(&thread, 128000, &ecpack_writer, p))
+      return 1;
+   /* no writer, ecpack_close() would wait for it forever */
+   fclose(p->file);
+   remove(filename);
+
+fail:
+   if (p->ring)
+      echuge_free(p->ring);
+   free(p->block);
+   free(p->index);
+   ecpack_codec_free(&p->codec);
+   memset(p, 0, sizeof(*p));
+   return 0;
+}
+
+/** Cyclic thread: record one cycle, never blocks.
+ *
+ * @param[in] p      = recording
+ * @param[in] time   = time of the record, f.e. ec_DCtime
+ * @param[in] record = recsize bytes
+ * @return 1 when queued, 0 when the ring is full and the record is dropped
+ */
+int ecpack_write(ecpack_t *p, int64_t time, const void *record)
+{
+   uint32_t head = p->head;
+   uint8_t *slot;
+
+   if (!p->ring)
+      return 0;
+   if (head - __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE) >= ECPACK_RINGSIZE)
+   {
+      __atomic_add_fetch(&p->dropped, 1, __ATOMIC_RELAXED);
+      return 0;
+   }
+   slot = p->ring + (size_t)(head & (ECPACK_RINGSIZE - 1)) * p->slotsize;
+   memcpy(slot, &time, sizeof(time));
+   memcpy(slot + 8, record, p->recsize);
+   __atomic_store_n(&p->head, head + 1, __ATOMIC_RELEASE);
+   return 1;
+}
+
+/** Encode what is left, write the block index and close the file. */
+void ecpack_close(ecpack_t *p)
+{
+   uint64_t offset;
+
+   if (!p->file)
+      return;
+   p->running = 0;
+   while (!p->stopped)
+      osal_usleep(1000);
+   offset = (uint64_t)ftello(p->file);
+   fwrite(p->index, sizeof(*p->index), p->nblocks, p->file);
+   fwrite(&offset, sizeof(offset), 1, p->file);
+   fwrite(&p->nblocks, sizeof(p->nblocks), 1, p->file);
+   fwrite(ECPACK_INDEXMAGIC, 1, 8, p->file);
+   fclose(p->file);
+   echuge_free(p->ring);
+   free(p->block);
+   free(p->index);
+   ecpack_codec_free(&p->codec);
+   p->file = NULL;
+   p->ring = NULL;
+}
+
+uint32_t ecpack_dropped(const ecpack_t *p)
+{
+   return __atomic_load_n(&p->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,192 @@
+/** \file
+ * \brief Compressed per-cycle recording of process data
+ *
+ * The cyclic thread hands a timestamp and a fixed-size record (f.e. the inputs of all
+ * slaves in the IOmap) to ecpack_write(), which only copies it into a lock-free ring.
+ * A background thread encodes the records field by field against the previous cycle
+ * and writes them in blocks of a fixed number of records. Every block starts from
+ * zero, so it decodes on its own, and an index of all blocks at the end of the file
+ * gives random access by time (ecpack_read.c, ecpack_decode).
+ *
+ * Encoding of a field value v with previous values p1 and p2 in the block:
+ *   ECPACK_XOR    : v ^ p1, for bit fields like statuswords and digital inputs
+ *   ECPACK_DELTA  : zigzag(v - p1), for slowly varying values
+ *   ECPACK_DELTA2 : zigzag(v - 2 p1 + p2), for values changing at a steady rate like
+ *                   positions and counters
+ * The record time is an implicit ECPACK_DELTA2 field in front of the others. Per record
+ * a bit per group of 8 fields says which groups changed, per changed group a bit per
+ * field which fields changed, and only those follow as LEB128 varints.
+ *
+ * File layout
+ * -----------
+ * header  : magic[8], uint32 version, uint32 record size, uint32 records per block,
+ *           uint32 number of fields, per field uint32 offset, uint8 width, uint8 kind,
+ *           uint8 len + name
+ * blocks  : ecpack_blockt, payload
+ * index   : ecpack_indext per block
+ * trailer : uint64 file offset of the index, uint32 number of blocks, magic[8]
+ * Without index (the recorder did not close the file) the reader scans the blocks.
+ */
+
+#ifndef _ECPACK_H
+#define _ECPACK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ECPACK_MAGIC        "ECPACK01"
+#define ECPACK_INDEXMAGIC   "ECPACKIX"
+#define ECPACK_BLOCKMAGIC   0x42504345
+#define ECPACK_VERSION      1
+#define ECPACK_MAXNAME      31
+/** records in the ring between cyclic thread and encoder, a power of two */
+#define ECPACK_RINGSIZE     2048
+
+typedef enum
+{
+   ECPACK_XOR = 0,
+   ECPACK_DELTA = 1,
+   ECPACK_DELTA2 = 2
+} ecpack_kindt;
+
+typedef struct
+{
+   char       name[ECPACK_MAXNAME + 1];
+   /** byte offset in the record */
+   uint32_t   offset;
+   /** 1, 2, 4 or 8 bytes, little endian, signed unless ECPACK_XOR */
+   uint8_t    width;
+   uint8_t    kind;
+} ecpack_fieldt;
+
+typedef struct __attribute__((__packed__))
+{
+   uint32_t   magic;
+   uint32_t   nrecords;
+   /** bytes of payload following the header */
+   uint32_t   length;
+   /** number of the first record since the start, dropped records included */
+   uint64_t   first;
+   int64_t    firsttime;
+   int64_t    lasttime;
+} ecpack_blockt;
+
+typedef struct __attribute__((__packed__))
+{
+   uint64_t   offset;
+   int64_t    firsttime;
+   int64_t    lasttime;
+} ecpack_indext;
+
+/** Per field coding state of one direction, the time is field 0 */
+typedef struct
+{
+   int        nfields;
+   uint32_t   *offset;
+   uint8_t    *width;
+   /** 64 - 8 width to sign extend signed fields, 0 for ECPACK_XOR */
+   int64_t    *shift;
+   /** all ones for ECPACK_XOR */
+   int64_t    *xormask;
+   /** all ones for ECPACK_DELTA2 */
+   int64_t    *slope;
+   int64_t    *prev;
+   int64_t    *prev2;
+   int64_t    *value;
+   int        first;
+} ecpack_codect;
+
+typedef struct
+{
+   FILE          *file;
+   ecpack_codect codec;
+   uint32_t      recsize;
+   /** ring slot: int64 time, then the record */
+   uint32_t      slotsize;
+   uint32_t      blockrecords;
+   uint8_t       *ring;
+   uint32_t      head;
+   uint32_t      tail;
+   uint32_t      dropped;
+   uint64_t      written;
+   /** payload of the block being encoded */
+   uint8_t       *block;
+   size_t        blocksize;
+   ecpack_blockt blockheader;
+   ecpack_indext *index;
+   uint32_t      nblocks;
+   uint32_t      maxblocks;
+   volatile int  running;
+   volatile int  stopped;
+} ecpack_t;
+
+typedef struct
+{
+   FILE          *file;
+   ecpack_codect codec;
+   ecpack_fieldt *fields;
+   int           nfields;
+   uint32_t      recsize;
+   uint32_t      slotsize;
+   uint32_t      blockrecords;
+   ecpack_indext *index;
+   uint32_t      nblocks;
+   /** block being decoded */
+   uint32_t      block;
+   uint8_t       *payload;
+   size_t        payloadsize;
+   uint32_t      length;
+   uint32_t      pos;
+   uint32_t      left;
+   /** the record in slot is not handed out yet */
+   int           pending;
+   uint8_t       *slot;
+} ecpack_readert;
+
+static inline uint64_t ecpack_zigzag(int64_t v)
+{
+   return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t ecpack_unzigzag(uint64_t z)
+{
+   return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+/** Little endian field of 1 to 8 bytes, zero extended */
+static inline uint64_t ecpack_load(const uint8_t *p, int width)
+{
+   uint64_t v = 0;
+
+   memcpy(&v, p, width);
+   return v;
+}
+
+/** Value of a field in a record, sign extended unless ECPACK_XOR */
+static inline int64_t ecpack_field_value(const ecpack_fieldt *f, const uint8_t *record)
+{
+   uint64_t v = ecpack_load(record + f->offset, f->width);
+   int shift = 64 - 8 * f->width;
+
+   if ((f->kind == ECPACK_XOR) || !shift)
+      return (int64_t)v;
+   return (int64_t)(v << shift) >> shift;
+}
+
+int ecpack_codec_init(ecpack_codect *c, const ecpack_fieldt *fields, int nfields);
+void ecpack_codec_free(ecpack_codect *c);
+
+int ecpack_open(ecpack_t *p, const char *filename, const ecpack_fieldt *fields, int nfields,
+                uint32_t recsize, uint32_t blockrecords);
+int ecpack_write(ecpack_t *p, int64_t time, const void *record);
+void ecpack_close(ecpack_t *p);
+uint32_t ecpack_dropped(const ecpack_t *p);
+
+int ecpack_reader_open(ecpack_readert *r, const char *filename);
+int ecpack_reader_seek(ecpack_readert *r, int64_t time);
+int ecpack_reader_next(ecpack_readert *r, int64_t *time, void *record);
+uint64_t ecpack_reader_count(ecpack_readert *r);
+void ecpack_reader_close(ecpack_readert *r);
+
+#endif
@@ -0,0 +1,97 @@
+/** \file
+ * \brief Offline decoder for process data recordings written by ecpack
+ *
+ * Usage : ecpack_decode recording [-f from_ns] [-t to_ns] [-s]
+ * Prints the records as CSV, one column per field. -f and -t select a time window,
+ * only the blocks that hold it are read. -s prints the size of the recording instead.
+ *
+ * Build with ecpack_read.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ecpack.h"
+
+static void print_stats(ecpack_readert *r, const char *filename)
+{
+   FILE *f = fopen(filename, "rb");
+   uint8_t *record = malloc(r->recsize);
+   uint64_t records = 0;
+   int64_t t, first = 0, last = 0;
+   long size = 0;
+
+   if (f)
+   {
+      fseek(f, 0, SEEK_END);
+      size = ftell(f);
+      fclose(f);
+   }
+   while (record && ecpack_reader_next(r, &t, record))
+   {
+      first = records ? first : t;
+      last = t;
+      records++;
+   }
+   printf("%" PRIu64 " records of %u bytes, %d fields, %u blocks, %.3f s\n",
+          records, r->recsize, r->nfields, r->nblocks, (last - first) * 1e-9);
+   if (size > 0)
+      printf("%ld bytes, %.1f bytes per record, %.1f times smaller than the records\n",
+             size, (double)size / (records ? records : 1),
+             (double)records * (r->recsize + 8) / size);
+   free(record);
+}
+
+int main(int argc, char *argv[])
+{
+   ecpack_readert r;
+   uint8_t *record;
+   int64_t from = INT64_MIN, to = INT64_MAX, t;
+   int i, stats = 0;
+
+   if (argc < 2)
+   {
+      printf("Usage: ecpack_decode recording [-f from_ns] [-t to_ns] [-s]\n");
+      return 1;
+   }
+   for (i = 2; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-f") && (i + 1 < argc))
+         from = strtoll(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+         to = strtoll(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-s"))
+         stats = 1;
+   }
+   if (!ecpack_reader_open(&r, argv[1]))
+   {
+      printf("Can not read recording %s\n", argv[1]);
+      return 1;
+   }
+   if (stats)
+   {
+      print_stats(&r, argv[1]);
+      ecpack_reader_close(&r);
+      return 0;
+   }
+   record = malloc(r.recsize ? r.recsize : 1);
+   printf("time_ns");
+   for (i = 0; i < r.nfields; i++)
+      printf(",%s", r.fields[i].name);
+   printf("\n");
+   if (record && ((from == INT64_MIN) || ecpack_reader_seek(&r, from)))
+   {
+      while (ecpack_reader_next(&r, &t, record) && (t <= to))
+      {
+         printf("%" PRId64, t);
+         for (i = 0; i < r.nfields; i++)
+            printf(",%" PRId64, ecpack_field_value(&r.fields[i], record));
+         printf("\n");
+      }
+   }
+   free(record);
+   ecpack_reader_close(&r);
+   return 0;
+}
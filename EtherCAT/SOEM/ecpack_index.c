@@ -0,0 +1,156 @@
+/** \file
+ * \brief Min/max pyramid of process data recordings for viewers
+ *
+ * Usage : ecpack_index recording [field ...] [-a] [-b base] [-f fanout]
+ *         ecpack_index -q pyramid field from_ns to_ns pixels
+ * The first form writes recording.pyr for the given fields. Without names it indexes
+ * the fields listed in INDEX_DEFAULT of every slave (f.e. s3.PositionValue), with -a
+ * all fields of the recording; the pyramid grows with the number of fields, about
+ * 18 bytes per field and base records.
+ * The second prints the answer of a viewer query as CSV: pixel, start time, min, max.
+ *
+ * Build with ecpyramid.c and ecpack_read.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ecpyramid.h"
+
+#define INDEX_BASE    16
+#define INDEX_FANOUT  8
+
+/* fields indexed without names, matched after the slave prefix of the recording */
+static const char *const INDEX_DEFAULT[] =
+{
+   "Statusword", "PositionValue", "VelocityValue", "TorqueValue"
+};
+
+/* Names of the default fields in the recording, returns their number, -1 if it can
+   not be read */
+static int default_fields(const char *recording, char (**names)[ECPACK_MAXNAME + 1])
+{
+   ecpack_readert r;
+   const char *name, *dot;
+   size_t i;
+   int f, n = 0;
+
+   if (!ecpack_reader_open(&r, recording))
+      return -1;
+   *names = malloc((r.nfields ? r.nfields : 1) * sizeof(**names));
+   for (f = 0; *names && (f < r.nfields); f++)
+   {
+      dot = strchr(r.fields[f].name, '.');
+      name = dot ? dot + 1 : r.fields[f].name;
+      for (i = 0; i < sizeof(INDEX_DEFAULT) / sizeof(INDEX_DEFAULT[0]); i++)
+      {
+         if (!strcmp(name, INDEX_DEFAULT[i]))
+         {
+            memcpy((*names)[n++], r.fields[f].name, ECPACK_MAXNAME + 1);
+            break;
+         }
+      }
+   }
+   ecpack_reader_close(&r);
+   return *names ? n : -1;
+}
+
+static int query(int argc, char *argv[])
+{
+   ecpyr_t p;
+   ecpyr_pixelt *out;
+   int64_t from, to;
+   int column, pixels, i, n;
+
+   if (argc < 7)
+      return 1;
+   if (!ecpyr_open(&p, argv[2]))
+   {
+      printf("Can not map pyramid %s\n", argv[2]);
+      return 1;
+   }
+   column = ecpyr_column(&p, argv[3]);
+   from = strtoll(argv[4], NULL, 0);
+   to = strtoll(argv[5], NULL, 0);
+   pixels = atoi(argv[6]);
+   out = malloc((pixels > 0 ? pixels : 1) * sizeof(*out));
+   n = out ? ecpyr_query(&p, column, from, to, pixels, out) : -1;
+   if (n < 0)
+      printf("Query failed, unknown field %s or bad window\n", argv[3]);
+   else
+   {
+      printf("pixel,time_ns,min,max\n");
+      for (i = 0; i < pixels; i++)
+      {
+         if (out[i].n)
+            printf("%d,%" PRId64 ",%" PRId64 ",%" PRId64 "\n", i,
+                   from + (int64_t)((double)(to - from + 1) * i / pixels), out[i].min, out[i].max);
+      }
+   }
+   free(out);
+   ecpyr_close(&p);
+   return n < 0;
+}
+
+int main(int argc, char *argv[])
+{
+   char pyramid[ECPYR_MAXPATH];
+   char (*defaults)[ECPACK_MAXNAME + 1] = NULL;
+   const char **names;
+   uint32_t base = INDEX_BASE, fanout = INDEX_FANOUT;
+   int i, nnames = 0, all = 0, ok;
+
+   if ((argc > 1) && !strcmp(argv[1], "-q"))
+      return query(argc, argv);
+   if (argc < 2)
+   {
+      printf("Usage: ecpack_index recording [field ...] [-a] [-b base] [-f fanout]\n"
+             "       ecpack_index -q pyramid field from_ns to_ns pixels\n");
+      return 1;
+   }
+   names = malloc(argc * sizeof(*names));
+   if (!names)
+      return 1;
+   for (i = 2; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-b") && (i + 1 < argc))
+         base = (uint32_t)atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-f") && (i + 1 < argc))
+         fanout = (uint32_t)atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-a"))
+         all = 1;
+      else
+         names[nnames++] = argv[i];
+   }
+   if (!nnames && !all)
+   {
+      nnames = default_fields(argv[1], &defaults);
+      if (nnames <= 0)
+      {
+         printf("Can not index %s, unreadable recording or none of the default fields\n", argv[1]);
+         free(defaults);
+         free(names);
+         return 1;
+      }
+      free(names);
+      names = malloc(nnames * sizeof(*names));
+      for (i = 0; names && (i < nnames); i++)
+         names[i] = defaults[i];
+      if (!names)
+      {
+         free(defaults);
+         return 1;
+      }
+   }
+   snprintf(pyramid, sizeof(pyramid), "%s.pyr", argv[1]);
+   ok = ecpyr_build(argv[1], pyramid, (all && !nnames) ? NULL : names, nnames, base, fanout);
+   if (!ok)
+      printf("Can not index %s, unreadable recording or unknown field\n", argv[1]);
+   else
+      printf("%s written\n", pyramid);
+   free(defaults);
+   free(names);
+   return !ok;
+}
@@ -0,0 +1,165 @@
+/** \file
+ * \brief Merge the process data recordings of several lines on one timeline
+ *
+ * Usage : ecpack_merge recording... [-f from_ns] [-t to_ns] [-c field]...
+ * Prints the records of all recordings in time order as CSV: time, line (position of
+ * the recording on the command line, from 1), then the columns of every line as
+ * L<line>.<field>, filled for the line of the record. -c keeps only the given fields.
+ * The recordings have to share a time base, like the CLOCK_TAI times written by the
+ * example with -d (ectai.c). Every recording is streamed, one record per line is held.
+ *
+ * Build with ecpack_read.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "ecpack.h"
+
+typedef struct
+{
+   ecpack_readert reader;
+   uint8_t        *record;
+   int64_t        time;
+   /** selected fields, column of the first one in the output */
+   int            *fields;
+   int            nfields;
+   int            column;
+} merge_linet;
+
+static merge_linet *lines;
+static int *heap;
+static int nheap;
+
+static int before(int a, int b)
+{
+   return (lines[a].time < lines[b].time) || ((lines[a].time == lines[b].time) && (a < b));
+}
+
+static void sift_down(int i)
+{
+   int c, t;
+
+   while ((c = 2 * i + 1) < nheap)
+   {
+      if ((c + 1 < nheap) && before(heap[c + 1], heap[c]))
+         c++;
+      if (!before(heap[c], heap[i]))
+         break;
+      t = heap[c];
+      heap[c] = heap[i];
+      heap[i] = t;
+      i = c;
+   }
+}
+
+static int selected(const char *name, char **keep, int nkeep)
+{
+   int i;
+
+   for (i = 0; i < nkeep; i++)
+   {
+      if (!strcmp(name, keep[i]))
+         return 1;
+   }
+   return !nkeep;
+}
+
+int main(int argc, char *argv[])
+{
+   char **files = malloc(argc * sizeof(char *)), **keep = malloc(argc * sizeof(char *));
+   int64_t from = INT64_MIN, to = INT64_MAX;
+   int i, k, f, nfiles = 0, nkeep = 0, ncolumns = 0, ok = 1;
+   merge_linet *l;
+
+   for (i = 1; files && keep && (i < argc); i++)
+   {
+      if (!strcmp(argv[i], "-f") && (i + 1 < argc))
+         from = strtoll(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+         to = strtoll(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-c") && (i + 1 < argc))
+         keep[nkeep++] = argv[++i];
+      else
+         files[nfiles++] = argv[i];
+   }
+   if (!nfiles)
+   {
+      printf("Usage: ecpack_merge recording... [-f from_ns] [-t to_ns] [-c field]...\n");
+      return 1;
+   }
+   lines = calloc(nfiles, sizeof(*lines));
+   heap = malloc(nfiles * sizeof(int));
+   if (!lines || !heap)
+      return 1;
+   for (k = 0; ok && (k < nfiles); k++)
+   {
+      l = &lines[k];
+      if (!ecpack_reader_open(&l->reader, files[k]))
+      {
+         printf("Can not read recording %s\n", files[k]);
+         ok = 0;
+         break;
+      }
+      l->record = malloc(l->reader.recsize ? l->reader.recsize : 1);
+      l->fields = malloc((l->reader.nfields ? l->reader.nfields : 1) * sizeof(int));
+      ok = l->record && l->fields;
+      for (f = 0; ok && (f < l->reader.nfields); f++)
+      {
+         if (selected(l->reader.fields[f].name, keep, nkeep))
+            l->fields[l->nfields++] = f;
+      }
+      l->column = ncolumns;
+      ncolumns += l->nfields;
+   }
+
+   if (ok)
+   {
+      printf("time_ns,line");
+      for (k = 0; k < nfiles; k++)
+      {
+         for (f = 0; f < lines[k].nfields; f++)
+            printf(",L%d.%s", k + 1, lines[k].reader.fields[lines[k].fields[f]].name);
+      }
+      printf("\n");
+      /* first record of every line in the window, then always the earliest one */
+      for (k = 0; k < nfiles; k++)
+      {
+         l = &lines[k];
+         if (((from == INT64_MIN) || ecpack_reader_seek(&l->reader, from)) &&
+             ecpack_reader_next(&l->reader, &l->time, l->record) && (l->time <= to))
+            heap[nheap++] = k;
+      }
+      for (i = nheap / 2 - 1; i >= 0; i--)
+         sift_down(i);
+      while (nheap)
+      {
+         k = heap[0];
+         l = &lines[k];
+         printf("%" PRId64 ",%d", l->time, k + 1);
+         for (i = 0; i < l->column; i++)
+            printf(",");
+         for (f = 0; f < l->nfields; f++)
+            printf(",%" PRId64, ecpack_field_value(&l->reader.fields[l->fields[f]], l->record));
+         for (i = l->column + l->nfields; i < ncolumns; i++)
+            printf(",");
+         printf("\n");
+         if (!ecpack_reader_next(&l->reader, &l->time, l->record) || (l->time > to))
+            heap[0] = heap[--nheap];
+         sift_down(0);
+      }
+   }
+   for (k = 0; k < nfiles; k++)
+   {
+      ecpack_reader_close(&lines[k].reader);
+      free(lines[k].record);
+      free(lines[k].fields);
+   }
+   free(lines);
+   free(heap);
+   free(files);
+   free(keep);
+   return !ok;
+}
@@ -0,0 +1,360 @@
+/** \file
+ * \brief Compressed per-cycle recording of process data, reader side
+ *
+ * Also holds the per field coding state used by both directions. Needs no SOEM, so
+ * offline tools build with this file alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecpack.h"
+
+/** Set up the coding state for the given fields, the time is added as field 0.
+ *
+ * Record offsets are shifted by 8, the codec works on slots of time and record.
+ *
+ * @return 1 on success, 0 when out of memory
+ */
+int ecpack_codec_init(ecpack_codect *c, const ecpack_fieldt *fields, int nfields)
+{
+   int i, n = nfields + 1;
+
+   memset(c, 0, sizeof(*c));
+   c->nfields = n;
+   c->offset = malloc(n * sizeof(uint32_t));
+   c->width = malloc(n);
+   c->shift = malloc(n * sizeof(int64_t));
+   c->xormask = malloc(n * sizeof(int64_t));
+   c->slope = malloc(n * sizeof(int64_t));
+   c->prev = calloc(n, sizeof(int64_t));
+   c->prev2 = calloc(n, sizeof(int64_t));
+   c->value = calloc(n, sizeof(int64_t));
+   if (!c->offset || !c->width || !c->shift || !c->xormask || !c->slope ||
+       !c->prev || !c->prev2 || !c->value)
+   {
+      ecpack_codec_free(c);
+      return 0;
+   }
+   c->offset[0] = 0;
+   c->width[0] = 8;
+   c->shift[0] = 0;
+   c->xormask[0] = 0;
+   c->slope[0] = -1;
+   for (i = 1; i < n; i++)
+   {
+      const ecpack_fieldt *f = &fields[i - 1];
+
+      c->offset[i] = f->offset + 8;
+      c->width[i] = f->width;
+      c->shift[i] = (f->kind == ECPACK_XOR) ? 0 : 64 - 8 * f->width;
+      c->xormask[i] = (f->kind == ECPACK_XOR) ? -1 : 0;
+      c->slope[i] = (f->kind == ECPACK_DELTA2) ? -1 : 0;
+   }
+   c->first = 1;
+   return 1;
+}
+
+void ecpack_codec_free(ecpack_codect *c)
+{
+   free(c->offset);
+   free(c->width);
+   free(c->shift);
+   free(c->xormask);
+   free(c->slope);
+   free(c->prev);
+   free(c->prev2);
+   free(c->value);
+   memset(c, 0, sizeof(*c));
+}
+
+static int ecpack_get(FILE *f, void *p, size_t size)
+{
+   return fread(p, 1, size, f) == size;
+}
+
+static int ecpack_getvarint(ecpack_readert *r, uint64_t *v)
+{
+   int shift = 0;
+   uint8_t b;
+
+   *v = 0;
+   do
+   {
+      if ((r->pos >= r->length) || (shift > 63))
+         return 0;
+      b = r->payload[r->pos++];
+      *v |= (uint64_t)(b & 0x7F) << shift;
+      shift += 7;
+   } while (b & 0x80);
+   return 1;
+}
+
+/* Block index from the trailer, or by walking the block headers of an unclosed file */
+static int ecpack_read_index(ecpack_readert *r, off_t start)
+{
+   ecpack_blockt header;
+   ecpack_indext *index;
+   uint64_t offset;
+   uint32_t n, max = 0;
+   char magic[8];
+
+   if (!fseeko(r->file, -20, SEEK_END) && ecpack_get(r->file, &offset, sizeof(offset)) &&
+       ecpack_get(r->file, &n, sizeof(n)) && ecpack_get(r->file, magic, 8) &&
+       !memcmp(magic, ECPACK_INDEXMAGIC, 8))
+   {
+      r->index = malloc((n ? n : 1) * sizeof(*r->index));
+      if (!r->index || fseeko(r->file, (off_t)offset, SEEK_SET) ||
+          !ecpack_get(r->file, r->index, n * sizeof(*r->index)))
+         return 0;
+      r->nblocks = n;
+      return 1;
+   }
+   fseeko(r->file, start, SEEK_SET);
+   while (ecpack_get(r->file, &header, sizeof(header)) && (header.magic == ECPACK_BLOCKMAGIC))
+   {
+      if (r->nblocks == max)
+      {
+         max = max ? 2 * max : 1024;
+         index = realloc(r->index, max * sizeof(*index));
+         if (!index)
+            return 0;
+         r->index = index;
+      }
+      r->index[r->nblocks].offset = (uint64_t)(ftello(r->file) - (off_t)sizeof(header));
+      r->index[r->nblocks].firsttime = header.firsttime;
+      r->index[r->nblocks].lasttime = header.lasttime;
+      if (fseeko(r->file, header.length, SEEK_CUR))
+         break;
+      r->nblocks++;
+   }
+   return 1;
+}
+
+/** Open a recording and read its block index.
+ *
+ * @param[out] r        = reader, positioned at the first record
+ * @param[in]  filename = recording
+ * @return 1 on success, 0 if the file is not a recording or out of memory
+ */
+int ecpack_reader_open(ecpack_readert *r, const char *filename)
+{
+   uint32_t version, n;
+   char magic[8];
+   uint8_t len;
+   int i;
+
+   memset(r, 0, sizeof(*r));
+   r->file = fopen(filename, "rb");
+   if (!r->file)
+      return 0;
+   if (!ecpack_get(r->file, magic, 8) || memcmp(magic, ECPACK_MAGIC, 8) ||
+       !ecpack_get(r->file, &version, sizeof(version)) || (version != ECPACK_VERSION) ||
+       !ecpack_get(r->file, &r->recsize, sizeof(r->recsize)) ||
+       !ecpack_get(r->file, &r->blockrecords, sizeof(r->blockrecords)) ||
+       !ecpack_get(r->file, &n, sizeof(n)))
+      goto fail;
+   r->nfields = (int)n;
+   r->fields = calloc(n ? n : 1, sizeof(*r->fields));
+   if (!r->fields)
+      goto fail;
+   for (i = 0; i < r->nfields; i++)
+   {
+      if (!ecpack_get(r->file, &r->fields[i].offset, sizeof(r->fields[i].offset)) ||
+          !ecpack_get(r->file, &r->fields[i].width, 1) || !ecpack_get(r->file, &r->fields[i].kind, 1) ||
+          !ecpack_get(r->file, &len, 1) || (len > ECPACK_MAXNAME) ||
+          !ecpack_get(r->file, r->fields[i].name, len))
+         goto fail;
+   }
+   r->slotsize = (uint32_t)((8 + r->recsize + 7) & ~7u);
+   r->slot = calloc(1, r->slotsize);
+   if (!r->slot || !ecpack_codec_init(&r->codec, r->fields, r->nfields) ||
+       !ecpack_read_index(r, ftello(r->file)))
+      goto fail;
+   r->block = 0;
+   r->left = 0;
+   if (r->nblocks)
+      ecpack_reader_seek(r, r->index[0].firsttime);
+   return 1;
+
+fail:
+   ecpack_reader_close(r);
+   return 0;
+}
+
+void ecpack_reader_close(ecpack_readert *r)
+{
+   if (r->file)
+      fclose(r->file);
+   ecpack_codec_free(&r->codec);
+   free(r->fields);
+   free(r->index);
+   free(r->payload);
+   free(r->slot);
+   memset(r, 0, sizeof(*r));
+}
+
+/* Load block b and reset the coding state */
+static int ecpack_load_block(ecpack_readert *r, uint32_t b)
+{
+   ecpack_blockt header;
+   uint8_t *payload;
+
+   if ((b >= r->nblocks) || fseeko(r->file, (off_t)r->index[b].offset, SEEK_SET) ||
+       !ecpack_get(r->file, &header, sizeof(header)) || (header.magic != ECPACK_BLOCKMAGIC))
+      return 0;
+   if (header.length > r->payloadsize)
+   {
+      payload = realloc(r->payload, header.length);
+      if (!payload)
+         return 0;
+      r->payload = payload;
+      r->payloadsize = header.length;
+   }
+   if (!ecpack_get(r->file, r->payload, header.length))
+      return 0;
+   r->block = b;
+   r->length = header.length;
+   r->pos = 0;
+   r->left = header.nrecords;
+   r->codec.first = 1;
+   memset(r->codec.prev, 0, r->codec.nfields * sizeof(int64_t));
+   memset(r->codec.prev2, 0, r->codec.nfields * sizeof(int64_t));
+   return 1;
+}
+
+/* Decode the next record of the current block into r->slot */
+static int ecpack_decode(ecpack_readert *r)
+{
+   ecpack_codect *c = &r->codec;
+   int g, i, n = c->nfields, ngroups = (n + 7) / 8, nmask = (ngroups + 7) / 8;
+   const uint8_t *gmask;
+   uint8_t m;
+   uint64_t z;
+   int64_t v, first = -(int64_t)c->first;
+   uint64_t pred;
+
+   if (r->pos + nmask > r->length)
+      return 0;
+   gmask = &r->payload[r->pos];
+   r->pos += nmask;
+   memset(c->value, 0, n * sizeof(int64_t));
+   /* mark the changed fields, then fill in their residuals in field order */
+   for (g = 0; g < ngroups; g++)
+   {
+      if (!(gmask[g >> 3] & (1 << (g & 7))))
+         continue;
+      if (r->pos >= r->length)
+         return 0;
+      m = r->payload[r->pos++];
+      for (i = 8 * g; (i < n) && (i < 8 * g + 8); i++)
+         c->value[i] = (m >> (i - 8 * g)) & 1;
+   }
+   for (i = 0; i < n; i++)
+   {
+      z = 0;
+      if (c->value[i] && !ecpack_getvarint(r, &z))
+         return 0;
+      pred = (uint64_t)c->prev[i] +
+             (((uint64_t)c->prev[i] - (uint64_t)c->prev2[i]) & (uint64_t)c->slope[i]);
+      v = c->xormask[i] ? (int64_t)z ^ c->prev[i] : (int64_t)(pred + (uint64_t)ecpack_unzigzag(z));
+      c->prev2[i] = (c->prev[i] & ~first) | (v & first);
+      c->prev[i] = v;
+      memcpy(r->slot + c->offset[i], &v, c->width[i]);
+   }
+   c->first = 0;
+   return 1;
+}
+
+/** Position the reader at the first record at or after a time.
+ *
+ * Reads and decodes only the block that holds the time.
+ *
+ * @return 1 on success, 0 if no record is that late
+ */
+int ecpack_reader_seek(ecpack_readert *r, int64_t time)
+{
+   uint32_t lo = 0, hi = r->nblocks, mid;
+   int64_t t;
+
+   r->pending = 0;
+   /* first block that ends at or after the time */
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (r->index[mid].lasttime < time)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   if ((lo >= r->nblocks) || !ecpack_load_block(r, lo))
+   {
+      r->left = 0;
+      return 0;
+   }
+   while (r->left && ecpack_decode(r))
+   {
+      r->left--;
+      memcpy(&t, r->slot, sizeof(t));
+      if (t >= time)
+      {
+         /* handed out by the next ecpack_reader_next() */
+         r->pending = 1;
+         return 1;
+      }
+   }
+   r->left = 0;
+   return 0;
+}
+
+/** Read the next record.
+ *
+ * @param[in]  r      = reader
+ * @param[out] time   = time of the record
+ * @param[out] record = recsize bytes, bytes not covered by a field are 0
+ * @return 1 on success, 0 at the end of the recording or on a damaged block
+ */
+int ecpack_reader_next(ecpack_readert *r, int64_t *time, void *record)
+{
+   if (!r->pending)
+   {
+      while (!r->left)
+      {
+         if ((r->block + 1 >= r->nblocks) || !ecpack_load_block(r, r->block + 1))
+            return 0;
+      }
+      if (!ecpack_decode(r))
+      {
+         r->left = 0;
+         return 0;
+      }
+      r->left--;
+   }
+   r->pending = 0;
+   memcpy(time, r->slot, sizeof(*time));
+   memcpy(record, r->slot + 8, r->recsize);
+   return 1;
+}
+
+/** Number of records in the recording, summed from the block headers without decoding.
+ * The position of the reader does not change.
+ *
+ * @param[in] r = reader
+ * @return records, up to the first unreadable block
+ */
+uint64_t ecpack_reader_count(ecpack_readert *r)
+{
+   ecpack_blockt header;
+   uint64_t n = 0;
+   uint32_t b;
+
+   for (b = 0; b < r->nblocks; b++)
+   {
+      if (fseeko(r->file, (off_t)r->index[b].offset, SEEK_SET) ||
+          !ecpack_get(r->file, &header, sizeof(header)) || (header.magic != ECPACK_BLOCKMAGIC))
+         break;
+      n += header.nrecords;
+   }
+   return n;
+}
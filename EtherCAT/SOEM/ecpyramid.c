@@ -0,0 +1,465 @@
+/** \file
+ * \brief Min/max pyramid over the columns of a process data recording
+ *
+ * Needs no SOEM, build together with ecpack_read.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ecpyramid.h"
+
+/** bytes of closed buckets a level collects before writing them, at least one bucket */
+#define ECPYR_WRITEBUF     65536
+
+/* One level while building: the bucket being filled and the closed ones not written yet */
+typedef struct
+{
+   /** planned and written buckets, file offsets of the level */
+   uint64_t   nbuckets;
+   uint64_t   written;
+   uint64_t   times;
+   uint64_t   minmax;
+   /** open bucket: start time, records or buckets merged, min/max of every column */
+   int64_t    time;
+   uint32_t   n;
+   int64_t    *open;
+   int64_t    *buftimes;
+   int64_t    *bufminmax;
+   uint32_t   nbuf;
+   uint32_t   maxbuf;
+} ecpyr_buildlevelt;
+
+typedef struct
+{
+   int                  fd;
+   int                  ncolumns;
+   uint32_t             fanout;
+   int                  nlevels;
+   ecpyr_buildlevelt    level[ECPYR_MAXLEVELS];
+} ecpyr_buildt;
+
+static int ecpyr_pwrite(int fd, const void *data, size_t size, uint64_t offset)
+{
+   const uint8_t *p = data;
+   ssize_t n;
+
+   while (size)
+   {
+      n = pwrite(fd, p, size, (off_t)offset);
+      if (n <= 0)
+         return 0;
+      p += n;
+      size -= (size_t)n;
+      offset += (uint64_t)n;
+   }
+   return 1;
+}
+
+/* Write the closed buckets of a level to its place in the file */
+static int ecpyr_flush(ecpyr_buildt *b, ecpyr_buildlevelt *lv)
+{
+   size_t row = 2 * b->ncolumns * sizeof(int64_t);
+   int ok;
+
+   ok = ecpyr_pwrite(b->fd, lv->buftimes, lv->nbuf * sizeof(int64_t), lv->times + lv->written * sizeof(int64_t)) &&
+        ecpyr_pwrite(b->fd, lv->bufminmax, lv->nbuf * row, lv->minmax + lv->written * row);
+   lv->written += lv->nbuf;
+   lv->nbuf = 0;
+   return ok;
+}
+
+/* Merge min/max pairs of all columns starting at time into the open bucket of a level */
+static void ecpyr_add(ecpyr_buildt *b, ecpyr_buildlevelt *lv, int64_t time, const int64_t *mm)
+{
+   int c;
+
+   if (!lv->n)
+   {
+      lv->time = time;
+      memcpy(lv->open, mm, 2 * b->ncolumns * sizeof(int64_t));
+   }
+   else
+   {
+      for (c = 0; c < 2 * b->ncolumns; c += 2)
+      {
+         lv->open[c] = (mm[c] < lv->open[c]) ? mm[c] : lv->open[c];
+         lv->open[c + 1] = (mm[c + 1] > lv->open[c + 1]) ? mm[c + 1] : lv->open[c + 1];
+      }
+   }
+   lv->n++;
+}
+
+/* Close the open bucket of level l and merge it into the level above */
+static int ecpyr_close_bucket(ecpyr_buildt *b, int l)
+{
+   ecpyr_buildlevelt *lv = &b->level[l];
+   int ok = 1;
+
+   if (lv->written + lv->nbuf >= lv->nbuckets)
+      return 0;
+   lv->buftimes[lv->nbuf] = lv->time;
+   memcpy(lv->bufminmax + (size_t)lv->nbuf * 2 * b->ncolumns, lv->open, 2 * b->ncolumns * sizeof(int64_t));
+   if (++lv->nbuf == lv->maxbuf)
+      ok = ecpyr_flush(b, lv);
+   if (ok && (l + 1 < b->nlevels))
+   {
+      ecpyr_add(b, &b->level[l + 1], lv->time, lv->open);
+      if (b->level[l + 1].n == b->fanout)
+         ok = ecpyr_close_bucket(b, l + 1);
+   }
+   lv->n = 0;
+   return ok;
+}
+
+/* Level 1 in one pass over the recording, the levels above follow bucket by bucket */
+static int ecpyr_scan(ecpack_readert *r, ecpyr_buildt *b, const uint32_t *field, uint32_t base,
+                      uint64_t *nrecords, int64_t *lasttime)
+{
+   uint8_t *record = malloc(r->recsize ? r->recsize : 1);
+   int64_t *mm = malloc(2 * (b->ncolumns ? b->ncolumns : 1) * sizeof(int64_t));
+   uint64_t n = 0;
+   int64_t t, v;
+   int c, l, ok = (record != NULL) && (mm != NULL);
+
+   while (ok && b->nlevels && ecpack_reader_next(r, &t, record))
+   {
+      for (c = 0; c < b->ncolumns; c++)
+      {
+         v = ecpack_field_value(&r->fields[field[c]], record);
+         mm[2 * c] = mm[2 * c + 1] = v;
+      }
+      ecpyr_add(b, &b->level[0], t, mm);
+      if (b->level[0].n == base)
+         ok = ecpyr_close_bucket(b, 0);
+      *lasttime = t;
+      n++;
+   }
+   /* partly filled buckets, from the bottom so each one still reaches the level above */
+   for (l = 0; ok && (l < b->nlevels); l++)
+   {
+      if (b->level[l].n)
+         ok = ecpyr_close_bucket(b, l);
+   }
+   for (l = 0; ok && (l < b->nlevels); l++)
+      ok = ecpyr_flush(b, &b->level[l]);
+   *nrecords = n;
+   free(mm);
+   free(record);
+   return ok;
+}
+
+/** Build the pyramid of a recording.
+ *
+ * Level 1 is written while the recording is read and every level above as its buckets
+ * close, so the memory needed is one open bucket and ECPYR_WRITEBUF per level, not the
+ * pyramid. The size of every level is planned from the record count of the block
+ * headers.
+ *
+ * @param[in] recording = ecpack recording
+ * @param[in] pyramid   = pyramid file to create
+ * @param[in] names     = fields to index, NULL for all
+ * @param[in] nnames    = number of names
+ * @param[in] base      = records per level 1 bucket
+ * @param[in] fanout    = buckets merged per level, at least 2
+ * @return 1 on success, 0 if a file can not be read or written, a field is unknown
+ *         or out of memory
+ */
+int ecpyr_build(const char *recording, const char *pyramid, const char *const *names, int nnames,
+                uint32_t base, uint32_t fanout)
+{
+   ecpack_readert r;
+   ecpyr_buildt b;
+   ecpyr_buildlevelt *lv;
+   ecpyr_headert header;
+   ecpyr_columnt *columns = NULL;
+   ecpyr_levelt table[ECPYR_MAXLEVELS];
+   uint32_t *field = NULL;
+   uint64_t offset, nrecords, nb;
+   int64_t lasttime = 0;
+   size_t row;
+   int ncolumns, c, l, i, ok = 0;
+
+   if ((base < 1) || (fanout < 2) || !ecpack_reader_open(&r, recording))
+      return 0;
+   memset(&b, 0, sizeof(b));
+   b.fd = -1;
+   ncolumns = names ? nnames : r.nfields;
+   row = 2 * (size_t)ncolumns * sizeof(int64_t);
+   field = malloc((ncolumns ? ncolumns : 1) * sizeof(uint32_t));
+   columns = calloc(ncolumns ? ncolumns : 1, sizeof(*columns));
+   if (!field || !columns)
+      goto out;
+   for (c = 0; c < ncolumns; c++)
+   {
+      for (i = 0; names && (i < r.nfields) && strcmp(r.fields[i].name, names[c]); i++)
+         ;
+      if (i == r.nfields)
+         goto out;
+      field[c] = names ? (uint32_t)i : (uint32_t)c;
+      memcpy(columns[c].name, r.fields[field[c]].name, ECPACK_MAXNAME);
+      columns[c].field = field[c];
+   }
+
+   /* plan the levels, each with its place in the file */
+   b.ncolumns = ncolumns;
+   b.fanout = fanout;
+   nb = (ecpack_reader_count(&r) + base - 1) / base;
+   while (nb && (b.nlevels < ECPYR_MAXLEVELS))
+   {
+      b.level[b.nlevels++].nbuckets = nb;
+      if (nb == 1)
+         break;
+      nb = (nb + fanout - 1) / fanout;
+   }
+   offset = sizeof(header) + ncolumns * sizeof(ecpyr_columnt) + b.nlevels * sizeof(ecpyr_levelt);
+   for (l = 0; l < b.nlevels; l++)
+   {
+      lv = &b.level[l];
+      lv->times = offset;
+      lv->minmax = offset + lv->nbuckets * sizeof(int64_t);
+      offset = lv->minmax + lv->nbuckets * row;
+      lv->maxbuf = (row && (row < ECPYR_WRITEBUF)) ? (uint32_t)(ECPYR_WRITEBUF / row) : 1;
+      lv->open = malloc(row ? row : 1);
+      lv->buftimes = malloc(lv->maxbuf * sizeof(int64_t));
+      lv->bufminmax = malloc(row ? lv->maxbuf * row : 1);
+      if (!lv->open || !lv->buftimes || !lv->bufminmax)
+         goto out;
+   }
+   b.fd = open(pyramid, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (b.fd < 0)
+      goto out;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, ECPYR_MAGIC, 8);
+   header.version = ECPYR_VERSION;
+   header.base = base;
+   header.fanout = fanout;
+   header.ncolumns = (uint32_t)ncolumns;
+   header.firsttime = r.nblocks ? r.index[0].firsttime : 0;
+   strncpy(header.recording, recording, ECPYR_MAXPATH - 1);
+   if (!ecpyr_scan(&r, &b, field, base, &nrecords, &lasttime))
+      goto out;
+   header.nrecords = nrecords;
+   header.lasttime = lasttime;
+   /* a damaged block ends the recording early, the levels keep what was written */
+   while (b.nlevels && !b.level[b.nlevels - 1].written)
+      b.nlevels--;
+   header.nlevels = (uint32_t)b.nlevels;
+   for (l = 0; l < b.nlevels; l++)
+   {
+      table[l].nbuckets = b.level[l].written;
+      table[l].times = b.level[l].times;
+      table[l].minmax = b.level[l].minmax;
+   }
+   offset = sizeof(header) + ncolumns * sizeof(ecpyr_columnt);
+   ok = ecpyr_pwrite(b.fd, &header, sizeof(header), 0) &&
+        ecpyr_pwrite(b.fd, columns, ncolumns * sizeof(*columns), sizeof(header)) &&
+        ecpyr_pwrite(b.fd, table, b.nlevels * sizeof(*table), offset);
+
+out:
+   if ((b.fd >= 0) && close(b.fd))
+      ok = 0;
+   for (l = 0; l < ECPYR_MAXLEVELS; l++)
+   {
+      free(b.level[l].open);
+      free(b.level[l].buftimes);
+      free(b.level[l].bufminmax);
+   }
+   free(columns);
+   free(field);
+   ecpack_reader_close(&r);
+   return ok;
+}
+
+/** Map a pyramid for queries.
+ *
+ * @return 1 on success, 0 if the file can not be mapped or is no pyramid
+ */
+int ecpyr_open(ecpyr_t *p, const char *pyramid)
+{
+   struct stat st;
+   int fd, l;
+
+   memset(p, 0, sizeof(*p));
+   fd = open(pyramid, O_RDONLY);
+   if (fd < 0)
+      return 0;
+   if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(ecpyr_headert)))
+   {
+      close(fd);
+      return 0;
+   }
+   p->size = (size_t)st.st_size;
+   p->map = mmap(NULL, p->size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (p->map == MAP_FAILED)
+   {
+      p->map = NULL;
+      return 0;
+   }
+   p->header = (const ecpyr_headert *)p->map;
+   p->columns = (const ecpyr_columnt *)(p->map + sizeof(ecpyr_headert));
+   p->levels = (const ecpyr_levelt *)(p->columns + p->header->ncolumns);
+   strncpy(p->pyramid, pyramid, ECPYR_MAXPATH - 1);
+   if (memcmp(p->header->magic, ECPYR_MAGIC, 8) || (p->header->version != ECPYR_VERSION) ||
+       ((const uint8_t *)(p->levels + p->header->nlevels) > p->map + p->size))
+   {
+      ecpyr_close(p);
+      return 0;
+   }
+   for (l = 0; l < (int)p->header->nlevels; l++)
+   {
+      if ((p->levels[l].times + p->levels[l].nbuckets * sizeof(int64_t) > p->size) ||
+          (p->levels[l].minmax + p->header->ncolumns * 2 * p->levels[l].nbuckets * sizeof(int64_t) > p->size))
+      {
+         ecpyr_close(p);
+         return 0;
+      }
+   }
+   return 1;
+}
+
+void ecpyr_close(ecpyr_t *p)
+{
+   if (p->map)
+      munmap((void *)p->map, p->size);
+   if (p->hasreader)
+      ecpack_reader_close(&p->reader);
+   memset(p, 0, sizeof(*p));
+}
+
+/** Column index of a field name, -1 if the field is not indexed. */
+int ecpyr_column(const ecpyr_t *p, const char *name)
+{
+   uint32_t c;
+
+   for (c = 0; c < p->header->ncolumns; c++)
+   {
+      if (!strncmp(p->columns[c].name, name, ECPACK_MAXNAME))
+         return (int)c;
+   }
+   return -1;
+}
+
+/* first bucket of a level starting after time t */
+static uint64_t ecpyr_after(const int64_t *times, uint64_t n, int64_t t)
+{
+   uint64_t lo = 0, hi = n, mid;
+
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (times[mid] <= t)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+static void ecpyr_pixel(ecpyr_pixelt *px, int64_t min, int64_t max)
+{
+   px->min = (!px->n || (min < px->min)) ? min : px->min;
+   px->max = (!px->n || (max > px->max)) ? max : px->max;
+   px->n++;
+}
+
+/* Records of the window from the recording, for windows finer than level 1 */
+static int ecpyr_query_records(ecpyr_t *p, int column, int64_t from, int64_t to, int pixels, ecpyr_pixelt *out)
+{
+   char recording[ECPYR_MAXPATH];
+   const ecpack_fieldt *f;
+   uint8_t *record;
+   size_t len;
+   int64_t t, v;
+   int px;
+
+   if (!p->hasreader)
+   {
+      /* where it was built, else next to the pyramid without its extension */
+      p->hasreader = ecpack_reader_open(&p->reader, p->header->recording);
+      len = strlen(p->pyramid);
+      if (!p->hasreader && (len > 4) && !strcmp(p->pyramid + len - 4, ".pyr"))
+      {
+         memcpy(recording, p->pyramid, len - 4);
+         recording[len - 4] = 0;
+         p->hasreader = ecpack_reader_open(&p->reader, recording);
+      }
+      if (!p->hasreader)
+         return 0;
+   }
+   record = malloc(p->reader.recsize ? p->reader.recsize : 1);
+   if (!record)
+      return 0;
+   f = &p->reader.fields[p->columns[column].field];
+   if (ecpack_reader_seek(&p->reader, from))
+   {
+      while (ecpack_reader_next(&p->reader, &t, record) && (t <= to))
+      {
+         v = ecpack_field_value(f, record);
+         px = (int)((double)(t - from) * pixels / ((double)(to - from) + 1));
+         ecpyr_pixel(&out[px], v, v);
+      }
+   }
+   free(record);
+   return 1;
+}
+
+/** Min and max per pixel of one column in a time window.
+ *
+ * @param[in]  p      = pyramid
+ * @param[in]  column = column index from ecpyr_column()
+ * @param[in]  from   = start of the window
+ * @param[in]  to     = end of the window, included
+ * @param[in]  pixels = width of the window in pixels
+ * @param[out] out    = pixels entries, empty ones have n 0
+ * @return number of pixels with data, -1 on a bad argument or unreadable recording
+ */
+int ecpyr_query(ecpyr_t *p, int column, int64_t from, int64_t to, int pixels, ecpyr_pixelt *out)
+{
+   const ecpyr_levelt *level;
+   const int64_t *times, *mm;
+   uint64_t lo, hi, b;
+   int64_t t;
+   int l, i, px, filled = 0;
+
+   if ((column < 0) || ((uint32_t)column >= p->header->ncolumns) || (pixels < 1) || (to < from))
+      return -1;
+   memset(out, 0, pixels * sizeof(*out));
+   /* coarsest level with enough buckets in the window */
+   for (l = (int)p->header->nlevels - 1; l >= 0; l--)
+   {
+      level = &p->levels[l];
+      times = (const int64_t *)(p->map + level->times);
+      lo = ecpyr_after(times, level->nbuckets, from);
+      lo = lo ? lo - 1 : 0;
+      hi = ecpyr_after(times, level->nbuckets, to);
+      if (hi - lo >= (uint64_t)pixels * ECPYR_OVERSAMPLE)
+         break;
+   }
+   if (l < 0)
+   {
+      if (!ecpyr_query_records(p, column, from, to, pixels, out))
+         return -1;
+   }
+   else
+   {
+      mm = (const int64_t *)(p->map + level->minmax) + 2 * column;
+      for (b = lo; b < hi; b++)
+      {
+         /* a bucket that starts before the window is drawn at its left border */
+         t = (times[b] < from) ? from : times[b];
+         px = (int)((double)(t - from) * pixels / ((double)(to - from) + 1));
+         ecpyr_pixel(&out[px], mm[2 * p->header->ncolumns * b], mm[2 * p->header->ncolumns * b + 1]);
+      }
+   }
+   for (i = 0; i < pixels; i++)
+      filled += (out[i].n != 0);
+   return filled;
+}
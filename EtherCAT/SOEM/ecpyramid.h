@@ -0,0 +1,100 @@
+/** \file
+ * \brief Min/max pyramid over the columns of a process data recording
+ *
+ * ecpyr_build() reads an ecpack recording once and writes a pyramid file next to it:
+ * for every selected field, level 1 holds the minimum and maximum of each bucket of
+ * `base` records, every further level merges `fanout` buckets of the level below. A
+ * viewer maps the pyramid and asks ecpyr_query() for a time window at a given number
+ * of pixels; the answer is at most one min/max pair per pixel, read from the coarsest
+ * level that still has a few buckets per pixel. The cost depends on the pixels, not on
+ * the length of the recording. Windows narrower than level 1 are read from the
+ * recording itself, through its block index.
+ *
+ * File layout, every array 8 byte aligned
+ * -----------
+ * header  : ecpyr_headert
+ * columns : ecpyr_columnt per column
+ * levels  : ecpyr_levelt per level
+ * level   : int64 start time per bucket, then per bucket int64 min, max of every column
+ *
+ * A level is stored bucket by bucket, so the builder can write each bucket as it closes.
+ */
+
+#ifndef _ECPYRAMID_H
+#define _ECPYRAMID_H
+
+#include <stdint.h>
+
+#include "ecpack.h"
+
+#define ECPYR_MAGIC        "ECPYR002"
+#define ECPYR_VERSION      2
+#define ECPYR_MAXPATH      256
+#define ECPYR_MAXLEVELS    64
+/** buckets per pixel at least, so buckets on pixel borders do not show */
+#define ECPYR_OVERSAMPLE   2
+
+typedef struct __attribute__((__packed__))
+{
+   char       magic[8];
+   uint32_t   version;
+   /** records per level 1 bucket */
+   uint32_t   base;
+   /** buckets of a level per bucket of the next */
+   uint32_t   fanout;
+   uint32_t   nlevels;
+   uint32_t   ncolumns;
+   uint32_t   reserved;
+   uint64_t   nrecords;
+   int64_t    firsttime;
+   int64_t    lasttime;
+   /** recording the pyramid was built from */
+   char       recording[ECPYR_MAXPATH];
+} ecpyr_headert;
+
+typedef struct __attribute__((__packed__))
+{
+   char       name[ECPACK_MAXNAME + 1];
+   /** field index in the recording */
+   uint32_t   field;
+   uint32_t   reserved;
+} ecpyr_columnt;
+
+typedef struct __attribute__((__packed__))
+{
+   uint64_t   nbuckets;
+   /** file offsets of the start times and of the min/max pairs of column 0 */
+   uint64_t   times;
+   uint64_t   minmax;
+} ecpyr_levelt;
+
+/** One pixel of a query, empty when n is 0 */
+typedef struct
+{
+   int64_t    min;
+   int64_t    max;
+   /** buckets or records merged into the pixel */
+   uint32_t   n;
+} ecpyr_pixelt;
+
+typedef struct
+{
+   const uint8_t        *map;
+   size_t               size;
+   const ecpyr_headert  *header;
+   const ecpyr_columnt  *columns;
+   const ecpyr_levelt   *levels;
+   /** recording for windows finer than level 1, opened on first use */
+   ecpack_readert       reader;
+   int                  hasreader;
+   char                 pyramid[ECPYR_MAXPATH];
+} ecpyr_t;
+
+int ecpyr_build(const char *recording, const char *pyramid, const char *const *names, int nnames,
+                uint32_t base, uint32_t fanout);
+int ecpyr_open(ecpyr_t *p, const char *pyramid);
+void ecpyr_close(ecpyr_t *p);
+int ecpyr_column(const ecpyr_t *p, const char *name);
+int ecpyr_query(ecpyr_t *p, int column, int64_t from, int64_t to, int pixels, ecpyr_pixelt *out);
+
+#endif
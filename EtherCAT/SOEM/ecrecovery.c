@@ -0,0 +1,119 @@
+/** \file
+ * \brief Recovery event record of the SOEM examples
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "ecrecovery.h"
+
+typedef struct
+{
+   int64    time;
+   uint8    event;
+} ecrec_entryt;
+
+const char *ecrec_name[ECREC_EVENTS] =
+{
+   "wkc_low", "wkc_ok", "check", "ack", "safeop_to_op", "reconfig", "lost", "recovered", "found", "resumed"
+};
+
+static FILE *ecrec_file;
+static ecrec_entryt ecrec_ring[ECREC_RINGSIZE];
+static uint32 ecrec_head, ecrec_tail, ecrec_lost;
+static boolean ecrec_low;
+
+static int64 ecrec_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Create the event file.
+ *
+ * @param[in] file = CSV file name
+ * @return 1 on success
+ */
+int ecrec_init(const char *file)
+{
+   ecrec_file = fopen(file, "w");
+   if (!ecrec_file)
+      return 0;
+   fprintf(ecrec_file, "time_ns,event,slave\n");
+   ecrec_head = ecrec_tail = ecrec_lost = 0;
+   ecrec_low = FALSE;
+   return 1;
+}
+
+/** Cyclic thread: note the working counter of a cycle, only changes are recorded.
+ *
+ * @param[in] wkc      = working counter received
+ * @param[in] expected = expected working counter
+ */
+void ecrec_wkc(int wkc, int expected)
+{
+   boolean low = (wkc < expected);
+   uint32 tail;
+
+   if (!ecrec_file || (low == ecrec_low))
+      return;
+   ecrec_low = low;
+   tail = __atomic_load_n(&ecrec_tail, __ATOMIC_ACQUIRE);
+   if (ecrec_head - tail >= ECREC_RINGSIZE)
+   {
+      ecrec_lost++;
+      return;
+   }
+   ecrec_ring[ecrec_head & (ECREC_RINGSIZE - 1)].time = ecrec_now();
+   ecrec_ring[ecrec_head & (ECREC_RINGSIZE - 1)].event = low ? ECREC_WKC_LOW : ECREC_WKC_OK;
+   __atomic_store_n(&ecrec_head, ecrec_head + 1, __ATOMIC_RELEASE);
+}
+
+/** Check thread: write the working counter transitions recorded so far. */
+void ecrec_flush(void)
+{
+   uint32 head, tail = ecrec_tail;
+   ecrec_entryt *e;
+
+   if (!ecrec_file)
+      return;
+   head = __atomic_load_n(&ecrec_head, __ATOMIC_ACQUIRE);
+   for (; tail != head; tail++)
+   {
+      e = &ecrec_ring[tail & (ECREC_RINGSIZE - 1)];
+      fprintf(ecrec_file, "%lld,%s,0\n", (long long)e->time, ecrec_name[e->event]);
+   }
+   __atomic_store_n(&ecrec_tail, tail, __ATOMIC_RELEASE);
+}
+
+/** Check thread: record a step of the error handling.
+ *
+ * @param[in] event = step
+ * @param[in] slave = slave concerned, 0 for the whole group
+ */
+void ecrec_event(ecrec_eventt event, int slave)
+{
+   int64 now = ecrec_now();
+
+   if (!ecrec_file)
+      return;
+   ecrec_flush();
+   fprintf(ecrec_file, "%lld,%s,%d\n", (long long)now, ecrec_name[event], slave);
+}
+
+/** Transitions lost because the check thread did not flush in time. */
+uint32 ecrec_dropped(void)
+{
+   return ecrec_lost;
+}
+
+void ecrec_close(void)
+{
+   if (!ecrec_file)
+      return;
+   ecrec_flush();
+   fclose(ecrec_file);
+   ecrec_file = NULL;
+}
@@ -0,0 +1,46 @@
+/** \file
+ * \brief Recovery event record of the SOEM examples
+ *
+ * Time stamps (CLOCK_MONOTONIC, ns) of the working counter falling below and returning
+ * to the expected value, taken in the cyclic thread, and of the steps of ecatcheck,
+ * written as CSV "time_ns,event,slave". Against the injection record of the line
+ * emulator (EtherCAT/emulator) recovery_report derives detection and recovery
+ * latencies per fault type.
+ *
+ * The cyclic thread only stores transitions in a small lock-free ring; the check
+ * thread is the single consumer and does all file output.
+ */
+
+#ifndef _ECRECOVERY_H
+#define _ECRECOVERY_H
+
+#include "ethercat.h"
+
+/** transitions kept between two flushes of the check thread, power of two */
+#define ECREC_RINGSIZE 256
+
+typedef enum
+{
+   ECREC_WKC_LOW = 0,
+   ECREC_WKC_OK,
+   ECREC_CHECK,
+   ECREC_ACK,
+   ECREC_SAFEOP_TO_OP,
+   ECREC_RECONFIG,
+   ECREC_LOST,
+   ECREC_RECOVERED,
+   ECREC_FOUND,
+   ECREC_RESUMED,
+   ECREC_EVENTS
+} ecrec_eventt;
+
+extern const char *ecrec_name[ECREC_EVENTS];
+
+int ecrec_init(const char *file);
+void ecrec_wkc(int wkc, int expected);
+void ecrec_event(ecrec_eventt event, int slave);
+void ecrec_flush(void);
+uint32 ecrec_dropped(void);
+void ecrec_close(void);
+
+#endif
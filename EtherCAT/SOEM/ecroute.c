@@ -0,0 +1,188 @@
+/** \file
+ * \brief Master-side routing of process data from slave inputs to slave outputs
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethercat.h"
+#include "ecroute.h"
+
+/* longest bit move, keeps shift plus length within the 64 bit window */
+#define ECROUTE_MAXMOVE 32
+
+/* a route in bits from the start of the IOmap */
+typedef struct
+{
+   uint32   src;
+   uint32   dst;
+   uint32   bits;
+   int      entry;
+} ecroute_runt;
+
+static int ecroute_bydst(const void *a, const void *b)
+{
+   const ecroute_runt *x = a, *y = b;
+
+   return (x->dst > y->dst) - (x->dst < y->dst);
+}
+
+static void ecroute_move(ecroute_t *r, uint32 src, uint32 dst, uint32 bits)
+{
+   ecroute_movet *m = &r->move[r->nmove++];
+
+   m->src = src / 8;
+   m->dst = dst / 8;
+   m->srcshift = (uint8)(src % 8);
+   m->dstshift = (uint8)(dst % 8);
+   m->srcn = (uint8)((m->srcshift + bits + 7) / 8);
+   m->dstn = (uint8)((m->dstshift + bits + 7) / 8);
+   m->mask = (((uint64)1 << bits) - 1) << m->dstshift;
+}
+
+/* Split a run into bit moves for its unaligned ends and a copy of the whole bytes */
+static void ecroute_split(ecroute_t *r, const ecroute_runt *run)
+{
+   uint32 src = run->src, dst = run->dst, bits = run->bits, head, chunk;
+   ecroute_copyt *c;
+
+   if ((src % 8) == (dst % 8))
+   {
+      head = (8 - src % 8) % 8;
+      if (head > bits)
+         head = bits;
+      if (head)
+         ecroute_move(r, src, dst, head);
+      src += head;
+      dst += head;
+      bits -= head;
+      if (bits >= 8)
+      {
+         c = &r->copy[r->ncopy++];
+         c->src = src / 8;
+         c->dst = dst / 8;
+         c->len = bits / 8;
+         src += c->len * 8;
+         dst += c->len * 8;
+         bits -= c->len * 8;
+      }
+   }
+   while (bits)
+   {
+      chunk = (bits > ECROUTE_MAXMOVE) ? ECROUTE_MAXMOVE : bits;
+      ecroute_move(r, src, dst, chunk);
+      src += chunk;
+      dst += chunk;
+      bits -= chunk;
+   }
+}
+
+/** Compile a routing table into a copy plan, call after ec_config_map().
+ *
+ * @param[out] r     = copy plan
+ * @param[in]  iomap = IOmap the slaves are mapped into
+ * @param[in]  table = routes, outputs written by more than one route are rejected
+ * @param[in]  n     = number of routes
+ * @return 1 on success, 0 if an entry is out of the process data of its slave or
+ *         overlaps another one (r->error) or memory is short
+ */
+int ecroute_compile(ecroute_t *r, uint8 *iomap, const ecroute_entryt *table, int n)
+{
+   ecroute_runt *run = malloc((n ? n : 1) * sizeof(ecroute_runt));
+   const ecroute_entryt *e;
+   ec_slavet *s, *d;
+   int i, m = 0, nmoves = 0;
+
+   memset(r, 0, sizeof(*r));
+   r->iomap = iomap;
+   r->error = -1;
+   if (!run)
+      return 0;
+   for (i = 0; i < n; i++)
+   {
+      e = &table[i];
+      s = &ec_slave[e->srcslave];
+      d = &ec_slave[e->dstslave];
+      if (!e->bits || (e->srcslave < 1) || (e->srcslave > ec_slavecount) ||
+          (e->dstslave < 1) || (e->dstslave > ec_slavecount) || !s->inputs || !d->outputs ||
+          (e->srcbit + e->bits > s->Ibits) || (e->dstbit + e->bits > d->Obits))
+      {
+         r->error = i;
+         free(run);
+         return 0;
+      }
+      run[i].src = (uint32)(s->inputs - iomap) * 8 + s->Istartbit + e->srcbit;
+      run[i].dst = (uint32)(d->outputs - iomap) * 8 + d->Ostartbit + e->dstbit;
+      run[i].bits = e->bits;
+      run[i].entry = i;
+   }
+   qsort(run, n, sizeof(ecroute_runt), ecroute_bydst);
+
+   /* merge routes adjacent on both sides, reject outputs written twice */
+   for (i = 0; i < n; i++)
+   {
+      if (m && (run[m - 1].dst + run[m - 1].bits > run[i].dst))
+      {
+         r->error = run[i].entry;
+         free(run);
+         return 0;
+      }
+      if (m && (run[m - 1].src + run[m - 1].bits == run[i].src) &&
+          (run[m - 1].dst + run[m - 1].bits == run[i].dst))
+         run[m - 1].bits += run[i].bits;
+      else
+         run[m++] = run[i];
+   }
+   for (i = 0; i < m; i++)
+      nmoves += run[i].bits / ECROUTE_MAXMOVE + 2;
+   r->copy = malloc(m * sizeof(ecroute_copyt) + 1);
+   r->move = malloc(nmoves * sizeof(ecroute_movet) + 1);
+   if (!r->copy || !r->move)
+   {
+      free(run);
+      ecroute_free(r);
+      return 0;
+   }
+   for (i = 0; i < m; i++)
+      ecroute_split(r, &run[i]);
+   free(run);
+   return 1;
+}
+
+/** Cyclic thread: copy the routed inputs of this cycle into the outputs of the next. */
+void ecroute_run(const ecroute_t *r)
+{
+   const ecroute_copyt *c;
+   const ecroute_movet *m;
+   uint8 *io = r->iomap;
+   uint64 v, w;
+   int i, k;
+
+   for (i = 0; i < r->ncopy; i++)
+   {
+      c = &r->copy[i];
+      memcpy(io + c->dst, io + c->src, c->len);
+   }
+   for (i = 0; i < r->nmove; i++)
+   {
+      m = &r->move[i];
+      v = 0;
+      for (k = 0; k < m->srcn; k++)
+         v |= (uint64)io[m->src + k] << (8 * k);
+      w = 0;
+      for (k = 0; k < m->dstn; k++)
+         w |= (uint64)io[m->dst + k] << (8 * k);
+      w = (w & ~m->mask) | (((v >> m->srcshift) << m->dstshift) & m->mask);
+      for (k = 0; k < m->dstn; k++)
+         io[m->dst + k] = (uint8)(w >> (8 * k));
+   }
+}
+
+void ecroute_free(ecroute_t *r)
+{
+   free(r->copy);
+   free(r->move);
+   r->copy = NULL;
+   r->move = NULL;
+   r->ncopy = r->nmove = 0;
+}
@@ -0,0 +1,71 @@
+/** \file
+ * \brief Master-side routing of process data from slave inputs to slave outputs
+ *
+ * A table of routes, each a run of bits in the inputs of one slave to be copied into
+ * the outputs of another, is compiled once after ec_config_map() into a copy plan over
+ * the IOmap: routes adjacent in the inputs and in the outputs are merged, byte-aligned
+ * runs become plain copies, the rest bit moves of at most 32 bits through a 64 bit
+ * window. ecroute_run() executes the plan in the cyclic thread after the inputs were
+ * received, the outputs go out with the next frame: one cycle latency for all routes.
+ */
+
+#ifndef _ECROUTE_H
+#define _ECROUTE_H
+
+#include <stddef.h>
+
+#include "ethercat.h"
+
+typedef struct
+{
+   uint16   srcslave;
+   /** bit offset in the inputs of the source slave */
+   uint32   srcbit;
+   uint16   dstslave;
+   /** bit offset in the outputs of the destination slave */
+   uint32   dstbit;
+   uint32   bits;
+} ecroute_entryt;
+
+/** A route of a whole field between two process data structures of the same width */
+#define ECROUTE_FIELD(src, intype, infield, dst, outtype, outfield) \
+   { (src), offsetof(intype, infield) * 8, (dst), offsetof(outtype, outfield) * 8, \
+     sizeof(((intype *)0)->infield) * 8 }
+
+typedef struct
+{
+   /** bytes at IOmap offset src to dst */
+   uint32   src;
+   uint32   dst;
+   uint32   len;
+} ecroute_copyt;
+
+typedef struct
+{
+   /** srcn bytes at src, shifted right by srcshift, shifted left by dstshift and
+       masked into dstn bytes at dst */
+   uint32   src;
+   uint32   dst;
+   uint8    srcshift;
+   uint8    dstshift;
+   uint8    srcn;
+   uint8    dstn;
+   uint64   mask;
+} ecroute_movet;
+
+typedef struct
+{
+   uint8          *iomap;
+   ecroute_copyt  *copy;
+   int            ncopy;
+   ecroute_movet  *move;
+   int            nmove;
+   /** table entry rejected by ecroute_compile(), -1 if none */
+   int            error;
+} ecroute_t;
+
+int ecroute_compile(ecroute_t *r, uint8 *iomap, const ecroute_entryt *table, int n);
+void ecroute_run(const ecroute_t *r);
+void ecroute_free(ecroute_t *r);
+
+#endif
@@ -0,0 +1,308 @@
+/** \file
+ * \brief Recovery of a segment of slaves that lost power together
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "ethercat.h"
+#include "ecsegment.h"
+
+typedef struct PACKED
+{
+   uint16 alstatus;
+   uint16 unused;
+   uint16 alstatuscode;
+} ecseg_alstatust;
+
+/* slaves of the batch still being brought up */
+static uint8 ecseg_active[EC_MAXSLAVE];
+static uint16 ecseg_first;
+static uint16 ecseg_last;
+/* next slave for the hook workers */
+static uint16 ecseg_next;
+static pthread_t ecseg_threads[ECSEG_MAXWORKERS];
+
+/** Find the first run of slaves of a group that do not answer, after ec_readstate().
+ *
+ * @param[in]  group = group of the slaves
+ * @param[out] first = first slave of the run
+ * @param[out] last  = last slave of the run
+ * @return 1 if a run of at least ECSEG_MINSLAVES slaves was found
+ */
+int ecseg_find(uint8 group, uint16 *first, uint16 *last)
+{
+   int slave, start = 0;
+
+   for (slave = 1; slave <= ec_slavecount + 1; slave++)
+   {
+      if ((slave <= ec_slavecount) && (ec_slave[slave].group == group) &&
+          (ec_slave[slave].state == EC_STATE_NONE))
+      {
+         if (!start)
+            start = slave;
+      }
+      else if (start)
+      {
+         if (slave - start >= ECSEG_MINSLAVES)
+         {
+            *first = (uint16)start;
+            *last = (uint16)(slave - 1);
+            return 1;
+         }
+         start = 0;
+      }
+   }
+   return 0;
+}
+
+/* Give the slave at its position its station address again */
+static int ecseg_address(uint16 slave)
+{
+   uint16 adp = (uint16)(1 - slave), readadr = 0xfffe;
+   int wkc;
+
+   wkc = ec_APRD(adp, ECT_REG_STADR, sizeof(readadr), &readadr, EC_TIMEOUTRET);
+   if (etohs(readadr) == ec_slave[slave].configadr)
+      return 1;
+   if ((wkc > 0) && (readadr == 0))
+      return ec_APWRw(adp, ECT_REG_STADR, htoes(ec_slave[slave].configadr), EC_TIMEOUTRET) > 0;
+   return 0;
+}
+
+/** Start a batch: give every slave of first..last at its position its station address
+ * ec_slave[].configadr, if it has none yet.
+ *
+ * @return number of slaves in the batch
+ */
+int ecseg_begin(uint16 first, uint16 last)
+{
+   uint16 slave;
+   int n = 0;
+
+   if ((first < 1) || (last >= EC_MAXSLAVE) || (last < first))
+      return 0;
+   ecseg_first = first;
+   ecseg_last = last;
+   for (slave = first; slave <= last; slave++)
+   {
+      ecseg_active[slave] = (uint8)ecseg_address(slave);
+      n += ecseg_active[slave];
+   }
+   return n;
+}
+
+/** 1 if the slave is still part of the batch. */
+int ecseg_isactive(uint16 slave)
+{
+   return (slave >= ecseg_first) && (slave <= ecseg_last) && ecseg_active[slave];
+}
+
+/** Drop a slave from the batch.
+ *
+ * @param[in] slave     = slave to drop
+ * @param[in] unaddress = TRUE to clear the station address given by ecseg_begin()
+ */
+void ecseg_drop(uint16 slave, boolean unaddress)
+{
+   ecseg_active[slave] = 0;
+   if (unaddress)
+      ec_FPWRw(ec_slave[slave].configadr, ECT_REG_STADR, htoes(0), EC_TIMEOUTRET);
+}
+
+/* Compare alias and identity of all slaves with the configuration, EEPROM reads of
+   all slaves in flight at once */
+static void ecseg_identify(void)
+{
+   static const uint16 sii[3] = { ECT_SII_MANUF, ECT_SII_ID, ECT_SII_REV };
+   uint32 expected;
+   uint16 slave;
+   int k;
+
+   for (slave = ecseg_first; slave <= ecseg_last; slave++)
+   {
+      if (!ecseg_active[slave])
+         continue;
+      ec_eeprom2master(slave);
+      if (ec_FPRDw(ec_slave[slave].configadr, ECT_REG_ALIAS, EC_TIMEOUTRET) !=
+          htoes(ec_slave[slave].aliasadr))
+         ecseg_drop(slave, TRUE);
+   }
+   for (k = 0; k < 3; k++)
+   {
+      for (slave = ecseg_first; slave <= ecseg_last; slave++)
+      {
+         if (ecseg_active[slave])
+            ec_readeeprom1(slave, sii[k]);
+      }
+      for (slave = ecseg_first; slave <= ecseg_last; slave++)
+      {
+         if (!ecseg_active[slave])
+            continue;
+         expected = (k == 0) ? ec_slave[slave].eep_man :
+                    (k == 1) ? ec_slave[slave].eep_id : ec_slave[slave].eep_rev;
+         if (etohl(ec_readeeprom2(slave, EC_TIMEOUTEEP)) != expected)
+            ecseg_drop(slave, TRUE);
+      }
+   }
+}
+
+/** Request a state from all slaves of the batch without waiting. */
+void ecseg_request(uint16 state)
+{
+   uint16 slave;
+
+   for (slave = ecseg_first; slave <= ecseg_last; slave++)
+   {
+      if (ecseg_active[slave])
+         ec_FPWRw(ec_slave[slave].configadr, ECT_REG_ALCTL, htoes(state), EC_TIMEOUTRET);
+   }
+}
+
+/** Wait until all slaves of the batch reached a state, slaves refusing it or late
+ * are dropped.
+ *
+ * @param[in] state   = requested state
+ * @param[in] timeout = timeout in us, for all slaves together
+ * @return number of slaves left in the batch
+ */
+int ecseg_wait(uint16 state, int timeout)
+{
+   ecseg_alstatust al;
+   osal_timert timer;
+   uint16 slave;
+   int pending, left;
+
+   osal_timer_start(&timer, timeout);
+   do
+   {
+      pending = 0;
+      for (slave = ecseg_first; slave <= ecseg_last; slave++)
+      {
+         if (!ecseg_active[slave] || (ec_slave[slave].state == state))
+            continue;
+         memset(&al, 0, sizeof(al));
+         ec_FPRD(ec_slave[slave].configadr, ECT_REG_ALSTAT, sizeof(al), &al, EC_TIMEOUTRET);
+         ec_slave[slave].state = etohs(al.alstatus);
+         ec_slave[slave].ALstatuscode = etohs(al.alstatuscode);
+         if (ec_slave[slave].state & EC_STATE_ERROR)
+            ecseg_drop(slave, FALSE);
+         else if (ec_slave[slave].state != state)
+            pending++;
+      }
+      if (pending)
+         osal_usleep(1000);
+   } while (pending && !osal_timer_is_expired(&timer));
+
+   left = 0;
+   for (slave = ecseg_first; slave <= ecseg_last; slave++)
+   {
+      if (ecseg_active[slave] && (ec_slave[slave].state != state))
+         ecseg_drop(slave, FALSE);
+      left += ecseg_active[slave];
+   }
+   return left;
+}
+
+static void *ecseg_worker(void *ptr)
+{
+   uint16 slave;
+   (void)ptr;                  /* Not used */
+
+   while ((slave = __atomic_fetch_add(&ecseg_next, 1, __ATOMIC_ACQ_REL)) <= ecseg_last)
+   {
+      if (!ecseg_active[slave])
+         continue;
+      if (ec_slave[slave].PO2SOconfig)
+         ec_slave[slave].PO2SOconfig(slave);
+      if (ec_slave[slave].PO2SOconfigx)
+         ec_slave[slave].PO2SOconfigx(&ecx_context, slave);
+   }
+   return NULL;
+}
+
+/** Run the PRE_OP to SAFE_OP hooks of all slaves of the batch on worker threads,
+ * each slave on its own mailbox. The calling thread works along, so the hooks also
+ * run when no worker can be created. */
+void ecseg_hooks(void)
+{
+   uint16 slave;
+   int i, nhooks = 0, nthreads = 0;
+
+   for (slave = ecseg_first; slave <= ecseg_last; slave++)
+   {
+      if (ecseg_active[slave] && (ec_slave[slave].PO2SOconfig || ec_slave[slave].PO2SOconfigx))
+         nhooks++;
+   }
+   if (!nhooks)
+      return;
+   ecseg_next = ecseg_first;
+   for (i = 1; (i < nhooks) && (i < ECSEG_MAXWORKERS); i++)
+   {
+      if (!pthread_create(&ecseg_threads[nthreads], NULL, ecseg_worker, NULL))
+         nthreads++;
+   }
+   ecseg_worker(NULL);
+   for (i = 0; i < nthreads; i++)
+      pthread_join(ecseg_threads[i], NULL);
+}
+
+/** Bring a segment of lost slaves back to OP together, like ec_recover_slave() and
+ * ec_reconfig_slave() followed by the request of OP do for a single slave.
+ *
+ * @param[in] first   = first slave of the segment
+ * @param[in] last    = last slave of the segment
+ * @param[in] timeout = timeout of each state change in us, for the whole segment
+ * @return number of slaves in OP, the others keep EC_STATE_NONE or the state they reached
+ */
+int ecseg_recover(uint16 first, uint16 last, int timeout)
+{
+   uint16 slave, configadr;
+   int nsm, nfmmu;
+
+   if (!ecseg_begin(first, last))
+      return 0;
+   ecseg_identify();
+
+   ecseg_request(EC_STATE_INIT);
+   for (slave = first; slave <= last; slave++)
+   {
+      if (ecseg_active[slave])
+         ec_eeprom2pdi(slave);
+   }
+   if (!ecseg_wait(EC_STATE_INIT, timeout))
+      return 0;
+   for (slave = first; slave <= last; slave++)
+   {
+      if (!ecseg_active[slave])
+         continue;
+      configadr = ec_slave[slave].configadr;
+      for (nsm = 0; nsm < EC_MAXSM; nsm++)
+      {
+         if (ec_slave[slave].SM[nsm].StartAddr)
+            ec_FPWR(configadr, (uint16)(ECT_REG_SM0 + (nsm * sizeof(ec_smt))),
+                    sizeof(ec_smt), &ec_slave[slave].SM[nsm], EC_TIMEOUTRET);
+      }
+   }
+
+   ecseg_request(EC_STATE_PRE_OP);
+   if (!ecseg_wait(EC_STATE_PRE_OP, timeout))
+      return 0;
+   ecseg_hooks();
+
+   ecseg_request(EC_STATE_SAFE_OP);
+   if (!ecseg_wait(EC_STATE_SAFE_OP, timeout))
+      return 0;
+   for (slave = first; slave <= last; slave++)
+   {
+      if (!ecseg_active[slave])
+         continue;
+      configadr = ec_slave[slave].configadr;
+      for (nfmmu = 0; nfmmu < ec_slave[slave].FMMUunused; nfmmu++)
+         ec_FPWR(configadr, (uint16)(ECT_REG_FMMU0 + (nfmmu * sizeof(ec_fmmut))),
+                 sizeof(ec_fmmut), &ec_slave[slave].FMMU[nfmmu], EC_TIMEOUTRET);
+   }
+
+   ecseg_request(EC_STATE_OPERATIONAL);
+   return ecseg_wait(EC_STATE_OPERATIONAL, timeout);
+}
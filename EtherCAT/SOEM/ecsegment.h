@@ -0,0 +1,38 @@
+/** \file
+ * \brief Recovery of a segment of slaves that lost power together
+ *
+ * When a section of the line loses power, all its slaves come back in INIT without
+ * their station address. ec_recover_slave() and ec_reconfig_slave() bring them back
+ * one after the other and each waits for its own state changes, so the recovery time
+ * adds up over the segment. Here every step is issued to all slaves of the segment
+ * before waiting for any of them: re-addressing, the identity check with split EEPROM
+ * reads, the AL state requests, and the PRE_OP to SAFE_OP hooks with their mailbox
+ * traffic, which run on worker threads. The segment is back in OP after the time of
+ * its slowest slave instead of the sum over all slaves.
+ *
+ * The steps are public for other bring-ups of several slaves at once, like the
+ * hot-connect of echotconnect.c: ecseg_begin() addresses the slaves of a batch, the
+ * other functions act on the slaves still in it.
+ *
+ * Call from the check thread only, the cyclic thread keeps running meanwhile.
+ */
+
+#ifndef _ECSEGMENT_H
+#define _ECSEGMENT_H
+
+#include "ethercat.h"
+
+/** shorter runs of lost slaves are left to the recovery per slave */
+#define ECSEG_MINSLAVES   2
+#define ECSEG_MAXWORKERS  8
+
+int ecseg_find(uint8 group, uint16 *first, uint16 *last);
+int ecseg_begin(uint16 first, uint16 last);
+int ecseg_isactive(uint16 slave);
+void ecseg_drop(uint16 slave, boolean unaddress);
+void ecseg_request(uint16 state);
+int ecseg_wait(uint16 state, int timeout);
+void ecseg_hooks(void);
+int ecseg_recover(uint16 first, uint16 last, int timeout);
+
+#endif
@@ -0,0 +1,129 @@
+/** \file
+ * \brief Consistent snapshot of the slave states for observers
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "ecstate.h"
+
+const char *ecstate_counter_name[ECSTATE_COUNTERS] =
+{
+   "acks", "reconfigs", "losses", "recoveries"
+};
+
+/* the writer's own copy, only the check thread touches it */
+static ecstate_snapshott ecstate_work;
+static ecstate_snapshott ecstate_published;
+static uint32 ecstate_seq;
+
+static int64 ecstate_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* copy the part of a snapshot that is in use */
+static void ecstate_copy(ecstate_snapshott *dst, const ecstate_snapshott *src, int slavecount)
+{
+   memcpy(dst, src, offsetof(ecstate_snapshott, slave));
+   memcpy(dst->slave, src->slave, (slavecount + 1) * sizeof(ecstate_slavet));
+}
+
+void ecstate_init(void)
+{
+   memset(&ecstate_work, 0, sizeof(ecstate_work));
+   __atomic_store_n(&ecstate_seq, 0, __ATOMIC_RELEASE);
+   memset(&ecstate_published, 0, sizeof(ecstate_published));
+}
+
+/** Check thread: count a recovery step of a slave, published with the next pass. */
+void ecstate_event(uint16 slave, ecstate_countert counter)
+{
+   if (slave < EC_MAXSLAVE)
+      ecstate_work.slave[slave].count[counter]++;
+}
+
+/** Check thread: publish the state of all slaves, call after every pass.
+ *
+ * @param[in] group       = group checked by the thread
+ * @param[in] wkc         = last working counter of the cycle
+ * @param[in] expectedwkc = expected working counter
+ */
+void ecstate_publish(uint8 group, int wkc, int expectedwkc)
+{
+   ecstate_slavet *s;
+   int64 now = ecstate_now();
+   int slave, n = (ec_slavecount < EC_MAXSLAVE) ? ec_slavecount : EC_MAXSLAVE - 1;
+   uint32 seq;
+
+   for (slave = 1; slave <= n; slave++)
+   {
+      s = &ecstate_work.slave[slave];
+      if ((s->state != ec_slave[slave].state) || (s->islost != ec_slave[slave].islost))
+         s->transition = now;
+      s->state = ec_slave[slave].state;
+      s->alstatuscode = ec_slave[slave].ALstatuscode;
+      s->islost = ec_slave[slave].islost;
+   }
+   ecstate_work.version++;
+   ecstate_work.time = now;
+   ecstate_work.slavecount = n;
+   ecstate_work.docheckstate = ec_group[group].docheckstate;
+   ecstate_work.wkc = wkc;
+   ecstate_work.expectedwkc = expectedwkc;
+
+   seq = ecstate_seq;
+   __atomic_store_n(&ecstate_seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   ecstate_copy(&ecstate_published, &ecstate_work, n);
+   __atomic_store_n(&ecstate_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/** Any thread: consistent copy of the last publication.
+ *
+ * @param[out] snap = snapshot, slave entries up to snap->slavecount are valid
+ * @return version of the snapshot, 0 before the first publication
+ */
+uint32 ecstate_read(ecstate_snapshott *snap)
+{
+   uint32 seq;
+   int n;
+
+   do
+   {
+      seq = __atomic_load_n(&ecstate_seq, __ATOMIC_ACQUIRE);
+      if (seq & 1)
+         continue;
+      n = __atomic_load_n(&ecstate_published.slavecount, __ATOMIC_RELAXED);
+      ecstate_copy(snap, &ecstate_published, (n < EC_MAXSLAVE) ? n : EC_MAXSLAVE - 1);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   } while ((seq & 1) || (seq != __atomic_load_n(&ecstate_seq, __ATOMIC_RELAXED)));
+   return snap->version;
+}
+
+/** Any thread: consistent copy of one slave of the last publication.
+ *
+ * @return version of the snapshot, 0 before the first publication or for a slave
+ *         number out of range
+ */
+uint32 ecstate_read_slave(uint16 slave, ecstate_slavet *out)
+{
+   uint32 seq, version;
+
+   if (slave >= EC_MAXSLAVE)
+      return 0;
+   do
+   {
+      seq = __atomic_load_n(&ecstate_seq, __ATOMIC_ACQUIRE);
+      if (seq & 1)
+         continue;
+      *out = ecstate_published.slave[slave];
+      version = ecstate_published.version;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   } while ((seq & 1) || (seq != __atomic_load_n(&ecstate_seq, __ATOMIC_RELAXED)));
+   return version;
+}
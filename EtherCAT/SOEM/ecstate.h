@@ -0,0 +1,61 @@
+/** \file
+ * \brief Consistent snapshot of the slave states for observers
+ *
+ * ecatcheck() owns ec_slave[].state, islost and ec_group[].docheckstate and changes
+ * them while the cycle runs. Instead of reading those, observers read a snapshot the
+ * check thread publishes after every pass under a sequence lock: the writer makes the
+ * sequence odd, copies, and makes it even again; a reader copies between two reads of
+ * an even, unchanged sequence and retries otherwise. Readers never block the writer or
+ * each other and do not touch the cyclic thread at all.
+ *
+ * One writer, the check thread. Readers on any thread, at any rate.
+ */
+
+#ifndef _ECSTATE_H
+#define _ECSTATE_H
+
+#include "ethercat.h"
+
+typedef enum
+{
+   /** SAFE_OP + ERROR acknowledged */
+   ECSTATE_ACKS = 0,
+   ECSTATE_RECONFIGS,
+   ECSTATE_LOSSES,
+   ECSTATE_RECOVERIES,
+   ECSTATE_COUNTERS
+} ecstate_countert;
+
+typedef struct
+{
+   uint16   state;
+   uint16   alstatuscode;
+   boolean  islost;
+   uint32   count[ECSTATE_COUNTERS];
+   /** CLOCK_MONOTONIC ns of the last change of state or lost flag */
+   int64    transition;
+} ecstate_slavet;
+
+typedef struct
+{
+   /** number of publications, 0 before the first */
+   uint32         version;
+   /** CLOCK_MONOTONIC ns of the publication */
+   int64          time;
+   int            slavecount;
+   boolean        docheckstate;
+   int            wkc;
+   int            expectedwkc;
+   /** indexed like ec_slave, entries above slavecount are not copied */
+   ecstate_slavet slave[EC_MAXSLAVE];
+} ecstate_snapshott;
+
+extern const char *ecstate_counter_name[ECSTATE_COUNTERS];
+
+void ecstate_init(void);
+void ecstate_event(uint16 slave, ecstate_countert counter);
+void ecstate_publish(uint8 group, int wkc, int expectedwkc);
+uint32 ecstate_read(ecstate_snapshott *snap);
+uint32 ecstate_read_slave(uint16 slave, ecstate_slavet *out);
+
+#endif
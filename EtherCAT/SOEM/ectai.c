@@ -0,0 +1,104 @@
+/** \file
+ * \brief Mapping of the DC system time of a line to CLOCK_TAI
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "ectai.h"
+
+void ectai_init(ectai_t *m)
+{
+   memset(m, 0, sizeof(*m));
+}
+
+/** CLOCK_TAI in ns. */
+int64 ectai_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_TAI, &ts);
+   return (int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Add the earliest pair of a window to the fit and solve it */
+static void ectai_fit(ectai_t *m)
+{
+   double x, y, d, den;
+
+   if (!m->points)
+   {
+      m->xref = m->wdc;
+      m->yref = m->wmin;
+   }
+   x = (double)(m->wdc - m->xref);
+   y = (double)(m->wmin - m->yref);
+   m->sw = ECTAI_FORGET * m->sw + 1;
+   m->sx = ECTAI_FORGET * m->sx + x;
+   m->sy = ECTAI_FORGET * m->sy + y;
+   m->sxx = ECTAI_FORGET * m->sxx + x * x;
+   m->sxy = ECTAI_FORGET * m->sxy + x * y;
+   m->points++;
+   /* move the origin to the newest point, keeps the sums small over hours */
+   d = x;
+   m->sxx += d * d * m->sw - 2 * d * m->sx;
+   m->sxy -= d * m->sy;
+   m->sx -= d * m->sw;
+   m->xref = m->wdc;
+   den = m->sw * m->sxx - m->sx * m->sx;
+   m->drift = ((m->points > 1) && (den > 0)) ? (m->sw * m->sxy - m->sx * m->sy) / den : 0;
+   m->offset = (m->sy - m->drift * m->sx) / m->sw;
+   m->valid = TRUE;
+}
+
+/** Add a pair of DC time and CLOCK_TAI taken at the same moment.
+ *
+ * @param[in] m      = mapping of the line
+ * @param[in] dctime = DC time of the last received frame
+ * @param[in] tai    = CLOCK_TAI right after the receive
+ */
+void ectai_update(ectai_t *m, int64 dctime, int64 tai)
+{
+   int64 offset = tai - dctime;
+
+   /* no distributed clocks (or no new frame), nothing to fit */
+   m->nodc = m->valid && (dctime == m->lastdc);
+   m->lastdc = dctime;
+   m->lasttai = tai;
+   if (m->nodc)
+      return;
+   if (!m->wn || (offset < m->wmin))
+   {
+      m->wmin = offset;
+      m->wdc = dctime;
+   }
+   /* the first pair gives a coarse mapping until the first window is complete */
+   if (!m->valid)
+   {
+      m->xref = dctime;
+      m->yref = offset;
+      m->valid = TRUE;
+   }
+   if (++m->wn >= ECTAI_WINDOW)
+   {
+      ectai_fit(m);
+      m->wn = 0;
+   }
+}
+
+/** Cyclic thread: ectai_update() with CLOCK_TAI now, call right after receiving. */
+void ectai_sample(ectai_t *m, int64 dctime)
+{
+   ectai_update(m, dctime, ectai_now());
+}
+
+/** CLOCK_TAI of a DC time of the line, 0 before the first update. While the DC time
+ * stands still the CLOCK_TAI of the last update. */
+int64 ectai_time(const ectai_t *m, int64 dctime)
+{
+   if (!m->valid)
+      return 0;
+   if (m->nodc)
+      return m->lasttai;
+   return dctime + m->yref + (int64)(m->offset + m->drift * (double)(dctime - m->xref));
+}
@@ -0,0 +1,57 @@
+/** \file
+ * \brief Mapping of the DC system time of a line to CLOCK_TAI
+ *
+ * Every line has its own DC reference clock, so ec_DCtime of two lines on one host
+ * has different offsets and rates. The cyclic thread samples CLOCK_TAI right after
+ * each receive and pairs it with the DC time of the frame. Receive latency only makes
+ * the host clock late, so per window of cycles the earliest pair is kept, and a linear
+ * fit with exponential forgetting over these points gives offset and drift. Times of
+ * all lines mapped with ectai_time() are on one timeline and can be merged.
+ *
+ * Without distributed clocks ec_DCtime never changes. While the DC time stands still
+ * from one update to the next, ectai_time() gives the CLOCK_TAI of the last update
+ * instead, the host clock at the receive, and the fit is left as it is.
+ *
+ * CLOCK_TAI equals CLOCK_REALTIME until the TAI offset of the kernel is set (f.e. by
+ * ptp4l or chronyd), it is the same for all lines of a host in either case.
+ */
+
+#ifndef _ECTAI_H
+#define _ECTAI_H
+
+#include "ethercat.h"
+
+/** cycles per fit point */
+#define ECTAI_WINDOW    100
+/** weight of older fit points per window */
+#define ECTAI_FORGET    0.99
+
+typedef struct
+{
+   /* earliest pair of the current window, as CLOCK_TAI - DC time */
+   int64    wmin;
+   int64    wdc;
+   uint32   wn;
+   /* fit of offset over DC time relative to xref and yref */
+   int64    xref;
+   int64    yref;
+   double   sw, sx, sy, sxx, sxy;
+   uint32   points;
+   /** offset at xref relative to yref, ns */
+   double   offset;
+   /** drift, ns per ns of DC time */
+   double   drift;
+   boolean  valid;
+   /* last update, the DC time did not advance in it if nodc */
+   int64    lastdc;
+   int64    lasttai;
+   boolean  nodc;
+} ectai_t;
+
+void ectai_init(ectai_t *m);
+void ectai_update(ectai_t *m, int64 dctime, int64 tai);
+void ectai_sample(ectai_t *m, int64 dctime);
+int64 ectai_time(const ectai_t *m, int64 dctime);
+int64 ectai_now(void);
+
+#endif
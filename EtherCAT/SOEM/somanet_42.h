@@ -0,0 +1,56 @@
+/** \file
+ * \brief Process data layout of SOMANET drives with v4.2 firmware
+ *
+ * The structures overlay the inputs and outputs of one drive in the IOmap
+ * (default PDO mapping).
+ */
+
+#ifndef _SOMANET_42_H
+#define _SOMANET_42_H
+
+#include "ethercat.h"
+
+/* define pointer structure */
+typedef struct PACKED
+{
+  int16 Statusword;
+  int8  OpModeDisplay;
+  int32 PositionValue;
+  int32 VelocityValue;
+  int16 TorqueValue;
+  int32 SecPositionValue;
+  int32 SecVelocityValue;
+  int16 AnalogInput1;
+  int16 AnalogInput2;
+  int16 AnalogInput3;
+  int16 AnalogInput4;
+  int32 TuningStatus;
+  int8  DigitalInput1;
+  int8  DigitalInput2;
+  int8  DigitalInput3;
+  int8  DigitalInput4;
+  int32 UserMISO;
+  int32 Timestamp;
+  int32 PositionDemandInternalValue;
+  int32 VelocityDemandValue;
+  int16 TorqueDemand;
+} in_somanet_42t;
+
+typedef struct PACKED
+{
+  int16 Controlword;
+  int8  OpMode;
+  int16 TargetTorque;
+  int32 TargetPosition;
+  int32 TargetVelocity;
+  int16 TorqueOffset;
+  int32 TuningCommand;
+  int8  DigitalOutput1;
+  int8  DigitalOutput2;
+  int8  DigitalOutput3;
+  int8  DigitalOutput4;
+  int32 UserMOSI;
+  int32 VelocityOffset;
+} out_somanet_42t;
+
+#endif
@@ -0,0 +1,88 @@
+/** \file
+ * \brief Many SOMANET axes on the process data of their slaves
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethercat.h"
+#include "somanet_axes.h"
+
+/** Keep the process data pointers of the axes.
+ *
+ * @param[out] axes  = axes
+ * @param[in]  naxes = number of axes
+ * @param[in]  in    = inputs of every axis in the IOmap
+ * @param[in]  out   = outputs of every axis in the IOmap
+ * @return 1 on success, 0 when out of memory
+ */
+int axes_setup(axes_t *axes, int naxes, in_somanet_42t **in, out_somanet_42t **out)
+{
+   memset(axes, 0, sizeof(*axes));
+   axes->naxes = naxes;
+   axes->in = malloc(naxes * sizeof(*axes->in));
+   axes->out = malloc(naxes * sizeof(*axes->out));
+   if (!axes->in || !axes->out)
+   {
+      axes_free(axes);
+      return 0;
+   }
+   memcpy(axes->in, in, naxes * sizeof(*axes->in));
+   memcpy(axes->out, out, naxes * sizeof(*axes->out));
+   return 1;
+}
+
+void axes_free(axes_t *axes)
+{
+   free(axes->in);
+   free(axes->out);
+   memset(axes, 0, sizeof(*axes));
+}
+
+/* CiA402 power up of one axis: the next controlword for the statusword */
+static int16 axes_cia402_controlword(int16 sw, int16 cw)
+{
+   int fault = (sw & 0b0000000001001111) == 0b0000000000001000;
+   int disabled = (sw & 0b0000000001001111) == 0b0000000001000000;
+   int ready = (sw & 0b0000000001101111) == 0b0000000000100001;
+   int switchedon = (sw & 0b0000000001101111) == 0b0000000000100011;
+   int openabled = (sw & 0b0000000001101111) == 0b0000000000100111;
+
+   return fault ? 0b10000000 :
+          disabled ? 0b00000110 :
+          ready ? 0b00000111 :
+          (switchedon | openabled) ? 0b00001111 : cw;
+}
+
+/** CiA402 power up of all axes, the multi-axis version of the single axis example.
+ *
+ * Resets faults, walks every drive to Operation enabled and commands the target
+ * velocity once it is enabled.
+ *
+ * @param[in] axes           = axes
+ * @param[in] opmode         = operation mode to request
+ * @param[in] targetvelocity = velocity per axis in Operation enabled, NULL leaves
+ *                             TargetVelocity as it is
+ * @return number of axes in Operation enabled
+ */
+int axes_cia402_enable(axes_t *axes, int8 opmode, const int32 *targetvelocity)
+{
+   const in_somanet_42t *in;
+   out_somanet_42t *out;
+   int n, openabled, enabled = 0;
+   int16 sw;
+
+   for (n = 0; n < axes->naxes; n++)
+   {
+      in = axes->in[n];
+      out = axes->out[n];
+      sw = in->Statusword;
+      openabled = (sw & 0b0000000001101111) == 0b0000000000100111;
+      out->OpMode = opmode;
+      out->Controlword = axes_cia402_controlword(sw, out->Controlword);
+      if (openabled && targetvelocity)
+         out->TargetVelocity = targetvelocity[n];
+      enabled += openabled;
+   }
+   return enabled;
+}
@@ -0,0 +1,41 @@
+/** \file
+ * \brief SOMANET axes on the slaves of the SOEM master
+ *
+ * Kept apart from somanet_axes.c, which only works on process data pointers, so that
+ * somanet_simulate links without SOEM.
+ */
+
+#include <stdlib.h>
+
+#include "ethercat.h"
+#include "somanet_axes.h"
+
+/** Set up consecutive slaves as axes, call after ec_config_map().
+ *
+ * @param[out] axes       = axes
+ * @param[in]  firstslave = slave number of the first axis
+ * @param[in]  naxes      = number of axes
+ * @return 1 on success, 0 when out of memory or a slave has less process data than
+ *         in_somanet_42t and out_somanet_42t, f.e. another device or a shorter mapping
+ */
+int axes_setup_slaves(axes_t *axes, uint16 firstslave, int naxes)
+{
+   in_somanet_42t **in = malloc(naxes * sizeof(*in));
+   out_somanet_42t **out = malloc(naxes * sizeof(*out));
+   int n, ok = (in != NULL) && (out != NULL);
+   ec_slavet *s;
+
+   for (n = 0; ok && (n < naxes); n++)
+   {
+      s = &ec_slave[firstslave + n];
+      in[n] = (in_somanet_42t *)s->inputs;
+      out[n] = (out_somanet_42t *)s->outputs;
+      ok = in[n] && out[n] && (s->Ibytes >= sizeof(in_somanet_42t)) &&
+           (s->Obytes >= sizeof(out_somanet_42t));
+   }
+   if (ok)
+      ok = axes_setup(axes, naxes, in, out);
+   free(in);
+   free(out);
+   return ok;
+}
@@ -0,0 +1,164 @@
+/** \file
+ * \brief Cycle engine of the SOMANET axes, shared by the bus and the simulation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ethercat.h"
+#include "somanet_engine.h"
+
+/** Set up the motion of the axes, call after axes_setup() or axes_setup_slaves() of
+ * e->axes with the inputs of the first cycle in place.
+ *
+ * @param[in] e    = engine with its axes set up
+ * @param[in] mode = ENGINE_CSV, ENGINE_PP or ENGINE_IP
+ * @param[in] time = time of the current cycle in ns, the time base of ENGINE_IP
+ * @return 1 on success, 0 when out of memory, e->axes is freed then
+ */
+int engine_setup(engine_t *e, int mode, int64 time)
+{
+   int n, naxes = e->axes.naxes, ok;
+
+   e->mode = mode;
+   memset(&e->pp, 0, sizeof(e->pp));
+   memset(&e->ip, 0, sizeof(e->ip));
+   e->ppbase = e->ipbase = NULL;
+   e->ppnext = NULL;
+   e->velocitylimit = ENGINE_VELOCITY_LIMIT;
+   e->positionrange = ENGINE_POSITION_RANGE;
+   e->followinglimit = ENGINE_FOLLOWING_LIMIT;
+   e->trips = 0;
+   e->velocity = malloc((naxes ? naxes : 1) * sizeof(int32));
+   e->trip = calloc(naxes ? naxes : 1, sizeof(uint8));
+   ok = (e->velocity != NULL) && (e->trip != NULL);
+   for (n = 0; ok && (n < naxes); n++)
+      e->velocity[n] = ENGINE_VELOCITY;
+   if (ok && (mode == ENGINE_PP))
+   {
+      e->ppbase = malloc((naxes ? naxes : 1) * sizeof(int32));
+      e->ppnext = calloc(naxes ? naxes : 1, sizeof(uint32));
+      ok = e->ppbase && e->ppnext && pp_setup(&e->pp, naxes, ENGINE_PP_QUEUE, TRUE);
+      for (n = 0; ok && (n < naxes); n++)
+         e->ppbase[n] = e->axes.in[n]->PositionValue;
+   }
+   if (ok && (mode == ENGINE_IP))
+   {
+      e->ipbase = malloc((naxes ? naxes : 1) * sizeof(int32));
+      ok = e->ipbase && ip_setup(&e->ip, naxes, ENGINE_IP_BUFFER);
+      for (n = 0; ok && (n < naxes); n++)
+         e->ipbase[n] = e->axes.in[n]->PositionValue;
+      e->ipdue = time + ENGINE_IP_LEAD_US * 1000LL;
+      e->ipnext = 0;
+   }
+   if (!ok)
+      engine_free(e);
+   return ok;
+}
+
+void engine_free(engine_t *e)
+{
+   pp_free(&e->pp);
+   ip_free(&e->ip);
+   axes_free(&e->axes);
+   free(e->velocity);
+   free(e->ppbase);
+   free(e->ppnext);
+   free(e->ipbase);
+   free(e->trip);
+   e->velocity = e->ppbase = e->ipbase = NULL;
+   e->ppnext = NULL;
+   e->trip = NULL;
+}
+
+/** Setpoint producer of ENGINE_IP: push the next setpoint of all axes until a buffer
+ * is full. Runs at its own slow pace, on its own thread on the bus, the buffers
+ * decouple it from the cycle. */
+void engine_produce(engine_t *e)
+{
+   int n, full;
+
+   while (1)
+   {
+      full = 0;
+      for (n = 0; n < e->ip.naxes; n++)
+         full |= (ip_level(&e->ip, n) >= e->ip.size);
+      if (full)
+         break;
+      for (n = 0; n < e->ip.naxes; n++)
+         ip_push(&e->ip, n, e->ipdue, e->ipbase[n] +
+                 (int32)(ENGINE_IP_AMPLITUDE *
+                         sin(2 * M_PI * e->ipnext * ENGINE_IP_PERIOD_US * 1e-6 / ENGINE_IP_SINE_S)));
+      e->ipnext++;
+      e->ipdue += ENGINE_IP_PERIOD_US * 1000LL;
+   }
+}
+
+/* Check the axes in Operation enabled against the limits and keep tripped axes
+   disabled, after the motion wrote the outputs of this cycle */
+static void engine_check(engine_t *e)
+{
+   const in_somanet_42t *in;
+   const int32 *base = (e->mode == ENGINE_PP) ? e->ppbase : (e->mode == ENGINE_IP) ? e->ipbase : NULL;
+   int n;
+   uint8 trip;
+
+   for (n = 0; n < e->axes.naxes; n++)
+   {
+      in = e->axes.in[n];
+      if (!e->trip[n] && ((in->Statusword & 0b0000000001101111) == 0b0000000000100111))
+      {
+         trip = 0;
+         if (llabs((int64)in->VelocityValue) > e->velocitylimit)
+            trip |= ENGINE_TRIP_VELOCITY;
+         if (base && (llabs((int64)in->PositionValue - base[n]) > e->positionrange))
+            trip |= ENGINE_TRIP_POSITION;
+         if (base && (llabs((int64)in->PositionDemandInternalValue - in->PositionValue) > e->followinglimit))
+            trip |= ENGINE_TRIP_FOLLOWING;
+         e->trip[n] = trip;
+         e->trips += (trip != 0);
+      }
+      if (e->trip[n])
+         e->axes.out[n]->Controlword = 0;
+   }
+}
+
+/** One cycle of all axes on the IOmap. Call with the inputs of this cycle received, the outputs go out with the next frame.
+ *
+ * @param[in] e    = engine
+ * @param[in] time = time of the cycle in ns, the time base of the setpoints
+ * @return number of axes in Operation enabled
+ */
+int engine_cycle(engine_t *e, int64 time)
+{
+   uint32 k;
+   int n, enabled;
+
+   if (e->mode == ENGINE_PP)
+   {
+      /* keep the queues full, the handshake takes them at its own pace */
+      for (n = 0; n < e->pp.naxes; n++)
+      {
+         while (1)
+         {
+            k = e->ppnext[n] % (2 * ENGINE_PP_STEPS);
+            if (!pp_push(&e->pp, n, e->ppbase[n] + ENGINE_PP_STEP *
+                         (int32)((k < ENGINE_PP_STEPS) ? k : 2 * ENGINE_PP_STEPS - k)))
+               break;
+            e->ppnext[n]++;
+         }
+      }
+      enabled = axes_cia402_enable(&e->axes, PP_OPMODE, NULL);
+      pp_cycle(&e->pp, &e->axes);
+   }
+   else if (e->mode == ENGINE_IP)
+   {
+      enabled = axes_cia402_enable(&e->axes, IP_OPMODE, NULL);
+      ip_cycle(&e->ip, &e->axes, time);
+   }
+   else
+      enabled = axes_cia402_enable(&e->axes, ENGINE_CSV_OPMODE, e->velocity);
+   engine_check(e);
+   return enabled;
+}
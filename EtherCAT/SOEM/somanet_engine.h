@@ -0,0 +1,87 @@
+/** \file
+ * \brief Cycle engine of the SOMANET axes, shared by the bus and the simulation
+ *
+ * One call of engine_cycle() per cycle does everything the master computes for the
+ * axes: CiA402 power up and the motion of the selected mode, directly on the process
+ * data of every slave. It only sees the process data and the
+ * time it is given, so the same code runs on the IOmap of the bus with ec_DCtime
+ * (CSV_test_SOMANET_v42) and on the drive model of somanet_sim.c with a virtual clock
+ * (somanet_simulate).
+ *
+ * Modes, all axes in the same one:
+ *   ENGINE_CSV : ENGINE_VELOCITY in cyclic synchronous velocity
+ *   ENGINE_PP  : a stream of queued profile position targets, a triangle of
+ *                ENGINE_PP_STEPS steps around the start position (somanet_pp.c)
+ *   ENGINE_IP  : a sine around the start position as setpoints ENGINE_IP_PERIOD_US
+ *                apart, produced by engine_produce() at its own pace and interpolated
+ *                in the cycle (somanet_ip.c)
+ *
+ * Every cycle also checks the axes in Operation enabled against their limits: |VelocityValue|
+ * above velocitylimit and, in ENGINE_PP and ENGINE_IP, PositionValue further than
+ * positionrange from the start position or PositionDemandInternalValue - PositionValue
+ * above followinglimit. An axis that breaks one trips: from then on the engine writes
+ * Controlword 0 (Disable voltage, the axis coasts) until engine_free(), the reason is
+ * latched in trip and the trip counted in trips.
+ */
+
+#ifndef _SOMANET_ENGINE_H
+#define _SOMANET_ENGINE_H
+
+#include "ethercat.h"
+#include "somanet_axes.h"
+#include "somanet_pp.h"
+#include "somanet_ip.h"
+
+#define ENGINE_CSV            0
+#define ENGINE_PP             1
+#define ENGINE_IP             2
+
+#define ENGINE_CSV_OPMODE     9
+#define ENGINE_VELOCITY       100
+#define ENGINE_PP_STEP        1000
+#define ENGINE_PP_STEPS       100
+#define ENGINE_PP_QUEUE       16
+#define ENGINE_IP_PERIOD_US   20000
+#define ENGINE_IP_LEAD_US     100000
+#define ENGINE_IP_AMPLITUDE   20000
+#define ENGINE_IP_SINE_S      2.0
+#define ENGINE_IP_BUFFER      64
+/** default limits, rpm and encoder counts */
+#define ENGINE_VELOCITY_LIMIT 3000
+#define ENGINE_POSITION_RANGE 262144
+#define ENGINE_FOLLOWING_LIMIT 5000
+
+#define ENGINE_TRIP_VELOCITY  0x01
+#define ENGINE_TRIP_POSITION  0x02
+#define ENGINE_TRIP_FOLLOWING 0x04
+
+typedef struct
+{
+   int      mode;
+   axes_t   axes;
+   /** velocity per axis of ENGINE_CSV */
+   int32    *velocity;
+   /** start positions and next target per axis of ENGINE_PP */
+   pp_t     pp;
+   int32    *ppbase;
+   uint32   *ppnext;
+   /** start positions of ENGINE_IP, time and number of the next setpoint to produce */
+   ip_t     ip;
+   int32    *ipbase;
+   int64    ipdue;
+   int64    ipnext;
+   /** limits, set to the defaults by engine_setup() */
+   int32    velocitylimit;
+   int32    positionrange;
+   int32    followinglimit;
+   /** ENGINE_TRIP_* per axis, latched, and the number of axes tripped */
+   uint8    *trip;
+   uint32   trips;
+} engine_t;
+
+int engine_setup(engine_t *e, int mode, int64 time);
+void engine_free(engine_t *e);
+void engine_produce(engine_t *e);
+int engine_cycle(engine_t *e, int64 time);
+
+#endif
@@ -0,0 +1,452 @@
+/** \file
+ * \brief Frequency response identification of SOMANET axes
+ *
+ * The cycle thread only evaluates the excitation and stores two floats per axis
+ * and cycle. Finished captures are handed to the workers through a lock-free
+ * queue, so the spectral estimation never runs in the cycle thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "ethercat.h"
+#include "echuge.h"
+#include "somanet_ident.h"
+
+#define IDENT_MAXWORKERS  8
+
+static ident_axist *ident_queue[IDENT_MAXAXES];
+static uint32 ident_queued;
+static uint32 ident_claimed;
+static pthread_t ident_threads[IDENT_MAXWORKERS];
+static volatile int ident_running;
+static int ident_nthreads;
+
+static int ident_is_pow2(int n)
+{
+   return (n > 0) && ((n & (n - 1)) == 0);
+}
+
+/** Build one period of a Schroeder-phased multisine on log spaced FFT bins. */
+static int ident_multisine(ident_axist *ax)
+{
+   int L = ax->cfg.segment;
+   double df = 1.0 / (L * ax->cfg.cycletime);
+   int kmin = (int)ceil(ax->cfg.f0 / df);
+   int kmax = (int)floor(ax->cfg.f1 / df);
+   double ratio, peak = 0.0, v;
+   int i, n, k, last = 0;
+
+   if (kmin < 1)
+      kmin = 1;
+   if (kmax > L / 2 - 1)
+      kmax = L / 2 - 1;
+   if (kmax < kmin)
+      return 0;
+   ratio = (kmax > kmin) ? pow((double)kmax / kmin, 1.0 / (IDENT_MAXLINES - 1)) : 1.0;
+   ax->nlines = 0;
+   for (i = 0; i < IDENT_MAXLINES; i++)
+   {
+      k = (int)lround(kmin * pow(ratio, i));
+      if (k > kmax)
+         break;
+      if (k > last)
+      {
+         ax->lines[ax->nlines++] = k;
+         last = k;
+      }
+   }
+   for (n = 0; n < L; n++)
+   {
+      v = 0.0;
+      for (i = 0; i < ax->nlines; i++)
+         v += cos(2.0 * M_PI * ax->lines[i] * n / L - M_PI * i * (i + 1) / ax->nlines);
+      ax->period[n] = (float)v;
+      if (fabs(v) > peak)
+         peak = fabs(v);
+   }
+   for (n = 0; n < L; n++)
+      ax->period[n] = (float)(ax->period[n] / peak);
+   return ax->nlines;
+}
+
+/** Prepare an axis for identification, allocates the capture buffers.
+ *
+ * @param[out] ax  = axis
+ * @param[in]  cfg = measurement configuration
+ * @return 1 on success, 0 on invalid configuration or out of memory
+ */
+int ident_setup(ident_axist *ax, const ident_configt *cfg)
+{
+   int L = cfg->segment;
+
+   memset(ax, 0, sizeof(*ax));
+   ax->cfg = *cfg;
+   if (!ident_is_pow2(L) || (L < 64) || (cfg->averages < 1) || (cfg->cycletime <= 0.0) ||
+       (cfg->f0 <= 0.0) || (cfg->f1 <= cfg->f0) || (cfg->f1 >= 0.5 / cfg->cycletime))
+      return 0;
+
+   ax->nsamples = L + (cfg->averages - 1) * (L / 2);
+   /* written from the cyclic loop, keep them prefaulted and locked */
+   ax->u = echuge_alloc(ax->nsamples * sizeof(float), "ident u");
+   ax->y = echuge_alloc(ax->nsamples * sizeof(float), "ident y");
+   ax->freq = calloc(L / 2 + 1, sizeof(double));
+   ax->magnitude = calloc(L / 2 + 1, sizeof(double));
+   ax->phase = calloc(L / 2 + 1, sizeof(double));
+   ax->coherence = calloc(L / 2 + 1, sizeof(double));
+   if (!ax->u || !ax->y || !ax->freq || !ax->magnitude || !ax->phase || !ax->coherence)
+   {
+      ident_free(ax);
+      return 0;
+   }
+   if (cfg->excitation == IDENT_MULTISINE)
+   {
+      ax->period = echuge_alloc(L * sizeof(float), "ident period");
+      if (!ax->period || !ident_multisine(ax))
+      {
+         ident_free(ax);
+         return 0;
+      }
+      /* one period to settle, then every segment sees a steady state period */
+      ax->settle = L;
+   }
+   ax->state = IDENT_IDLE;
+   return 1;
+}
+
+void ident_free(ident_axist *ax)
+{
+   echuge_free(ax->u);
+   echuge_free(ax->y);
+   echuge_free(ax->period);
+   free(ax->freq);
+   free(ax->magnitude);
+   free(ax->phase);
+   free(ax->coherence);
+   memset(ax, 0, sizeof(*ax));
+}
+
+/** Arm the measurement, the excitation starts with the next ident_cycle(). */
+void ident_start(ident_axist *ax)
+{
+   ax->sample = 0;
+   ax->nbins = 0;
+   ax->state = IDENT_RUNNING;
+}
+
+/** Drop the measurement of an axis that left Operation enabled during the capture.
+ *
+ * The offset object goes back to 0 and the axis to IDENT_IDLE, so the capture can
+ * be started again. Does nothing unless the axis is being excited.
+ *
+ * @param[in]  ax  = axis
+ * @param[out] out = outputs of the drive
+ */
+void ident_abort(ident_axist *ax, out_somanet_42t *out)
+{
+   if (ax->state != IDENT_RUNNING)
+      return;
+   if (ax->cfg.input == IDENT_TORQUE_OFFSET)
+      out->TorqueOffset = 0;
+   else
+      out->VelocityOffset = 0;
+   ax->state = IDENT_IDLE;
+}
+
+/** Hand a finished capture to the workers. Called from the cycle thread only. */
+static void ident_queue_push(ident_axist *ax)
+{
+   uint32 q = ident_queued;
+
+   ident_queue[q % IDENT_MAXAXES] = ax;
+   __atomic_store_n(&ident_queued, q + 1, __ATOMIC_RELEASE);
+}
+
+static ident_axist *ident_queue_pop(void)
+{
+   uint32 c = __atomic_load_n(&ident_claimed, __ATOMIC_ACQUIRE);
+
+   while (c != __atomic_load_n(&ident_queued, __ATOMIC_ACQUIRE))
+   {
+      if (__atomic_compare_exchange_n(&ident_claimed, &c, c + 1, FALSE,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         return ident_queue[c % IDENT_MAXAXES];
+   }
+   return NULL;
+}
+
+/** Excite and capture one axis, call once per cycle after receiving the process data.
+ *
+ * @param[in]  ax  = axis
+ * @param[in]  in  = inputs of the drive
+ * @param[out] out = outputs of the drive, the offset object is written
+ * @return 1 while the axis is being excited, 0 otherwise
+ */
+int ident_cycle(ident_axist *ax, const in_somanet_42t *in, out_somanet_42t *out)
+{
+   const ident_configt *cfg = &ax->cfg;
+   double e, t, T, lnr;
+   int32 value;
+   int k;
+
+   if (ax->state != IDENT_RUNNING)
+      return 0;
+
+   k = ax->sample - ax->settle;
+   if (cfg->excitation == IDENT_MULTISINE)
+   {
+      e = cfg->amplitude * ax->period[ax->sample & (cfg->segment - 1)];
+   }
+   else
+   {
+      /* logarithmic sweep from f0 to f1 over the whole capture */
+      t = k * cfg->cycletime;
+      T = ax->nsamples * cfg->cycletime;
+      lnr = log(cfg->f1 / cfg->f0);
+      e = cfg->amplitude * sin(2.0 * M_PI * cfg->f0 * T / lnr * (exp(t / T * lnr) - 1.0));
+   }
+   value = (int32)lrint(e);
+   if (cfg->input == IDENT_TORQUE_OFFSET)
+      out->TorqueOffset = (int16)value;
+   else
+      out->VelocityOffset = value;
+
+   if (k >= 0)
+   {
+      ax->u[k] = (float)value;
+      ax->y[k] = (float)in->VelocityValue;
+   }
+   ax->sample++;
+   if (k + 1 >= ax->nsamples)
+   {
+      out->TorqueOffset = 0;
+      out->VelocityOffset = 0;
+      ax->state = IDENT_CAPTURED;
+      ident_queue_push(ax);
+   }
+   return 1;
+}
+
+/** In-place iterative radix-2 FFT. */
+static void ident_fft(double *re, double *im, int n)
+{
+   int i, j, k, len;
+   double wr, wi, ur, ui, tr, ti, a, t;
+
+   for (i = 1, j = 0; i < n; i++)
+   {
+      k = n >> 1;
+      while (j & k)
+      {
+         j ^= k;
+         k >>= 1;
+      }
+      j |= k;
+      if (i < j)
+      {
+         t = re[i]; re[i] = re[j]; re[j] = t;
+         t = im[i]; im[i] = im[j]; im[j] = t;
+      }
+   }
+   for (len = 2; len <= n; len <<= 1)
+   {
+      a = -2.0 * M_PI / len;
+      for (i = 0; i < n; i += len)
+      {
+         for (k = 0; k < len / 2; k++)
+         {
+            wr = cos(a * k);
+            wi = sin(a * k);
+            ur = re[i + k];
+            ui = im[i + k];
+            tr = re[i + k + len / 2] * wr - im[i + k + len / 2] * wi;
+            ti = re[i + k + len / 2] * wi + im[i + k + len / 2] * wr;
+            re[i + k] = ur + tr;
+            im[i + k] = ui + ti;
+            re[i + k + len / 2] = ur - tr;
+            im[i + k + len / 2] = ui - ti;
+         }
+      }
+   }
+}
+
+/** Welch estimate of the frequency response and coherence of a captured axis. */
+static int ident_process(ident_axist *ax)
+{
+   int L = ax->cfg.segment, half = L / 2;
+   double *ur, *ui, *yr, *yi, *w, *puu, *pyy, *pyr, *pyi;
+   double umean = 0.0, ymean = 0.0, h_re, h_im, df, ph, last = 0.0;
+   int s, n, k, b, nbins = 0, ok = 0;
+
+   ur = calloc(L, sizeof(double));
+   ui = calloc(L, sizeof(double));
+   yr = calloc(L, sizeof(double));
+   yi = calloc(L, sizeof(double));
+   w = calloc(L, sizeof(double));
+   puu = calloc(half + 1, sizeof(double));
+   pyy = calloc(half + 1, sizeof(double));
+   pyr = calloc(half + 1, sizeof(double));
+   pyi = calloc(half + 1, sizeof(double));
+   if (!ur || !ui || !yr || !yi || !w || !puu || !pyy || !pyr || !pyi)
+      goto out;
+
+   /* multisine segments hold whole periods, a rectangular window is leakage free */
+   for (n = 0; n < L; n++)
+      w[n] = (ax->cfg.excitation == IDENT_MULTISINE) ? 1.0 : 0.5 - 0.5 * cos(2.0 * M_PI * n / L);
+   for (n = 0; n < ax->nsamples; n++)
+   {
+      umean += ax->u[n];
+      ymean += ax->y[n];
+   }
+   umean /= ax->nsamples;
+   ymean /= ax->nsamples;
+
+   for (s = 0; s < ax->cfg.averages; s++)
+   {
+      for (n = 0; n < L; n++)
+      {
+         ur[n] = (ax->u[s * half + n] - umean) * w[n];
+         yr[n] = (ax->y[s * half + n] - ymean) * w[n];
+         ui[n] = 0.0;
+         yi[n] = 0.0;
+      }
+      ident_fft(ur, ui, L);
+      ident_fft(yr, yi, L);
+      for (k = 1; k <= half; k++)
+      {
+         puu[k] += ur[k] * ur[k] + ui[k] * ui[k];
+         pyy[k] += yr[k] * yr[k] + yi[k] * yi[k];
+         /* Y * conj(U) */
+         pyr[k] += yr[k] * ur[k] + yi[k] * ui[k];
+         pyi[k] += yi[k] * ur[k] - yr[k] * ui[k];
+      }
+   }
+
+   df = 1.0 / (L * ax->cfg.cycletime);
+   for (k = 1; k < half; k++)
+   {
+      if (ax->cfg.excitation == IDENT_MULTISINE)
+      {
+         for (b = 0; (b < ax->nlines) && (ax->lines[b] != k); b++)
+            ;
+         if (b == ax->nlines)
+            continue;
+      }
+      else if ((k * df < ax->cfg.f0) || (k * df > ax->cfg.f1))
+      {
+         continue;
+      }
+      if (puu[k] <= 0.0)
+         continue;
+      h_re = pyr[k] / puu[k];
+      h_im = pyi[k] / puu[k];
+      ph = atan2(h_im, h_re) * 180.0 / M_PI;
+      /* unwrap against the previous bin */
+      if (nbins)
+      {
+         while (ph - last > 180.0)
+            ph -= 360.0;
+         while (ph - last < -180.0)
+            ph += 360.0;
+      }
+      last = ph;
+      ax->freq[nbins] = k * df;
+      ax->magnitude[nbins] = 20.0 * log10(sqrt(h_re * h_re + h_im * h_im) + 1e-300);
+      ax->phase[nbins] = ph;
+      ax->coherence[nbins] = (pyy[k] > 0.0) ?
+         (pyr[k] * pyr[k] + pyi[k] * pyi[k]) / (puu[k] * pyy[k]) : 0.0;
+      nbins++;
+   }
+   ax->nbins = nbins;
+   ok = 1;
+
+out:
+   free(ur);
+   free(ui);
+   free(yr);
+   free(yi);
+   free(w);
+   free(puu);
+   free(pyy);
+   free(pyr);
+   free(pyi);
+   return ok;
+}
+
+static void *ident_worker(void *ptr)
+{
+   ident_axist *ax;
+   (void)ptr;                  /* Not used */
+
+   while (ident_running)
+   {
+      ax = ident_queue_pop();
+      if (!ax)
+      {
+         osal_usleep(1000);
+         continue;
+      }
+      ax->state = IDENT_PROCESSING;
+      ax->state = ident_process(ax) ? IDENT_DONE : IDENT_FAILED;
+   }
+   return NULL;
+}
+
+/** Start the background threads that compute the frequency responses.
+ *
+ * @param[in] nworkers = number of threads, captures of different axes are
+ *                       processed in parallel
+ * @return number of started threads, 0 if none could be created
+ */
+int ident_start_workers(int nworkers)
+{
+   int i;
+
+   if (nworkers > IDENT_MAXWORKERS)
+      nworkers = IDENT_MAXWORKERS;
+   ident_running = 1;
+   ident_nthreads = 0;
+   for (i = 0; i < nworkers; i++)
+   {
+      if (!pthread_create(&ident_threads[ident_nthreads], NULL, ident_worker, NULL))
+         ident_nthreads++;
+   }
+   if (!ident_nthreads)
+      ident_running = 0;
+   return ident_nthreads;
+}
+
+/** Stop the workers after the capture being processed and join them. */
+void ident_stop_workers(void)
+{
+   int i;
+
+   ident_running = 0;
+   for (i = 0; i < ident_nthreads; i++)
+      pthread_join(ident_threads[i], NULL);
+   ident_nthreads = 0;
+}
+
+/** Write the Bode data of an identified axis as CSV.
+ *
+ * @return 1 on success, 0 if the axis has no result or the file can not be written
+ */
+int ident_write_csv(const ident_axist *ax, const char *filename)
+{
+   FILE *f;
+   int i;
+
+   if (ax->state != IDENT_DONE)
+      return 0;
+   f = fopen(filename, "w");
+   if (!f)
+      return 0;
+   fprintf(f, "frequency_hz,magnitude_db,phase_deg,coherence\n");
+   for (i = 0; i < ax->nbins; i++)
+      fprintf(f, "%.4f,%.3f,%.2f,%.4f\n", ax->freq[i], ax->magnitude[i], ax->phase[i], ax->coherence[i]);
+   fclose(f);
+   return 1;
+}
@@ -0,0 +1,91 @@
+/** \file
+ * \brief Frequency response identification of SOMANET axes
+ *
+ * At cycle rate an excitation (logarithmic chirp or Schroeder-phased multisine) is
+ * added to the VelocityOffset or TorqueOffset of the drive and the excitation and the
+ * VelocityValue are captured. When the capture is complete, worker threads estimate
+ * the frequency response with Welch averaging (H1 = Pyu / Puu) and the coherence.
+ * Any number of axes can measure at the same time, each with its own ident_axist.
+ */
+
+#ifndef _SOMANET_IDENT_H
+#define _SOMANET_IDENT_H
+
+#include "ethercat.h"
+#include "somanet_42.h"
+
+#define IDENT_MAXAXES     256
+#define IDENT_MAXLINES    64
+
+typedef enum
+{
+   IDENT_CHIRP = 0,
+   IDENT_MULTISINE = 1
+} ident_excitationt;
+
+typedef enum
+{
+   IDENT_VELOCITY_OFFSET = 0,
+   IDENT_TORQUE_OFFSET = 1
+} ident_inputt;
+
+typedef enum
+{
+   IDENT_IDLE = 0,
+   IDENT_RUNNING,
+   IDENT_CAPTURED,
+   IDENT_PROCESSING,
+   IDENT_DONE,
+   IDENT_FAILED
+} ident_statet;
+
+typedef struct
+{
+   ident_excitationt excitation;
+   ident_inputt      input;
+   /** peak excitation in the unit of the offset object */
+   double            amplitude;
+   /** excited band in Hz */
+   double            f0;
+   double            f1;
+   /** cycle time in s */
+   double            cycletime;
+   /** Welch segment length in samples, power of two */
+   int               segment;
+   /** number of averaged segments */
+   int               averages;
+} ident_configt;
+
+typedef struct
+{
+   ident_configt     cfg;
+   volatile int      state;
+   int               nsamples;
+   int               sample;
+   /** settling samples before the capture starts (one multisine period) */
+   int               settle;
+   /** captured excitation and response */
+   float             *u;
+   float             *y;
+   /** one period of the multisine and its excited FFT bins */
+   float             *period;
+   int               lines[IDENT_MAXLINES];
+   int               nlines;
+   /** Bode data, valid in state IDENT_DONE */
+   int               nbins;
+   double            *freq;
+   double            *magnitude;
+   double            *phase;
+   double            *coherence;
+} ident_axist;
+
+int ident_setup(ident_axist *ax, const ident_configt *cfg);
+void ident_free(ident_axist *ax);
+void ident_start(ident_axist *ax);
+int ident_cycle(ident_axist *ax, const in_somanet_42t *in, out_somanet_42t *out);
+void ident_abort(ident_axist *ax, out_somanet_42t *out);
+int ident_start_workers(int nworkers);
+void ident_stop_workers(void);
+int ident_write_csv(const ident_axist *ax, const char *filename);
+
+#endif
@@ -0,0 +1,180 @@
+/** \file
+ * \brief Interpolated position from buffered setpoints for SOMANET axes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethercat.h"
+#include "somanet_ip.h"
+
+/** Allocate empty setpoint buffers.
+ *
+ * @param[out] ip    = buffers
+ * @param[in]  naxes = number of axes
+ * @param[in]  size  = setpoints per buffer, rounded up to a power of two
+ * @return 1 on success, 0 when out of memory
+ */
+int ip_setup(ip_t *ip, int naxes, uint32 size)
+{
+   uint32 s = 2;
+   int n;
+
+   while (s < size)
+      s <<= 1;
+   memset(ip, 0, sizeof(*ip));
+   ip->naxes = naxes;
+   ip->size = s;
+   ip->buffer = malloc((size_t)naxes * s * sizeof(ip_pointt));
+   ip->head = calloc(naxes, sizeof(uint32));
+   ip->tail = calloc(naxes, sizeof(uint32));
+   ip->last = calloc(naxes, sizeof(ip_pointt));
+   ip->offset = calloc(naxes, sizeof(int32));
+   ip->state = calloc(naxes, sizeof(uint8));
+   ip->underruns = calloc(naxes, sizeof(uint32));
+   ip->starved = calloc(naxes, sizeof(uint32));
+   ip->minlevel = malloc(naxes * sizeof(uint32));
+   if (!ip->buffer || !ip->head || !ip->tail || !ip->last || !ip->offset || !ip->state ||
+       !ip->underruns || !ip->starved || !ip->minlevel)
+   {
+      ip_free(ip);
+      return 0;
+   }
+   for (n = 0; n < naxes; n++)
+      ip->minlevel[n] = s;
+   return 1;
+}
+
+void ip_free(ip_t *ip)
+{
+   free(ip->buffer);
+   free(ip->head);
+   free(ip->tail);
+   free(ip->last);
+   free(ip->offset);
+   free(ip->state);
+   free(ip->underruns);
+   free(ip->starved);
+   free(ip->minlevel);
+   memset(ip, 0, sizeof(*ip));
+}
+
+/** Producer: append a setpoint of one axis, times have to increase.
+ *
+ * @param[in] ip       = buffers
+ * @param[in] axis     = axis index
+ * @param[in] time     = time the axis has to be at position
+ * @param[in] position = absolute position
+ * @return 1 when buffered, 0 when the buffer is full
+ */
+int ip_push(ip_t *ip, int axis, int64 time, int32 position)
+{
+   uint32 head = ip->head[axis];
+   ip_pointt *p;
+
+   if (head - __atomic_load_n(&ip->tail[axis], __ATOMIC_ACQUIRE) >= ip->size)
+      return 0;
+   p = &ip->buffer[(size_t)axis * ip->size + (head & (ip->size - 1))];
+   p->time = time;
+   p->position = position;
+   __atomic_store_n(&ip->head[axis], head + 1, __ATOMIC_RELEASE);
+   return 1;
+}
+
+/** Number of setpoints of an axis not yet passed. */
+uint32 ip_level(ip_t *ip, int axis)
+{
+   return __atomic_load_n(&ip->head[axis], __ATOMIC_ACQUIRE) -
+          __atomic_load_n(&ip->tail[axis], __ATOMIC_ACQUIRE);
+}
+
+/* Position of the setpoint stream of one axis at time, between the last setpoint passed
+   and the next one if there is one */
+static int32 ip_interpolate(const ip_pointt *last, const ip_pointt *next, int64 time)
+{
+   if (!next)
+      return last->position;
+   return last->position + (int32)(((int64)next->position - last->position) *
+                                   (time - last->time) / (next->time - last->time));
+}
+
+/* Target position of one axis, 1 when a started axis ran out of setpoints */
+static int ip_axis(ip_t *ip, int n, int16 sw, int8 opmode, int32 position, int32 *target,
+                   int64 time)
+{
+   const ip_pointt *next = NULL;
+   uint32 head, tail, level;
+   int passed = 0, underrun;
+
+   head = __atomic_load_n(&ip->head[n], __ATOMIC_ACQUIRE);
+   tail = ip->tail[n];
+   /* pass everything that is due, keep the last of it as start of the segment */
+   while (head != tail)
+   {
+      next = &ip->buffer[(size_t)n * ip->size + (tail & (ip->size - 1))];
+      if (next->time > time)
+         break;
+      ip->last[n] = *next;
+      passed = 1;
+      next = NULL;
+      tail++;
+   }
+   __atomic_store_n(&ip->tail[n], tail, __ATOMIC_RELEASE);
+   if (!(((sw & 0b0000000001101111) == 0b0000000000100111) && (opmode == IP_OPMODE)))
+   {
+      /* what fell due is dropped, enabling starts over */
+      *target = position;
+      ip->state[n] = IP_IDLE;
+      return 0;
+   }
+   if (ip->state[n] == IP_IDLE)
+   {
+      if (!passed)
+         return 0;
+      /* reseed: the stream is shifted to go on from where the axis is */
+      ip->offset[n] = (int32)((int64)position - ip_interpolate(&ip->last[n], next, time));
+      ip->state[n] = IP_RUNNING;
+   }
+
+   level = head - tail;
+   ip->minlevel[n] = (level < ip->minlevel[n]) ? level : ip->minlevel[n];
+   underrun = !next && (time > ip->last[n].time);
+   ip->starved[n] += underrun && (ip->state[n] != IP_STARVED);
+   ip->underruns[n] += underrun;
+   ip->state[n] = underrun ? IP_STARVED : IP_RUNNING;
+   *target = (int32)((int64)ip_interpolate(&ip->last[n], next, time) + ip->offset[n]);
+   return underrun;
+}
+
+/** Cyclic thread: target position of all axes on their process data, call after
+ *  axes_cia402_enable() with IP_OPMODE.
+ *
+ * Until an axis is in Operation enabled in IP_OPMODE its target follows the actual
+ * position and setpoints that fall due are dropped. Once enabled, f.e. again after a
+ * fault reset, the axis holds until a setpoint is due. Then the interpolator is reseeded
+ * from the actual position: the setpoints are shifted by the distance of the axis to the
+ * stream at that time, so the axis goes on with the motion of the stream without a step
+ * to where the stream went meanwhile. After the last setpoint it stays there and counts
+ * underruns until the next arrives.
+ *
+ * @param[in] ip   = buffers
+ * @param[in] axes = axes, TargetPosition is written
+ * @param[in] time = time of this cycle
+ * @return number of started axes with an underrun in this cycle
+ */
+int ip_cycle(ip_t *ip, axes_t *axes, int64 time)
+{
+   const in_somanet_42t *in;
+   int32 target;
+   int n, underruns = 0;
+
+   for (n = 0; n < axes->naxes; n++)
+   {
+      in = axes->in[n];
+      target = axes->out[n]->TargetPosition;
+      underruns += ip_axis(ip, n, in->Statusword, in->OpModeDisplay, in->PositionValue,
+                           &target, time);
+      axes->out[n]->TargetPosition = target;
+   }
+   return underruns;
+}
@@ -0,0 +1,69 @@
+/** \file
+ * \brief Interpolated position from buffered setpoints for SOMANET axes
+ *
+ * Every axis gets a ring buffer of timed position setpoints. Producers fill it at their
+ * own pace and with their own jitter; once per cycle ip_cycle() passes the setpoints
+ * that are due and commands the position interpolated linearly to the cycle time. A
+ * producer that delivers one setpoint per cycle is followed point by point, a slower one
+ * (a script, a planner on the network) still gives a smooth setpoint every cycle.
+ *
+ * The default PDO mapping has no interpolation data record (0x60C1), so the drives run
+ * in cyclic synchronous position mode and the interpolation happens on the master.
+ *
+ * Times are in ns on the timeline of the caller of ip_cycle(), f.e. ec_DCtime. The
+ * buffers are single producer, single consumer: one thread per axis may call ip_push()
+ * while the cyclic thread runs ip_cycle().
+ */
+
+#ifndef _SOMANET_IP_H
+#define _SOMANET_IP_H
+
+#include "ethercat.h"
+#include "somanet_axes.h"
+
+/** cyclic synchronous position */
+#define IP_OPMODE 8
+
+#define IP_IDLE      0
+#define IP_RUNNING   1
+#define IP_STARVED   2
+
+typedef struct
+{
+   int64             time;
+   int32             position;
+} ip_pointt;
+
+typedef struct
+{
+   int               naxes;
+   /** entries per buffer, a power of two */
+   uint32            size;
+   /** naxes buffers of size setpoints */
+   ip_pointt         *buffer;
+   /** written by ip_push() */
+   uint32            *head;
+   /** written by ip_cycle() */
+   uint32            *tail;
+   /** last setpoint passed per axis, valid once started */
+   ip_pointt         *last;
+   /** shift of the setpoints per axis, taken at enable so the stream goes on from the
+       actual position */
+   int32             *offset;
+   /** IP_IDLE, IP_RUNNING or IP_STARVED per axis */
+   uint8             *state;
+   /** cycles past the last setpoint with an empty buffer */
+   uint32            *underruns;
+   /** underrun episodes, a stream that ends counts one */
+   uint32            *starved;
+   /** lowest buffer level seen while started */
+   uint32            *minlevel;
+} ip_t;
+
+int ip_setup(ip_t *ip, int naxes, uint32 size);
+void ip_free(ip_t *ip);
+int ip_push(ip_t *ip, int axis, int64 time, int32 position);
+uint32 ip_level(ip_t *ip, int axis);
+int ip_cycle(ip_t *ip, axes_t *axes, int64 time);
+
+#endif
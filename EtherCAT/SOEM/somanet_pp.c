@@ -0,0 +1,148 @@
+/** \file
+ * \brief Streaming profile position mode for SOMANET axes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethercat.h"
+#include "somanet_pp.h"
+
+/** Allocate empty target queues.
+ *
+ * @param[out] pp          = queues
+ * @param[in]  naxes       = number of axes
+ * @param[in]  size        = targets per queue, rounded up to a power of two
+ * @param[in]  immediately = TRUE: a new set-point replaces the running move at once
+ *                           (Change set immediately), FALSE: the drive finishes the
+ *                           running move first and buffers one set-point
+ * @return 1 on success, 0 when out of memory
+ */
+int pp_setup(pp_t *pp, int naxes, uint32 size, boolean immediately)
+{
+   uint32 s = 2;
+
+   while (s < size)
+      s <<= 1;
+   memset(pp, 0, sizeof(*pp));
+   pp->naxes = naxes;
+   pp->size = s;
+   pp->change = immediately ? PP_CW_CHANGE_IMMEDIATELY : 0;
+   pp->queue = malloc((size_t)naxes * s * sizeof(int32));
+   pp->head = calloc(naxes, sizeof(uint32));
+   pp->tail = calloc(naxes, sizeof(uint32));
+   pp->bits = calloc(naxes, sizeof(int16));
+   pp->acked = calloc(naxes, sizeof(uint32));
+   pp->waits = calloc(naxes, sizeof(uint32));
+   if (!pp->queue || !pp->head || !pp->tail || !pp->bits || !pp->acked || !pp->waits)
+   {
+      pp_free(pp);
+      return 0;
+   }
+   return 1;
+}
+
+void pp_free(pp_t *pp)
+{
+   free(pp->queue);
+   free(pp->head);
+   free(pp->tail);
+   free(pp->bits);
+   free(pp->acked);
+   free(pp->waits);
+   memset(pp, 0, sizeof(*pp));
+}
+
+/** Producer: queue a target position of one axis.
+ *
+ * @param[in] pp     = queues
+ * @param[in] axis   = axis index
+ * @param[in] target = absolute target position
+ * @return 1 when queued, 0 when the queue is full
+ */
+int pp_push(pp_t *pp, int axis, int32 target)
+{
+   uint32 head = pp->head[axis];
+
+   if (head - __atomic_load_n(&pp->tail[axis], __ATOMIC_ACQUIRE) >= pp->size)
+      return 0;
+   pp->queue[(size_t)axis * pp->size + (head & (pp->size - 1))] = target;
+   __atomic_store_n(&pp->head[axis], head + 1, __ATOMIC_RELEASE);
+   return 1;
+}
+
+/** Number of targets of an axis not yet handed to the drive. */
+uint32 pp_queued(pp_t *pp, int axis)
+{
+   return __atomic_load_n(&pp->head[axis], __ATOMIC_ACQUIRE) -
+          __atomic_load_n(&pp->tail[axis], __ATOMIC_ACQUIRE);
+}
+
+/** Cyclic thread: 1 while an axis has queued targets, a handshake in progress or a
+ *  move that has not reached its target.
+ */
+int pp_busy(pp_t *pp, const axes_t *axes, int axis)
+{
+   int16 sw = axes->in[axis]->Statusword;
+
+   return pp_queued(pp, axis) || (pp->bits[axis] & PP_CW_NEW_SETPOINT) ||
+          (sw & PP_SW_SETPOINT_ACK) || !(sw & PP_SW_TARGET_REACHED);
+}
+
+/* Set-point handshake of one axis, writes target and controlword, 1 when a set-point
+   was handed to the drive */
+static int pp_axis(pp_t *pp, int n, int16 sw, int8 opmode, int32 *target, int16 *cw)
+{
+   int enabled = ((sw & 0b0000000001101111) == 0b0000000000100111) && (opmode == PP_OPMODE);
+   int ack = (sw & PP_SW_SETPOINT_ACK) != 0;
+   int high = (pp->bits[n] & PP_CW_NEW_SETPOINT) != 0;
+   uint32 tail = pp->tail[n];
+   int queued = __atomic_load_n(&pp->head[n], __ATOMIC_ACQUIRE) != tail;
+   /* both handshake lines low: the drive takes a new set-point right now */
+   int issue = enabled && !high && !ack && queued;
+
+   if (issue)
+   {
+      *target = pp->queue[(size_t)n * pp->size + (tail & (pp->size - 1))];
+      __atomic_store_n(&pp->tail[n], tail + 1, __ATOMIC_RELEASE);
+   }
+   pp->acked[n] += high && ack;
+   pp->waits[n] += enabled && !high && ack && queued;
+   /* New set-point stays up until the acknowledge is seen, and drops in that cycle */
+   pp->bits[n] = (enabled && (issue || (high && !ack))) ? PP_CW_NEW_SETPOINT : 0;
+   *cw = enabled ? (*cw & ~(PP_CW_NEW_SETPOINT | PP_CW_CHANGE_IMMEDIATELY)) | pp->bits[n] | pp->change :
+         *cw;
+   return issue;
+}
+
+/** Cyclic thread: set-point handshake of all axes on their process data, call after
+ *  axes_cia402_enable() with PP_OPMODE.
+ *
+ * An axis takes part once it is in Operation enabled and shows profile position mode.
+ * Outside of that its queue is left alone and New set-point stays clear, so targets
+ * queued early go out once the drive is ready.
+ *
+ * @param[in] pp   = queues
+ * @param[in] axes = axes, TargetPosition and Controlword are written
+ * @return number of set-points handed to the drives in this cycle
+ */
+int pp_cycle(pp_t *pp, axes_t *axes)
+{
+   const in_somanet_42t *in;
+   out_somanet_42t *out;
+   int32 target;
+   int16 cw;
+   int n, issued = 0;
+
+   for (n = 0; n < axes->naxes; n++)
+   {
+      in = axes->in[n];
+      out = axes->out[n];
+      target = out->TargetPosition;
+      cw = out->Controlword;
+      issued += pp_axis(pp, n, in->Statusword, in->OpModeDisplay, &target, &cw);
+      out->TargetPosition = target;
+      out->Controlword = cw;
+   }
+   return issued;
+}
@@ -0,0 +1,57 @@
+/** \file
+ * \brief Streaming profile position mode for SOMANET axes
+ *
+ * Every axis gets a queue of target positions. Once per cycle pp_cycle() runs the
+ * set-point handshake of profile position mode on the process data: a queued target
+ * goes out with New set-point (controlword bit 4) in the first cycle the drive shows
+ * Set-point acknowledge (statusword bit 12) clear, and bit 4 is released in the first
+ * cycle the acknowledge is seen. No cycle is lost between moves beyond what the drive
+ * itself needs to answer.
+ *
+ * Targets are absolute position increments. The queues are single producer, single
+ * consumer: one thread per axis may call pp_push() while the cyclic thread runs
+ * pp_cycle().
+ */
+
+#ifndef _SOMANET_PP_H
+#define _SOMANET_PP_H
+
+#include "ethercat.h"
+#include "somanet_axes.h"
+
+#define PP_OPMODE                   1
+
+#define PP_CW_NEW_SETPOINT          0x0010
+#define PP_CW_CHANGE_IMMEDIATELY    0x0020
+#define PP_SW_TARGET_REACHED        0x0400
+#define PP_SW_SETPOINT_ACK          0x1000
+
+typedef struct
+{
+   int               naxes;
+   /** entries per queue, a power of two */
+   uint32            size;
+   /** naxes queues of size targets */
+   int32             *queue;
+   /** written by pp_push() */
+   uint32            *head;
+   /** written by pp_cycle() */
+   uint32            *tail;
+   /** handshake bits of the controlword per axis */
+   int16             *bits;
+   /** set-points acknowledged per axis */
+   uint32            *acked;
+   /** cycles a queued target waited for the drive to release the acknowledge */
+   uint32            *waits;
+   /** PP_CW_CHANGE_IMMEDIATELY or 0 */
+   int16             change;
+} pp_t;
+
+int pp_setup(pp_t *pp, int naxes, uint32 size, boolean immediately);
+void pp_free(pp_t *pp);
+int pp_push(pp_t *pp, int axis, int32 target);
+uint32 pp_queued(pp_t *pp, int axis);
+int pp_busy(pp_t *pp, const axes_t *axes, int axis);
+int pp_cycle(pp_t *pp, axes_t *axes);
+
+#endif
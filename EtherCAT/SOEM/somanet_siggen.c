@@ -0,0 +1,226 @@
+/** \file
+ * \brief Master-side signal generator for SOMANET axes
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "ethercat.h"
+#include "somanet_siggen.h"
+
+static int siggen_is_position(const siggen_t *gen)
+{
+   return (gen->cfg.profile == SIGGEN_POSITION_BIDIRECTIONAL) ||
+          (gen->cfg.profile == SIGGEN_POSITION_RAMP) ||
+          (gen->cfg.profile == SIGGEN_POSITION_SINE_WAVE);
+}
+
+static int siggen_is_sine(const siggen_t *gen)
+{
+   return (gen->cfg.profile == SIGGEN_POSITION_SINE_WAVE) ||
+          (gen->cfg.profile == SIGGEN_VELOCITY_SINE_WAVE);
+}
+
+static siggen_piecet *siggen_add(siggen_t *gen, siggen_piecetypet type, double value, double duration)
+{
+   siggen_piecet *p = &gen->piece[gen->npieces++];
+
+   memset(p, 0, sizeof(*p));
+   p->type = type;
+   p->start = gen->period;
+   p->value = value;
+   p->duration = duration;
+   gen->period += duration;
+   return p;
+}
+
+static void siggen_hold(siggen_t *gen, double value, double duration)
+{
+   if (duration > 0.0)
+      siggen_add(gen, SIGGEN_HOLD, value, duration);
+}
+
+/** Trapezoidal move from standstill to standstill, triangular if the distance is short. */
+static void siggen_move(siggen_t *gen, double from, double distance)
+{
+   double a = gen->cfg.acceleration, d = gen->cfg.deceleration, D = fabs(distance);
+   double v = gen->cfg.profile_velocity;
+   siggen_piecet *p;
+
+   /* peak velocity of a triangular profile over the distance */
+   if (v * v * (a + d) / (2.0 * a * d) > D)
+      v = sqrt(2.0 * D * a * d / (a + d));
+   p = siggen_add(gen, SIGGEN_MOVE, from, 0.0);
+   p->delta = distance;
+   p->v = v;
+   p->a = a;
+   p->d = d;
+   p->ta = v / a;
+   p->tc = (v > 0.0) ? (D - v * v / (2.0 * a) - v * v / (2.0 * d)) / v : 0.0;
+   if (p->tc < 0.0)
+      p->tc = 0.0;
+   p->duration = p->ta + p->tc + v / d;
+   gen->period += p->duration;
+}
+
+/** Linear velocity change, accelerating away from zero and decelerating towards it. */
+static void siggen_ramp(siggen_t *gen, double from, double to)
+{
+   double rate = (fabs(to) > fabs(from)) ? gen->cfg.acceleration : gen->cfg.deceleration;
+   siggen_piecet *p = siggen_add(gen, SIGGEN_RAMP, from, fabs(to - from) / rate);
+
+   p->delta = to - from;
+}
+
+/** Lay out a profile.
+ *
+ * @param[out] gen = generator
+ * @param[in]  cfg = profile configuration
+ * @return 1 on success, 0 if the configuration can not be generated
+ */
+int siggen_setup(siggen_t *gen, const siggen_configt *cfg)
+{
+   double T = cfg->target;
+
+   memset(gen, 0, sizeof(*gen));
+   gen->cfg = *cfg;
+   if (siggen_is_sine(gen))
+   {
+      if (cfg->frequency <= 0.0)
+         return 0;
+      gen->cfg.repeat = TRUE;
+      gen->period = 1.0 / cfg->frequency;
+      return 1;
+   }
+   if ((cfg->acceleration <= 0.0) || (cfg->deceleration <= 0.0) || (cfg->sustain_time < 0.0))
+      return 0;
+   if (siggen_is_position(gen) && (cfg->profile_velocity <= 0.0))
+      return 0;
+
+   switch (cfg->profile)
+   {
+      case SIGGEN_POSITION_BIDIRECTIONAL:
+         siggen_move(gen, 0.0, T);
+         siggen_hold(gen, T, cfg->sustain_time);
+         siggen_move(gen, T, -T);
+         siggen_hold(gen, 0.0, cfg->sustain_time);
+         break;
+      case SIGGEN_POSITION_RAMP:
+         siggen_move(gen, 0.0, T);
+         siggen_hold(gen, T, cfg->sustain_time);
+         break;
+      case SIGGEN_VELOCITY_BIDIRECTIONAL:
+         siggen_ramp(gen, 0.0, T);
+         siggen_hold(gen, T, cfg->sustain_time);
+         siggen_ramp(gen, T, 0.0);
+         siggen_ramp(gen, 0.0, -T);
+         siggen_hold(gen, -T, cfg->sustain_time);
+         siggen_ramp(gen, -T, 0.0);
+         break;
+      case SIGGEN_VELOCITY_RAMP:
+         siggen_ramp(gen, 0.0, T);
+         siggen_hold(gen, T, cfg->sustain_time);
+         siggen_ramp(gen, T, 0.0);
+         break;
+      default:
+         return 0;
+   }
+   return gen->period > 0.0;
+}
+
+/** Start the profile at the given cycle, position profiles start at the actual position. */
+void siggen_start(siggen_t *gen, const in_somanet_42t *in, int64 cycle)
+{
+   gen->origin = in->PositionValue;
+   gen->startcycle = cycle;
+   gen->active = TRUE;
+}
+
+void siggen_stop(siggen_t *gen)
+{
+   gen->active = FALSE;
+}
+
+static double siggen_piece(const siggen_piecet *p, double tau)
+{
+   double s, td;
+
+   if (tau > p->duration)
+      tau = p->duration;
+   switch (p->type)
+   {
+      case SIGGEN_MOVE:
+         s = (p->delta < 0.0) ? -1.0 : 1.0;
+         if (tau < p->ta)
+            return p->value + s * 0.5 * p->a * tau * tau;
+         if (tau < p->ta + p->tc)
+            return p->value + s * (0.5 * p->a * p->ta * p->ta + p->v * (tau - p->ta));
+         td = tau - p->ta - p->tc;
+         return p->value + s * (0.5 * p->a * p->ta * p->ta + p->v * p->tc + p->v * td - 0.5 * p->d * td * td);
+      case SIGGEN_RAMP:
+         /* a ramp between equal values takes no time, it is at its end point */
+         if (p->duration <= 0.0)
+            return p->value + p->delta;
+         return p->value + p->delta * tau / p->duration;
+      default:
+         return p->value;
+   }
+}
+
+/** Evaluate the profile at time t since start.
+ *
+ * @return position relative to the start position, or velocity
+ */
+double siggen_eval(siggen_t *gen, double t)
+{
+   const siggen_piecet *p;
+   int i;
+
+   if (siggen_is_sine(gen))
+      return gen->cfg.amplitude * sin(2.0 * M_PI * gen->cfg.frequency * t);
+   if (t >= gen->period)
+   {
+      if (!gen->cfg.repeat)
+      {
+         p = &gen->piece[gen->npieces - 1];
+         return siggen_piece(p, p->duration);
+      }
+      t = fmod(t, gen->period);
+   }
+   for (i = gen->npieces - 1; (i > 0) && (gen->piece[i].start > t); i--)
+      ;
+   p = &gen->piece[i];
+   return siggen_piece(p, t - p->start);
+}
+
+/** Write the setpoints of all active generators, call once per cycle.
+ *
+ * @param[in]  gen       = generators, one per axis
+ * @param[out] out       = outputs of the axes
+ * @param[in]  naxes     = number of axes
+ * @param[in]  cycle     = current cycle count
+ * @param[in]  cycletime = cycle time in s
+ * @return number of generators still active
+ */
+int siggen_cycle(siggen_t *gen, out_somanet_42t **out, int naxes, int64 cycle, double cycletime)
+{
+   double t, value;
+   int n, active = 0;
+
+   for (n = 0; n < naxes; n++)
+   {
+      if (!gen[n].active)
+         continue;
+      t = (double)(cycle - gen[n].startcycle) * cycletime;
+      value = siggen_eval(&gen[n], t);
+      if (siggen_is_position(&gen[n]))
+         out[n]->TargetPosition = (int32)lrint(gen[n].origin + value);
+      else
+         out[n]->TargetVelocity = (int32)lrint(value);
+      if (!gen[n].cfg.repeat && (t >= gen[n].period))
+         gen[n].active = FALSE;
+      else
+         active++;
+   }
+   return active;
+}
@@ -0,0 +1,89 @@
+/** \file
+ * \brief Master-side signal generator for SOMANET axes
+ *
+ * Native counterpart of the Motion Master signal generator profiles (bidirectional,
+ * ramp and sine wave, for position and velocity). Each profile is laid out once into
+ * a few pieces (moves, ramps and holds); every cycle the setpoint is evaluated in
+ * closed form from the cycle count, so there is no integration drift and any number
+ * of axes costs one evaluation each.
+ *
+ * Units are those of the process data: position profiles work in position increments,
+ * profile velocity in increments/s and acceleration in increments/s^2; velocity profiles
+ * in the velocity unit of the drive and its unit per s. Position targets are relative
+ * to the actual position when the generator starts. Sustain times are in s.
+ */
+
+#ifndef _SOMANET_SIGGEN_H
+#define _SOMANET_SIGGEN_H
+
+#include "ethercat.h"
+#include "somanet_42.h"
+
+#define SIGGEN_MAXPIECES  8
+
+typedef enum
+{
+   SIGGEN_POSITION_BIDIRECTIONAL = 0,
+   SIGGEN_VELOCITY_BIDIRECTIONAL,
+   SIGGEN_POSITION_RAMP,
+   SIGGEN_VELOCITY_RAMP,
+   SIGGEN_POSITION_SINE_WAVE,
+   SIGGEN_VELOCITY_SINE_WAVE
+} siggen_profilet;
+
+typedef struct
+{
+   siggen_profilet   profile;
+   /** target position (relative) or target velocity */
+   double            target;
+   double            profile_velocity;
+   double            acceleration;
+   double            deceleration;
+   double            sustain_time;
+   /** sine wave amplitude and frequency in Hz */
+   double            amplitude;
+   double            frequency;
+   /** restart the profile when it ends, sine waves always repeat */
+   boolean           repeat;
+} siggen_configt;
+
+typedef enum
+{
+   SIGGEN_HOLD = 0,
+   SIGGEN_MOVE,
+   SIGGEN_RAMP
+} siggen_piecetypet;
+
+typedef struct
+{
+   siggen_piecetypet type;
+   double            start;      /* start time in the profile */
+   double            duration;
+   double            value;      /* position or velocity at the start of the piece */
+   double            delta;      /* distance of a move, velocity change of a ramp */
+   double            v;          /* reached velocity of a move */
+   double            ta;         /* acceleration time of a move */
+   double            tc;         /* constant velocity time of a move */
+   double            a;
+   double            d;
+} siggen_piecet;
+
+typedef struct
+{
+   siggen_configt    cfg;
+   siggen_piecet     piece[SIGGEN_MAXPIECES];
+   int               npieces;
+   double            period;
+   /** position at start for position profiles */
+   double            origin;
+   int64             startcycle;
+   boolean           active;
+} siggen_t;
+
+int siggen_setup(siggen_t *gen, const siggen_configt *cfg);
+void siggen_start(siggen_t *gen, const in_somanet_42t *in, int64 cycle);
+void siggen_stop(siggen_t *gen);
+double siggen_eval(siggen_t *gen, double t);
+int siggen_cycle(siggen_t *gen, out_somanet_42t **out, int naxes, int64 cycle, double cycletime);
+
+#endif
@@ -0,0 +1,171 @@
+/** \file
+ * \brief In-process model of SOMANET drives for offline runs of the cycle engine
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ethercat.h"
+#include "somanet_sim.h"
+#include "somanet_pp.h"
+
+#define SIM_SW_FAULT          0x0008
+#define SIM_SW_DISABLED       0x0040
+#define SIM_SW_READY          0x0021
+#define SIM_SW_SWITCHEDON     0x0023
+#define SIM_SW_ENABLED        0x0027
+/** distance to the target counted as reached, counts */
+#define SIM_PP_WINDOW         10
+
+/** Lay out the IOmap for naxes drives, all switched on disabled at position 0.
+ *
+ * @param[out] sim       = simulation
+ * @param[in]  naxes     = number of drives
+ * @param[in]  cycletime = cycle time in ns, the step of the virtual clock
+ * @return 1 on success, 0 when out of memory
+ */
+int sim_setup(sim_t *sim, int naxes, int64 cycletime)
+{
+   size_t osize = sizeof(out_somanet_42t), isize = sizeof(in_somanet_42t);
+   int n;
+
+   memset(sim, 0, sizeof(*sim));
+   sim->naxes = naxes;
+   sim->cycletime = cycletime;
+   sim->iomap = calloc(naxes ? naxes : 1, osize + isize);
+   sim->in = malloc((naxes ? naxes : 1) * sizeof(*sim->in));
+   sim->out = malloc((naxes ? naxes : 1) * sizeof(*sim->out));
+   sim->drive = calloc(naxes ? naxes : 1, sizeof(sim_drivet));
+   if (!sim->iomap || !sim->in || !sim->out || !sim->drive)
+   {
+      sim_free(sim);
+      return 0;
+   }
+   for (n = 0; n < naxes; n++)
+   {
+      sim->out[n] = (out_somanet_42t *)&sim->iomap[n * osize];
+      sim->in[n] = (in_somanet_42t *)&sim->iomap[naxes * osize + n * isize];
+      sim->drive[n].statusword = SIM_SW_DISABLED;
+      sim->in[n]->Statusword = SIM_SW_DISABLED;
+   }
+   return 1;
+}
+
+void sim_free(sim_t *sim)
+{
+   free(sim->iomap);
+   free(sim->in);
+   free(sim->out);
+   free(sim->drive);
+   memset(sim, 0, sizeof(*sim));
+}
+
+/** Put a drive into Fault, the engine has to reset it. */
+void sim_fault(sim_t *sim, int axis)
+{
+   sim->drive[axis].statusword = SIM_SW_FAULT;
+   sim->drive[axis].faults++;
+}
+
+/* CiA402 state machine, the transitions the controlword asks for */
+static int16 sim_state(int16 sw, int16 cw)
+{
+   int fault = (sw & 0b0000000001001111) == SIM_SW_FAULT;
+   int disabled = (sw & 0b0000000001001111) == SIM_SW_DISABLED;
+   int ready = (sw & 0b0000000001101111) == SIM_SW_READY;
+   int switchedon = (sw & 0b0000000001101111) == SIM_SW_SWITCHEDON;
+   int enabled = (sw & 0b0000000001101111) == SIM_SW_ENABLED;
+
+   if (fault)
+      return (cw & 0x80) ? SIM_SW_DISABLED : SIM_SW_FAULT;
+   if (!(cw & 0x02))
+      return SIM_SW_DISABLED;
+   if ((cw & 0x87) == 0x06)
+      return (disabled || ready || switchedon || enabled) ? SIM_SW_READY : sw;
+   if ((cw & 0x8f) == 0x07)
+      return (ready || switchedon || enabled) ? SIM_SW_SWITCHEDON : sw;
+   if ((cw & 0x8f) == 0x0f)
+      return (switchedon || enabled) ? SIM_SW_ENABLED : ready ? SIM_SW_SWITCHEDON : sw;
+   return sw;
+}
+
+/* One cycle of a drive: take the outputs, move, answer with the inputs */
+static void sim_drive(sim_drivet *d, const out_somanet_42t *out, in_somanet_42t *in,
+                      double dt, int64 time)
+{
+   double av = dt / (SIM_VELOCITY_TAU_S + dt), ap = dt / (SIM_POSITION_TAU_S + dt);
+   double scale = SIM_COUNTS_PER_REV / 60.0, vcmd = 0, last = d->position, step;
+   int16 cw = out->Controlword, pp = d->statusword & (PP_SW_TARGET_REACHED | PP_SW_SETPOINT_ACK);
+   int16 state = sim_state(d->statusword & 0b0000000001101111, cw);
+   boolean nsp = (cw & PP_CW_NEW_SETPOINT) != 0;
+
+   if (state != SIM_SW_ENABLED)
+   {
+      /* no torque, the axis coasts down */
+      d->velocity -= d->velocity * av;
+      d->position += d->velocity * scale * dt;
+      d->demand = d->position;
+      pp = PP_SW_TARGET_REACHED;
+   }
+   else if (out->OpMode == 9)
+   {
+      vcmd = out->TargetVelocity;
+      d->velocity += (vcmd - d->velocity) * av;
+      d->position += d->velocity * scale * dt;
+      d->demand = d->position;
+   }
+   else if ((out->OpMode == 8) || (out->OpMode == PP_OPMODE))
+   {
+      if (out->OpMode == 8)
+         d->demand = out->TargetPosition;
+      else
+      {
+         /* set-point handshake, a new target replaces the current one */
+         if (nsp && !(pp & PP_SW_SETPOINT_ACK))
+         {
+            d->target = out->TargetPosition;
+            pp = PP_SW_SETPOINT_ACK;
+         }
+         else if (!nsp)
+            pp &= ~PP_SW_SETPOINT_ACK;
+         step = SIM_PP_VELOCITY * scale * dt;
+         d->demand += (d->target > d->demand + step) ? step :
+                      (d->target < d->demand - step) ? -step : d->target - d->demand;
+         if ((d->demand == d->target) && (fabs(d->target - d->position) <= SIM_PP_WINDOW))
+         {
+            d->reached += !(pp & PP_SW_TARGET_REACHED);
+            pp |= PP_SW_TARGET_REACHED;
+         }
+         else
+            pp &= ~PP_SW_TARGET_REACHED;
+      }
+      d->position += (d->demand - d->position) * ap;
+      d->velocity = (d->position - last) / (scale * dt);
+      vcmd = d->velocity;
+      if (fabs(d->demand - d->position) > d->maxerror)
+         d->maxerror = fabs(d->demand - d->position);
+   }
+   d->newsetpoint = nsp;
+   d->statusword = state | pp;
+
+   in->Statusword = d->statusword;
+   in->OpModeDisplay = out->OpMode;
+   in->PositionValue = (int32)(int64)llround(d->position);
+   in->VelocityValue = (int32)lround(d->velocity);
+   in->VelocityDemandValue = (int32)lround(vcmd);
+   in->PositionDemandInternalValue = (int32)(int64)llround(d->demand);
+   in->Timestamp = (int32)(time / 1000);
+}
+
+/** One bus cycle: every drive takes its outputs and answers with its inputs, then the
+ * virtual clock advances by one cycle. */
+void sim_exchange(sim_t *sim)
+{
+   double dt = sim->cycletime * 1e-9;
+   int n;
+
+   for (n = 0; n < sim->naxes; n++)
+      sim_drive(&sim->drive[n], sim->out[n], sim->in[n], dt, sim->time);
+   sim->time += sim->cycletime;
+}
@@ -0,0 +1,62 @@
+/** \file
+ * \brief In-process model of SOMANET drives for offline runs of the cycle engine
+ *
+ * Stands in for the bus and the drives: a synthetic IOmap laid out like ec_config_map()
+ * does (all outputs, then all inputs, packed) and per drive a model of the v4.2
+ * firmware as far as the engine uses it: the CiA402 state machine, the operation modes
+ * CSV, CSP and profile position with its set-point handshake, and a velocity loop as a
+ * first order lag that moves the position. sim_exchange() is one bus cycle on a virtual
+ * clock: the drives take the outputs the master wrote and answer with the inputs it
+ * reads next, then the clock advances by one cycle. Nothing waits for real time.
+ */
+
+#ifndef _SOMANET_SIM_H
+#define _SOMANET_SIM_H
+
+#include "ethercat.h"
+#include "somanet_42.h"
+
+/** time constant of the velocity loop */
+#define SIM_VELOCITY_TAU_S   0.01
+/** time constant of the position loop in CSP */
+#define SIM_POSITION_TAU_S   0.005
+/** encoder counts per revolution, velocities are in rpm */
+#define SIM_COUNTS_PER_REV   65536
+/** travel velocity in profile position mode, rpm */
+#define SIM_PP_VELOCITY      300
+
+typedef struct
+{
+   int16    statusword;
+   double   position;
+   /** rpm */
+   double   velocity;
+   /** position demand of CSP and profile position */
+   double   demand;
+   int32    target;
+   /** New set-point of the controlword in the last cycle */
+   boolean  newsetpoint;
+   /** largest |demand - position| in Operation enabled, counts */
+   double   maxerror;
+   uint32   reached;
+   uint32   faults;
+} sim_drivet;
+
+typedef struct
+{
+   int               naxes;
+   /** virtual clock, ns */
+   int64             time;
+   int64             cycletime;
+   uint8             *iomap;
+   in_somanet_42t    **in;
+   out_somanet_42t   **out;
+   sim_drivet        *drive;
+} sim_t;
+
+int sim_setup(sim_t *sim, int naxes, int64 cycletime);
+void sim_free(sim_t *sim);
+void sim_exchange(sim_t *sim);
+void sim_fault(sim_t *sim, int axis);
+
+#endif
@@ -0,0 +1,134 @@
+/** \file
+ * \brief Run the cycle engine of the SOMANET axes offline, faster than real time
+ *
+ * Usage : somanet_simulate [-a|-p|-c] [-n axes] [-t seconds] [-u cycle_us] [-f axis seconds] [-l counts]
+ * Runs the engine of somanet_engine.c, the cycle of CSV_test_SOMANET_v42 with -a
+ * (default), -p or -c, against the drive model of somanet_sim.c instead of the bus. The
+ * clock is virtual: every cycle advances it by cycle_us (default 5000, the cycle of the
+ * example) and the next cycle starts at once, nothing sleeps and no NIC is needed. The
+ * setpoint producer of -c runs every ENGINE_IP_PERIOD_US / 2 of virtual time, the pace
+ * of its thread in the example. -f puts an axis (from 1) into Fault at the given time,
+ * the engine has to reset it. -l sets the following error limit of the engine
+ * (default ENGINE_FOLLOWING_LIMIT), a low one trips the axes. Prints the state of every axis at the end and the
+ * simulated against the wall clock time.
+ *
+ * Build with somanet_sim.c, somanet_engine.c, somanet_axes.c, somanet_pp.c and
+ * somanet_ip.c. Only the SOEM headers are needed for the types, the SOEM library is
+ * not linked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ethercat.h"
+#include "somanet_engine.h"
+#include "somanet_sim.h"
+
+static int64 wall_ns(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+   int i, mode = ENGINE_CSV, naxes = 1, faultaxis = 0, enabled = 0, ok = 1;
+   int32 followinglimit = ENGINE_FOLLOWING_LIMIT;
+   double seconds = 10, faultat = 0;
+   int64 cycletime = 5000000LL, end, faulttime, produce, t0, wall;
+   uint64 cycles = 0;
+   engine_t e;
+   sim_t sim;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-a"))
+         mode = ENGINE_CSV;
+      else if (!strcmp(argv[i], "-p"))
+         mode = ENGINE_PP;
+      else if (!strcmp(argv[i], "-c"))
+         mode = ENGINE_IP;
+      else if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+         naxes = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+         seconds = atof(argv[++i]);
+      else if (!strcmp(argv[i], "-u") && (i + 1 < argc))
+         cycletime = strtoll(argv[++i], NULL, 0) * 1000LL;
+      else if (!strcmp(argv[i], "-f") && (i + 2 < argc))
+      {
+         faultaxis = atoi(argv[++i]);
+         faultat = atof(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-l") && (i + 1 < argc))
+         followinglimit = atoi(argv[++i]);
+      else
+         ok = 0;
+   }
+   if (!ok || (naxes < 1) || (cycletime <= 0) || (faultaxis < 0) || (faultaxis > naxes))
+   {
+      printf("Usage: somanet_simulate [-a|-p|-c] [-n axes] [-t seconds] [-u cycle_us] [-f axis seconds] [-l counts]\n");
+      return 1;
+   }
+   if (!sim_setup(&sim, naxes, cycletime))
+      return 1;
+   /* first exchange puts the inputs in place, like the frame before the engine starts */
+   sim_exchange(&sim);
+   if (!axes_setup(&e.axes, naxes, sim.in, sim.out) || !engine_setup(&e, mode, sim.time))
+   {
+      sim_free(&sim);
+      return 1;
+   }
+   e.followinglimit = followinglimit;
+   end = sim.time + (int64)(seconds * 1e9);
+   faulttime = faultaxis ? sim.time + (int64)(faultat * 1e9) : -1;
+   produce = sim.time;
+
+   t0 = wall_ns();
+   while (sim.time < end)
+   {
+      if ((mode == ENGINE_IP) && (sim.time >= produce))
+      {
+         engine_produce(&e);
+         produce += ENGINE_IP_PERIOD_US / 2 * 1000LL;
+      }
+      enabled = engine_cycle(&e, sim.time);
+      sim_exchange(&sim);
+      if ((faulttime >= 0) && (sim.time >= faulttime))
+      {
+         sim_fault(&sim, faultaxis - 1);
+         faulttime = -1;
+      }
+      cycles++;
+   }
+   wall = wall_ns() - t0;
+
+   printf("%s, %d axes, %llu cycles of %lld us, %d in Operation enabled\n",
+          (mode == ENGINE_PP) ? "profile position" : (mode == ENGINE_IP) ? "cyclic synchronous position" :
+          "cyclic synchronous velocity", naxes, (unsigned long long)cycles,
+          (long long)(cycletime / 1000), enabled);
+   for (i = 0; i < naxes; i++)
+   {
+      printf("Axis %d: statusword 0x%4.4x position %d velocity %d max following error %.0f faults %u",
+             i + 1, (uint16)sim.in[i]->Statusword, sim.in[i]->PositionValue,
+             sim.in[i]->VelocityValue, sim.drive[i].maxerror, sim.drive[i].faults);
+      if (e.trip[i])
+         printf(" tripped 0x%2.2x", e.trip[i]);
+      if (mode == ENGINE_PP)
+         printf(" targets acknowledged %u reached %u waits %u", e.pp.acked[i],
+                sim.drive[i].reached, e.pp.waits[i]);
+      else if (mode == ENGINE_IP)
+         printf(" min level %u underruns %u starved %u", e.ip.minlevel[i], e.ip.underruns[i],
+                e.ip.starved[i]);
+      printf("\n");
+   }
+   printf("Simulated %.3f s in %.3f s wall clock, %.0fx real time, %.1f ns per cycle\n",
+          (double)(cycles * cycletime) * 1e-9, wall * 1e-9,
+          (double)(cycles * cycletime) / (wall ? wall : 1), (double)wall / (cycles ? cycles : 1));
+   engine_free(&e);
+   sim_free(&sim);
+   return 0;
+}
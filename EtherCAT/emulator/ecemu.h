@@ -0,0 +1,248 @@
+/** \file
+ * \brief Emulated line of SOMANET drives, ESC register level
+ *
+ * Every slave has the memory of an ESC (registers and process RAM) and answers the
+ * datagrams of a frame in line order: position, configured, broadcast and logical
+ * addressing, FMMU mapping, SyncManager mailboxes with a CoE SDO server, the SII
+ * EEPROM interface, AL state machine with the SyncManager watchdog and DC receive
+ * and system times. Behind the ESC runs a CiA402 drive with a simple motor model,
+ * process data layout as in SOEM/somanet_42.h.
+ *
+ * Frames are taken from and returned to a raw socket (ecemu_main.c), so SOEM runs
+ * unmodified against the other end of a veth pair.
+ */
+
+#ifndef _ECEMU_H
+#define _ECEMU_H
+
+#include <stdint.h>
+
+#define ECEMU_ETHERTYPE       0x88A4
+#define ECEMU_MAXSLAVES       512
+#define ECEMU_MEMSIZE         0x3000
+#define ECEMU_EEPROMWORDS     512
+#define ECEMU_MBXSIZE         128
+#define ECEMU_MBXQUEUE        4
+/** SyncManager watchdog, OP falls back to SAFE_OP + ERROR without outputs */
+#define ECEMU_WATCHDOG_NS     100000000LL
+/** forwarding delay of one slave, used for the DC receive times */
+#define ECEMU_FWDDELAY_NS     600
+
+/* ESC registers */
+#define ECEMU_REG_TYPE        0x0000
+#define ECEMU_REG_PORTDES     0x0007
+#define ECEMU_REG_ESCSUP      0x0008
+#define ECEMU_REG_STADR       0x0010
+#define ECEMU_REG_ALIAS       0x0012
+#define ECEMU_REG_DLSTAT      0x0110
+#define ECEMU_REG_ALCTL       0x0120
+#define ECEMU_REG_ALSTAT      0x0130
+#define ECEMU_REG_ALSTATCODE  0x0134
+#define ECEMU_REG_PDICTL      0x0140
+#define ECEMU_REG_RXERR       0x0300
+#define ECEMU_REG_FWDRXERR    0x0308
+#define ECEMU_REG_EEPCFG      0x0500
+#define ECEMU_REG_EEPCTL      0x0502
+#define ECEMU_REG_EEPADR      0x0504
+#define ECEMU_REG_EEPDAT      0x0508
+#define ECEMU_REG_FMMU0       0x0600
+#define ECEMU_REG_SM0         0x0800
+#define ECEMU_REG_DCTIME0     0x0900
+#define ECEMU_REG_DCSYSTIME   0x0910
+#define ECEMU_REG_DCSOF       0x0918
+#define ECEMU_REG_DCSYSOFFSET 0x0920
+
+#define ECEMU_MAXFMMU         8
+#define ECEMU_MAXSM           8
+
+/* AL states and status codes */
+#define ECEMU_STATE_INIT      0x01
+#define ECEMU_STATE_PRE_OP    0x02
+#define ECEMU_STATE_BOOT      0x03
+#define ECEMU_STATE_SAFE_OP   0x04
+#define ECEMU_STATE_OP        0x08
+#define ECEMU_STATE_ERROR     0x10
+
+#define ECEMU_AL_INVALIDSTATE    0x0011
+#define ECEMU_AL_SYNCERROR       0x001A
+#define ECEMU_AL_WATCHDOG        0x001B
+#define ECEMU_AL_INVALIDOUTPUTS  0x001D
+#define ECEMU_AL_INVALIDINPUTS   0x001E
+
+/* default SyncManager layout, also written to the SII */
+#define ECEMU_MBXOUT          0x1000
+#define ECEMU_MBXIN           0x1080
+#define ECEMU_PDOUT           0x1100
+#define ECEMU_PDIN            0x1400
+
+#define ECEMU_MAXDATAGRAMS    64
+
+/* EtherCAT commands */
+enum
+{
+   ECEMU_CMD_NOP = 0,
+   ECEMU_CMD_APRD,
+   ECEMU_CMD_APWR,
+   ECEMU_CMD_APRW,
+   ECEMU_CMD_FPRD,
+   ECEMU_CMD_FPWR,
+   ECEMU_CMD_FPRW,
+   ECEMU_CMD_BRD,
+   ECEMU_CMD_BWR,
+   ECEMU_CMD_BRW,
+   ECEMU_CMD_LRD,
+   ECEMU_CMD_LWR,
+   ECEMU_CMD_LRW,
+   ECEMU_CMD_ARMW,
+   ECEMU_CMD_FRMW
+};
+
+/* CiA402 states of the drive */
+#define ECEMU_DRIVE_SWITCH_ON_DISABLED 0
+#define ECEMU_DRIVE_READY_TO_SWITCH_ON 1
+#define ECEMU_DRIVE_SWITCHED_ON        2
+#define ECEMU_DRIVE_OPERATION_ENABLED  3
+#define ECEMU_DRIVE_QUICK_STOP_ACTIVE  4
+#define ECEMU_DRIVE_FAULT              5
+
+/* drive model */
+#define ECEMU_DRIVE_RESOLUTION  65536.0    /* increments per revolution */
+#define ECEMU_DRIVE_TAU         0.01       /* velocity loop time constant in s */
+#define ECEMU_DRIVE_POSTAU      0.005      /* position loop time constant in s */
+#define ECEMU_DRIVE_COAST       3000.0     /* deceleration when disabled in rpm/s */
+#define ECEMU_DRIVE_TORQUEGAIN  5.0        /* rpm/s per per mille torque */
+
+#define ECEMU_OPMODE_CSP  8
+#define ECEMU_OPMODE_CSV  9
+#define ECEMU_OPMODE_CST  10
+
+#define ECEMU_VENDOR          0x000022D2
+#define ECEMU_PRODUCT         0x00000201
+#define ECEMU_REVISION        0x0A000002
+
+/** outputs of a drive, out_somanet_42t */
+typedef struct __attribute__((__packed__))
+{
+   uint16_t Controlword;
+   int8_t   OpMode;
+   int16_t  TargetTorque;
+   int32_t  TargetPosition;
+   int32_t  TargetVelocity;
+   int16_t  TorqueOffset;
+   int32_t  TuningCommand;
+   int8_t   DigitalOutput[4];
+   int32_t  UserMOSI;
+   int32_t  VelocityOffset;
+} ecemu_outputst;
+
+/** inputs of a drive, in_somanet_42t */
+typedef struct __attribute__((__packed__))
+{
+   uint16_t Statusword;
+   int8_t   OpModeDisplay;
+   int32_t  PositionValue;
+   int32_t  VelocityValue;
+   int16_t  TorqueValue;
+   int32_t  SecPositionValue;
+   int32_t  SecVelocityValue;
+   int16_t  AnalogInput[4];
+   int32_t  TuningStatus;
+   int8_t   DigitalInput[4];
+   int32_t  UserMISO;
+   int32_t  Timestamp;
+   int32_t  PositionDemandInternalValue;
+   int32_t  VelocityDemandValue;
+   int16_t  TorqueDemand;
+} ecemu_inputst;
+
+/** CiA402 drive behind the ESC */
+typedef struct
+{
+   uint8_t  state;         /* ECEMU_DRIVE_... */
+   uint16_t lastcontrolword;
+   int8_t   opmode;
+   double   position;      /* increments */
+   double   velocity;      /* rpm */
+   double   torque;        /* per mille of rated torque */
+   int32_t  demandposition;
+   int32_t  demandvelocity;
+   int64_t  lastupdate;
+} ecemu_drivet;
+
+typedef struct
+{
+   uint8_t        mem[ECEMU_MEMSIZE];
+   uint16_t       eeprom[ECEMU_EEPROMWORDS];
+   /** position in the line, 0 based */
+   int            position;
+   /** offset of the local DC clock to CLOCK_MONOTONIC */
+   int64_t        clockoffset;
+   /** last write of the outputs, for the SyncManager watchdog */
+   int64_t        lastoutputs;
+   /** responses waiting for the read mailbox */
+   uint8_t        mbxqueue[ECEMU_MBXQUEUE][ECEMU_MBXSIZE];
+   int            mbxhead;
+   int            mbxcount;
+   ecemu_drivet   drive;
+} ecemu_slavet;
+
+/** datagram of a frame being processed, address and working counter kept apart */
+typedef struct
+{
+   uint8_t  *header;
+   uint8_t  *data;
+   int      length;
+   uint16_t adp;
+   uint16_t wkc;
+} ecemu_datagramt;
+
+struct ecemu_batch;
+
+typedef struct
+{
+   ecemu_slavet   *slave;
+   int            nslaves;
+   /** frames return after this many slaves (link loss behind them) */
+   int            reachable;
+   /** CLOCK_MONOTONIC of the frame being processed */
+   int64_t        now;
+   uint64_t       frames;
+   /** incremented on every write to FMMU or SyncManager registers */
+   uint32_t       layout;
+   /** drive models of the line in structure-of-arrays form, NULL for ecemu_drivet */
+   struct ecemu_batch *batch;
+} ecemu_linet;
+
+/* ecemu_esc.c */
+int ecemu_line_init(ecemu_linet *line, int nslaves);
+void ecemu_line_free(ecemu_linet *line);
+void ecemu_slave_reset(ecemu_slavet *slave);
+int ecemu_frame(ecemu_linet *line, uint8_t *frame, int length, int corruptat);
+int ecemu_parse(uint8_t *frame, int length, ecemu_datagramt *dg);
+void ecemu_datagram(ecemu_linet *line, ecemu_slavet *slave, ecemu_datagramt *dg);
+void ecemu_watchdog(ecemu_linet *line, ecemu_slavet *slave);
+void ecemu_return(uint8_t *frame, const ecemu_datagramt *dg, int ndg);
+int64_t ecemu_wiretime(const ecemu_linet *line, int length);
+void ecemu_set_alerror(ecemu_slavet *slave, uint16_t code);
+uint8_t ecemu_alstate(const ecemu_slavet *slave);
+void ecemu_set_reachable(ecemu_linet *line, int reachable);
+uint16_t ecemu_get16(const uint8_t *p);
+uint32_t ecemu_get32(const uint8_t *p);
+void ecemu_put16(uint8_t *p, uint16_t v);
+void ecemu_put32(uint8_t *p, uint32_t v);
+uint8_t *ecemu_outputs(ecemu_slavet *slave);
+uint8_t *ecemu_inputs(ecemu_slavet *slave);
+
+/* ecemu_sii.c */
+void ecemu_sii_build(uint16_t *eeprom);
+
+/* ecemu_coe.c */
+int ecemu_coe(ecemu_slavet *slave, const uint8_t *request, int length, uint8_t *response);
+
+/* ecemu_drive.c */
+void ecemu_drive_reset(ecemu_drivet *drive);
+uint16_t ecemu_drive_statusword(const ecemu_drivet *drive);
+void ecemu_drive_update(ecemu_drivet *drive, const ecemu_outputst *out, ecemu_inputst *in,
+                        int enabled, int64_t now);
+
+#endif
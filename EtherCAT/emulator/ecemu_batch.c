@@ -0,0 +1,257 @@
+/** \file
+ * \brief CiA402 drive models of a whole line in structure-of-arrays form
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ecemu_batch.h"
+
+#define ECEMU_BATCH_ALIGN 64
+
+/* Controlword commands, in the order ecemu_drive_control() tests them */
+enum
+{
+   ECEMU_CW_DISABLE_VOLTAGE = 0,
+   ECEMU_CW_QUICK_STOP,
+   ECEMU_CW_SHUTDOWN,
+   ECEMU_CW_SWITCH_ON,
+   ECEMU_CW_ENABLE_OPERATION,
+   ECEMU_CW_NONE,
+   ECEMU_CW_FAULT_RESET,
+   ECEMU_CW_COMMANDS
+};
+
+/* next state for each state and command, as ecemu_drive_control() */
+static const uint8_t ecemu_batch_next[6][ECEMU_CW_COMMANDS] =
+{
+   /* switch on disabled */  { 0, 0, 1, 0, 0, 0, 0 },
+   /* ready to switch on */  { 0, 0, 1, 2, 3, 1, 1 },
+   /* switched on */         { 0, 0, 1, 2, 3, 2, 2 },
+   /* operation enabled */   { 0, 4, 1, 2, 3, 3, 3 },
+   /* quick stop active */   { 0, 4, 4, 4, 3, 4, 4 },
+   /* fault */               { 5, 5, 5, 5, 5, 5, 0 }
+};
+
+static const uint16_t ecemu_batch_statusword[6] = { 0x0240, 0x0231, 0x0233, 0x0237, 0x0217, 0x0218 };
+
+static void *ecemu_batch_alloc(int n, size_t size)
+{
+   size_t bytes = ((n * size + ECEMU_BATCH_ALIGN - 1) / ECEMU_BATCH_ALIGN) * ECEMU_BATCH_ALIGN;
+   void *p = aligned_alloc(ECEMU_BATCH_ALIGN, bytes);
+
+   if (p)
+      memset(p, 0, bytes);
+   return p;
+}
+
+/** Allocate the drives of a line, all in Switch on disabled and at standstill.
+ *
+ * @return 1 on success
+ */
+int ecemu_batch_init(ecemu_batcht *batch, int nslaves)
+{
+   memset(batch, 0, sizeof(*batch));
+   batch->nslaves = nslaves;
+   batch->state = ecemu_batch_alloc(nslaves, sizeof(uint8_t));
+   batch->lastcontrolword = ecemu_batch_alloc(nslaves, sizeof(uint16_t));
+   batch->opmode = ecemu_batch_alloc(nslaves, sizeof(int8_t));
+   batch->csv = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->csp = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->cst = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->target = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->position = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->velocity = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->torque = ecemu_batch_alloc(nslaves, sizeof(double));
+   batch->demandposition = ecemu_batch_alloc(nslaves, sizeof(int32_t));
+   batch->demandvelocity = ecemu_batch_alloc(nslaves, sizeof(int32_t));
+   if (!batch->state || !batch->lastcontrolword || !batch->opmode || !batch->csv || !batch->csp || !batch->cst ||
+       !batch->target ||
+       !batch->position || !batch->velocity || !batch->torque || !batch->demandposition || !batch->demandvelocity)
+   {
+      ecemu_batch_free(batch);
+      return 0;
+   }
+   return 1;
+}
+
+void ecemu_batch_free(ecemu_batcht *batch)
+{
+   free(batch->state);
+   free(batch->lastcontrolword);
+   free(batch->opmode);
+   free(batch->csv);
+   free(batch->csp);
+   free(batch->cst);
+   free(batch->target);
+   free(batch->position);
+   free(batch->velocity);
+   free(batch->torque);
+   free(batch->demandposition);
+   free(batch->demandvelocity);
+   memset(batch, 0, sizeof(*batch));
+}
+
+/** Drive of one slave back to power-on, with ecemu_slave_reset(). */
+void ecemu_batch_reset(ecemu_batcht *batch, int n)
+{
+   batch->state[n] = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+   batch->lastcontrolword[n] = 0;
+   batch->opmode[n] = 0;
+   batch->csv[n] = batch->csp[n] = batch->cst[n] = batch->target[n] = 0.0;
+   batch->position[n] = batch->velocity[n] = batch->torque[n] = 0.0;
+   batch->demandposition[n] = batch->demandvelocity[n] = 0;
+}
+
+/** Start a frame: time step and the factors of the motor model, once for all drives.
+ *
+ * @return 1 if the drives are due to be advanced with ecemu_batch_update()
+ */
+int ecemu_batch_step(ecemu_batcht *batch, int64_t now)
+{
+   double dt = batch->lastupdate ? (now - batch->lastupdate) * 1e-9 : 0.0;
+
+   if (batch->lastupdate && (now - batch->lastupdate < ECEMU_BATCH_MINSTEP))
+      return 0;
+   batch->lastupdate = now;
+   batch->dt = (dt > 0.1) ? 0.1 : dt;
+   batch->velgain = 1.0 - exp(-batch->dt / ECEMU_DRIVE_TAU);
+   batch->posgain = 1.0 - exp(-batch->dt / ECEMU_DRIVE_POSTAU);
+   batch->coast = ECEMU_DRIVE_COAST * batch->dt;
+   return 1;
+}
+
+static int ecemu_batch_command(uint16_t cw)
+{
+   return !(cw & 0x02) ? ECEMU_CW_DISABLE_VOLTAGE :
+          ((cw & 0x06) == 0x02) ? ECEMU_CW_QUICK_STOP :
+          ((cw & 0x87) == 0x06) ? ECEMU_CW_SHUTDOWN :
+          ((cw & 0x8F) == 0x07) ? ECEMU_CW_SWITCH_ON :
+          ((cw & 0x8F) == 0x0F) ? ECEMU_CW_ENABLE_OPERATION : ECEMU_CW_NONE;
+}
+
+/* device control and the commands of this frame, from the outputs in ESC memory */
+static void ecemu_batch_gather(ecemu_batcht *batch, ecemu_linet *line, int first, int last)
+{
+   const ecemu_outputst *out;
+   uint16_t cw;
+   uint8_t state;
+   int n, cmd;
+
+   for (n = first; n < last; n++)
+   {
+      state = batch->state[n];
+      if ((ecemu_alstate(&line->slave[n]) & 0x1F) != ECEMU_STATE_OP)
+      {
+         /* outputs not valid: disable like on a communication loss */
+         batch->state[n] = (state == ECEMU_DRIVE_FAULT) ? state : ECEMU_DRIVE_SWITCH_ON_DISABLED;
+         batch->csv[n] = batch->csp[n] = batch->cst[n] = 0.0;
+         continue;
+      }
+      out = (const ecemu_outputst *)ecemu_outputs(&line->slave[n]);
+      cw = out->Controlword;
+      cmd = (state == ECEMU_DRIVE_FAULT) ?
+            (((cw & 0x80) && !(batch->lastcontrolword[n] & 0x80)) ? ECEMU_CW_FAULT_RESET : ECEMU_CW_NONE) :
+            ecemu_batch_command(cw);
+      state = ecemu_batch_next[state][cmd];
+      batch->state[n] = state;
+      batch->lastcontrolword[n] = cw;
+      batch->opmode[n] = out->OpMode;
+      batch->csv[n] = batch->csp[n] = batch->cst[n] = 0.0;
+      if (state != ECEMU_DRIVE_OPERATION_ENABLED)
+         continue;
+      switch (out->OpMode)
+      {
+         case ECEMU_OPMODE_CSV:
+            batch->demandvelocity[n] = out->TargetVelocity + out->VelocityOffset;
+            batch->target[n] = batch->demandvelocity[n];
+            batch->csv[n] = 1.0;
+            break;
+         case ECEMU_OPMODE_CSP:
+            batch->demandposition[n] = out->TargetPosition;
+            batch->target[n] = batch->demandposition[n];
+            batch->csp[n] = 1.0;
+            break;
+         case ECEMU_OPMODE_CST:
+            batch->target[n] = out->TargetTorque + out->TorqueOffset;
+            batch->cst[n] = 1.0;
+            break;
+         default:
+            break;
+      }
+   }
+}
+
+/* first order motor of all drives: every mode is computed and blended with the
+   weights, without branches so that the loop vectorizes. The arrays are restrict
+   parameters, GCC does not take restrict from locals and would give up on the
+   number of run-time alias checks. */
+static void ecemu_batch_motor(const ecemu_batcht *batch, const double *restrict csv, const double *restrict csp,
+                              const double *restrict cst, const double *restrict target, double *restrict position,
+                              double *restrict velocity, double *restrict torque, int first, int last)
+{
+   const double dt = batch->dt, velgain = batch->velgain, posgain = batch->posgain, coast = batch->coast;
+   const double inc = ECEMU_DRIVE_RESOLUTION / 60.0 * dt, rpm = 60.0 / ECEMU_DRIVE_RESOLUTION / dt;
+   const double accel = ECEMU_DRIVE_TORQUEGAIN * dt, trq = 1.0 / (dt * ECEMU_DRIVE_TORQUEGAIN);
+   double v, p, vcsv, pcsp, vcst, vcoast, vn, slow;
+   int n;
+
+   for (n = first; n < last; n++)
+   {
+      v = velocity[n];
+      p = position[n];
+      vcsv = v + (target[n] - v) * velgain;
+      pcsp = p + (target[n] - p) * posgain;
+      vcst = v + target[n] * accel;
+      slow = fabs(v) - coast;
+      vcoast = copysign(slow > 0.0 ? slow : 0.0, v);
+      vn = csv[n] * vcsv + csp[n] * (pcsp - p) * rpm + cst[n] * vcst + (1.0 - csv[n] - csp[n] - cst[n]) * vcoast;
+      torque[n] = (vn - v) * trq;
+      velocity[n] = vn;
+      position[n] = csp[n] * pcsp + (1.0 - csp[n]) * (p + vn * inc);
+   }
+}
+
+/* inputs of this frame into ESC memory */
+static void ecemu_batch_scatter(ecemu_batcht *batch, ecemu_linet *line, int first, int last)
+{
+   ecemu_inputst *in;
+   int n;
+
+   for (n = first; n < last; n++)
+   {
+      if ((batch->csv[n] + batch->csp[n] + batch->cst[n]) == 0.0)
+         batch->demandvelocity[n] = 0;
+      if ((batch->state[n] == ECEMU_DRIVE_QUICK_STOP_ACTIVE) && (batch->velocity[n] == 0.0))
+         batch->state[n] = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+      if ((ecemu_alstate(&line->slave[n]) & 0x0F) < ECEMU_STATE_SAFE_OP)
+         continue;
+      in = (ecemu_inputst *)ecemu_inputs(&line->slave[n]);
+      in->Statusword = ecemu_batch_statusword[batch->state[n]];
+      in->OpModeDisplay = batch->opmode[n];
+      in->PositionValue = (int32_t)llround(batch->position[n]);
+      in->VelocityValue = (int32_t)lround(batch->velocity[n]);
+      in->TorqueValue = (int16_t)lround(fmax(-32768.0, fmin(32767.0, batch->torque[n])));
+      in->PositionDemandInternalValue = batch->demandposition[n];
+      in->VelocityDemandValue = batch->demandvelocity[n];
+      in->TorqueDemand = in->TorqueValue;
+      in->Timestamp = (int32_t)(line->now / 1000);
+   }
+}
+
+/** Advance the drives first..last-1 by the step of ecemu_batch_step() and publish their inputs.
+ *
+ * @param[in,out] batch = drives of the line
+ * @param[in,out] line  = line, outputs are read from and inputs written to ESC memory
+ * @param[in]     first = first slave, 0 based
+ * @param[in]     last  = slave after the range
+ */
+void ecemu_batch_update(ecemu_batcht *batch, ecemu_linet *line, int first, int last)
+{
+   ecemu_batch_gather(batch, line, first, last);
+   if (batch->dt > 0.0)
+      ecemu_batch_motor(batch, batch->csv, batch->csp, batch->cst, batch->target, batch->position,
+                        batch->velocity, batch->torque, first, last);
+   ecemu_batch_scatter(batch, line, first, last);
+}
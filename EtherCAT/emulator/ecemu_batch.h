@@ -0,0 +1,56 @@
+/** \file
+ * \brief CiA402 drive models of a whole line in structure-of-arrays form
+ *
+ * Same behaviour as ecemu_drive.c, but all drives advance together once per frame
+ * with one time step: the exponentials are evaluated once per frame instead of once
+ * per drive, the device control is a table lookup and the motor model is arithmetic
+ * over plain arrays that the compiler vectorizes. ecemu_batch_step() is called once
+ * per frame, then ecemu_batch_update() for disjoint ranges of slaves, possibly from
+ * several threads.
+ *
+ * The drives advance at most every ECEMU_BATCH_MINSTEP: the frames a master sends
+ * back to back in one cycle are handled by one step, like drives that take their
+ * outputs and latch their inputs at the sync event.
+ */
+
+#ifndef _ECEMU_BATCH_H
+#define _ECEMU_BATCH_H
+
+#include <stdint.h>
+
+#include "ecemu.h"
+
+#define ECEMU_BATCH_MINSTEP 50000
+
+typedef struct ecemu_batch
+{
+   int      nslaves;
+   /* time step of the current frame and the factors derived from it */
+   int64_t  lastupdate;
+   double   dt;
+   double   velgain;
+   double   posgain;
+   double   coast;
+   /* device control */
+   uint8_t  *state;
+   uint16_t *lastcontrolword;
+   int8_t   *opmode;
+   /* motor model, the mode weights are 1.0 for the active mode, all 0.0 to coast */
+   double   *csv;
+   double   *csp;
+   double   *cst;
+   double   *target;
+   double   *position;
+   double   *velocity;
+   double   *torque;
+   int32_t  *demandposition;
+   int32_t  *demandvelocity;
+} ecemu_batcht;
+
+int ecemu_batch_init(ecemu_batcht *batch, int nslaves);
+void ecemu_batch_free(ecemu_batcht *batch);
+void ecemu_batch_reset(ecemu_batcht *batch, int n);
+int ecemu_batch_step(ecemu_batcht *batch, int64_t now);
+void ecemu_batch_update(ecemu_batcht *batch, ecemu_linet *line, int first, int last);
+
+#endif
@@ -0,0 +1,245 @@
+/** \file
+ * \brief CoE SDO server of an emulated SOMANET drive
+ *
+ * Object dictionary with identity, SyncManager communication types, PDO assignment
+ * and the fixed PDO mapping of SOEM/somanet_42.h. The mapped objects themselves are
+ * read from and written to the process data in ESC memory, so SDO and PDO access
+ * see the same values. All objects fit expedited upload and download.
+ */
+
+#include <string.h>
+#include <stddef.h>
+
+#include "ecemu.h"
+
+#define ECEMU_MBXHEADERSIZE   6
+#define ECEMU_MBXT_COE        0x03
+#define ECEMU_COES_SDOREQ     0x02
+#define ECEMU_COES_SDORES     0x03
+
+#define ECEMU_SDO_ABORT       0x80
+#define ECEMU_ABORT_UNSUPPORTED   0x06010000
+#define ECEMU_ABORT_READONLY      0x06010002
+#define ECEMU_ABORT_NOOBJECT      0x06020000
+#define ECEMU_ABORT_LENGTH        0x06070010
+#define ECEMU_ABORT_NOSUBINDEX    0x06090011
+
+#define ECEMU_RO  0
+#define ECEMU_RW  1
+
+typedef struct
+{
+   uint16_t index;
+   uint8_t  subindex;
+   uint8_t  size;
+   uint8_t  access;
+   /** 0, 'O' for outputs or 'I' for inputs, then value is the offset */
+   char     pdo;
+   uint32_t value;
+} ecemu_objectt;
+
+#define ECEMU_MAP(index, sub, bits)  (((uint32_t)(index) << 16) | ((sub) << 8) | (bits))
+#define ECEMU_OUT(index, sub, field) \
+   { index, sub, sizeof(((ecemu_outputst *)0)->field), ECEMU_RW, 'O', offsetof(ecemu_outputst, field) }
+#define ECEMU_IN(index, sub, field) \
+   { index, sub, sizeof(((ecemu_inputst *)0)->field), ECEMU_RO, 'I', offsetof(ecemu_inputst, field) }
+
+static const ecemu_objectt ecemu_od[] =
+{
+   { 0x1000, 0, 4, ECEMU_RO, 0, 0x00020192 },
+   { 0x1018, 0, 1, ECEMU_RO, 0, 4 },
+   { 0x1018, 1, 4, ECEMU_RO, 0, ECEMU_VENDOR },
+   { 0x1018, 2, 4, ECEMU_RO, 0, ECEMU_PRODUCT },
+   { 0x1018, 3, 4, ECEMU_RO, 0, ECEMU_REVISION },
+   { 0x1018, 4, 4, ECEMU_RO, 0, 0 },
+   { 0x1600, 0, 1, ECEMU_RO, 0, 13 },
+   { 0x1600, 1, 4, ECEMU_RO, 0, ECEMU_MAP(0x6040, 0, 16) },
+   { 0x1600, 2, 4, ECEMU_RO, 0, ECEMU_MAP(0x6060, 0, 8) },
+   { 0x1600, 3, 4, ECEMU_RO, 0, ECEMU_MAP(0x6071, 0, 16) },
+   { 0x1600, 4, 4, ECEMU_RO, 0, ECEMU_MAP(0x607A, 0, 32) },
+   { 0x1600, 5, 4, ECEMU_RO, 0, ECEMU_MAP(0x60FF, 0, 32) },
+   { 0x1600, 6, 4, ECEMU_RO, 0, ECEMU_MAP(0x60B2, 0, 16) },
+   { 0x1600, 7, 4, ECEMU_RO, 0, ECEMU_MAP(0x2701, 0, 32) },
+   { 0x1600, 8, 4, ECEMU_RO, 0, ECEMU_MAP(0x2601, 0, 8) },
+   { 0x1600, 9, 4, ECEMU_RO, 0, ECEMU_MAP(0x2602, 0, 8) },
+   { 0x1600, 10, 4, ECEMU_RO, 0, ECEMU_MAP(0x2603, 0, 8) },
+   { 0x1600, 11, 4, ECEMU_RO, 0, ECEMU_MAP(0x2604, 0, 8) },
+   { 0x1600, 12, 4, ECEMU_RO, 0, ECEMU_MAP(0x2703, 0, 32) },
+   { 0x1600, 13, 4, ECEMU_RO, 0, ECEMU_MAP(0x60B1, 0, 32) },
+   { 0x1A00, 0, 1, ECEMU_RO, 0, 21 },
+   { 0x1A00, 1, 4, ECEMU_RO, 0, ECEMU_MAP(0x6041, 0, 16) },
+   { 0x1A00, 2, 4, ECEMU_RO, 0, ECEMU_MAP(0x6061, 0, 8) },
+   { 0x1A00, 3, 4, ECEMU_RO, 0, ECEMU_MAP(0x6064, 0, 32) },
+   { 0x1A00, 4, 4, ECEMU_RO, 0, ECEMU_MAP(0x606C, 0, 32) },
+   { 0x1A00, 5, 4, ECEMU_RO, 0, ECEMU_MAP(0x6077, 0, 16) },
+   { 0x1A00, 6, 4, ECEMU_RO, 0, ECEMU_MAP(0x230A, 0, 32) },
+   { 0x1A00, 7, 4, ECEMU_RO, 0, ECEMU_MAP(0x230B, 0, 32) },
+   { 0x1A00, 8, 4, ECEMU_RO, 0, ECEMU_MAP(0x2401, 0, 16) },
+   { 0x1A00, 9, 4, ECEMU_RO, 0, ECEMU_MAP(0x2402, 0, 16) },
+   { 0x1A00, 10, 4, ECEMU_RO, 0, ECEMU_MAP(0x2403, 0, 16) },
+   { 0x1A00, 11, 4, ECEMU_RO, 0, ECEMU_MAP(0x2404, 0, 16) },
+   { 0x1A00, 12, 4, ECEMU_RO, 0, ECEMU_MAP(0x2702, 0, 32) },
+   { 0x1A00, 13, 4, ECEMU_RO, 0, ECEMU_MAP(0x2501, 0, 8) },
+   { 0x1A00, 14, 4, ECEMU_RO, 0, ECEMU_MAP(0x2502, 0, 8) },
+   { 0x1A00, 15, 4, ECEMU_RO, 0, ECEMU_MAP(0x2503, 0, 8) },
+   { 0x1A00, 16, 4, ECEMU_RO, 0, ECEMU_MAP(0x2504, 0, 8) },
+   { 0x1A00, 17, 4, ECEMU_RO, 0, ECEMU_MAP(0x2704, 0, 32) },
+   { 0x1A00, 18, 4, ECEMU_RO, 0, ECEMU_MAP(0x20F0, 0, 32) },
+   { 0x1A00, 19, 4, ECEMU_RO, 0, ECEMU_MAP(0x60FC, 0, 32) },
+   { 0x1A00, 20, 4, ECEMU_RO, 0, ECEMU_MAP(0x606B, 0, 32) },
+   { 0x1A00, 21, 4, ECEMU_RO, 0, ECEMU_MAP(0x6074, 0, 16) },
+   { 0x1C00, 0, 1, ECEMU_RO, 0, 4 },
+   { 0x1C00, 1, 1, ECEMU_RO, 0, 1 },
+   { 0x1C00, 2, 1, ECEMU_RO, 0, 2 },
+   { 0x1C00, 3, 1, ECEMU_RO, 0, 3 },
+   { 0x1C00, 4, 1, ECEMU_RO, 0, 4 },
+   { 0x1C12, 0, 1, ECEMU_RO, 0, 1 },
+   { 0x1C12, 1, 2, ECEMU_RO, 0, 0x1600 },
+   { 0x1C13, 0, 1, ECEMU_RO, 0, 1 },
+   { 0x1C13, 1, 2, ECEMU_RO, 0, 0x1A00 },
+   ECEMU_OUT(0x6040, 0, Controlword),
+   ECEMU_OUT(0x6060, 0, OpMode),
+   ECEMU_OUT(0x6071, 0, TargetTorque),
+   ECEMU_OUT(0x607A, 0, TargetPosition),
+   ECEMU_OUT(0x60FF, 0, TargetVelocity),
+   ECEMU_OUT(0x60B2, 0, TorqueOffset),
+   ECEMU_OUT(0x2701, 0, TuningCommand),
+   ECEMU_OUT(0x2601, 0, DigitalOutput[0]),
+   ECEMU_OUT(0x2602, 0, DigitalOutput[1]),
+   ECEMU_OUT(0x2603, 0, DigitalOutput[2]),
+   ECEMU_OUT(0x2604, 0, DigitalOutput[3]),
+   ECEMU_OUT(0x2703, 0, UserMOSI),
+   ECEMU_OUT(0x60B1, 0, VelocityOffset),
+   ECEMU_IN(0x6041, 0, Statusword),
+   ECEMU_IN(0x6061, 0, OpModeDisplay),
+   ECEMU_IN(0x6064, 0, PositionValue),
+   ECEMU_IN(0x606C, 0, VelocityValue),
+   ECEMU_IN(0x6077, 0, TorqueValue),
+   ECEMU_IN(0x230A, 0, SecPositionValue),
+   ECEMU_IN(0x230B, 0, SecVelocityValue),
+   ECEMU_IN(0x2401, 0, AnalogInput[0]),
+   ECEMU_IN(0x2402, 0, AnalogInput[1]),
+   ECEMU_IN(0x2403, 0, AnalogInput[2]),
+   ECEMU_IN(0x2404, 0, AnalogInput[3]),
+   ECEMU_IN(0x2702, 0, TuningStatus),
+   ECEMU_IN(0x2501, 0, DigitalInput[0]),
+   ECEMU_IN(0x2502, 0, DigitalInput[1]),
+   ECEMU_IN(0x2503, 0, DigitalInput[2]),
+   ECEMU_IN(0x2504, 0, DigitalInput[3]),
+   ECEMU_IN(0x2704, 0, UserMISO),
+   ECEMU_IN(0x20F0, 0, Timestamp),
+   ECEMU_IN(0x60FC, 0, PositionDemandInternalValue),
+   ECEMU_IN(0x606B, 0, VelocityDemandValue),
+   ECEMU_IN(0x6074, 0, TorqueDemand),
+};
+
+#define ECEMU_NOBJECTS (sizeof(ecemu_od) / sizeof(ecemu_od[0]))
+
+static const ecemu_objectt *ecemu_od_find(uint16_t index, uint8_t subindex, uint32_t *abort)
+{
+   const ecemu_objectt *o = NULL;
+   unsigned i;
+
+   *abort = ECEMU_ABORT_NOOBJECT;
+   for (i = 0; i < ECEMU_NOBJECTS; i++)
+   {
+      if (ecemu_od[i].index != index)
+         continue;
+      *abort = ECEMU_ABORT_NOSUBINDEX;
+      if (ecemu_od[i].subindex == subindex)
+      {
+         o = &ecemu_od[i];
+         break;
+      }
+   }
+   return o;
+}
+
+static uint8_t *ecemu_od_pdo(ecemu_slavet *slave, const ecemu_objectt *o)
+{
+   return ((o->pdo == 'O') ? ecemu_outputs(slave) : ecemu_inputs(slave)) + o->value;
+}
+
+/* expedited response or abort, 4 data bytes */
+static int ecemu_sdo_response(uint8_t *response, uint16_t index, uint8_t subindex, uint8_t command,
+                              const uint8_t *data)
+{
+   uint8_t *coe = response + ECEMU_MBXHEADERSIZE;
+   int length = 2 + 8;
+
+   memset(response, 0, ECEMU_MBXSIZE);
+   ecemu_put16(response, (uint16_t)length);
+   response[5] = ECEMU_MBXT_COE;
+   ecemu_put16(coe, ECEMU_COES_SDORES << 12);
+   coe[2] = command;
+   ecemu_put16(coe + 3, index);
+   coe[5] = subindex;
+   memcpy(coe + 6, data, 4);
+   return ECEMU_MBXHEADERSIZE + length;
+}
+
+static int ecemu_sdo_abort(uint8_t *response, uint16_t index, uint8_t subindex, uint32_t code)
+{
+   uint8_t data[4];
+
+   ecemu_put32(data, code);
+   return ecemu_sdo_response(response, index, subindex, ECEMU_SDO_ABORT, data);
+}
+
+/** Answer one mailbox request.
+ *
+ * @param[in]  slave    = slave, for the process data mapped objects
+ * @param[in]  request  = content of the write mailbox
+ * @param[in]  length   = size of the write mailbox
+ * @param[out] response = ECEMU_MBXSIZE bytes for the read mailbox
+ * @return 1 if there is a response
+ */
+int ecemu_coe(ecemu_slavet *slave, const uint8_t *request, int length, uint8_t *response)
+{
+   const uint8_t *coe = request + ECEMU_MBXHEADERSIZE;
+   const ecemu_objectt *o;
+   uint8_t data[8], command;
+   uint16_t index;
+   uint8_t subindex;
+   uint32_t abort;
+   int size;
+
+   if ((length < ECEMU_MBXHEADERSIZE + 10) || ((request[5] & 0x0F) != ECEMU_MBXT_COE) ||
+       ((ecemu_get16(coe) >> 12) != ECEMU_COES_SDOREQ))
+      return 0;
+   command = coe[2];
+   index = ecemu_get16(coe + 3);
+   subindex = coe[5];
+   /* complete access is not advertised in the SII */
+   if (command & 0x10)
+      return ecemu_sdo_abort(response, index, subindex, ECEMU_ABORT_UNSUPPORTED) > 0;
+   o = ecemu_od_find(index, subindex, &abort);
+   if (!o)
+      return ecemu_sdo_abort(response, index, subindex, abort) > 0;
+
+   switch (command >> 5)
+   {
+      case 2:
+         /* upload */
+         memset(data, 0, sizeof(data));
+         if (o->pdo)
+            memcpy(data, ecemu_od_pdo(slave, o), o->size);
+         else
+            ecemu_put32(data, o->value);
+         return ecemu_sdo_response(response, index, subindex, 0x43 | ((4 - o->size) << 2), data) > 0;
+      case 1:
+         /* expedited download */
+         if (!(command & 0x02))
+            return ecemu_sdo_abort(response, index, subindex, ECEMU_ABORT_UNSUPPORTED) > 0;
+         size = (command & 0x01) ? 4 - ((command >> 2) & 0x03) : o->size;
+         if (size != o->size)
+            return ecemu_sdo_abort(response, index, subindex, ECEMU_ABORT_LENGTH) > 0;
+         if ((o->access != ECEMU_RW) || !o->pdo)
+            return ecemu_sdo_abort(response, index, subindex, ECEMU_ABORT_READONLY) > 0;
+         memcpy(ecemu_od_pdo(slave, o), coe + 6, o->size);
+         memset(data, 0, sizeof(data));
+         return ecemu_sdo_response(response, index, subindex, 0x60, data) > 0;
+      default:
+         return ecemu_sdo_abort(response, index, subindex, ECEMU_ABORT_UNSUPPORTED) > 0;
+   }
+}
@@ -0,0 +1,136 @@
+/** \file
+ * \brief CiA402 drive model behind an emulated ESC
+ *
+ * Device control state machine driven by the Controlword and a first order motor:
+ * CSV follows TargetVelocity + VelocityOffset, CSP follows TargetPosition, CST
+ * accelerates with TargetTorque + TorqueOffset. Without OP the drive disables like
+ * on a communication loss and the motor coasts to standstill.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "ecemu.h"
+
+void ecemu_drive_reset(ecemu_drivet *drive)
+{
+   memset(drive, 0, sizeof(*drive));
+   drive->state = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+}
+
+uint16_t ecemu_drive_statusword(const ecemu_drivet *drive)
+{
+   static const uint16_t pattern[] = { 0x0040, 0x0021, 0x0023, 0x0027, 0x0007, 0x0008 };
+   uint16_t sw = pattern[drive->state] | 0x0200;
+
+   /* voltage enabled once the drive left Switch on disabled */
+   if (drive->state != ECEMU_DRIVE_SWITCH_ON_DISABLED)
+      sw |= 0x0010;
+   return sw;
+}
+
+static void ecemu_drive_control(ecemu_drivet *drive, uint16_t cw)
+{
+   uint8_t state = drive->state;
+
+   if (state == ECEMU_DRIVE_FAULT)
+   {
+      if ((cw & 0x80) && !(drive->lastcontrolword & 0x80))
+         state = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+   }
+   else if (!(cw & 0x02))
+      state = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+   else if ((cw & 0x06) == 0x02)
+      state = (state == ECEMU_DRIVE_OPERATION_ENABLED) ? ECEMU_DRIVE_QUICK_STOP_ACTIVE :
+              (state == ECEMU_DRIVE_QUICK_STOP_ACTIVE) ? state : ECEMU_DRIVE_SWITCH_ON_DISABLED;
+   else if ((cw & 0x87) == 0x06)
+   {
+      if (state != ECEMU_DRIVE_QUICK_STOP_ACTIVE)
+         state = ECEMU_DRIVE_READY_TO_SWITCH_ON;
+   }
+   else if ((cw & 0x8F) == 0x07)
+   {
+      if ((state == ECEMU_DRIVE_READY_TO_SWITCH_ON) || (state == ECEMU_DRIVE_OPERATION_ENABLED))
+         state = ECEMU_DRIVE_SWITCHED_ON;
+   }
+   else if ((cw & 0x8F) == 0x0F)
+   {
+      if ((state == ECEMU_DRIVE_READY_TO_SWITCH_ON) || (state == ECEMU_DRIVE_SWITCHED_ON) ||
+          (state == ECEMU_DRIVE_QUICK_STOP_ACTIVE))
+         state = ECEMU_DRIVE_OPERATION_ENABLED;
+   }
+   drive->state = state;
+   drive->lastcontrolword = cw;
+}
+
+/** Advance the drive to now and publish its inputs.
+ *
+ * @param[in,out] drive   = drive
+ * @param[in]     out     = outputs from the master
+ * @param[out]    in      = inputs for the master
+ * @param[in]     enabled = ESC in OP, outputs are valid
+ * @param[in]     now     = CLOCK_MONOTONIC in ns
+ */
+void ecemu_drive_update(ecemu_drivet *drive, const ecemu_outputst *out, ecemu_inputst *in,
+                        int enabled, int64_t now)
+{
+   double dt = drive->lastupdate ? (now - drive->lastupdate) * 1e-9 : 0.0;
+   double v0 = drive->velocity, target, step;
+
+   if (dt > 0.1)
+      dt = 0.1;
+   drive->lastupdate = now;
+   if (enabled)
+   {
+      ecemu_drive_control(drive, out->Controlword);
+      drive->opmode = out->OpMode;
+   }
+   else if (drive->state != ECEMU_DRIVE_FAULT)
+      drive->state = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+
+   if ((drive->state == ECEMU_DRIVE_OPERATION_ENABLED) && (dt > 0.0))
+   {
+      switch (drive->opmode)
+      {
+         case ECEMU_OPMODE_CSV:
+            drive->demandvelocity = out->TargetVelocity + out->VelocityOffset;
+            drive->velocity += (drive->demandvelocity - drive->velocity) * (1.0 - exp(-dt / ECEMU_DRIVE_TAU));
+            drive->position += drive->velocity / 60.0 * ECEMU_DRIVE_RESOLUTION * dt;
+            break;
+         case ECEMU_OPMODE_CSP:
+            drive->demandposition = out->TargetPosition;
+            step = (drive->demandposition - drive->position) * (1.0 - exp(-dt / ECEMU_DRIVE_POSTAU));
+            drive->position += step;
+            drive->velocity = step / dt / ECEMU_DRIVE_RESOLUTION * 60.0;
+            break;
+         case ECEMU_OPMODE_CST:
+            drive->velocity += (out->TargetTorque + out->TorqueOffset) * ECEMU_DRIVE_TORQUEGAIN * dt;
+            drive->position += drive->velocity / 60.0 * ECEMU_DRIVE_RESOLUTION * dt;
+            break;
+         default:
+            break;
+      }
+   }
+   else if (dt > 0.0)
+   {
+      /* disabled or quick stop: decelerate to standstill */
+      step = ECEMU_DRIVE_COAST * dt;
+      target = (fabs(drive->velocity) <= step) ? 0.0 : drive->velocity - copysign(step, drive->velocity);
+      drive->velocity = target;
+      drive->position += drive->velocity / 60.0 * ECEMU_DRIVE_RESOLUTION * dt;
+      drive->demandvelocity = 0;
+   }
+   drive->torque = (dt > 0.0) ? (drive->velocity - v0) / dt / ECEMU_DRIVE_TORQUEGAIN : 0.0;
+   if (drive->state == ECEMU_DRIVE_QUICK_STOP_ACTIVE && drive->velocity == 0.0)
+      drive->state = ECEMU_DRIVE_SWITCH_ON_DISABLED;
+
+   in->Statusword = ecemu_drive_statusword(drive);
+   in->OpModeDisplay = drive->opmode;
+   in->PositionValue = (int32_t)llround(drive->position);
+   in->VelocityValue = (int32_t)lround(drive->velocity);
+   in->TorqueValue = (int16_t)lround(fmax(-32768.0, fmin(32767.0, drive->torque)));
+   in->PositionDemandInternalValue = drive->demandposition;
+   in->VelocityDemandValue = drive->demandvelocity;
+   in->TorqueDemand = in->TorqueValue;
+   in->Timestamp = (int32_t)(now / 1000);
+}
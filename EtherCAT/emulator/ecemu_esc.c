@@ -0,0 +1,638 @@
+/** \file
+ * \brief Emulated line of SOMANET drives, ESC register level
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecemu.h"
+#include "ecemu_batch.h"
+
+#define ECEMU_ETHHEADERSIZE   14
+#define ECEMU_DGHEADERSIZE    10
+
+uint16_t ecemu_get16(const uint8_t *p)
+{
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t ecemu_get32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t ecemu_get64(const uint8_t *p)
+{
+   return (uint64_t)ecemu_get32(p) | ((uint64_t)ecemu_get32(p + 4) << 32);
+}
+
+void ecemu_put16(uint8_t *p, uint16_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+}
+
+void ecemu_put32(uint8_t *p, uint32_t v)
+{
+   ecemu_put16(p, (uint16_t)v);
+   ecemu_put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void ecemu_put64(uint8_t *p, uint64_t v)
+{
+   ecemu_put32(p, (uint32_t)v);
+   ecemu_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static int ecemu_overlaps(uint32_t a, int alen, uint32_t b, int blen)
+{
+   return (a < b + blen) && (b < a + alen);
+}
+
+static uint8_t *ecemu_sm(ecemu_slavet *s, int n)
+{
+   return &s->mem[ECEMU_REG_SM0 + 8 * n];
+}
+
+static int ecemu_sm_enabled(ecemu_slavet *s, int n)
+{
+   uint8_t *sm = ecemu_sm(s, n);
+
+   return (sm[6] & 0x01) && (ecemu_get16(sm + 2) > 0) &&
+          (ecemu_get16(sm) + ecemu_get16(sm + 2) <= ECEMU_MEMSIZE);
+}
+
+/** Process data of a slave, as placed by the master through SM2/SM3. */
+uint8_t *ecemu_outputs(ecemu_slavet *s)
+{
+   return &s->mem[ecemu_sm_enabled(s, 2) ? ecemu_get16(ecemu_sm(s, 2)) : ECEMU_PDOUT];
+}
+
+uint8_t *ecemu_inputs(ecemu_slavet *s)
+{
+   return &s->mem[ecemu_sm_enabled(s, 3) ? ecemu_get16(ecemu_sm(s, 3)) : ECEMU_PDIN];
+}
+
+uint8_t ecemu_alstate(const ecemu_slavet *s)
+{
+   return s->mem[ECEMU_REG_ALSTAT];
+}
+
+static void ecemu_set_alstate(ecemu_slavet *s, uint8_t state, uint16_t code)
+{
+   s->mem[ECEMU_REG_ALSTAT] = state;
+   ecemu_put16(&s->mem[ECEMU_REG_ALSTATCODE], code);
+}
+
+/** Local error of the application, OP falls back to SAFE_OP. */
+void ecemu_set_alerror(ecemu_slavet *s, uint16_t code)
+{
+   uint8_t state = ecemu_alstate(s) & 0x0F;
+
+   if (state == ECEMU_STATE_OP)
+      state = ECEMU_STATE_SAFE_OP;
+   ecemu_set_alstate(s, state | ECEMU_STATE_ERROR, code);
+}
+
+/** Power-on state of a slave, station address and configuration are lost. */
+void ecemu_slave_reset(ecemu_slavet *s)
+{
+   uint8_t *m = s->mem;
+
+   memset(m, 0, sizeof(s->mem));
+   ecemu_sii_build(s->eeprom);
+   m[ECEMU_REG_TYPE] = 0x11;
+   m[0x0001] = 0x02;
+   m[0x0004] = ECEMU_MAXFMMU;
+   m[0x0005] = ECEMU_MAXSM;
+   m[0x0006] = (ECEMU_MEMSIZE - 0x1000) / 1024;
+   m[ECEMU_REG_PORTDES] = 0x0F;
+   /* DC supported, 64 bit DC */
+   ecemu_put16(&m[ECEMU_REG_ESCSUP], 0x000C);
+   /* the ESC loads alias and PDI configuration from the SII */
+   ecemu_put16(&m[ECEMU_REG_ALIAS], s->eeprom[4]);
+   ecemu_put16(&m[ECEMU_REG_PDICTL], s->eeprom[0]);
+   ecemu_set_alstate(s, ECEMU_STATE_INIT, 0);
+   s->mbxhead = 0;
+   s->mbxcount = 0;
+   s->lastoutputs = 0;
+   ecemu_drive_reset(&s->drive);
+}
+
+static void ecemu_dlstatus(ecemu_linet *line, ecemu_slavet *s)
+{
+   /* PDI operational, port 0 link and communication, ports 2 and 3 closed */
+   uint16_t dl = 0x0001 | 0x0010 | 0x0200 | 0x1000 | 0x4000;
+
+   if (s->position < line->reachable - 1)
+      dl |= 0x0020 | 0x0800;
+   else
+      dl |= 0x0400;
+   ecemu_put16(&s->mem[ECEMU_REG_DLSTAT], dl);
+}
+
+/** Link loss behind the given number of slaves, frames return from there. */
+void ecemu_set_reachable(ecemu_linet *line, int reachable)
+{
+   int n;
+
+   line->reachable = reachable;
+   for (n = 0; n < line->nslaves; n++)
+      ecemu_dlstatus(line, &line->slave[n]);
+}
+
+/** Allocate a line of slaves in power-on state.
+ *
+ * @return 1 on success
+ */
+int ecemu_line_init(ecemu_linet *line, int nslaves)
+{
+   int n;
+
+   memset(line, 0, sizeof(*line));
+   if ((nslaves < 1) || (nslaves > ECEMU_MAXSLAVES))
+      return 0;
+   line->slave = calloc(nslaves, sizeof(ecemu_slavet));
+   if (!line->slave)
+      return 0;
+   line->nslaves = nslaves;
+   for (n = 0; n < nslaves; n++)
+   {
+      line->slave[n].position = n;
+      /* free running local clocks, far apart like after power-on */
+      line->slave[n].clockoffset = (int64_t)(n + 1) * 1234567891LL;
+      ecemu_slave_reset(&line->slave[n]);
+   }
+   ecemu_set_reachable(line, nslaves);
+   return 1;
+}
+
+void ecemu_line_free(ecemu_linet *line)
+{
+   free(line->slave);
+   memset(line, 0, sizeof(*line));
+}
+
+static int64_t ecemu_localtime(ecemu_linet *line, ecemu_slavet *s)
+{
+   return line->now + s->clockoffset + (int64_t)s->position * ECEMU_FWDDELAY_NS;
+}
+
+/* registers the master can not write */
+static int ecemu_writable(uint32_t a)
+{
+   if ((a < 0x0010) || (a >= ECEMU_MEMSIZE))
+      return 0;
+   if ((a >= ECEMU_REG_DLSTAT) && (a < ECEMU_REG_DLSTAT + 2))
+      return 0;
+   if ((a >= ECEMU_REG_ALSTAT) && (a < ECEMU_REG_ALSTAT + 6))
+      return 0;
+   if ((a >= ECEMU_REG_SM0) && (a < ECEMU_REG_SM0 + 8 * ECEMU_MAXSM) && ((a & 7) == 5))
+      return 0;
+   if ((a >= ECEMU_REG_DCTIME0) && (a < ECEMU_REG_DCSYSOFFSET))
+      return 0;
+   return 1;
+}
+
+static void ecemu_alcontrol(ecemu_linet *line, ecemu_slavet *s)
+{
+   uint8_t ctl = s->mem[ECEMU_REG_ALCTL];
+   uint8_t req = ctl & 0x0F, state = ecemu_alstate(s) & 0x0F;
+   int error = ecemu_alstate(s) & ECEMU_STATE_ERROR;
+   int down = (req == ECEMU_STATE_INIT) ||
+              ((req < state) && (req != ECEMU_STATE_BOOT) && (state != ECEMU_STATE_BOOT));
+
+   if (error)
+   {
+      /* going up needs the error acknowledged, going down is always possible */
+      if (!(ctl & 0x10) && !down)
+         return;
+      ecemu_set_alstate(s, state, 0);
+   }
+   if (req == state)
+      return;
+   if (down)
+   {
+      ecemu_set_alstate(s, req, 0);
+      return;
+   }
+   switch (req)
+   {
+      case ECEMU_STATE_PRE_OP:
+         if (state != ECEMU_STATE_INIT)
+            break;
+         if (!ecemu_sm_enabled(s, 0) || !ecemu_sm_enabled(s, 1))
+         {
+            ecemu_set_alstate(s, state | ECEMU_STATE_ERROR, 0x0016);
+            return;
+         }
+         ecemu_set_alstate(s, req, 0);
+         return;
+      case ECEMU_STATE_BOOT:
+         if (state != ECEMU_STATE_INIT)
+            break;
+         ecemu_set_alstate(s, req, 0);
+         return;
+      case ECEMU_STATE_SAFE_OP:
+         if (state != ECEMU_STATE_PRE_OP)
+            break;
+         if (!ecemu_sm_enabled(s, 2) || (ecemu_get16(ecemu_sm(s, 2) + 2) != sizeof(ecemu_outputst)))
+         {
+            ecemu_set_alstate(s, state | ECEMU_STATE_ERROR, ECEMU_AL_INVALIDOUTPUTS);
+            return;
+         }
+         if (!ecemu_sm_enabled(s, 3) || (ecemu_get16(ecemu_sm(s, 3) + 2) != sizeof(ecemu_inputst)))
+         {
+            ecemu_set_alstate(s, state | ECEMU_STATE_ERROR, ECEMU_AL_INVALIDINPUTS);
+            return;
+         }
+         ecemu_set_alstate(s, req, 0);
+         return;
+      case ECEMU_STATE_OP:
+         if (state != ECEMU_STATE_SAFE_OP)
+            break;
+         s->lastoutputs = line->now;
+         ecemu_set_alstate(s, req, 0);
+         return;
+      default:
+         break;
+   }
+   ecemu_set_alstate(s, state | ECEMU_STATE_ERROR, ECEMU_AL_INVALIDSTATE);
+}
+
+static void ecemu_eeprom(ecemu_slavet *s)
+{
+   uint16_t ctl = ecemu_get16(&s->mem[ECEMU_REG_EEPCTL]);
+   uint32_t addr = ecemu_get32(&s->mem[ECEMU_REG_EEPADR]);
+   int i;
+
+   switch ((ctl >> 8) & 0x07)
+   {
+      case 1:
+         for (i = 0; i < 2; i++)
+            ecemu_put16(&s->mem[ECEMU_REG_EEPDAT + 2 * i],
+                        (addr + i < ECEMU_EEPROMWORDS) ? s->eeprom[addr + i] : 0xFFFF);
+         break;
+      case 2:
+         if (addr < ECEMU_EEPROMWORDS)
+            s->eeprom[addr] = ecemu_get16(&s->mem[ECEMU_REG_EEPDAT]);
+         break;
+      default:
+         break;
+   }
+   /* done at once: not busy, no error, 4 byte reads */
+   ecemu_put16(&s->mem[ECEMU_REG_EEPCTL], 0x0000);
+}
+
+static void ecemu_dclatch(ecemu_linet *line, ecemu_slavet *s)
+{
+   int64_t t0 = line->now + s->clockoffset, d = ECEMU_FWDDELAY_NS;
+   int64_t port0 = t0 + s->position * d;
+   int64_t port1 = t0 + (2 * (line->reachable - 1) - s->position) * d;
+
+   ecemu_put32(&s->mem[ECEMU_REG_DCTIME0], (uint32_t)port0);
+   ecemu_put32(&s->mem[ECEMU_REG_DCTIME0 + 4], (s->position < line->reachable - 1) ? (uint32_t)port1 : 0);
+   ecemu_put32(&s->mem[ECEMU_REG_DCTIME0 + 8], 0);
+   ecemu_put32(&s->mem[ECEMU_REG_DCTIME0 + 12], 0);
+   ecemu_put64(&s->mem[ECEMU_REG_DCSOF], (uint64_t)port0);
+}
+
+static void ecemu_mbxload(ecemu_slavet *s)
+{
+   uint8_t *sm = ecemu_sm(s, 1);
+   int len = ecemu_get16(sm + 2);
+
+   if (!s->mbxcount || !ecemu_sm_enabled(s, 1) || (sm[5] & 0x08))
+      return;
+   memset(&s->mem[ecemu_get16(sm)], 0, len);
+   memcpy(&s->mem[ecemu_get16(sm)], s->mbxqueue[s->mbxhead], (len < ECEMU_MBXSIZE) ? len : ECEMU_MBXSIZE);
+   s->mbxhead = (s->mbxhead + 1) % ECEMU_MBXQUEUE;
+   s->mbxcount--;
+   sm[5] |= 0x08;
+}
+
+static void ecemu_mbxwrite(ecemu_slavet *s)
+{
+   uint8_t *sm = ecemu_sm(s, 0);
+
+   if ((s->mbxcount < ECEMU_MBXQUEUE) &&
+       ecemu_coe(s, &s->mem[ecemu_get16(sm)], ecemu_get16(sm + 2),
+                 s->mbxqueue[(s->mbxhead + s->mbxcount) % ECEMU_MBXQUEUE]))
+      s->mbxcount++;
+   /* the request is consumed right away, the write mailbox is empty again */
+   sm[5] &= ~0x08;
+   ecemu_mbxload(s);
+}
+
+static void ecemu_read(ecemu_linet *line, ecemu_slavet *s, uint16_t ado, uint8_t *data, int len, int bitor)
+{
+   uint8_t *sm;
+   int i;
+
+   if (ecemu_overlaps(ado, len, ECEMU_REG_DCSYSTIME, 8))
+      ecemu_put64(&s->mem[ECEMU_REG_DCSYSTIME],
+                  (uint64_t)(ecemu_localtime(line, s) + (int64_t)ecemu_get64(&s->mem[ECEMU_REG_DCSYSOFFSET])));
+   if (!bitor)
+      memcpy(data, &s->mem[ado], len);
+   else
+   {
+      for (i = 0; i < len; i++)
+         data[i] |= s->mem[ado + i];
+   }
+   /* reading the last byte of the read mailbox frees it */
+   sm = ecemu_sm(s, 1);
+   if (ecemu_sm_enabled(s, 1) && (sm[5] & 0x08) &&
+       ecemu_overlaps(ado, len, ecemu_get16(sm) + ecemu_get16(sm + 2) - 1, 1))
+   {
+      sm[5] &= ~0x08;
+      ecemu_mbxload(s);
+   }
+}
+
+static void ecemu_write(ecemu_linet *line, ecemu_slavet *s, uint16_t ado, const uint8_t *data, int len)
+{
+   uint8_t *sm;
+   int i, n;
+
+   /* process data and mailboxes lie above all registers the master can not write */
+   if ((ado >= ECEMU_REG_DCSYSOFFSET) && (ado + len <= ECEMU_MEMSIZE))
+      memcpy(&s->mem[ado], data, len);
+   else
+   {
+      for (i = 0; i < len; i++)
+      {
+         if (ecemu_writable(ado + i))
+            s->mem[ado + i] = data[i];
+      }
+   }
+   if (ecemu_overlaps(ado, len, ECEMU_REG_ALCTL, 1))
+      ecemu_alcontrol(line, s);
+   if (ecemu_overlaps(ado, len, ECEMU_REG_EEPCTL + 1, 1))
+      ecemu_eeprom(s);
+   if (ecemu_overlaps(ado, len, ECEMU_REG_DCTIME0, 1))
+      ecemu_dclatch(line, s);
+   if (ecemu_overlaps(ado, len, ECEMU_REG_FMMU0, 16 * ECEMU_MAXFMMU) ||
+       ecemu_overlaps(ado, len, ECEMU_REG_SM0, 8 * ECEMU_MAXSM))
+      __atomic_add_fetch(&line->layout, 1, __ATOMIC_RELEASE);
+   for (n = 0; n < ECEMU_MAXSM; n++)
+   {
+      /* (re)configuring a SyncManager empties its buffer */
+      if (ecemu_overlaps(ado, len, ECEMU_REG_SM0 + 8 * n, 8))
+      {
+         ecemu_sm(s, n)[5] = 0;
+         if (n == 1)
+            s->mbxcount = 0;
+      }
+   }
+   sm = ecemu_sm(s, 0);
+   if (ecemu_sm_enabled(s, 0) && ecemu_overlaps(ado, len, ecemu_get16(sm) + ecemu_get16(sm + 2) - 1, 1))
+      ecemu_mbxwrite(s);
+   sm = ecemu_sm(s, 2);
+   if (ecemu_sm_enabled(s, 2) && ecemu_overlaps(ado, len, ecemu_get16(sm), ecemu_get16(sm + 2)))
+      s->lastoutputs = line->now;
+}
+
+/* FMMU access, returns the working counter increment */
+static int ecemu_logical(ecemu_linet *line, ecemu_slavet *s, uint8_t cmd, uint32_t laddr, uint8_t *data, int len)
+{
+   uint8_t *f;
+   uint32_t start, lo, hi;
+   int n, pass, op, reads = 0, writes = 0;
+
+   /* process data SyncManagers are only enabled from SAFE_OP */
+   if ((ecemu_alstate(s) & 0x0F) < ECEMU_STATE_SAFE_OP)
+      return 0;
+   /* outputs are taken from the incoming frame before the inputs replace data */
+   for (pass = 0; pass < 2; pass++)
+   {
+      for (n = 0; n < ECEMU_MAXFMMU; n++)
+      {
+         f = &s->mem[ECEMU_REG_FMMU0 + 16 * n];
+         if (!(f[12] & 0x01))
+            continue;
+         start = ecemu_get32(f);
+         lo = (laddr > start) ? laddr : start;
+         hi = ((laddr + len) < (start + ecemu_get16(f + 4))) ? (laddr + len) : (start + ecemu_get16(f + 4));
+         if ((lo >= hi) || (ecemu_get16(f + 8) + (hi - start) > ECEMU_MEMSIZE))
+            continue;
+         if ((pass == 0) && (f[11] & 0x02) && (cmd != ECEMU_CMD_LRD))
+         {
+            ecemu_write(line, s, ecemu_get16(f + 8) + (lo - start), data + (lo - laddr), hi - lo);
+            writes = 1;
+         }
+         if ((pass == 1) && (f[11] & 0x01) && (cmd != ECEMU_CMD_LWR))
+         {
+            ecemu_read(line, s, ecemu_get16(f + 8) + (lo - start), data + (lo - laddr), hi - lo, 0);
+            reads = 1;
+         }
+      }
+   }
+   op = ((ecemu_alstate(s) & 0x1F) == ECEMU_STATE_OP);
+   /* with a batch the drives of the whole line are advanced once per frame */
+   if ((reads || writes) && !line->batch)
+      ecemu_drive_update(&s->drive, (const ecemu_outputst *)ecemu_outputs(s), (ecemu_inputst *)ecemu_inputs(s),
+                         op, line->now);
+   /* outputs are only accepted in OP, a slave in SAFE_OP lowers the working counter */
+   if (!op)
+      writes = 0;
+   return reads + ((cmd == ECEMU_CMD_LRW) ? 2 * writes : writes);
+}
+
+/* access of one slave to a physically addressed datagram */
+static int ecemu_physical(ecemu_linet *line, ecemu_slavet *s, uint8_t cmd, uint16_t ado, uint8_t *data, int len,
+                          int addressed)
+{
+   uint8_t tmp[1500];
+
+   if (ado + len > ECEMU_MEMSIZE)
+      return 0;
+   switch (cmd)
+   {
+      case ECEMU_CMD_APRD:
+      case ECEMU_CMD_FPRD:
+         ecemu_read(line, s, ado, data, len, 0);
+         return 1;
+      case ECEMU_CMD_BRD:
+         ecemu_read(line, s, ado, data, len, 1);
+         return 1;
+      case ECEMU_CMD_APWR:
+      case ECEMU_CMD_FPWR:
+      case ECEMU_CMD_BWR:
+         ecemu_write(line, s, ado, data, len);
+         return 1;
+      case ECEMU_CMD_APRW:
+      case ECEMU_CMD_FPRW:
+      case ECEMU_CMD_BRW:
+         memcpy(tmp, data, len);
+         ecemu_read(line, s, ado, data, len, cmd == ECEMU_CMD_BRW);
+         ecemu_write(line, s, ado, tmp, len);
+         return 3;
+      case ECEMU_CMD_ARMW:
+      case ECEMU_CMD_FRMW:
+         /* the addressed slave reads, all others write (and ignore system time writes) */
+         if (addressed)
+            ecemu_read(line, s, ado, data, len, 0);
+         else
+            ecemu_write(line, s, ado, data, len);
+         return 1;
+      default:
+         return 0;
+   }
+}
+
+/** Processing of one datagram by one slave. */
+void ecemu_datagram(ecemu_linet *line, ecemu_slavet *s, ecemu_datagramt *dg)
+{
+   uint8_t cmd = dg->header[0];
+   uint16_t ado = ecemu_get16(dg->header + 4);
+   uint16_t station = ecemu_get16(&s->mem[ECEMU_REG_STADR]);
+
+   switch (cmd)
+   {
+      case ECEMU_CMD_APRD:
+      case ECEMU_CMD_APWR:
+      case ECEMU_CMD_APRW:
+         if (dg->adp == 0)
+            dg->wkc += ecemu_physical(line, s, cmd, ado, dg->data, dg->length, 1);
+         dg->adp++;
+         break;
+      case ECEMU_CMD_ARMW:
+         dg->wkc += ecemu_physical(line, s, cmd, ado, dg->data, dg->length, dg->adp == 0);
+         dg->adp++;
+         break;
+      case ECEMU_CMD_FPRD:
+      case ECEMU_CMD_FPWR:
+      case ECEMU_CMD_FPRW:
+         if (dg->adp == station)
+            dg->wkc += ecemu_physical(line, s, cmd, ado, dg->data, dg->length, 1);
+         break;
+      case ECEMU_CMD_FRMW:
+         dg->wkc += ecemu_physical(line, s, cmd, ado, dg->data, dg->length, dg->adp == station);
+         break;
+      case ECEMU_CMD_BRD:
+      case ECEMU_CMD_BWR:
+      case ECEMU_CMD_BRW:
+         dg->wkc += ecemu_physical(line, s, cmd, ado, dg->data, dg->length, 1);
+         dg->adp++;
+         break;
+      case ECEMU_CMD_LRD:
+      case ECEMU_CMD_LWR:
+      case ECEMU_CMD_LRW:
+         dg->wkc += ecemu_logical(line, s, cmd, ecemu_get32(dg->header + 2), dg->data, dg->length);
+         break;
+      default:
+         break;
+   }
+}
+
+static void ecemu_count(uint8_t *counter)
+{
+   if (*counter < 0xFF)
+      (*counter)++;
+}
+
+/** Split a frame into its datagrams.
+ *
+ * @param[in]  frame  = ethernet frame
+ * @param[in]  length = frame length
+ * @param[out] dg     = datagrams, ECEMU_MAXDATAGRAMS
+ * @return number of datagrams, 0 if it is no EtherCAT frame
+ */
+int ecemu_parse(uint8_t *frame, int length, ecemu_datagramt *dg)
+{
+   uint8_t *p = frame + ECEMU_ETHHEADERSIZE + 2, *end = frame + length;
+   int ndg = 0, last;
+
+   if ((length < ECEMU_ETHHEADERSIZE + 2) ||
+       ((frame[12] << 8 | frame[13]) != ECEMU_ETHERTYPE) ||
+       ((ecemu_get16(frame + ECEMU_ETHHEADERSIZE) >> 12) != 1))
+      return 0;
+   do
+   {
+      dg[ndg].header = p;
+      dg[ndg].length = ecemu_get16(p + 6) & 0x07FF;
+      dg[ndg].data = p + ECEMU_DGHEADERSIZE;
+      if (dg[ndg].data + dg[ndg].length + 2 > end)
+         break;
+      dg[ndg].adp = ecemu_get16(p + 2);
+      dg[ndg].wkc = ecemu_get16(dg[ndg].data + dg[ndg].length);
+      last = !(ecemu_get16(p + 6) & 0x8000);
+      p = dg[ndg].data + dg[ndg].length + 2;
+      ndg++;
+   } while (!last && (ndg < ECEMU_MAXDATAGRAMS) && (p + ECEMU_DGHEADERSIZE + 2 <= end));
+   return ndg;
+}
+
+/** SyncManager watchdog of a slave, checked when a frame passes. */
+void ecemu_watchdog(ecemu_linet *line, ecemu_slavet *s)
+{
+   if (((ecemu_alstate(s) & 0x1F) == ECEMU_STATE_OP) && (line->now - s->lastoutputs > ECEMU_WATCHDOG_NS))
+      ecemu_set_alerror(s, ECEMU_AL_WATCHDOG);
+}
+
+/** Put the processed address and working counter fields back into the frame. */
+void ecemu_return(uint8_t *frame, const ecemu_datagramt *dg, int ndg)
+{
+   int i;
+
+   for (i = 0; i < ndg; i++)
+   {
+      ecemu_put16(dg[i].header + 2, dg[i].adp);
+      ecemu_put16(dg[i].data + dg[i].length, dg[i].wkc);
+   }
+   /* the first slave marks the source address as processed */
+   frame[6] |= 0x02;
+}
+
+/** Time from the first bit of a frame leaving the master until its last bit is back:
+ * the frame with FCS and preamble at 100 Mbit/s plus the forwarding delay out and
+ * back through every reachable slave.
+ */
+int64_t ecemu_wiretime(const ecemu_linet *line, int length)
+{
+   int bytes = ((length + 4 < 64) ? 64 : length + 4) + 8;
+
+   return bytes * 80LL + 2LL * line->reachable * ECEMU_FWDDELAY_NS;
+}
+
+/** Pass one frame through the line.
+ *
+ * @param[in]     line      = line, line->now set to the receive time
+ * @param[in,out] frame     = ethernet frame, modified in place
+ * @param[in]     length    = frame length
+ * @param[in]     corruptat = slave in front of which the frame is damaged, -1 for none
+ * @return 1 if the frame returns to the master, 0 if it is dropped
+ */
+int ecemu_frame(ecemu_linet *line, uint8_t *frame, int length, int corruptat)
+{
+   ecemu_datagramt dg[ECEMU_MAXDATAGRAMS];
+   ecemu_slavet *s;
+   int n, i, ndg;
+
+   ndg = ecemu_parse(frame, length, dg);
+   if (!ndg)
+      return 0;
+   line->frames++;
+   /* link down at the first slave, nothing comes back */
+   if (!line->reachable)
+      return 0;
+   for (n = 0; n < line->reachable; n++)
+   {
+      s = &line->slave[n];
+      if ((corruptat >= 0) && (n >= corruptat))
+      {
+         /* the damaged frame is forwarded without processing and counted as error */
+         ecemu_count(&s->mem[(n == corruptat) ? ECEMU_REG_RXERR : ECEMU_REG_FWDRXERR]);
+         continue;
+      }
+      ecemu_watchdog(line, s);
+      for (i = 0; i < ndg; i++)
+         ecemu_datagram(line, s, &dg[i]);
+   }
+   if (line->batch && ecemu_batch_step(line->batch, line->now))
+      ecemu_batch_update(line->batch, line, 0, line->nslaves);
+   if (corruptat >= 0)
+      return 0;
+   ecemu_return(frame, dg, ndg);
+   return 1;
+}
@@ -0,0 +1,232 @@
+/** \file
+ * \brief Scripted fault injection into the emulated line
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecemu_fault.h"
+#include "ecemu_batch.h"
+
+#define ECEMU_MS 1000000LL
+
+const char *ecemu_fault_name[ECEMU_FAULT_TYPES] =
+{
+   "drop", "corrupt", "disconnect", "powercycle", "alerror", "delay"
+};
+
+static int ecemu_fault_arg(const char *args, const char *key, long *value)
+{
+   const char *p = strstr(args, key);
+   size_t len = strlen(key);
+
+   if (!p || (p[len] != '='))
+      return 0;
+   *value = strtol(p + len + 1, NULL, 0);
+   return 1;
+}
+
+/** Read a fault script.
+ *
+ * @param[out] script = script
+ * @param[in]  file   = script file
+ * @return number of faults, -1 on error
+ */
+int ecemu_fault_load(ecemu_scriptt *script, const char *file)
+{
+   FILE *f = fopen(file, "r");
+   char line[256], name[32], args[200];
+   ecemu_faultt *fault;
+   long v, ms, count;
+   int n, type, lineno = 0;
+
+   memset(script, 0, sizeof(*script));
+   script->repeat = 1;
+   if (!f)
+      return -1;
+   while (fgets(line, sizeof(line), f))
+   {
+      lineno++;
+      args[0] = 0;
+      if ((line[0] == '#') || (sscanf(line, "%31s", name) != 1))
+         continue;
+      if (!strcmp(name, "period"))
+      {
+         if (sscanf(line, "%*s %ld %ld", &ms, &count) != 2)
+            goto error;
+         script->period = ms * ECEMU_MS;
+         script->repeat = (int)count;
+         continue;
+      }
+      n = sscanf(line, "%ld %31s %199[^\n]", &ms, name, args);
+      if ((n < 2) || (script->nfaults >= ECEMU_MAXFAULTS))
+         goto error;
+      for (type = 0; (type < ECEMU_FAULT_TYPES) && strcmp(name, ecemu_fault_name[type]); type++)
+         ;
+      if (type == ECEMU_FAULT_TYPES)
+         goto error;
+      fault = &script->fault[script->nfaults++];
+      fault->type = (ecemu_faulttypet)type;
+      fault->at = ms * ECEMU_MS;
+      fault->slave = ecemu_fault_arg(args, "slave", &v) ? (int)v : 1;
+      fault->frames = ecemu_fault_arg(args, "frames", &v) ? (int)v : 1;
+      fault->duration = (ecemu_fault_arg(args, "duration", &v) ? v : 0) * ECEMU_MS;
+      if (type == ECEMU_FAULT_ALERROR)
+         fault->param = ecemu_fault_arg(args, "code", &v) ? (uint32_t)v : ECEMU_AL_SYNCERROR;
+      if (type == ECEMU_FAULT_DELAY)
+         fault->param = ecemu_fault_arg(args, "us", &v) ? (uint32_t)v : 1000;
+      if ((fault->slave < 1) || (fault->slave > ECEMU_MAXSLAVES))
+         goto error;
+   }
+   fclose(f);
+   return script->nfaults;
+error:
+   fprintf(stderr, "%s:%d: invalid line\n", file, lineno);
+   fclose(f);
+   return -1;
+}
+
+int ecemu_fault_csv(ecemu_scriptt *script, const char *file)
+{
+   script->csv = fopen(file, "w");
+   if (!script->csv)
+      return 0;
+   fprintf(script->csv, "time_ns,event,fault,slave,param\n");
+   return 1;
+}
+
+void ecemu_fault_close(ecemu_scriptt *script)
+{
+   if (script->csv)
+      fclose(script->csv);
+   script->csv = NULL;
+}
+
+static void ecemu_fault_log(ecemu_scriptt *script, int64_t now, const char *event, ecemu_faulttypet type,
+                            int slave, uint32_t param)
+{
+   if (script->csv)
+   {
+      fprintf(script->csv, "%lld,%s,%s,%d,%u\n", (long long)now, event, ecemu_fault_name[type], slave, param);
+      fflush(script->csv);
+   }
+}
+
+static void ecemu_fault_inject(ecemu_scriptt *script, ecemu_linet *line, const ecemu_faultt *fault, int64_t now)
+{
+   int slave = (fault->slave <= line->nslaves) ? fault->slave : line->nslaves;
+
+   ecemu_fault_log(script, now, "inject", fault->type, slave,
+                   (fault->type == ECEMU_FAULT_ALERROR) || (fault->type == ECEMU_FAULT_DELAY) ?
+                   fault->param : (uint32_t)fault->frames);
+   switch (fault->type)
+   {
+      case ECEMU_FAULT_DROP:
+         script->dropframes = fault->frames;
+         break;
+      case ECEMU_FAULT_CORRUPT:
+         script->corruptframes = fault->frames;
+         script->corruptat = slave - 1;
+         break;
+      case ECEMU_FAULT_DISCONNECT:
+      case ECEMU_FAULT_POWERCYCLE:
+         ecemu_set_reachable(line, slave - 1);
+         script->reconnectat = now + fault->duration;
+         script->reconnectslave = slave;
+         script->reconnectreset = (fault->type == ECEMU_FAULT_POWERCYCLE);
+         break;
+      case ECEMU_FAULT_ALERROR:
+         ecemu_set_alerror(&line->slave[slave - 1], (uint16_t)fault->param);
+         /* nothing to undo, the master has to acknowledge */
+         ecemu_fault_log(script, now, "clear", fault->type, slave, fault->param);
+         break;
+      case ECEMU_FAULT_DELAY:
+         script->delayus = fault->param;
+         script->delayuntil = now + fault->duration;
+         break;
+      default:
+         break;
+   }
+}
+
+/** Inject due faults and end expired ones, call for every frame and when idle. */
+void ecemu_fault_poll(ecemu_scriptt *script, ecemu_linet *line, int64_t now)
+{
+   const ecemu_faultt *fault;
+   int n;
+
+   if (!script->t0)
+   {
+      /* the script starts once the master has the whole line in OP */
+      for (n = 0; (n < line->nslaves) && (ecemu_alstate(&line->slave[n]) == ECEMU_STATE_OP); n++)
+         ;
+      if ((n < line->nslaves) || !script->nfaults)
+         return;
+      script->t0 = now;
+   }
+   if (script->reconnectat && (now >= script->reconnectat))
+   {
+      if (script->reconnectreset)
+      {
+         ecemu_slave_reset(&line->slave[script->reconnectslave - 1]);
+         if (line->batch)
+            ecemu_batch_reset(line->batch, script->reconnectslave - 1);
+      }
+      ecemu_set_reachable(line, line->nslaves);
+      ecemu_fault_log(script, now, "clear", script->reconnectreset ? ECEMU_FAULT_POWERCYCLE : ECEMU_FAULT_DISCONNECT,
+                      script->reconnectslave, 0);
+      script->reconnectat = 0;
+   }
+   if (script->delayuntil && (now >= script->delayuntil))
+   {
+      ecemu_fault_log(script, now, "clear", ECEMU_FAULT_DELAY, 0, script->delayus);
+      script->delayuntil = 0;
+      script->delayus = 0;
+   }
+   while (!ecemu_fault_done(script))
+   {
+      fault = &script->fault[script->next];
+      if (now < script->t0 + script->cycle * script->period + fault->at)
+         break;
+      ecemu_fault_inject(script, line, fault, now);
+      if (++script->next == script->nfaults)
+      {
+         script->next = 0;
+         script->cycle++;
+      }
+   }
+}
+
+/** Effect of the active faults on a frame entering the line.
+ *
+ * @param[in]  script    = script
+ * @param[in]  now       = receive time
+ * @param[out] corruptat = slave (0 based) in front of which the frame is damaged, -1 for none
+ * @param[out] delay     = ns to hold the returning frame
+ * @return 0 if the frame is lost before the first slave
+ */
+int ecemu_fault_frame(ecemu_scriptt *script, int64_t now, int *corruptat, int64_t *delay)
+{
+   *corruptat = -1;
+   *delay = script->delayus * 1000LL;
+   if (script->dropframes)
+   {
+      if (--script->dropframes == 0)
+         ecemu_fault_log(script, now, "clear", ECEMU_FAULT_DROP, 0, 0);
+      return 0;
+   }
+   if (script->corruptframes)
+   {
+      *corruptat = script->corruptat;
+      if (--script->corruptframes == 0)
+         ecemu_fault_log(script, now, "clear", ECEMU_FAULT_CORRUPT, script->corruptat + 1, 0);
+   }
+   return 1;
+}
+
+/** All repetitions of the script are injected. */
+int ecemu_fault_done(const ecemu_scriptt *script)
+{
+   return !script->nfaults || (script->cycle >= script->repeat);
+}
@@ -0,0 +1,90 @@
+/** \file
+ * \brief Scripted fault injection into the emulated line
+ *
+ * A script lists faults with their time after the whole line reached OP:
+ *
+ *    # time_ms  fault       arguments
+ *    period     2000 50                  repeat the script every 2000 ms, 50 times
+ *    100        drop        frames=5
+ *    400        corrupt     slave=2 frames=3
+ *    700        disconnect  slave=2 duration=300
+ *    1200       powercycle  slave=1 duration=200
+ *    1500       alerror     slave=1 code=0x1A
+ *    1800       delay       us=3000 duration=50
+ *
+ * drop loses frames before the first slave, corrupt damages them in front of the
+ * given slave (it and the slaves behind count RX errors, the master drops the frame
+ * for its FCS), disconnect opens the link in front of the slave, powercycle does the
+ * same and resets the slave on return, alerror forces SAFE_OP + ERROR with the AL
+ * status code and delay holds every returning frame. Slaves are numbered from 1 as
+ * in SOEM.
+ *
+ * Every injection and its end are written with CLOCK_MONOTONIC time stamps to a CSV
+ * file, for recovery_report together with the events of the master.
+ */
+
+#ifndef _ECEMU_FAULT_H
+#define _ECEMU_FAULT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ecemu.h"
+
+#define ECEMU_MAXFAULTS 64
+
+typedef enum
+{
+   ECEMU_FAULT_DROP = 0,
+   ECEMU_FAULT_CORRUPT,
+   ECEMU_FAULT_DISCONNECT,
+   ECEMU_FAULT_POWERCYCLE,
+   ECEMU_FAULT_ALERROR,
+   ECEMU_FAULT_DELAY,
+   ECEMU_FAULT_TYPES
+} ecemu_faulttypet;
+
+typedef struct
+{
+   ecemu_faulttypet  type;
+   /** ns after the line reached OP, within one period */
+   int64_t           at;
+   int               slave;
+   int               frames;
+   int64_t           duration;
+   /** AL status code or delay in us */
+   uint32_t          param;
+} ecemu_faultt;
+
+typedef struct
+{
+   ecemu_faultt      fault[ECEMU_MAXFAULTS];
+   int               nfaults;
+   int64_t           period;
+   int               repeat;
+   FILE              *csv;
+   /** time the line first reached OP, 0 before */
+   int64_t           t0;
+   int               cycle;
+   int               next;
+   /* active effects */
+   int               dropframes;
+   int               corruptframes;
+   int               corruptat;
+   int64_t           delayuntil;
+   uint32_t          delayus;
+   int64_t           reconnectat;
+   int               reconnectslave;
+   int               reconnectreset;
+} ecemu_scriptt;
+
+extern const char *ecemu_fault_name[ECEMU_FAULT_TYPES];
+
+int ecemu_fault_load(ecemu_scriptt *script, const char *file);
+int ecemu_fault_csv(ecemu_scriptt *script, const char *file);
+void ecemu_fault_close(ecemu_scriptt *script);
+void ecemu_fault_poll(ecemu_scriptt *script, ecemu_linet *line, int64_t now);
+int ecemu_fault_frame(ecemu_scriptt *script, int64_t now, int *corruptat, int64_t *delay);
+int ecemu_fault_done(const ecemu_scriptt *script);
+
+#endif
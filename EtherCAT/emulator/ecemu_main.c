@@ -0,0 +1,260 @@
+/** \file
+ * \brief Emulated EtherCAT line of SOMANET drives on a raw socket
+ *
+ * Usage : ecemu [ifname] [nslaves] [-f script] [-o injections.csv] [-j threads] [-w] [-b] [-v]
+ * ifname is the emulator end of a veth pair, the master runs on the other end.
+ * -f runs a fault script (see ecemu_fault.h) once the master has the line in OP
+ * -o writes the injection time stamps for recovery_report
+ * -j advances the drives in structure-of-arrays form (ecemu_batch.c) and splits the
+ *    process data frames over that many threads (ecemu_workers.c, at most one per
+ *    core), for lines of hundreds of drives
+ * -w returns every frame no earlier than it would come back from a real line:
+ *    frame time at 100 Mbit/s plus the forwarding delay of every slave
+ * -b busy polls the socket instead of sleeping in poll(), and keeps the worker
+ *    threads spinning between frames instead of sleeping
+ * -v prints the AL state of the line when it changes and the processing time per second
+ *
+ * Build with ecemu_esc.c, ecemu_sii.c, ecemu_coe.c, ecemu_drive.c, ecemu_fault.c,
+ * ecemu_batch.c and ecemu_workers.c, link with -lm -lpthread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "ecemu.h"
+#include "ecemu_fault.h"
+#include "ecemu_batch.h"
+#include "ecemu_workers.h"
+
+#define ECEMU_FRAMESIZE 1518
+
+static volatile sig_atomic_t ecemu_stop;
+
+static void ecemu_sigint(int sig)
+{
+   (void)sig;
+   ecemu_stop = 1;
+}
+
+static int64_t ecemu_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int ecemu_open(const char *ifname)
+{
+   struct sockaddr_ll addr;
+   struct packet_mreq mreq;
+   int sock, ifindex = (int)if_nametoindex(ifname);
+
+   if (!ifindex)
+      return -1;
+   sock = socket(PF_PACKET, SOCK_RAW, htons(ECEMU_ETHERTYPE));
+   if (sock < 0)
+      return -1;
+   memset(&addr, 0, sizeof(addr));
+   addr.sll_family = AF_PACKET;
+   addr.sll_protocol = htons(ECEMU_ETHERTYPE);
+   addr.sll_ifindex = ifindex;
+   memset(&mreq, 0, sizeof(mreq));
+   mreq.mr_ifindex = ifindex;
+   mreq.mr_type = PACKET_MR_PROMISC;
+   if ((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+       (setsockopt(sock, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0))
+   {
+      close(sock);
+      return -1;
+   }
+   return sock;
+}
+
+/* lowest AL state on the line, with the error flag if any slave has it set */
+static uint8_t ecemu_linestate(const ecemu_linet *line)
+{
+   uint8_t state = 0xFF, error = 0, s;
+   int n;
+
+   for (n = 0; n < line->nslaves; n++)
+   {
+      s = ecemu_alstate(&line->slave[n]);
+      error |= s & ECEMU_STATE_ERROR;
+      if ((s & 0x0F) < state)
+         state = s & 0x0F;
+   }
+   return state | error;
+}
+
+/* hold the frame until the time it would return from the wire, spinning for short waits */
+static void ecemu_hold(int64_t until)
+{
+   struct timespec ts;
+   int64_t now = ecemu_now();
+
+   if (until - now > 200000)
+   {
+      ts.tv_sec = (until - 100000) / 1000000000LL;
+      ts.tv_nsec = (until - 100000) % 1000000000LL;
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+   }
+   while (ecemu_now() < until)
+      ;
+}
+
+int main(int argc, char *argv[])
+{
+   ecemu_linet line;
+   ecemu_scriptt script;
+   ecemu_batcht batch;
+   ecemu_workerst pool;
+   uint8_t frame[ECEMU_FRAMESIZE], state, laststate = 0;
+   struct sockaddr_ll from;
+   socklen_t fromlen;
+   struct pollfd pfd;
+   int64_t delay, done, proc, procmax = 0, procsum = 0, nextreport = 0;
+   int sock, nslaves, i, len, corruptat, nthreads = 0, verbose = 0, wiretime = 0, busypoll = 0, ok;
+   int nproc = 0, late = 0;
+   const char *scriptfile = NULL, *csvfile = NULL;
+
+   printf("SOEM (Simple Open EtherCAT Master)\nSOMANET line emulator\n");
+   if (argc < 3)
+   {
+      printf("Usage: ecemu ifname nslaves [-f script] [-o injections.csv] [-j threads] [-w] [-b] [-v]\n");
+      return 1;
+   }
+   for (i = 3; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc))
+         scriptfile = argv[++i];
+      else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+         csvfile = argv[++i];
+      else if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc))
+         nthreads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-w") == 0)
+         wiretime = 1;
+      else if (strcmp(argv[i], "-b") == 0)
+         busypoll = 1;
+      else if (strcmp(argv[i], "-v") == 0)
+         verbose = 1;
+   }
+   nslaves = atoi(argv[2]);
+   if (!ecemu_line_init(&line, nslaves))
+   {
+      printf("Invalid number of slaves %s, 1..%d\n", argv[2], ECEMU_MAXSLAVES);
+      return 1;
+   }
+   memset(&script, 0, sizeof(script));
+   if (scriptfile && (ecemu_fault_load(&script, scriptfile) < 0))
+   {
+      printf("Could not read fault script %s\n", scriptfile);
+      ecemu_line_free(&line);
+      return 1;
+   }
+   if (csvfile && !ecemu_fault_csv(&script, csvfile))
+      printf("Could not create %s, injections are not recorded\n", csvfile);
+   sock = ecemu_open(argv[1]);
+   if (sock < 0)
+   {
+      printf("No socket connection on %s\nExecute as root\n", argv[1]);
+      ecemu_fault_close(&script);
+      ecemu_line_free(&line);
+      return 1;
+   }
+   if (nthreads > 0)
+   {
+      if (!ecemu_batch_init(&batch, nslaves) || !ecemu_workers_start(&pool, &line, nthreads, busypoll))
+      {
+         printf("Can not start %d worker threads\n", nthreads);
+         ecemu_batch_free(&batch);
+         close(sock);
+         ecemu_fault_close(&script);
+         ecemu_line_free(&line);
+         return 1;
+      }
+      line.batch = &batch;
+   }
+   printf("%d slaves on %s, %d threads, %d faults x %d\n", nslaves, argv[1], nthreads ? pool.nworkers : 1,
+          script.nfaults, script.nfaults ? script.repeat : 0);
+   signal(SIGINT, ecemu_sigint);
+   signal(SIGTERM, ecemu_sigint);
+
+   pfd.fd = sock;
+   pfd.events = POLLIN;
+   while (!ecemu_stop)
+   {
+      if (poll(&pfd, 1, busypoll ? 0 : 1) <= 0)
+      {
+         /* timed faults end also while the master sends nothing */
+         ecemu_fault_poll(&script, &line, ecemu_now());
+         continue;
+      }
+      fromlen = sizeof(from);
+      len = (int)recvfrom(sock, frame, sizeof(frame), 0, (struct sockaddr *)&from, &fromlen);
+      /* our own returned frames are seen as outgoing */
+      if ((len <= 0) || (from.sll_pkttype == PACKET_OUTGOING))
+         continue;
+      line.now = ecemu_now();
+      ecemu_fault_poll(&script, &line, line.now);
+      if (!ecemu_fault_frame(&script, line.now, &corruptat, &delay))
+         continue;
+      ok = nthreads ? ecemu_workers_frame(&pool, frame, len, corruptat) : ecemu_frame(&line, frame, len, corruptat);
+      done = ecemu_now();
+      proc = done - line.now;
+      procmax = (proc > procmax) ? proc : procmax;
+      procsum += proc;
+      nproc++;
+      if (!ok)
+         continue;
+      if (wiretime)
+      {
+         late += (proc > ecemu_wiretime(&line, len));
+         delay += ecemu_wiretime(&line, len);
+      }
+      if (delay)
+         ecemu_hold(line.now + delay);
+      if (send(sock, frame, len, 0) != len)
+         perror("send");
+      if (!verbose)
+         continue;
+      state = ecemu_linestate(&line);
+      if (state != laststate)
+      {
+         printf("%lld: line state 0x%2.2x\n", (long long)line.now, state);
+         laststate = state;
+      }
+      if (done >= nextreport)
+      {
+         if (nextreport)
+            printf("%d frames, processing mean %.1f us max %.1f us, %d later than the wire\n", nproc,
+                   procsum / 1000.0 / nproc, procmax / 1000.0, late);
+         nextreport = done + 1000000000LL;
+         procmax = procsum = 0;
+         nproc = late = 0;
+      }
+   }
+   printf("%llu frames, %s\n", (unsigned long long)line.frames,
+          ecemu_fault_done(&script) ? "script complete" : "script incomplete");
+   if (nthreads)
+   {
+      printf("%llu frames in parallel, %llu serial\n", (unsigned long long)pool.parallelframes,
+             (unsigned long long)pool.serialframes);
+      ecemu_workers_stop(&pool);
+      ecemu_batch_free(&batch);
+   }
+   close(sock);
+   ecemu_fault_close(&script);
+   ecemu_line_free(&line);
+   return 0;
+}
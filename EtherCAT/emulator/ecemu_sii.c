@@ -0,0 +1,117 @@
+/** \file
+ * \brief SII EEPROM image of an emulated SOMANET drive
+ *
+ * Identity, mailbox configuration and the categories SOEM reads during
+ * ec_config_init(): strings, general (CoE with PDO assignment and configuration,
+ * so the mapping is read by SDO), FMMU usage and SyncManagers.
+ */
+
+#include <string.h>
+
+#include "ecemu.h"
+
+#define ECEMU_SII_STRINGS  10
+#define ECEMU_SII_GENERAL  30
+#define ECEMU_SII_FMMU     40
+#define ECEMU_SII_SM       41
+#define ECEMU_SII_END      0xFFFF
+
+static const char *ecemu_sii_string[] = { "SOMANET", "SOMANET Emulator" };
+
+/* ETG.2010 checksum of the configuration area */
+static uint8_t ecemu_sii_crc(const uint16_t *eeprom)
+{
+   uint8_t crc = 0xFF, b;
+   int i, bit;
+
+   for (i = 0; i < 14; i++)
+   {
+      b = (uint8_t)(eeprom[i / 2] >> (8 * (i & 1)));
+      crc ^= b;
+      for (bit = 0; bit < 8; bit++)
+         crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+   }
+   return crc;
+}
+
+static int ecemu_sii_category(uint16_t *eeprom, int w, uint16_t type, const uint8_t *data, int bytes)
+{
+   int i, words = (bytes + 1) / 2;
+
+   eeprom[w++] = type;
+   eeprom[w++] = (uint16_t)words;
+   for (i = 0; i < words; i++)
+      eeprom[w + i] = (uint16_t)(data[2 * i] | (((2 * i + 1) < bytes) ? (data[2 * i + 1] << 8) : 0));
+   return w + words;
+}
+
+static void ecemu_sii_sm(uint8_t *p, uint16_t start, uint16_t length, uint8_t control, uint8_t type)
+{
+   p[0] = (uint8_t)start;
+   p[1] = (uint8_t)(start >> 8);
+   p[2] = (uint8_t)length;
+   p[3] = (uint8_t)(length >> 8);
+   p[4] = control;
+   p[5] = 0;
+   p[6] = 0x01;
+   p[7] = type;
+}
+
+void ecemu_sii_build(uint16_t *eeprom)
+{
+   uint8_t buf[128];
+   int i, w, len;
+
+   for (i = 0; i < ECEMU_EEPROMWORDS; i++)
+      eeprom[i] = 0xFFFF;
+   memset(eeprom, 0, 0x40 * sizeof(uint16_t));
+   /* configuration area: PDI control, alias 0 */
+   eeprom[0] = 0x0005;
+   eeprom[7] = ecemu_sii_crc(eeprom);
+   eeprom[0x08] = (uint16_t)ECEMU_VENDOR;
+   eeprom[0x09] = (uint16_t)(ECEMU_VENDOR >> 16);
+   eeprom[0x0A] = (uint16_t)ECEMU_PRODUCT;
+   eeprom[0x0B] = (uint16_t)(ECEMU_PRODUCT >> 16);
+   eeprom[0x0C] = (uint16_t)ECEMU_REVISION;
+   eeprom[0x0D] = (uint16_t)(ECEMU_REVISION >> 16);
+   /* bootstrap and standard mailbox */
+   eeprom[0x14] = eeprom[0x18] = ECEMU_MBXOUT;
+   eeprom[0x15] = eeprom[0x19] = ECEMU_MBXSIZE;
+   eeprom[0x16] = eeprom[0x1A] = ECEMU_MBXIN;
+   eeprom[0x17] = eeprom[0x1B] = ECEMU_MBXSIZE;
+   /* mailbox protocols: CoE */
+   eeprom[0x1C] = 0x0004;
+   /* size in kbit - 1, version */
+   eeprom[0x3E] = (ECEMU_EEPROMWORDS * 16 / 1024) - 1;
+   eeprom[0x3F] = 1;
+
+   w = 0x40;
+   len = 0;
+   buf[len++] = 2;
+   for (i = 0; i < 2; i++)
+   {
+      buf[len] = (uint8_t)strlen(ecemu_sii_string[i]);
+      memcpy(&buf[len + 1], ecemu_sii_string[i], buf[len]);
+      len += 1 + buf[len];
+   }
+   w = ecemu_sii_category(eeprom, w, ECEMU_SII_STRINGS, buf, len);
+
+   memset(buf, 0, 32);
+   buf[2] = 1;          /* order string */
+   buf[3] = 1;          /* name string */
+   buf[5] = 0x0D;       /* CoE: SDO, PDO assign, PDO configuration */
+   buf[9] = 1;          /* DS402 channels */
+   w = ecemu_sii_category(eeprom, w, ECEMU_SII_GENERAL, buf, 32);
+
+   buf[0] = 1;          /* FMMU0 outputs */
+   buf[1] = 2;          /* FMMU1 inputs */
+   w = ecemu_sii_category(eeprom, w, ECEMU_SII_FMMU, buf, 2);
+
+   ecemu_sii_sm(&buf[0], ECEMU_MBXOUT, ECEMU_MBXSIZE, 0x26, 1);
+   ecemu_sii_sm(&buf[8], ECEMU_MBXIN, ECEMU_MBXSIZE, 0x22, 2);
+   ecemu_sii_sm(&buf[16], ECEMU_PDOUT, sizeof(ecemu_outputst), 0x64, 3);
+   ecemu_sii_sm(&buf[24], ECEMU_PDIN, sizeof(ecemu_inputst), 0x20, 4);
+   w = ecemu_sii_category(eeprom, w, ECEMU_SII_SM, buf, 32);
+
+   eeprom[w] = ECEMU_SII_END;
+}
@@ -0,0 +1,315 @@
+/** \file
+ * \brief Process data frames of a large line on several threads
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ECEMU_PAUSE() _mm_pause()
+#else
+#define ECEMU_PAUSE() do { } while (0)
+#endif
+
+#include "ecemu_workers.h"
+#include "ecemu_batch.h"
+
+/* pauses a waiting thread spins before it sleeps on the futex, a few us */
+#define ECEMU_SPINS 100
+
+static int ecemu_logical_cmd(uint8_t cmd)
+{
+   return (cmd == ECEMU_CMD_LRD) || (cmd == ECEMU_CMD_LWR) || (cmd == ECEMU_CMD_LRW);
+}
+
+static int ecemu_windowcmp(const void *a, const void *b)
+{
+   uint32_t x = ((const ecemu_windowt *)a)->start, y = ((const ecemu_windowt *)b)->start;
+
+   return (x > y) - (x < y);
+}
+
+static int ecemu_intcmp(const void *a, const void *b)
+{
+   int x = *(const int *)a, y = *(const int *)b;
+
+   return (x > y) - (x < y);
+}
+
+/* FMMU windows of all slaves sorted by logical address, returns 1 if no logical
+   address is mapped twice */
+static int ecemu_workers_layout(ecemu_workerst *pool)
+{
+   ecemu_linet *line = pool->line;
+   ecemu_windowt *w = pool->window;
+   uint8_t *f;
+   int n, i, nw = 0, disjoint = 1;
+
+   for (n = 0; n < line->nslaves; n++)
+   {
+      for (i = 0; i < ECEMU_MAXFMMU; i++)
+      {
+         f = &line->slave[n].mem[ECEMU_REG_FMMU0 + 16 * i];
+         if (!(f[12] & 0x01) || !ecemu_get16(f + 4))
+            continue;
+         w[nw].start = ecemu_get32(f);
+         w[nw].end = w[nw].start + ecemu_get16(f + 4);
+         w[nw].slave = n;
+         nw++;
+      }
+   }
+   qsort(w, nw, sizeof(*w), ecemu_windowcmp);
+   for (i = 1; i < nw; i++)
+      disjoint &= (w[i].start >= w[i - 1].end);
+   pool->nwindow = nw;
+   return disjoint;
+}
+
+/* wait until *word differs from value and return it: spin a little, then sleep on the
+   futex unless the pool is busy */
+static uint32_t ecemu_workers_wait(ecemu_workerst *pool, uint32_t *word, uint32_t value)
+{
+   uint32_t now;
+   int spin;
+
+   for (spin = 0; pool->busy || (spin < ECEMU_SPINS); spin++)
+   {
+      if ((now = __atomic_load_n(word, __ATOMIC_ACQUIRE)) != value)
+         return now;
+      ECEMU_PAUSE();
+   }
+   __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+   while ((now = __atomic_load_n(word, __ATOMIC_SEQ_CST)) == value)
+      syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+   __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_RELAXED);
+   return now;
+}
+
+/* increment *word and wake the threads sleeping on it */
+static void ecemu_workers_post(ecemu_workerst *pool, uint32_t *word)
+{
+   __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST))
+      syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* share of one worker in a frame */
+static void ecemu_workers_job(ecemu_workerst *pool, ecemu_workert *worker)
+{
+   ecemu_linet *line = pool->line;
+   ecemu_datagramt dg;
+   int n, k, i, last = (worker->last < line->reachable) ? worker->last : line->reachable;
+
+   memset(worker->wkc, 0, pool->ndg * sizeof(uint16_t));
+   /* the watchdog is far longer than ECEMU_BATCH_MINSTEP, checking it when the drives
+      advance saves touching every slave of the range for every frame */
+   for (n = worker->first; pool->advance && (n < last); n++)
+      ecemu_watchdog(line, &line->slave[n]);
+   for (k = worker->from; k < worker->to; k++)
+   {
+      n = pool->active[k];
+      for (i = 0; i < pool->ndg; i++)
+      {
+         if (!ecemu_logical_cmd(pool->dg[i].header[0]))
+            continue;
+         /* private copy, the working counters are summed after all workers are done */
+         dg = pool->dg[i];
+         dg.wkc = 0;
+         ecemu_datagram(line, &line->slave[n], &dg);
+         worker->wkc[i] += dg.wkc;
+      }
+   }
+   if (pool->advance)
+      ecemu_batch_update(line->batch, line, worker->first, worker->last);
+}
+
+static void *ecemu_workers_thread(void *arg)
+{
+   ecemu_workert *worker = arg;
+   ecemu_workerst *pool = worker->pool;
+   uint32_t job = 0;
+
+   while (1)
+   {
+      job = ecemu_workers_wait(pool, &pool->job, job);
+      if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+         return NULL;
+      ecemu_workers_job(pool, worker);
+      ecemu_workers_post(pool, &pool->done);
+   }
+}
+
+/** Split the line over nworkers threads, the caller of ecemu_workers_frame() included.
+ *
+ * More workers than online cores only wait for each other, nworkers is capped there.
+ *
+ * @param[out] pool     = worker pool
+ * @param[in]  line     = line to process
+ * @param[in]  nworkers = number of threads
+ * @param[in]  busy     = workers spin between frames instead of sleeping, one core each
+ * @return 1 on success
+ */
+int ecemu_workers_start(ecemu_workerst *pool, ecemu_linet *line, int nworkers, int busy)
+{
+   long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+   int i;
+
+   memset(pool, 0, sizeof(*pool));
+   if ((ncores > 0) && (nworkers > ncores))
+      nworkers = (int)ncores;
+   if (nworkers < 1)
+      nworkers = 1;
+   if (nworkers > ECEMU_MAXWORKERS)
+      nworkers = ECEMU_MAXWORKERS;
+   if (nworkers > line->nslaves)
+      nworkers = line->nslaves;
+   pool->line = line;
+   pool->busy = busy;
+   pool->checked = line->layout - 1;
+   pool->window = calloc(line->nslaves * ECEMU_MAXFMMU, sizeof(ecemu_windowt));
+   pool->seen = calloc(line->nslaves, sizeof(uint32_t));
+   pool->active = calloc(line->nslaves, sizeof(int));
+   if (!pool->window || !pool->seen || !pool->active)
+   {
+      ecemu_workers_stop(pool);
+      return 0;
+   }
+   pool->nworkers = nworkers;
+   for (i = 0; i < nworkers; i++)
+   {
+      pool->worker[i].pool = pool;
+      pool->worker[i].index = i;
+      pool->worker[i].first = line->nslaves * i / nworkers;
+      pool->worker[i].last = line->nslaves * (i + 1) / nworkers;
+   }
+   for (i = 1; i < nworkers; i++)
+   {
+      if (pthread_create(&pool->worker[i].thread, NULL, ecemu_workers_thread, &pool->worker[i]))
+      {
+         pool->nworkers = i;
+         ecemu_workers_stop(pool);
+         return 0;
+      }
+   }
+   return 1;
+}
+
+void ecemu_workers_stop(ecemu_workerst *pool)
+{
+   int i;
+
+   __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+   ecemu_workers_post(pool, &pool->job);
+   for (i = 1; i < pool->nworkers; i++)
+      pthread_join(pool->worker[i].thread, NULL);
+   pool->nworkers = 0;
+   free(pool->window);
+   free(pool->seen);
+   free(pool->active);
+   pool->window = NULL;
+   pool->seen = NULL;
+   pool->active = NULL;
+}
+
+/** Pass one frame through the line, as ecemu_frame(). */
+int ecemu_workers_frame(ecemu_workerst *pool, uint8_t *frame, int length, int corruptat)
+{
+   ecemu_linet *line = pool->line;
+   ecemu_datagramt dg[ECEMU_MAXDATAGRAMS];
+   uint32_t layout = __atomic_load_n(&line->layout, __ATOMIC_ACQUIRE), start, end, done;
+   uint8_t cmd;
+   int n, i, k, w, lo, hi, ndg, logical = 0, registers = 0;
+
+   if ((corruptat >= 0) || !line->reachable)
+      return ecemu_frame(line, frame, length, corruptat);
+   ndg = ecemu_parse(frame, length, dg);
+   for (i = 0; i < ndg; i++)
+   {
+      cmd = dg[i].header[0];
+      if (ecemu_logical_cmd(cmd))
+         logical = 1;
+      else if ((cmd == ECEMU_CMD_ARMW) || (cmd == ECEMU_CMD_FRMW))
+         registers = 1;
+      else if (cmd != ECEMU_CMD_NOP)
+         break;
+   }
+   if (layout != pool->checked)
+   {
+      pool->disjoint = ecemu_workers_layout(pool);
+      pool->checked = layout;
+   }
+   if (!ndg || !logical || (i < ndg) || !pool->disjoint)
+   {
+      pool->serialframes++;
+      return ecemu_frame(line, frame, length, corruptat);
+   }
+
+   pool->parallelframes++;
+   line->frames++;
+   /* slaves with a window in one of the logical datagrams: the windows are sorted and
+      disjoint, a binary search finds the first one of each datagram */
+   pool->nactive = 0;
+   for (i = 0; i < ndg; i++)
+   {
+      if (!ecemu_logical_cmd(dg[i].header[0]))
+         continue;
+      start = ecemu_get32(dg[i].header + 2);
+      end = start + dg[i].length;
+      lo = 0;
+      hi = pool->nwindow;
+      while (lo < hi)
+      {
+         k = (lo + hi) / 2;
+         if (pool->window[k].end <= start)
+            lo = k + 1;
+         else
+            hi = k;
+      }
+      for (k = lo; (k < pool->nwindow) && (pool->window[k].start < end); k++)
+      {
+         n = pool->window[k].slave;
+         if ((n < line->reachable) && (pool->seen[n] != (uint32_t)pool->parallelframes))
+         {
+            pool->seen[n] = (uint32_t)pool->parallelframes;
+            pool->active[pool->nactive++] = n;
+         }
+      }
+   }
+   qsort(pool->active, pool->nactive, sizeof(int), ecemu_intcmp);
+   /* every worker takes the active slaves of its own range, no slave is shared */
+   for (w = 0, k = 0; w < pool->nworkers; w++)
+   {
+      pool->worker[w].from = k;
+      while ((k < pool->nactive) && (pool->active[k] < pool->worker[w].last))
+         k++;
+      pool->worker[w].to = k;
+   }
+   pool->advance = line->batch && ecemu_batch_step(line->batch, line->now);
+   pool->dg = dg;
+   pool->ndg = ndg;
+   __atomic_store_n(&pool->done, 0, __ATOMIC_RELAXED);
+   ecemu_workers_post(pool, &pool->job);
+   ecemu_workers_job(pool, &pool->worker[0]);
+   while ((done = __atomic_load_n(&pool->done, __ATOMIC_ACQUIRE)) != (uint32_t)(pool->nworkers - 1))
+      ecemu_workers_wait(pool, &pool->done, done);
+   for (w = 0; w < pool->nworkers; w++)
+   {
+      for (i = 0; i < ndg; i++)
+         dg[i].wkc += pool->worker[w].wkc[i];
+   }
+   /* distributed clock datagrams touch only registers, in line order */
+   for (n = 0; registers && (n < line->reachable); n++)
+   {
+      for (i = 0; i < ndg; i++)
+      {
+         if (!ecemu_logical_cmd(dg[i].header[0]))
+            ecemu_datagram(line, &line->slave[n], &dg[i]);
+      }
+   }
+   ecemu_return(frame, dg, ndg);
+   return 1;
+}
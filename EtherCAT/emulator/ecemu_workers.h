@@ -0,0 +1,88 @@
+/** \file
+ * \brief Process data frames of a large line on several threads
+ *
+ * For a cyclic frame (logical datagrams, plus ARMW/FRMW for the distributed clocks)
+ * the line is split into fixed ranges, one per worker, the calling thread is worker 0.
+ * Each worker runs the SyncManager watchdog (when the drives advance), the logical
+ * datagrams and the drive models (ecemu_batch.c) for the slaves of its own range
+ * only, so no slave is touched by two threads; of the logical datagrams only the
+ * slaves whose FMMUs map into them are visited, found by a binary search over the
+ * sorted FMMU windows. A frame that reaches a part of the line keeps only the workers of that
+ * part busy. The ARMW/FRMW datagrams follow serially through the whole line. This is
+ * only equivalent to the slave by slave order of ecemu_frame() when the FMMU windows
+ * of different slaves do not overlap, which is checked whenever the master writes
+ * FMMU or SyncManager registers. All other frames, frames with injected corruption
+ * and overlapping layouts go through ecemu_frame().
+ *
+ * Between frames the workers spin briefly and then sleep on a futex, so a pool larger
+ * than the machine does not starve itself; ecemu_workers_start() also caps the pool at
+ * the online cores. Busy workers never sleep and take a core each.
+ */
+
+#ifndef _ECEMU_WORKERS_H
+#define _ECEMU_WORKERS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ecemu.h"
+
+#define ECEMU_MAXWORKERS 16
+
+struct ecemu_workers;
+
+/** logical window of an FMMU and the slave it belongs to */
+typedef struct
+{
+   uint32_t start;
+   uint32_t end;
+   int      slave;
+} ecemu_windowt;
+
+typedef struct
+{
+   struct ecemu_workers *pool;
+   pthread_t         thread;
+   int               index;
+   /* fixed range of slaves, the worker is the only one to touch them */
+   int               first;
+   int               last;
+   /* slaves of the range in pool->active for the current frame */
+   int               from;
+   int               to;
+   uint16_t          wkc[ECEMU_MAXDATAGRAMS];
+} __attribute__((aligned(64))) ecemu_workert;
+
+typedef struct ecemu_workers
+{
+   ecemu_linet       *line;
+   int               nworkers;
+   ecemu_workert     worker[ECEMU_MAXWORKERS];
+   /* FMMU windows of all slaves, sorted by start */
+   ecemu_windowt     *window;
+   int               nwindow;
+   /* frame in which a slave was last taken into active */
+   uint32_t          *seen;
+   /* frame being processed: datagrams, slaves they reach, drives due */
+   ecemu_datagramt   *dg;
+   int               ndg;
+   int               *active;
+   int               nactive;
+   int               advance;
+   uint32_t          job;
+   uint32_t          done;
+   int               stop;
+   int               busy;
+   uint32_t          sleepers;
+   /* FMMU windows of different slaves are disjoint, for line->layout == checked */
+   uint32_t          checked;
+   int               disjoint;
+   uint64_t          parallelframes;
+   uint64_t          serialframes;
+} ecemu_workerst;
+
+int ecemu_workers_start(ecemu_workerst *pool, ecemu_linet *line, int nworkers, int busy);
+void ecemu_workers_stop(ecemu_workerst *pool);
+int ecemu_workers_frame(ecemu_workerst *pool, uint8_t *frame, int length, int corruptat);
+
+#endif
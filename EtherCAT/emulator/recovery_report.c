@@ -0,0 +1,230 @@
+/** \file
+ * \brief Detection and recovery latency per fault type
+ *
+ * Usage : recovery_report [injections.csv] [master.csv]
+ * injections.csv is written by ecemu -o, master.csv by the SOEM example with -r.
+ * Both carry CLOCK_MONOTONIC time stamps, so master and emulator have to run on
+ * the same host.
+ *
+ * For every injection up to the next one:
+ * detection = first wkc_low or check of the master after the injection,
+ * recovery  = last wkc_ok or resumed of the master, from the end of the fault
+ *             (for alerror the end is the injection itself).
+ * Injections the master never noticed or never recovered from are counted separately.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define REPORT_MAXFAULTS 16
+
+typedef struct
+{
+   int64_t  time;
+   int64_t  clear;
+   char     fault[16];
+   int      slave;
+} report_injectiont;
+
+typedef struct
+{
+   int64_t  time;
+   int      detect;
+   int      recover;
+} report_eventt;
+
+typedef struct
+{
+   char     fault[16];
+   int      count;
+   int      undetected;
+   int      unrecovered;
+   int64_t  *detection;
+   int64_t  *recovery;
+   int      ndetection;
+   int      nrecovery;
+} report_faultt;
+
+static int report_cmp(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+   return (x > y) - (x < y);
+}
+
+static int report_cmpevent(const void *a, const void *b)
+{
+   return report_cmp(&((const report_eventt *)a)->time, &((const report_eventt *)b)->time);
+}
+
+static report_injectiont *report_injections(const char *file, int *n)
+{
+   FILE *f = fopen(file, "r");
+   report_injectiont *inj = NULL, *tmp;
+   char line[256], event[16], fault[16];
+   long long time;
+   int slave, size = 0, i;
+
+   *n = 0;
+   if (!f)
+      return NULL;
+   while (fgets(line, sizeof(line), f))
+   {
+      if (sscanf(line, "%lld,%15[^,],%15[^,],%d", &time, event, fault, &slave) != 4)
+         continue;
+      if (!strcmp(event, "inject"))
+      {
+         if (*n == size)
+         {
+            size = size ? 2 * size : 256;
+            tmp = realloc(inj, size * sizeof(*inj));
+            if (!tmp)
+               break;
+            inj = tmp;
+         }
+         inj[*n].time = inj[*n].clear = time;
+         strcpy(inj[*n].fault, fault);
+         inj[*n].slave = slave;
+         (*n)++;
+      }
+      else if (!strcmp(event, "clear"))
+      {
+         /* ends the latest injection of this fault */
+         for (i = *n - 1; (i >= 0) && strcmp(inj[i].fault, fault); i--)
+            ;
+         if (i >= 0)
+            inj[i].clear = time;
+      }
+   }
+   fclose(f);
+   return inj;
+}
+
+static report_eventt *report_events(const char *file, int *n)
+{
+   FILE *f = fopen(file, "r");
+   report_eventt *ev = NULL, *tmp;
+   char line[256], event[16];
+   long long time;
+   int slave, size = 0;
+
+   *n = 0;
+   if (!f)
+      return NULL;
+   while (fgets(line, sizeof(line), f))
+   {
+      if (sscanf(line, "%lld,%15[^,],%d", &time, event, &slave) != 3)
+         continue;
+      if (*n == size)
+      {
+         size = size ? 2 * size : 1024;
+         tmp = realloc(ev, size * sizeof(*ev));
+         if (!tmp)
+            break;
+         ev = tmp;
+      }
+      ev[*n].time = time;
+      ev[*n].detect = !strcmp(event, "wkc_low") || !strcmp(event, "check");
+      ev[*n].recover = !strcmp(event, "wkc_ok") || !strcmp(event, "resumed");
+      (*n)++;
+   }
+   fclose(f);
+   /* the check thread writes its own steps before flushing later transitions */
+   qsort(ev, *n, sizeof(*ev), report_cmpevent);
+   return ev;
+}
+
+static void report_print(const char *what, int64_t *v, int n)
+{
+   double sum = 0;
+   int i;
+
+   if (!n)
+   {
+      printf("  %-10s      -\n", what);
+      return;
+   }
+   qsort(v, n, sizeof(*v), report_cmp);
+   for (i = 0; i < n; i++)
+      sum += v[i];
+   printf("  %-10s mean %10.1f us  p50 %10.1f us  max %10.1f us\n", what,
+          sum / n / 1000.0, v[n / 2] / 1000.0, v[n - 1] / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+   report_injectiont *inj;
+   report_eventt *ev;
+   report_faultt fault[REPORT_MAXFAULTS], *ft;
+   int ninj, nev, nfault = 0, i, j, k, detected;
+   int64_t end, last;
+
+   if (argc < 3)
+   {
+      printf("Usage: recovery_report injections.csv master.csv\n");
+      return 1;
+   }
+   inj = report_injections(argv[1], &ninj);
+   ev = report_events(argv[2], &nev);
+   if (!inj || !ev)
+   {
+      printf("Can not read %s\n", !inj ? argv[1] : argv[2]);
+      free(inj);
+      free(ev);
+      return 1;
+   }
+   memset(fault, 0, sizeof(fault));
+   for (i = 0, j = 0; i < ninj; i++)
+   {
+      for (k = 0; (k < nfault) && strcmp(fault[k].fault, inj[i].fault); k++)
+         ;
+      if (k == nfault)
+      {
+         if (nfault == REPORT_MAXFAULTS)
+            continue;
+         strcpy(fault[nfault].fault, inj[i].fault);
+         fault[nfault].detection = calloc(ninj, sizeof(int64_t));
+         fault[nfault].recovery = calloc(ninj, sizeof(int64_t));
+         nfault++;
+      }
+      ft = &fault[k];
+      ft->count++;
+      end = (i + 1 < ninj) ? inj[i + 1].time : INT64_MAX;
+      while ((j < nev) && (ev[j].time < inj[i].time))
+         j++;
+      detected = 0;
+      last = 0;
+      for (k = j; (k < nev) && (ev[k].time < end); k++)
+      {
+         if (ev[k].detect && !detected)
+         {
+            ft->detection[ft->ndetection++] = ev[k].time - inj[i].time;
+            detected = 1;
+         }
+         if (ev[k].recover && detected)
+            last = ev[k].time;
+      }
+      if (!detected)
+         ft->undetected++;
+      else if (!last)
+         ft->unrecovered++;
+      else
+         ft->recovery[ft->nrecovery++] = (last > inj[i].clear) ? last - inj[i].clear : 0;
+   }
+
+   printf("%d injections, %d master events\n", ninj, nev);
+   for (k = 0; k < nfault; k++)
+   {
+      printf("%-10s %5d injected, %d undetected, %d not recovered\n", fault[k].fault, fault[k].count,
+             fault[k].undetected, fault[k].unrecovered);
+      report_print("detection", fault[k].detection, fault[k].ndetection);
+      report_print("recovery", fault[k].recovery, fault[k].nrecovery);
+      free(fault[k].detection);
+      free(fault[k].recovery);
+   }
+   free(inj);
+   free(ev);
+   return 0;
+}
@@ -0,0 +1,264 @@
+"""
+Client benchmarks against the mock Motion Master.
+
+Measures, without drives or a Motion Master:
+  - request latency of MotionMasterWrapper and MotionMasterAsyncClient, one request at a time
+  - request throughput of MotionMasterAsyncClient with many requests in flight
+  - monitoring rate: samples per second a collection receives and decodes
+  - profile position set-points per second, pipelined with the set-point acknowledge as `StateControl.pp_stream()`
+  - decode rate: monitoring messages decoded per second, no network
+  - bulk statusword decoding with NumPy
+
+Usage
+----
+    $ python3 benchmark_client.py --devices 8 --latency-ms 0.5
+
+With --address the benchmarks run against a server that is already running, i.e. `mock_motion_master.py` in
+another process, or a real Motion Master.
+"""
+import argparse
+import asyncio
+import os
+import statistics
+import sys
+import time
+
+# Add the lib directory to path
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', 'lib'))
+
+from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+from mock_motion_master import ACKNOWLEDGE_CYCLES, MockMotionMaster
+
+STATUSWORD = (0x6041, 0)
+MONITORED = [(0x6041, 0), (0x6064, 0), (0x606C, 0), (0x6077, 0)]
+PP_STEP = 1000  # increments between streamed targets, 10 ms of motion on the mock, longer than the handshake
+
+
+def report(name: str, latencies: list):
+    latencies = sorted(latencies)
+    print("{:<40} n {:6d}  mean {:8.1f} us  p50 {:8.1f} us  p99 {:8.1f} us".format(
+        name, len(latencies), statistics.mean(latencies) * 1e6, latencies[len(latencies) // 2] * 1e6,
+        latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))] * 1e6))
+
+
+def benchmark_wrapper(args, devices):
+    try:
+        from motion_master_wrapper import MotionMasterWrapper
+    except ImportError as e:
+        print("MotionMasterWrapper skipped: {}".format(e))
+        return
+    mmw = MotionMasterWrapper(args.address, 1.0)
+    mmw.connect_to_motion_master()
+    try:
+        start = time.perf_counter()
+        mmw.initialize_device_parameter_info_dict()
+        print("{:<40} {:8.1f} ms".format("wrapper parameter info, all devices", (time.perf_counter() - start) * 1e3))
+
+        latencies = []
+        for i in range(args.requests):
+            start = time.perf_counter()
+            mmw.get_device_parameter_value(devices[i % len(devices)], *STATUSWORD)
+            latencies.append(time.perf_counter() - start)
+        report("wrapper get, sequential", latencies)
+
+        topic = "benchmark_wrapper"
+        mmw.start_collection(topic, devices[0], MONITORED, args.interval_us, args.duration)
+        start = time.perf_counter()
+        samples = len(mmw.retrieve_collection(topic)["time"])
+        elapsed = time.perf_counter() - start
+        mmw.clear_collection(topic)
+        print("{:<40} {:8.0f} samples/s of {:.0f}".format(
+            "wrapper collection, {} objects".format(len(MONITORED)), samples / elapsed, 1e6 / args.interval_us))
+
+        benchmark_pp_stream(args, mmw, devices[0])
+    finally:
+        mmw.disconnect()
+
+
+def benchmark_pp_stream(args, mmw, device_address: int):
+    from somanet_cia402_state_control import StateControl
+    sc = StateControl(mmw, device_address)
+    sc.set_op_mode(sc.OP_MODES.PROFILE_POSITION)
+    sc.enable_operation()
+    try:
+        position = mmw.get_device_parameter_value(device_address, 0x6064, 0)
+        targets = [position + PP_STEP * (i + 1) for i in range(args.targets)]
+        start = time.perf_counter()
+        sc.pp_stream(targets)
+        elapsed = time.perf_counter() - start
+        print("{:<40} {:8.0f} set-points/s, {:6.2f} ms each".format(
+            "wrapper pp_stream, {} targets".format(len(targets)), len(targets) / elapsed, elapsed / len(targets) * 1e3))
+    finally:
+        sc.disable_voltage()
+
+
+async def benchmark_async(args, devices):
+    try:
+        from motion_master_async import MotionMasterAsyncClient
+    except ImportError as e:
+        print("MotionMasterAsyncClient skipped: {}".format(e))
+        return
+    client = MotionMasterAsyncClient(args.address, 1.0)
+    await client.connect()
+    try:
+        start = time.perf_counter()
+        await client.initialize_device_parameter_info_dict()
+        print("{:<40} {:8.1f} ms".format("async parameter info, all devices", (time.perf_counter() - start) * 1e3))
+
+        latencies = []
+        for i in range(args.requests):
+            start = time.perf_counter()
+            await client.get_device_parameter_value(devices[i % len(devices)], *STATUSWORD)
+            latencies.append(time.perf_counter() - start)
+        report("async get, sequential", latencies)
+
+        start = time.perf_counter()
+        for first in range(0, args.requests, args.concurrency):
+            await asyncio.gather(*(client.get_device_parameter_value(devices[i % len(devices)], *STATUSWORD)
+                                   for i in range(first, min(args.requests, first + args.concurrency))))
+        elapsed = time.perf_counter() - start
+        print("{:<40} {:8.0f} requests/s".format(
+            "async get, {} in flight".format(args.concurrency), args.requests / elapsed))
+
+        samples = 0
+        monitor = client.monitor("benchmark_async", devices[0], MONITORED, args.interval_us)
+        start = time.perf_counter()
+        async for _ in monitor:
+            samples += 1
+            if time.perf_counter() - start >= args.duration:
+                break
+        await monitor.aclose()
+        print("{:<40} {:8.0f} samples/s of {:.0f}".format(
+            "async monitor, {} objects".format(len(MONITORED)), samples / (time.perf_counter() - start),
+            1e6 / args.interval_us))
+
+        for count, wait_reached in ((1, True), (1, False), (len(devices), False)):
+            start = time.perf_counter()
+            await asyncio.gather(*(pp_stream_async(client, device, args.targets, wait_reached)
+                                   for device in devices[:count]))
+            elapsed = time.perf_counter() - start
+            print("{:<40} {:8.0f} set-points/s, {:6.2f} ms each".format(
+                "async pp {}, {} x {} devices".format("one by one" if wait_reached else "stream", args.targets,
+                                                      count),
+                count * args.targets / elapsed, elapsed / args.targets * 1e3))
+    finally:
+        await client.disconnect()
+
+
+async def pp_stream_async(client, device_address: int, count: int, wait_reached: bool = False, timeout: float = 4.0):
+    """
+    The set-point handshake of `StateControl.pp_stream()` on the async client, `count` targets of PP_STEP. With
+    wait_reached every target is reached before the next one is sent, as without the pipelining.
+    """
+    async def wait_statusword(condition, description: str):
+        deadline = time.perf_counter() + timeout
+        while not condition(await client.get_device_parameter_value(device_address, *STATUSWORD)):
+            if time.perf_counter() > deadline:
+                raise Exception("Device {}: {} didn't happen".format(device_address, description))
+
+    await client.set_device_parameter_value(device_address, 0x6060, 0, 1)
+    for controlword in (0x06, 0x07, 0x0F):
+        await client.set_device_parameter_value(device_address, 0x6040, 0, controlword)
+    position = await client.get_device_parameter_value(device_address, 0x6064, 0)
+    try:
+        for i in range(count):
+            await wait_statusword(lambda sw: not sw & 0x1000, "set-point buffer free")
+            await client.set_device_parameter_value(device_address, 0x607A, 0, position + PP_STEP * (i + 1))
+            await client.set_device_parameter_value(device_address, 0x6040, 0, 0x1F)
+            await wait_statusword(lambda sw: sw & 0x1000, "set-point acknowledged")
+            await client.set_device_parameter_value(device_address, 0x6040, 0, 0x0F)
+            if wait_reached:
+                await wait_statusword(lambda sw: sw & 0x0400, "target reached")
+    finally:
+        await client.set_device_parameter_value(device_address, 0x6040, 0, 0x00)
+
+
+def benchmark_decode(args):
+    """Decode and unpack a monitoring message of `objects` values, as a collection does for every sample."""
+    from motion_master_messages import decode
+    message = MotionMasterMessage()
+    monitoring = message.status.monitoring_parameter_values
+    monitoring.timestamp = 123456789
+    for i in range(args.objects):
+        parameter_value = monitoring.device_parameter_values.parameter_values.add()
+        parameter_value.index = 0x2100
+        parameter_value.subindex = i
+        parameter_value.int_value = i
+    data = message.SerializeToString()
+    count = 20000
+    start = time.perf_counter()
+    for _ in range(count):
+        values = decode(data).status.monitoring_parameter_values.device_parameter_values.parameter_values
+        [getattr(value, value.WhichOneof('type_value')) for value in values]
+    elapsed = time.perf_counter() - start
+    print("{:<40} {:8.0f} messages/s, {:.0f} values/s".format(
+        "decode monitoring, {} objects".format(args.objects), count / elapsed, count * args.objects / elapsed))
+
+
+def benchmark_statusword():
+    try:
+        import numpy as np
+        from somanet_cia402_state_control import Statusword
+    except ImportError as e:
+        print("Statusword bulk decoding skipped: {}".format(e))
+        return
+    sw = np.random.RandomState(0).choice(np.array([0x0240, 0x0231, 0x0233, 0x0237, 0x0218], dtype=np.uint16),
+                                         1000000)
+    start = time.perf_counter()
+    Statusword.state_intervals(sw, np.arange(len(sw)))
+    Statusword.decode(sw)
+    bulk = time.perf_counter() - start
+    start = time.perf_counter()
+    for value in sw[:10000]:
+        Statusword().get_human_readable_state(int(value))
+    single = (time.perf_counter() - start) * len(sw) / 10000
+    print("{:<40} bulk {:8.1f} ms, one at a time {:8.1f} ms (extrapolated)".format(
+        "statusword decode, 1M samples", bulk * 1e3, single * 1e3))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Motion Master client benchmarks')
+    parser.add_argument('--address', default=None, help='use a running server instead of an in-process mock')
+    parser.add_argument('--devices', type=int, default=4, help='devices of the in-process mock')
+    parser.add_argument('--latency-ms', type=float, default=0.0, help='response delay of the in-process mock')
+    parser.add_argument('--requests', type=int, default=2000, help='requests per latency benchmark')
+    parser.add_argument('--concurrency', type=int, default=64, help='requests in flight for the throughput')
+    parser.add_argument('--interval-us', type=int, default=1000, help='monitoring interval')
+    parser.add_argument('--duration', type=float, default=2.0, help='seconds of monitoring')
+    parser.add_argument('--objects', type=int, default=16, help='objects per message in the decode benchmark')
+    parser.add_argument('--targets', type=int, default=200, help='set-points per profile position stream')
+    parser.add_argument('--acknowledge-cycles', type=int, default=ACKNOWLEDGE_CYCLES,
+                        help='set-point acknowledge delay of the in-process mock, in cycles of 1 ms')
+    args = parser.parse_args()
+
+    server = None
+    if args.address is None:
+        args.address = '127.0.0.1'
+        server = MockMotionMaster(args.address, args.devices, args.latency_ms * 1e-3,
+                                  acknowledge_cycles=args.acknowledge_cycles)
+        server.start()
+        devices = list(server.devices)
+    else:
+        devices = None
+    try:
+        if devices is None:
+            from motion_master_async import MotionMasterAsyncClient
+
+            async def find_devices():
+                client = MotionMasterAsyncClient(args.address, 1.0)
+                await client.connect()
+                await client.initialize_device_parameter_info_dict()
+                await client.disconnect()
+                return [int(address) for address in client.device_and_parameter_info_dict]
+            devices = asyncio.get_event_loop().run_until_complete(find_devices())
+        benchmark_wrapper(args, devices)
+        asyncio.get_event_loop().run_until_complete(benchmark_async(args, devices))
+        benchmark_decode(args)
+        benchmark_statusword()
+    finally:
+        if server is not None:
+            server.stop()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,129 @@
+"""
+Loopback check of MotionMasterAsyncClient against the mock Motion Master.
+
+Runs every request of the client against an in-process mock on free ports, drives a device through the CiA402 state
+machine, monitors it, and injects malformed monitoring messages to check that the receive loop survives them. Exits
+with a non-zero status on the first failure.
+
+Usage
+----
+    $ python3 check_async_client.py
+"""
+import asyncio
+import os
+import socket
+import sys
+
+import zmq
+
+# Add the lib directory to path
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', 'lib'))
+
+from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+from mock_motion_master import MockMotionMaster
+from motion_master_async import MotionMasterAsyncClient
+from motion_master_messages import OperationFailed
+
+MARKER_TIMESTAMP = 4242
+MONITORING_TIMEOUT = 5  # seconds
+
+
+def free_port() -> int:
+    with socket.socket() as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+def check(condition: bool, description: str):
+    print("{:<60} {}".format(description, "ok" if condition else "FAILED"))
+    if not condition:
+        raise SystemExit(1)
+
+
+async def check_client(server: MockMotionMaster, injector_port: int, injector):
+    client = MotionMasterAsyncClient('127.0.0.1', 1.0, dealer_port=server.dealer_port, topics_port=server.topics_port)
+    await client.connect()
+    try:
+        check(await client.get_motion_master_version() == "mock", "system version")
+        await client.initialize_device_parameter_info_dict()
+        check(sorted(int(d) for d in client.device_and_parameter_info_dict) == sorted(server.devices),
+              "device info of {} devices".format(len(server.devices)))
+        device = min(server.devices)
+
+        await client.set_device_parameter_value(device, 0x6060, 0, 1)
+        for controlword, statusword in ((0x06, 0x0231), (0x07, 0x0233), (0x0F, 0x0237)):
+            await client.set_device_parameter_value(device, 0x6040, 0, controlword)
+            value = await client.get_device_parameter_value(device, 0x6041, 0)
+            check(value & 0x027F == statusword,
+                  "controlword 0x{:02x} gives statusword 0x{:04x}".format(controlword, value))
+
+        values = await asyncio.gather(*(client.get_device_parameter_value(d, 0x6061, 0) for d in server.devices))
+        check(values == [1] + [0] * (len(server.devices) - 1), "concurrent gets of all devices")
+        multi = await client.get_multi_device_parameter_values([(d, [(0x6060, 0)]) for d in server.devices])
+        check([(address, parameter_values[0][2]) for address, parameter_values in multi] ==
+              [(d, 1 if d == device else 0) for d in server.devices], "multi device get")
+        try:
+            await client.set_device_parameter_value(device, 0x1234, 0, 1)
+            check(False, "set of an unknown object raises")
+        except KeyError:
+            check(True, "set of an unknown object raises")
+        check(await client.get_device_file(device, "stack_info.json") == b'{}', "device file")
+
+        # A second publisher on the same SUB socket sends the malformed messages.
+        client._topics.connect("tcp://127.0.0.1:{}".format(injector_port))
+        marker = MotionMasterMessage()
+        marker.status.monitoring_parameter_values.timestamp = MARKER_TIMESTAMP
+        marker.status.monitoring_parameter_values.device_parameter_values.parameter_values.add().int_value = 1
+        received = {'samples': 0, 'marker': False}
+
+        async def receive(monitor):
+            injected = False
+            async for timestamp, values in monitor:
+                received['samples'] += 1
+                if timestamp == MARKER_TIMESTAMP:
+                    received['marker'] = True
+                elif received['samples'] == 10:
+                    check(len(values) == 2 and values[0] & 0x027F == 0x0237, "monitoring values")
+                    await asyncio.sleep(0.2)
+                    injector.send_multipart([b"check_async"])
+                    injector.send_multipart([b"check_async", b"garbage \xff"])
+                    injector.send_multipart([b"check_async", b"", marker.SerializeToString()])
+                    injected = True
+                if injected and received['marker'] and received['samples'] >= 50:
+                    break
+
+        monitor = client.monitor("check_async", device, [(0x6041, 0), (0x6064, 0)], 1000)
+        try:
+            await asyncio.wait_for(receive(monitor), MONITORING_TIMEOUT)
+        except asyncio.TimeoutError:
+            pass
+        await monitor.aclose()
+        check(received['marker'], "three frame monitoring message is delivered")
+        check(received['samples'] >= 50, "monitoring goes on after malformed messages")
+
+        await client.set_device_parameter_value(device, 0x6040, 0, 0x00)
+        check(await client.get_device_parameter_value(device, 0x6041, 0) & 0x027F == 0x0240, "disable voltage")
+    except OperationFailed as e:
+        check(False, str(e))
+    finally:
+        await client.disconnect()
+
+
+def main():
+    server = MockMotionMaster('127.0.0.1', 4, 0.0005, dealer_port=free_port(), topics_port=free_port())
+    server.start()
+    context = zmq.Context()
+    injector = context.socket(zmq.PUB)
+    injector_port = injector.bind_to_random_port("tcp://127.0.0.1")
+    try:
+        asyncio.get_event_loop().run_until_complete(check_client(server, injector_port, injector))
+    finally:
+        injector.close(linger=0)
+        context.term()
+        server.stop()
+    print("{} requests, {} monitoring messages on ports {}/{}".format(
+        server.requests, server.published, server.dealer_port, server.topics_port))
+
+
+if __name__ == '__main__':
+    main()
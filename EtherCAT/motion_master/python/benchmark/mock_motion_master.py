@@ -0,0 +1,400 @@
+"""
+Mock Motion Master
+
+A local stand-in for the Motion Master that speaks the same ZeroMQ/Protobuf protocol as the bindings: a ROUTER socket
+for requests and a PUB socket for monitoring topics. It simulates device info, parameter info and values, a CiA402
+state machine per device (statusword from controlword writes, profile position with a one deep set-point buffer and
+an acknowledge that is set and cleared some cycles late, velocity and position modes) and monitoring topics. Every
+response can be delayed by a configurable latency, without blocking other requests.
+
+Usage
+----
+    $ python3 mock_motion_master.py --devices 4 --latency-ms 1
+
+or in-process
+
+    server = MockMotionMaster(devices=4, latency_s=0.001)
+    server.start()
+    ...
+    server.stop()
+"""
+import argparse
+import heapq
+import itertools
+import logging
+import threading
+import time
+
+import zmq
+
+from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+
+logger = logging.getLogger(__name__)
+
+DEALER_PORT = 62524
+TOPICS_PORT = 62525
+PP_VELOCITY = 100000  # increments per second of profile position moves
+CYCLE_S = 0.001  # control cycle of the simulated drives
+ACKNOWLEDGE_CYCLES = 3  # cycles until a set-point bit edge shows in the statusword, and the acknowledge is held
+
+# Parameter value types, as used for the encoding in motion_master_messages.encode_parameter_value()
+INTEGER8 = 2
+INTEGER16 = 3
+INTEGER32 = 4
+UNSIGNED16 = 6
+UNSIGNED32 = 7
+REAL32 = 8
+
+# (index, subindex, name, value type) of the objects every device has
+OBJECTS = [
+    (0x6040, 0, 'Controlword', UNSIGNED16),
+    (0x6041, 0, 'Statusword', UNSIGNED16),
+    (0x6060, 0, 'Modes of operation', INTEGER8),
+    (0x6061, 0, 'Modes of operation display', INTEGER8),
+    (0x6064, 0, 'Position actual value', INTEGER32),
+    (0x606C, 0, 'Velocity actual value', INTEGER32),
+    (0x6077, 0, 'Torque actual value', INTEGER16),
+    (0x607A, 0, 'Target position', INTEGER32),
+    (0x60FF, 0, 'Target velocity', INTEGER32),
+    (0x6071, 0, 'Target torque', INTEGER16),
+]
+
+# CiA402 device control: statusword of each state, next state for (state, command)
+SWITCH_ON_DISABLED, READY_TO_SWITCH_ON, SWITCHED_ON, OPERATION_ENABLED, QUICK_STOP_ACTIVE, FAULT = range(6)
+STATUSWORDS = (0x0240, 0x0231, 0x0233, 0x0237, 0x0217, 0x0218)
+
+
+def _command(cw: int) -> str:
+    if not cw & 0x02:
+        return 'disable_voltage'
+    if cw & 0x06 == 0x02:
+        return 'quick_stop'
+    if cw & 0x87 == 0x06:
+        return 'shutdown'
+    if cw & 0x8F == 0x07:
+        return 'switch_on'
+    if cw & 0x8F == 0x0F:
+        return 'enable_operation'
+    return None
+
+
+TRANSITIONS = {
+    'disable_voltage': {READY_TO_SWITCH_ON: SWITCH_ON_DISABLED, SWITCHED_ON: SWITCH_ON_DISABLED,
+                        OPERATION_ENABLED: SWITCH_ON_DISABLED, QUICK_STOP_ACTIVE: SWITCH_ON_DISABLED},
+    'quick_stop': {READY_TO_SWITCH_ON: SWITCH_ON_DISABLED, SWITCHED_ON: SWITCH_ON_DISABLED,
+                   OPERATION_ENABLED: QUICK_STOP_ACTIVE},
+    'shutdown': {SWITCH_ON_DISABLED: READY_TO_SWITCH_ON, SWITCHED_ON: READY_TO_SWITCH_ON,
+                 OPERATION_ENABLED: READY_TO_SWITCH_ON},
+    'switch_on': {READY_TO_SWITCH_ON: SWITCHED_ON, OPERATION_ENABLED: SWITCHED_ON},
+    'enable_operation': {READY_TO_SWITCH_ON: OPERATION_ENABLED, SWITCHED_ON: OPERATION_ENABLED,
+                         QUICK_STOP_ACTIVE: OPERATION_ENABLED},
+}
+
+
+class MockDevice:
+    """Object values and CiA402 behaviour of one simulated drive."""
+
+    def __init__(self, device_address: int, position: int, extra_parameters: int,
+                 acknowledge_cycles: int = ACKNOWLEDGE_CYCLES):
+        self.device_address = device_address
+        self.position = position
+        self.objects = [(index, subindex, name, value_type, '') for index, subindex, name, value_type in OBJECTS]
+        # A bigger object dictionary makes the parameter info as heavy as on a real drive.
+        self.objects += [(0x2100 + i // 250, 1 + i % 250, 'Parameter {}'.format(i), INTEGER32, 'Mock parameters')
+                         for i in range(extra_parameters)]
+        self.values = {(index, subindex): 0.0 if value_type == REAL32 else 0
+                       for index, subindex, _, value_type, _ in self.objects}
+        self.state = SWITCH_ON_DISABLED
+        self.position_value = 0.0
+        self.last_update = time.monotonic()
+        # Profile position: the set-point moved to, the one buffered behind it, a rising edge of bit 4 the drive
+        # hasn't taken yet as (when, target, change set-point now), and when the acknowledge is cleared.
+        self.acknowledge = False
+        self.acknowledge_delay = acknowledge_cycles * CYCLE_S
+        self.pp_target = 0.0
+        self.pp_buffered = None
+        self.pp_edge = None
+        self.pp_release = None
+
+    def update(self, now: float):
+        """Advance the motion to now and refresh the actual values and the statusword."""
+        dt = now - self.last_update
+        self.last_update = now
+        mode = self.values[(0x6060, 0)]
+        enabled = self.state == OPERATION_ENABLED
+        velocity = 0.0
+        reached = True
+        if enabled and mode == 1:
+            self._take_set_point(now)
+            remaining = self.pp_target - self.position_value
+            step = PP_VELOCITY * dt
+            velocity = max(-PP_VELOCITY, min(PP_VELOCITY, remaining / dt)) if dt > 0 else 0.0
+            reached = abs(remaining) <= step
+            if reached and self.pp_buffered is not None:
+                # The buffered set-point starts when the current one is reached.
+                self.pp_target, self.pp_buffered = self.pp_buffered, None
+                reached = False
+        else:
+            self.pp_target = self.position_value
+            self.pp_buffered = None
+            self.pp_edge = None
+            if enabled and mode == 9:
+                velocity = self.values[(0x60FF, 0)]
+            elif enabled and mode == 8:
+                velocity = (self.values[(0x607A, 0)] - self.position_value) / dt if dt > 0 else 0.0
+        self._release_acknowledge(now)
+        self.position_value += velocity * dt
+        self.values[(0x6064, 0)] = int(round(self.position_value))
+        self.values[(0x606C, 0)] = int(round(velocity))
+        self.values[(0x6061, 0)] = mode
+        statusword = STATUSWORDS[self.state]
+        if reached:
+            statusword |= 0x0400
+        if self.acknowledge:
+            statusword |= 0x1000
+        self.values[(0x6041, 0)] = statusword
+
+    def _take_set_point(self, now: float):
+        """Acknowledge the set-point of a rising edge of bit 4 once the drive has seen it."""
+        if self.pp_edge is None or now < self.pp_edge[0]:
+            return
+        _, target, immediate = self.pp_edge
+        self.pp_edge = None
+        self.acknowledge = True
+        if immediate or abs(self.pp_target - self.position_value) < 1:
+            self.pp_target = target
+        else:
+            self.pp_buffered = target
+
+    def _release_acknowledge(self, now: float):
+        """Clear the acknowledge a few cycles after bit 4 fell and the buffer is free again."""
+        if not self.acknowledge or self.values[(0x6040, 0)] & 0x10 or self.pp_edge is not None \
+                or self.pp_buffered is not None:
+            self.pp_release = None
+        elif self.pp_release is None:
+            self.pp_release = now + self.acknowledge_delay
+        elif now >= self.pp_release:
+            self.acknowledge = False
+            self.pp_release = None
+
+    def write(self, index: int, subindex: int, value, now: float):
+        """Store a value, a controlword runs the state machine and the set-point handshake."""
+        if index == 0x6040:
+            self.update(now)
+            previous = self.values[(0x6040, 0)]
+            if self.state == FAULT:
+                if value & 0x80 and not previous & 0x80:
+                    self.state = SWITCH_ON_DISABLED
+            else:
+                self.state = TRANSITIONS.get(_command(value), {}).get(self.state, self.state)
+            # Profile position: a rising edge of bit 4 is taken with the target of now, but only cycles later, and
+            # not at all while the acknowledge of the previous one is still set.
+            if value & 0x10 and not previous & 0x10 and not self.acknowledge and self.pp_edge is None:
+                self.pp_edge = (now + self.acknowledge_delay, self.values[(0x607A, 0)], bool(value & 0x20))
+        self.values[(index, subindex)] = value
+        self.update(now)
+
+
+class MockMotionMaster:
+    """
+    The server, running in its own thread. All requests are handled in one loop; responses and monitoring messages
+    are scheduled on a heap, so a latency delays each response without holding up the others.
+    """
+
+    def __init__(self, address: str = '127.0.0.1', devices: int = 1, latency_s: float = 0.0,
+                 extra_parameters: int = 0, dealer_port: int = DEALER_PORT, topics_port: int = TOPICS_PORT,
+                 acknowledge_cycles: int = ACKNOWLEDGE_CYCLES):
+        self.address = address
+        self.dealer_port = dealer_port
+        self.topics_port = topics_port
+        self.latency_s = latency_s
+        self.devices = {1000 + i: MockDevice(1000 + i, i, extra_parameters, acknowledge_cycles) for i in range(devices)}
+        self.requests = 0
+        self.published = 0
+        self._schedule = []
+        self._sequence = itertools.count()
+        self._monitorings = {}
+        self._thread = None
+        self._stop = threading.Event()
+        self._started = threading.Event()
+
+    def start(self):
+        """Bind the sockets and serve in a background thread"""
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._serve, name="mock motion master", daemon=True)
+        self._thread.start()
+        self._started.wait()
+
+    def stop(self):
+        self._stop.set()
+        self._thread.join()
+
+    def _at(self, when: float, action, *args):
+        heapq.heappush(self._schedule, (when, next(self._sequence), action, args))
+
+    def _serve(self):
+        context = zmq.Context()
+        router = context.socket(zmq.ROUTER)
+        router.bind("tcp://{}:{}".format(self.address, self.dealer_port))
+        publisher = context.socket(zmq.PUB)
+        publisher.bind("tcp://{}:{}".format(self.address, self.topics_port))
+        poller = zmq.Poller()
+        poller.register(router, zmq.POLLIN)
+        self._started.set()
+        try:
+            while not self._stop.is_set():
+                now = time.monotonic()
+                while self._schedule and self._schedule[0][0] <= now:
+                    _, _, action, args = heapq.heappop(self._schedule)
+                    action(router, publisher, *args)
+                wait = 0.1 if not self._schedule else max(0.0, self._schedule[0][0] - time.monotonic())
+                if poller.poll(wait * 1000):
+                    while True:
+                        try:
+                            frames = router.recv_multipart(zmq.NOBLOCK)
+                        except zmq.Again:
+                            break
+                        self._handle(frames)
+        finally:
+            router.close(linger=0)
+            publisher.close(linger=0)
+            context.term()
+
+    def _reply(self, router, publisher, frames, response: MotionMasterMessage):
+        router.send_multipart(frames[:-1] + [response.SerializeToString()])
+
+    def _handle(self, frames):
+        self.requests += 1
+        message = MotionMasterMessage()
+        message.ParseFromString(frames[-1])
+        request = message.request
+        now = time.monotonic()
+        # The one request field that is set, whatever the oneof is called in this protocol version.
+        fields = request.ListFields()
+        kind = fields[0][0].name if fields else None
+        response = MotionMasterMessage()
+        response.id = message.id
+        status = response.status
+
+        if kind == 'ping_system':
+            return
+        elif kind == 'get_system_version':
+            status.system_version.version = "mock"
+        elif kind == 'get_device_info':
+            for device in self.devices.values():
+                info = status.device_info.devices.add()
+                info.device_address = device.device_address
+                info.position = device.position
+        elif kind == 'get_device_parameter_info':
+            device = self.devices[request.get_device_parameter_info.device_address]
+            status.device_parameter_info.device_address = device.device_address
+            for index, subindex, name, value_type, group in device.objects:
+                parameter = status.device_parameter_info.parameters.add()
+                parameter.index = index
+                parameter.subindex = subindex
+                parameter.name = name
+                parameter.value_type = value_type
+                parameter.group = group
+        elif kind == 'get_device_parameter_values':
+            self._get_values(request.get_device_parameter_values, status.device_parameter_values, now)
+        elif kind == 'get_multi_device_parameter_values':
+            for get in request.get_multi_device_parameter_values.collection:
+                self._get_values(get, status.multi_device_parameter_values.collection.add(), now)
+        elif kind == 'set_device_parameter_values':
+            self._set_values(request.set_device_parameter_values, status.device_parameter_values, now)
+        elif kind == 'start_monitoring_device_parameter_values':
+            start = request.start_monitoring_device_parameter_values
+            self._monitorings[message.id] = start
+            self._at(now, self._publish, message.id, now)
+            return
+        elif kind == 'stop_monitoring_device_parameter_values':
+            self._monitorings.pop(request.stop_monitoring_device_parameter_values.start_monitoring_request_id, None)
+            return
+        elif kind == 'get_device_file':
+            status.device_file.name = request.get_device_file.name
+            status.device_file.content = b'{}'
+        else:
+            logger.warning("Request %s isn't simulated", kind)
+            return
+        self._at(now + self.latency_s, self._reply, frames, response)
+
+    def _get_values(self, get, device_parameter_values, now: float):
+        device = self.devices[get.device_address]
+        device.update(now)
+        device_parameter_values.device_address = device.device_address
+        for parameter in get.parameters:
+            parameter_value = device_parameter_values.parameter_values.add()
+            parameter_value.index = parameter.index
+            parameter_value.subindex = parameter.subindex
+            value = device.values.get((parameter.index, parameter.subindex))
+            if value is None:
+                parameter_value.error.SetInParent()
+            elif isinstance(value, float):
+                parameter_value.float_value = value
+                parameter_value.success.SetInParent()
+            else:
+                parameter_value.int_value = value
+                parameter_value.success.SetInParent()
+
+    def _set_values(self, set_values, device_parameter_values, now: float):
+        device = self.devices[set_values.device_address]
+        device_parameter_values.device_address = device.device_address
+        for parameter in set_values.parameter_values:
+            parameter_value = device_parameter_values.parameter_values.add()
+            parameter_value.index = parameter.index
+            parameter_value.subindex = parameter.subindex
+            if (parameter.index, parameter.subindex) not in device.values:
+                parameter_value.error.SetInParent()
+                continue
+            device.write(parameter.index, parameter.subindex,
+                         getattr(parameter, parameter.WhichOneof('type_value')), now)
+            parameter_value.success.SetInParent()
+
+    def _publish(self, router, publisher, request_id: str, when: float):
+        start = self._monitorings.get(request_id)
+        if start is None:
+            return
+        now = time.monotonic()
+        message = MotionMasterMessage()
+        monitoring = message.status.monitoring_parameter_values
+        monitoring.timestamp = int(now * 1e6)
+        if 'get_multi_device_parameter_values' in start.DESCRIPTOR.fields_by_name and \
+                start.HasField('get_multi_device_parameter_values'):
+            for get in start.get_multi_device_parameter_values.collection:
+                self._get_values(get, monitoring.multi_device_parameter_values.collection.add(), now)
+        else:
+            self._get_values(start.get_device_parameter_values, monitoring.device_parameter_values, now)
+        publisher.send_multipart([start.topic.encode("utf-8"), message.SerializeToString()])
+        self.published += 1
+        # Scheduled on the ideal period, so the rate holds as long as the server keeps up.
+        period = max(start.interval, 100) * 1e-6
+        when = when + period if when + period > now - period else now + period
+        self._at(when, self._publish, request_id, when)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Local stand-in for the Motion Master')
+    parser.add_argument('--address', default='127.0.0.1', help='address to bind to')
+    parser.add_argument('--devices', type=int, default=1, help='number of simulated devices')
+    parser.add_argument('--latency-ms', type=float, default=0.0, help='delay of every response')
+    parser.add_argument('--extra-parameters', type=int, default=0, help='additional objects per device')
+    parser.add_argument('--dealer-port', type=int, default=DEALER_PORT, help='port of the request socket')
+    parser.add_argument('--topics-port', type=int, default=TOPICS_PORT, help='port of the monitoring socket')
+    parser.add_argument('--acknowledge-cycles', type=int, default=ACKNOWLEDGE_CYCLES,
+                        help='cycles of {} ms a set-point acknowledge takes and is held'.format(CYCLE_S * 1e3))
+    args = parser.parse_args()
+    server = MockMotionMaster(args.address, args.devices, args.latency_ms * 1e-3, args.extra_parameters,
+                              args.dealer_port, args.topics_port, args.acknowledge_cycles)
+    server.start()
+    print("Mock Motion Master with {} devices on {}:{}/{}, Ctrl+C to stop".format(
+        args.devices, args.address, args.dealer_port, args.topics_port))
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        server.stop()
+        print("{} requests, {} monitoring messages".format(server.requests, server.published))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,314 @@
+"""
+Motion Master asyncio Client
+
+An asyncio counterpart of `MotionMasterWrapper` that talks ZeroMQ directly. There is one receive loop per socket:
+responses are matched to the waiting request by message ID with a dict lookup, monitoring messages are queued raw per
+topic and only decoded when they are consumed. Requests are awaitable, so any number of devices can be driven
+concurrently from one event loop.
+
+Usage
+----
+    client = MotionMasterAsyncClient('127.0.0.1', 0.1)
+    await client.connect()
+    await client.initialize_device_parameter_info_dict()
+    values = await asyncio.gather(*(client.get_device_parameter_value(d, 0x6041, 0) for d in devices))
+    async for timestamp, values in client.monitor('my_app_monitor', device, [(0x6064, 0)], 1000):
+        ...
+"""
+import asyncio
+import itertools
+import logging
+import os
+from typing import Any, AsyncIterator, Dict, List, Tuple
+
+import zmq
+import zmq.asyncio
+
+from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+from motion_master_messages import OperationFailed, decode, encode_parameter_value
+from motion_master_messages import check_device_parameter_value_status
+
+logger = logging.getLogger(__name__)
+
+DEALER_PORT = 62524
+TOPICS_PORT = 62525
+KEEPALIVE_PERIOD = 0.5  # seconds between pings, the Motion Master drops clients that stop pinging
+FILE_OPERATION_TIMEOUT = 5  # seconds
+MONITORING_QUEUE_SIZE = 10000  # messages per topic before the oldest are dropped
+
+
+class MotionMasterAsyncClient:
+    """
+    Awaitable requests and async iterators for monitoring topics on one connection to the Motion Master.
+    """
+
+    def __init__(self, address: str, message_timeout: float, logging: bool = False, dealer_port: int = DEALER_PORT,
+                 topics_port: int = TOPICS_PORT) -> None:
+        """Setup the sockets, nothing is connected before `connect()`"""
+        self.timeout_s = message_timeout
+        self.device_and_parameter_info_dict = {}
+        self._address = address
+        self._dealer_port = dealer_port
+        self._topics_port = topics_port
+        self._context = zmq.asyncio.Context.instance()
+        self._dealer = None
+        self._topics = None
+        self._tasks = []
+        # Response futures and monitoring queues, by message ID and by topic.
+        self._responses = {}
+        self._queues = {}
+        # Message IDs only have to be unique for this client.
+        self._id_prefix = os.urandom(8).hex()
+        self._id_counter = itertools.count()
+        logger.disabled = not logging
+
+    async def connect(self):
+        """Connect to the Motion Master and start the receive loops and the keepalive"""
+        self._dealer = self._context.socket(zmq.DEALER)
+        self._dealer.connect("tcp://{}:{}".format(self._address, self._dealer_port))
+        self._topics = self._context.socket(zmq.SUB)
+        self._topics.connect("tcp://{}:{}".format(self._address, self._topics_port))
+        self._tasks = [asyncio.ensure_future(self._receive_responses()),
+                       asyncio.ensure_future(self._receive_topics()),
+                       asyncio.ensure_future(self._keepalive())]
+
+    async def disconnect(self):
+        """Stop the loops, fail the requests still waiting and close the sockets"""
+        for task in self._tasks:
+            task.cancel()
+        await asyncio.gather(*self._tasks, return_exceptions=True)
+        self._tasks = []
+        for future in self._responses.values():
+            if not future.done():
+                future.cancel()
+        self._responses.clear()
+        self._dealer.close(linger=0)
+        self._topics.close(linger=0)
+
+    async def _receive_responses(self):
+        while True:
+            frames = await self._dealer.recv_multipart(copy=True)
+            try:
+                message = decode(frames[-1])
+            except Exception:
+                continue
+            future = self._responses.pop(message.id, None)
+            if future is not None and not future.done():
+                future.set_result(message)
+
+    async def _receive_topics(self):
+        while True:
+            frames = await self._topics.recv_multipart(copy=True)
+            # Topic first and the message last, anything in between is ignored.
+            if len(frames) < 2:
+                logger.warning("Monitoring message with %s frames skipped", len(frames))
+                continue
+            try:
+                queue = self._queues.get(frames[0])
+                if queue is None:
+                    continue
+                if queue.full():
+                    queue.get_nowait()
+                    logger.warning("Monitoring queue of %s is full, dropping the oldest message", frames[0])
+                queue.put_nowait(frames[-1])
+            except Exception as e:
+                logger.error("Exception while queueing a monitoring message: %s", e)
+
+    async def _keepalive(self):
+        while True:
+            message = MotionMasterMessage()
+            message.request.ping_system.SetInParent()
+            await self.send(message)
+            await asyncio.sleep(KEEPALIVE_PERIOD)
+
+    def new_message(self) -> MotionMasterMessage:
+        """Return an empty message with a unique ID, to be filled in by the caller and passed to `request()`"""
+        msg = MotionMasterMessage()
+        msg.id = "{}-{}".format(self._id_prefix, next(self._id_counter))
+        return msg
+
+    async def send(self, message: MotionMasterMessage):
+        """Send the message to the Motion Master without waiting for a response"""
+        await self._dealer.send(message.SerializeToString())
+
+    async def request(self, message: MotionMasterMessage, description: str = None,
+                      timeout: float = None) -> MotionMasterMessage:
+        """Send a message from `new_message()` and return the response with the same ID.
+
+        Raises
+        ------
+        Exception
+            If there is no response within the timeout.
+        """
+        future = asyncio.get_event_loop().create_future()
+        self._responses[message.id] = future
+        try:
+            await self.send(message)
+            return await asyncio.wait_for(future, self.timeout_s if timeout is None else timeout)
+        except asyncio.TimeoutError:
+            raise Exception("No response from Motion Master for message '{}'".format(
+                description if description is not None else message.id))
+        finally:
+            self._responses.pop(message.id, None)
+
+    async def get_motion_master_version(self) -> str:
+        """Return the version string of the Motion Master"""
+        msg = self.new_message()
+        msg.request.get_system_version.SetInParent()
+        message = await self.request(msg, "get Motion Master version")
+        return message.status.system_version.version
+
+    async def initialize_device_parameter_info_dict(self):
+        """Retrieve and set device_parameter_info_dict for all devices, as `MotionMasterWrapper`.
+
+        The parameter info of all devices is requested concurrently.
+        """
+        msg = self.new_message()
+        msg.request.get_device_info.SetInParent()
+        message = await self.request(msg, "get device info")
+        self.device_and_parameter_info_dict.clear()
+        for device_info in message.status.device_info.devices:
+            self.device_and_parameter_info_dict[str(device_info.device_address)] = {"info": device_info}
+        if not self.device_and_parameter_info_dict:
+            logger.warning("No devices were found on the network!")
+            return
+        logger.info("Found %s devices on the network.", len(self.device_and_parameter_info_dict))
+
+        async def get_parameter_info(device_dict):
+            msg = self.new_message()
+            msg.request.get_device_parameter_info.device_address = device_dict['info'].device_address
+            message = await self.request(msg, "get parameters from device {} ({})".format(
+                device_dict['info'].position, device_dict['info'].device_address))
+            device_dict['parameters'] = {"{:04x}:{}".format(parameter.index, parameter.subindex): parameter
+                                         for parameter in message.status.device_parameter_info.parameters}
+            if not device_dict['parameters']:
+                logger.warning("Parameter info retrieval for device %s didn't find any entries!",
+                               device_dict['info'].device_address)
+
+        await asyncio.gather(*(get_parameter_info(device_dict)
+                               for device_dict in self.device_and_parameter_info_dict.values()))
+
+    async def get_device_parameter_value(self, device_address: int, index: int, subindex: int) -> Any:
+        """Return the value of the object at the given index and subindex."""
+        msg = self.new_message()
+        msg.request.get_device_parameter_values.device_address = device_address
+        parameter = msg.request.get_device_parameter_values.parameters.add()
+        parameter.index = index
+        parameter.subindex = subindex
+        message = await self.request(msg, "get 0x{:04x}:{}".format(index, subindex))
+        received_parameter_value = message.status.device_parameter_values.parameter_values[0]
+        check_device_parameter_value_status(received_parameter_value)
+        return getattr(received_parameter_value, received_parameter_value.WhichOneof('type_value'))
+
+    async def get_multi_device_parameter_values(self, request_list: List[Tuple[int, List[Tuple[int, int]]]]) \
+            -> List[Tuple[int, List[Tuple[int, int, Any]]]]:
+        """Return the values of multiple parameter for multiple devices, as `MotionMasterWrapper`."""
+        msg = self.new_message()
+        collection = msg.request.get_multi_device_parameter_values.collection
+        for device_address, parameter_list in request_list:
+            get_device_parameter_value = collection.add()
+            get_device_parameter_value.device_address = device_address
+            for index, subindex in parameter_list:
+                parameter = get_device_parameter_value.parameters.add()
+                parameter.index = index
+                parameter.subindex = subindex
+        message = await self.request(msg, "get multi {}".format(request_list))
+        multi_device_parameter_values = []
+        for device_parameter_values in message.status.multi_device_parameter_values.collection:
+            parameter_values = []
+            for received_parameter_value in device_parameter_values.parameter_values:
+                check_device_parameter_value_status(received_parameter_value)
+                value = getattr(received_parameter_value, received_parameter_value.WhichOneof('type_value'))
+                parameter_values.append((received_parameter_value.index, received_parameter_value.subindex, value))
+            multi_device_parameter_values.append((device_parameter_values.device_address, parameter_values))
+        return multi_device_parameter_values
+
+    async def set_device_parameter_value(self, device_address: int, index: int, subindex: int, value: Any):
+        """Set a device parameter to a specific value and wait until the write is confirmed.
+
+        The type is looked up in the parameter info from `initialize_device_parameter_info_dict()`.
+
+        Raises
+        ------
+        KeyError
+            When the object doesn't exist on the device.
+        TypeError
+            When the type of the value can't be deduced.
+        OperationFailed
+            When the set operation reports an error.
+        """
+        device_dict = self.device_and_parameter_info_dict.get(str(device_address))
+        param_info = device_dict.get('parameters', {}).get("{:04x}:{}".format(index, subindex)) \
+            if device_dict else None
+        if param_info is None:
+            raise KeyError("Object 0x{:04x}:{} doesn't exist for device {}.".format(index, subindex, device_address))
+        msg = self.new_message()
+        msg.request.set_device_parameter_values.device_address = device_address
+        parameter = msg.request.set_device_parameter_values.parameter_values.add()
+        parameter.index = index
+        parameter.subindex = subindex
+        encode_parameter_value(parameter, param_info.value_type, value)
+        message = await self.request(msg, "set 0x{:04x}:{} to {}".format(index, subindex, value))
+        check_device_parameter_value_status(message.status.device_parameter_values.parameter_values[0])
+
+    async def get_device_file(self, device_address: int, filename: str) -> Any:
+        """Return the content of a file on the device."""
+        msg = self.new_message()
+        msg.request.get_device_file.device_address = device_address
+        msg.request.get_device_file.name = filename
+        message = await self.request(msg, "GetDeviceFile {}".format(filename), FILE_OPERATION_TIMEOUT)
+        if message.status.device_file.WhichOneof('data') == 'error':
+            code = MotionMasterMessage.Status.DeviceFile.Error.Code.Name(message.status.device_file.error.code)
+            raise OperationFailed("GetDeviceFile request returned error {} for file {}".format(
+                code, message.status.device_file.name))
+        return message.status.device_file.content
+
+    async def monitor(self, topic_name: str, device_address: int, parameter_list: List[Tuple[int, int]],
+                      sampling_period_us: int) -> AsyncIterator[Tuple[int, List[Any]]]:
+        """Monitor objects of a device, yielding (timestamp, values) with the values in the order of parameter_list.
+
+        The monitoring is stopped on the Motion Master when the iteration ends, so use it within
+        `async for` and leave the loop with break, or call `aclose()` on the returned generator.
+
+        Parameters
+        ----------
+        topic_name : str
+            An identifier that should be unique to the running instance of Motion Master.
+        device_address : int
+            The unique identifier for the device you wish to use.
+        parameter_list : List[Tuple[int, int]]
+            A list of the parameters from the object dictionary for sampling. I.e. [(0x2001, 1), (0x603f, 0)]
+        sampling_period_us : int
+            Number of microseconds between samples.
+        """
+        topic = topic_name.encode("utf-8")
+        if topic in self._queues:
+            raise KeyError("Topic `{}` is already monitored.".format(topic_name))
+        queue = asyncio.Queue(MONITORING_QUEUE_SIZE)
+        self._queues[topic] = queue
+        self._topics.setsockopt(zmq.SUBSCRIBE, topic)
+
+        msg = self.new_message()
+        msg.request.start_monitoring_device_parameter_values.topic = topic_name
+        msg.request.start_monitoring_device_parameter_values.interval = sampling_period_us
+        get_device_parameter_values = msg.request.start_monitoring_device_parameter_values.get_device_parameter_values
+        get_device_parameter_values.device_address = device_address
+        for index, subindex in parameter_list:
+            parameter = get_device_parameter_values.parameters.add()
+            parameter.index = index
+            parameter.subindex = subindex
+        await self.send(msg)
+        try:
+            while True:
+                try:
+                    monitoring = decode(await queue.get()).status.monitoring_parameter_values
+                except Exception:
+                    continue
+                yield monitoring.timestamp, [getattr(value, value.WhichOneof('type_value'))
+                                             for value in monitoring.device_parameter_values.parameter_values]
+        finally:
+            self._topics.setsockopt(zmq.UNSUBSCRIBE, topic)
+            del self._queues[topic]
+            stop = self.new_message()
+            stop.request.stop_monitoring_device_parameter_values.start_monitoring_request_id = msg.id
+            await self.send(stop)
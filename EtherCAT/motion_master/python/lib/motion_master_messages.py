@@ -0,0 +1,80 @@
+"""
+Motion Master Messages
+
+Helpers for building and checking MotionMasterMessage, shared by the Motion Master clients.
+
+"""
+import logging
+from typing import Any
+
+from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+
+logger = logging.getLogger(__name__)
+
+
+class OperationFailed(Exception):
+    """Exception for operations that just didn't work."""
+    pass
+
+
+def decode(data: str) -> MotionMasterMessage:
+    """Return a MotionMasterMessage decoded from the network Protobuf data.
+
+    Parameters
+    ----------
+    data : str
+        The raw data from the Motion Master bindings, needed to be converted.
+    """
+    try:
+        msg = MotionMasterMessage()
+        msg.ParseFromString(data)
+    except Exception as e:
+        logger.error("Exception while parsing the message: %s", e)
+        raise e
+    return msg
+
+
+def check_device_parameter_value_status(parameter):
+    """Checks the status field of the MotionMasterMessage to see if the request was successful.
+
+    Raises
+    -------
+    OperationFailed
+        If the status is an error.
+
+    Returns
+    -------
+    bool
+        True if the message status was successful.
+    """
+    status_name = parameter.WhichOneof('status')
+    if status_name == 'success':
+        return True
+    elif status_name == 'error':
+        status_code = MotionMasterMessage.Status.DeviceParameterValues.ParameterValue.Error.Code.Name(
+            getattr(parameter, status_name).code)
+        raise OperationFailed("Status code returned error {} for object 0x{:04x}:{}".format(
+            status_code, parameter.index, parameter.subindex))
+
+
+def encode_parameter_value(parameter, value_type: int, value: Any):
+    """Set the value field of a request parameter that matches the value type from the device parameter info.
+
+    Raises
+    ------
+    TypeError
+        If the value type isn't understood.
+    """
+    if 1 <= value_type <= 7:
+        # Value is some type of integer.
+        parameter.int_value = value
+    elif value_type == 8:
+        parameter.float_value = value
+    elif value_type == 9:
+        parameter.string_value = value
+    elif 10 <= value_type <= 11:
+        parameter.raw_value = value
+    elif value_type == 12:
+        parameter.int_value = value
+    else:
+        raise TypeError("Type for object 0x{:04x}:{} isn't understood.".format(parameter.index, parameter.subindex))
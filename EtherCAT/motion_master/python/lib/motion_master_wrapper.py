@@ -3,64 +3,166 @@ Motion Master Module
 
 """
 import time
+import threading
 from typing import Any, List, Tuple, Dict
 import logging
 import uuid
-from collections import OrderedDict
+from collections import OrderedDict, deque
 import rx
 from rx import operators as ops
 
 from motion_master_bindings.motion_master_bindings import MotionMasterBindings
 from motion_master_proto.motion_master_pb2 import MotionMasterMessage
+from motion_master_messages import OperationFailed, decode, encode_parameter_value
+from motion_master_messages import check_device_parameter_value_status as _check_device_parameter_value_status
 
 logger = logging.getLogger(__name__)
 
 FILE_OPERATION_TIMEOUT = 5  # seconds
+HEARTBEAT_PERIOD = 0.25  # seconds without any message before the connection is checked
+RECONNECT_DELAY = 0.01  # seconds, first wait between reconnect attempts
+RECONNECT_MAX_DELAY = 2.0  # seconds, the wait doubles up to this
 
 
-class OperationFailed(Exception):
-    """Exception for operations that just didn't work."""
-    pass
+class Decimation:
+    """Collection mode that keeps the minimum, maximum and mean of every `window` samples.
 
-
-def decode(data: str) -> MotionMasterMessage:
-    """Return a MotionMasterMessage decoded from the network Protobuf data.
-
-    Parameters
-    ----------
-    data : str
-        The raw data from the Motion Master bindings, needed to be converted.
+    The collection has the keys '<key>/min', '<key>/max' and '<key>/mean' for every object, and 'time' holds the
+    timestamp of the first sample of each window. The last window holds what is left when the collection completes
+    or is stopped, which may be fewer samples. Only for numeric objects.
     """
-    try:
-        msg = MotionMasterMessage()
-        msg.ParseFromString(data)
-    except Exception as e:
-        logger.error("Exception while parsing the message: %s", e)
-        raise e
-    return msg
 
+    def __init__(self, window: int):
+        if window < 1:
+            raise ValueError("Decimation window must be at least one sample.")
+        self.window = window
 
-def _check_device_parameter_value_status(parameter):
-    """Checks the status field of the MotionMasterMessage to see if the request was successful.
 
-    Raises
-    -------
-    OperationFailed
-        If the status is an error.
+class Trigger:
+    """Collection mode that only keeps windows of samples around the moments a condition on one object becomes true.
 
-    Returns
-    -------
-    bool
-        True if the message status was successful.
+    The condition is `value > above`, `value < below`, or `value & mask == match`. Every capture holds `pre` samples
+    before the trigger, the trigger sample and `post` samples after it; the collection key 'triggers' lists the row of
+    each trigger sample. With `repeat` the trigger re-arms after each capture.
     """
-    status_name = parameter.WhichOneof('status')
-    if status_name == 'success':
-        return True
-    elif status_name == 'error':
-        status_code = MotionMasterMessage.Status.DeviceParameterValues.ParameterValue.Error.Code.Name(
-            getattr(parameter, status_name).code)
-        raise OperationFailed("Status code returned error {} for object 0x{:04x}:{}".format(
-            status_code, parameter.index, parameter.subindex))
+
+    def __init__(self, key: str, above: float = None, below: float = None, mask: int = None, match: int = None,
+                 pre: int = 100, post: int = 100, repeat: bool = True):
+        if [above is not None, below is not None, mask is not None].count(True) != 1:
+            raise ValueError("Trigger needs exactly one of above, below or mask.")
+        self.key = key
+        self.above = above
+        self.below = below
+        self.mask = mask
+        self.match = mask if match is None else match
+        self.pre = pre
+        self.post = post
+        self.repeat = repeat
+
+    def condition(self, value) -> bool:
+        if self.above is not None:
+            return value > self.above
+        if self.below is not None:
+            return value < self.below
+        return (value & self.mask) == self.match
+
+
+def _collection_sink(local_collection_topic: Dict[str, Any], keys: List[str], decimation: Decimation = None,
+                     trigger: Trigger = None):
+    """Add the lists for the keys to the collection and return a function that stores one sample.
+
+    The returned function takes the timestamp and the values in the order of `keys`. A decimated collection also gets
+    a 'flush' function that stores the partial window left when the collection ends.
+    """
+    if decimation is not None and trigger is not None:
+        raise ValueError("A collection can either be decimated or triggered.")
+    if trigger is not None and trigger.key not in keys:
+        raise KeyError("Trigger key `{}` isn't part of the collection.".format(trigger.key))
+
+    if decimation is not None:
+        columns = []
+        for key in keys:
+            columns.append((local_collection_topic.setdefault(key + "/min", list()),
+                            local_collection_topic.setdefault(key + "/max", list()),
+                            local_collection_topic.setdefault(key + "/mean", list())))
+        time_column = local_collection_topic.setdefault("time", list())
+        window = {'count': 0, 'time': None, 'min': None, 'max': None, 'sum': None}
+
+        def flush():
+            if window['count'] == 0:
+                return
+            time_column.append(window['time'])
+            for (low, high, mean), lowest, highest, total in zip(columns, window['min'], window['max'],
+                                                                 window['sum']):
+                low.append(lowest)
+                high.append(highest)
+                mean.append(total / window['count'])
+            window['count'] = 0
+
+        def put_decimated(timestamp, values):
+            if window['count'] == 0:
+                window['time'] = timestamp
+                window['min'] = list(values)
+                window['max'] = list(values)
+                window['sum'] = list(values)
+            else:
+                low, high, total = window['min'], window['max'], window['sum']
+                for i, value in enumerate(values):
+                    if value < low[i]:
+                        low[i] = value
+                    elif value > high[i]:
+                        high[i] = value
+                    total[i] += value
+            window['count'] += 1
+            if window['count'] == decimation.window:
+                flush()
+
+        local_collection_topic['flush'] = flush
+        return put_decimated
+
+    columns = [local_collection_topic.setdefault(key, list()) for key in keys]
+    time_column = local_collection_topic.setdefault("time", list())
+
+    def put(timestamp, values):
+        time_column.append(timestamp)
+        for column, value in zip(columns, values):
+            column.append(value)
+
+    if trigger is None:
+        return put
+
+    position = keys.index(trigger.key)
+    triggers = local_collection_topic.setdefault("triggers", list())
+    history = deque(maxlen=trigger.pre) if trigger.pre > 0 else None
+    state = {'armed': True, 'previous': False, 'remaining': 0}
+
+    def put_triggered(timestamp, values):
+        active = trigger.condition(values[position])
+        if state['remaining']:
+            put(timestamp, values)
+            state['remaining'] -= 1
+        elif state['armed'] and active and not state['previous']:
+            # Rising edge of the condition: keep what led to it and what follows.
+            if history is not None:
+                for row in history:
+                    put(*row)
+                history.clear()
+            triggers.append(len(time_column))
+            put(timestamp, values)
+            state['remaining'] = trigger.post
+            state['armed'] = trigger.repeat
+        elif history is not None:
+            history.append((timestamp, values))
+        state['previous'] = active
+
+    return put_triggered
+
+
+def _flush_collection(local_collection_topic: Dict[str, Any]):
+    """Store the samples a collection still holds back, i.e. the last partial window of a decimated one."""
+    flush = local_collection_topic.get('flush')
+    if flush is not None:
+        flush()
 
 
 class MotionMasterWrapper:
@@ -68,8 +170,13 @@ class MotionMasterWrapper:
     Provide a way to hide some of the code required to send and receive messages.
     """
 
-    def __init__(self, address: str, message_timeout: float, logging: bool = False) -> None:
-        """Setup the Motion Master bindings and init some stuff"""
+    def __init__(self, address: str, message_timeout: float, logging: bool = False, reconnect: bool = True,
+                 reconnect_attempts: int = None) -> None:
+        """Setup the Motion Master bindings and init some stuff
+
+        With `reconnect` a lost connection is detected by a heartbeat and restored in the background, see
+        `reconnect()`. `reconnect_attempts` limits the attempts per loss, None tries until `disconnect()`.
+        """
 
         self.timeout_s = message_timeout
         self._mmb = MotionMasterBindings(address)
@@ -77,28 +184,187 @@ class MotionMasterWrapper:
         self.collection = dict()
         logger.disabled = not logging
 
+        # All observables are built on these subjects, which outlive the connections of the bindings.
+        self._dealer_subject = rx.subject.Subject()
+        self._topics_subject = rx.subject.Subject()
+        self._bridges = []
+        # Requests waiting for their response, by message ID, in the order they were sent.
+        self._pending = OrderedDict()
+        self._connection_lock = threading.RLock()
+        self._reconnect = reconnect
+        self.reconnect_attempts = reconnect_attempts
+        self._last_received = time.monotonic()
+        self._lost = False
+        self._closing = False
+        self._watchdog = None
+        self._wake_watchdog = threading.Event()
+
         logger.debug("Using address %s", address)
         logger.debug("Using message_timeout %s seconds", message_timeout)
 
     def connect_to_motion_master(self):
         """Connect to the Motion Master and enable keepalive checks"""
+        self._closing = False
         self._mmb.connect()
         self._mmb.enable_keepalive()
+        self._bridge()
+        if self._reconnect and self._watchdog is None:
+            self._watchdog = threading.Thread(target=self._watch_connection, name="motion master watchdog",
+                                              daemon=True)
+            self._watchdog.start()
 
     def send_to_motion_master(self, message: MotionMasterMessage):
         """Send the message to the Motion Master
 
+        If the connection is lost, the message is sent again once it is restored.
+
         Parameters
         ----------
         message : MotionMasterMessage
             A fully formed message, ready for encoding and transport to the Motion Master.
         """
-        self._mmb.send_message(message)
+        with self._connection_lock:
+            # A request is only replayed once it was sent, so it never goes out twice.
+            if message.id in self._pending:
+                self._pending[message.id] = message
+            try:
+                self._mmb.send_message(message)
+                return
+            except Exception as e:
+                if not self._reconnect or self._closing:
+                    raise e
+                logger.warning("Sending to Motion Master failed: %s", e)
+                self._lost = True
+            if self.reconnect() and message.id not in self._pending:
+                self._mmb.send_message(message)
 
     def disconnect(self):
         """Disconnects from the Motion Master"""
+        self._closing = True
+        if self._watchdog is not None:
+            self._wake_watchdog.set()
+            self._watchdog.join()
+            self._watchdog = None
+        for bridge in self._bridges:
+            bridge.dispose()
+        self._bridges = []
         self._mmb.disconnect()
 
+    def reconnect(self) -> bool:
+        """Connect again after the connection to the Motion Master was lost.
+
+        Waits with exponential backoff between the attempts. The device and parameter info is kept, monitoring of
+        the running collections is started again under the same topics and request IDs, and the requests that are
+        still waiting for a response are sent again. Does nothing if the connection was restored meanwhile, so a
+        loss seen by several threads reconnects and replays the pending requests once. A caller blocked in a request gets its response as if
+        nothing happened, as long as the reconnect is done within its timeout.
+
+        Returns
+        -------
+        bool
+            True if the connection is restored, False after `reconnect_attempts` failed attempts or on
+            `disconnect()`.
+        """
+        with self._connection_lock:
+            # Another thread that saw the same loss may have reconnected while this one waited for the lock.
+            if not self._lost:
+                return True
+            delay = RECONNECT_DELAY
+            attempt = 0
+            while not self._closing:
+                attempt += 1
+                try:
+                    self._mmb.disconnect()
+                except Exception as e:
+                    logger.debug("Disconnect before reconnecting failed: %s", e)
+                try:
+                    self._mmb.connect()
+                    self._mmb.enable_keepalive()
+                    self._bridge()
+                    if self._ping(HEARTBEAT_PERIOD):
+                        self._lost = False
+                        self._resynchronize()
+                        logger.info("Reconnected to Motion Master after %s attempts", attempt)
+                        return True
+                except Exception as e:
+                    logger.debug("Reconnect attempt %s failed: %s", attempt, e)
+                if self.reconnect_attempts is not None and attempt >= self.reconnect_attempts:
+                    logger.error("Could not reconnect to Motion Master in %s attempts", attempt)
+                    return False
+                time.sleep(delay)
+                delay = min(2 * delay, RECONNECT_MAX_DELAY)
+            return False
+
+    def _bridge(self):
+        """Forward the subjects of the current connection of the bindings into the subjects of the wrapper."""
+        for bridge in self._bridges:
+            bridge.dispose()
+        self._last_received = time.monotonic()
+        self._bridges = [
+            self._mmb.get_dealer_subject().subscribe(on_next=self._on_dealer_message,
+                                                     on_error=self._on_connection_error),
+            self._mmb.get_topics_subject().subscribe(on_next=self._on_topic_message,
+                                                     on_error=self._on_connection_error),
+        ]
+
+    def _on_dealer_message(self, data):
+        self._last_received = time.monotonic()
+        self._dealer_subject.on_next(data)
+
+    def _on_topic_message(self, data):
+        self._last_received = time.monotonic()
+        self._topics_subject.on_next(data)
+
+    def _on_connection_error(self, error):
+        logger.warning("Connection to Motion Master failed: %s", error)
+        self._lost = True
+        self._wake_watchdog.set()
+
+    def _ping(self, timeout: float) -> bool:
+        """Return True if the Motion Master answers a version request within the timeout."""
+        msg = MotionMasterMessage()
+        msg.id = str(uuid.uuid4())
+        msg.request.get_system_version.SetInParent()
+        answered = threading.Event()
+        disposable = self._dealer_subject.pipe(
+            ops.map(lambda data: decode(data[0])),
+            ops.filter(lambda decoded_message: decoded_message.id == msg.id),
+            ops.take(1),
+        ).subscribe(on_next=lambda _: answered.set())
+        try:
+            with self._connection_lock:
+                self._mmb.send_message(msg)
+            return answered.wait(timeout)
+        except Exception as e:
+            logger.debug("Ping failed: %s", e)
+            return False
+        finally:
+            disposable.dispose()
+
+    def _watch_connection(self):
+        """Check the connection whenever nothing was received for a heartbeat period, reconnect if it is lost."""
+        while not self._closing:
+            self._wake_watchdog.wait(HEARTBEAT_PERIOD)
+            self._wake_watchdog.clear()
+            if self._closing:
+                break
+            if not self._lost and time.monotonic() - self._last_received < HEARTBEAT_PERIOD:
+                continue
+            if self._lost or not self._ping(HEARTBEAT_PERIOD):
+                logger.warning("Lost connection to Motion Master, reconnecting...")
+                self._lost = True
+                self.reconnect()
+
+    def _resynchronize(self):
+        """Restart the running collections and replay the requests without response on a new connection."""
+        for topic_name, local_collection_topic in self.collection.items():
+            if local_collection_topic.get('is_active'):
+                self._mmb.subscribe_to_topic(topic_name)
+                self._mmb.send_message(local_collection_topic['start_message'])
+        for message in list(self._pending.values()):
+            if message is not None:
+                self._mmb.send_message(message)
+
     def _get_request_and_single_response_observable(self, description: str = None, timeout: int = None) -> Tuple[
         MotionMasterMessage, rx.Observable]:
         """Set up a unique request and an observable that filters for a single response.
@@ -116,11 +382,14 @@ class MotionMasterWrapper:
         else:
             message = "No response from Motion Master for message '{}'".format(description)
         # Build an observable that returns messages with the same unique_id.
-        obs = self._mmb.get_dealer_subject().pipe(
+        # Until then the request is pending, and replayed if the connection is restored in between.
+        self._pending[unique_id] = None
+        obs = self._dealer_subject.pipe(
             ops.map(lambda data: decode(data[0])),
             ops.filter(lambda decoded_message: decoded_message.id == unique_id),
             ops.take(1),
             ops.timeout(timeout, other=rx.throw(Exception(message))),
+            ops.finally_action(lambda: self._pending.pop(unique_id, None)),
         )
         # A ReplaySubject will cache the last object and re-send it on subscription.
         # This prevents the loss of a message before a subscription can be made.
@@ -325,40 +594,54 @@ class MotionMasterWrapper:
         OperationFailed
             When the set operation reports an error.
         """
+        self.set_device_parameter_values(device_address, [(index, subindex, value)])
+
+    def set_device_parameter_values(self, device_address: int, parameter_list: List[Tuple[int, int, Any]]):
+        """Set several parameters of a device with one request. This method blocks until all writes are confirmed.
+
+        The parameters are written in the order of the list, so a target can be written together with the
+        controlword that starts it.
 
+        Parameters
+        ----------
+        device_address : int
+            The unique identifier for the device you wish to use
+        parameter_list : List[Tuple[int, int, Any]]
+            Index, subindex and value of each object. The types are looked up from the device parameter info stored
+            locally.
+
+        Raises
+        ------
+        TypeError
+            When the type of a value can't be deduced.
+        OperationFailed
+            When a set operation reports an error.
+        """
         msg, obs = self._get_request_and_single_response_observable(
-            "set 0x{:04x}:{} to {}".format(index, subindex, value))
+            "set " + ", ".join("0x{:04x}:{} to {}".format(index, subindex, value)
+                               for index, subindex, value in parameter_list))
         msg.request.set_device_parameter_values.device_address = device_address
-        parameter = msg.request.set_device_parameter_values.parameter_values.add()
-        parameter.index = index
-        parameter.subindex = subindex
 
         # Set the value based on the type.
         if len(self.device_and_parameter_info_dict) == 0:
-            raise TypeError("Unclear how to encode {} in the message; dictionary is not populated.".format(value))
-
-        param_info = self.device_and_parameter_info_dict.get(str(device_address)).get('parameters').get(
-            "{:04x}:{}".format(index, subindex))
-        if param_info is None:
-            raise KeyError("Object 0x{:04x}:{} doesn't exist for device {}.".format(index, subindex, device_address))
-        if 1 <= param_info.value_type <= 7:
-            # Value is some type of integer.
-            parameter.int_value = value
-        elif param_info.value_type == 8:
-            parameter.float_value = value
-        elif param_info.value_type == 9:
-            parameter.string_value = value
-        elif 10 <= param_info.value_type <= 11:
-            parameter.raw_value = value
-        elif param_info.value_type == 12:
-            parameter.int_value = value
-        else:
-            raise TypeError("Type for object 0x{:04x}:{} isn't understood.".format(index, subindex))
+            raise TypeError("Unclear how to encode {} in the message; dictionary is not populated.".format(
+                parameter_list))
+
+        parameters_info = self.device_and_parameter_info_dict.get(str(device_address)).get('parameters')
+        for index, subindex, value in parameter_list:
+            parameter = msg.request.set_device_parameter_values.parameter_values.add()
+            parameter.index = index
+            parameter.subindex = subindex
+            param_info = parameters_info.get("{:04x}:{}".format(index, subindex))
+            if param_info is None:
+                raise KeyError("Object 0x{:04x}:{} doesn't exist for device {}.".format(index, subindex,
+                                                                                       device_address))
+            encode_parameter_value(parameter, param_info.value_type, value)
 
         self.send_to_motion_master(msg)
         message = obs.run()
-        return_parameter = message.status.device_parameter_values.parameter_values[0]
-        _check_device_parameter_value_status(return_parameter)
+        for return_parameter in message.status.device_parameter_values.parameter_values:
+            _check_device_parameter_value_status(return_parameter)
 
     def get_motion_master_version(self) -> str:
         """Return the version string of the Motion Master
@@ -428,7 +711,8 @@ class MotionMasterWrapper:
                 logger.info("  ...completed successfully.")
 
     def start_collection(self, topic_name: str, device_address: int, parameter_list: List[Tuple[int, int]],
-                         sampling_period_us: int = None, duration_s: float = None):
+                         sampling_period_us: int = None, duration_s: float = None, decimation: Decimation = None,
+                         trigger: Trigger = None):
         """Setup and start collection of the objects in the list.
 
         This will configure the Motion Master to monitor the objects and return their values at the specified frequency.
@@ -447,6 +731,10 @@ class MotionMasterWrapper:
         duration_s : float, optional
             The time in seconds to collect samples. Total number of samples is sampling_period_us * duration_s. If not
             specified, the collection will continue until canceled.
+        decimation : Decimation, optional
+            Keep only the minimum, maximum and mean of each window of samples.
+        trigger : Trigger, optional
+            Keep only the samples around the moments a condition becomes true.
 
         Raises
         ------
@@ -459,34 +747,119 @@ class MotionMasterWrapper:
         clear_collection
         retrieve_collection
         """
-        if topic_name in self.collection:
-            raise KeyError("Key `{}` already exists. Cancel or retrieve collection for this key first."
-                           .format(topic_name))
-
         # Init the collection with an empty list for each object.
-        local_collection_topic = OrderedDict()
-        for index, subindex in parameter_list:
-            local_collection_topic["{:04x}:{}".format(index, subindex)] = list()
-        local_collection_topic["time"] = list()
-        self.collection[topic_name] = local_collection_topic
+        keys = ["{:04x}:{}".format(index, subindex) for index, subindex in parameter_list]
+        local_collection_topic, put_sample = self._new_collection(topic_name, keys, decimation, trigger)
 
         # Build an observer that puts the message values into the array.
         def put_values_into_collection_array(message):
             """Assumes the message is already filtered for topic."""
-            local_collection_topic["time"].append(message.status.monitoring_parameter_values.timestamp)
+            values = {}
             for received_parameter_value in \
                     message.status.monitoring_parameter_values.device_parameter_values.parameter_values:
-                value = getattr(received_parameter_value, received_parameter_value.WhichOneof('type_value'))
-                local_collection_topic["{:04x}:{}".format(received_parameter_value.index,
-                                                          received_parameter_value.subindex)].append(value)
+                values["{:04x}:{}".format(received_parameter_value.index, received_parameter_value.subindex)] = \
+                    getattr(received_parameter_value, received_parameter_value.WhichOneof('type_value'))
+            put_sample(message.status.monitoring_parameter_values.timestamp, [values[key] for key in keys])
 
+        def add_parameters(start_monitoring):
+            get_device_parameter_values = start_monitoring.get_device_parameter_values
+            get_device_parameter_values.device_address = device_address
+            for index, subindex in parameter_list:
+                parameter = get_device_parameter_values.parameters.add()
+                parameter.index = index
+                parameter.subindex = subindex
+
+        self._start_monitoring(topic_name, local_collection_topic, put_values_into_collection_array, add_parameters,
+                               sampling_period_us, duration_s)
+
+    def start_multi_device_collection(self, topic_name: str,
+                                      request_list: List[Tuple[int, List[Tuple[int, int]]]],
+                                      sampling_period_us: int = None, duration_s: float = None,
+                                      decimation: Decimation = None, trigger: Trigger = None):
+        """Setup and start collection of objects of several devices in one topic.
+
+        One monitoring request covers all devices, like `get_multi_device_parameter_values()`, so every sample has
+        one timestamp for all devices and is decoded once. The collection has a 'device:index:subindex' key for
+        every object, i.e. '1:6064:0', and one 'time' column. Use it like a collection from `start_collection()`.
+
+        Parameters
+        ----------
+        topic_name : str
+            An identifier that should be unique to the running instance of Motion Master.
+        request_list : [(device_address, [(index, subindex)])]
+            A list of devices and for each device a list of objects to sample
+        sampling_period_us : int
+            Number of microseconds between samples.
+        duration_s : float, optional
+            The time in seconds to collect samples. If not specified, the collection will continue until canceled.
+        decimation : Decimation, optional
+            Keep only the minimum, maximum and mean of each window of samples.
+        trigger : Trigger, optional
+            Keep only the samples around the moments a condition becomes true.
+
+        Raises
+        ------
+        OperationFailed
+            If the Motion Master protocol has no monitoring of several devices.
+        """
+        if 'get_multi_device_parameter_values' not in \
+                MotionMasterMessage.Request.StartMonitoringDeviceParameterValues.DESCRIPTOR.fields_by_name:
+            raise OperationFailed("This Motion Master version can't monitor several devices in one topic.")
+
+        # The values come in the order of the request, so they are stored by position without looking at the keys.
+        local_collection_topic, put_sample = self._new_collection(
+            topic_name, ["{}:{:04x}:{}".format(device_address, index, subindex)
+                         for device_address, parameter_list in request_list for index, subindex in parameter_list],
+            decimation, trigger)
+
+        def put_values_into_collection_arrays(message):
+            """Assumes the message is already filtered for topic."""
+            monitoring_parameter_values = message.status.monitoring_parameter_values
+            put_sample(monitoring_parameter_values.timestamp,
+                       [getattr(received_parameter_value, received_parameter_value.WhichOneof('type_value'))
+                        for device_parameter_values in monitoring_parameter_values.multi_device_parameter_values.collection
+                        for received_parameter_value in device_parameter_values.parameter_values])
+
+        def add_parameters(start_monitoring):
+            collection = start_monitoring.get_multi_device_parameter_values.collection
+            for device_address, parameter_list in request_list:
+                get_device_parameter_values = collection.add()
+                get_device_parameter_values.device_address = device_address
+                for index, subindex in parameter_list:
+                    parameter = get_device_parameter_values.parameters.add()
+                    parameter.index = index
+                    parameter.subindex = subindex
+
+        self._start_monitoring(topic_name, local_collection_topic, put_values_into_collection_arrays, add_parameters,
+                               sampling_period_us, duration_s)
+
+    def _new_collection(self, topic_name: str, keys: List[str], decimation: Decimation = None,
+                        trigger: Trigger = None):
+        """Add a collection for the keys, return it and the function that stores one sample in it."""
+        if topic_name in self.collection:
+            raise KeyError("Key `{}` already exists. Cancel or retrieve collection for this key first."
+                           .format(topic_name))
+        local_collection_topic = OrderedDict()
+        put_sample = _collection_sink(local_collection_topic, keys, decimation, trigger)
+        self.collection[topic_name] = local_collection_topic
+        return local_collection_topic, put_sample
+
+    def _start_monitoring(self, topic_name: str, local_collection_topic: Dict[str, Any], put_values, add_parameters,
+                          sampling_period_us: int, duration_s: float):
+        """Subscribe the collection to its topic and request the Motion Master to start monitoring.
+
+        `put_values` stores the values of one monitoring message in the collection, `add_parameters` adds the
+        objects to the start monitoring request.
+        """
         def handle_completed_collection():
             """Stops the Motion Master monitoring and flags the data as complete."""
+            _flush_collection(local_collection_topic)
             local_collection_topic['is_complete'] = True
+            local_collection_topic['is_active'] = False
             # Request the Motion Master to kill the monitoring topic.
             msg = MotionMasterMessage()
             msg.id = str(uuid.uuid4())
-            msg.request.stop_monitor_device_parameter_values.start_monitoring_request_id = \
+            msg.request.stop_monitoring_device_parameter_values.start_monitoring_request_id = \
                 local_collection_topic['request_id']
             self.send_to_motion_master(msg)
 
@@ -496,19 +869,19 @@ class MotionMasterWrapper:
         if duration_s is None:
             # Complete means it can be retrieved immediately.
             local_collection_topic['is_complete'] = True
-            disposable = self._mmb.get_topics_subject().pipe(
+            disposable = self._topics_subject.pipe(
                 ops.filter(lambda data: data[0].decode("utf-8") == topic_name),  # topic must match
                 ops.map(lambda data: decode(data[1])),  # convert the data to a message
-            ).subscribe(observer=put_values_into_collection_array)
+            ).subscribe(observer=put_values)
         else:
             number_of_samples = int(duration_s * 1e6 / sampling_period_us)
             local_collection_topic['is_complete'] = False
-            disposable = self._mmb.get_topics_subject().pipe(
+            disposable = self._topics_subject.pipe(
                 ops.filter(lambda data: data[0].decode("utf-8") == topic_name),  # topic must match
                 ops.map(lambda data: decode(data[1])),  # convert the data to a message
                 ops.take(number_of_samples),  # kill obs after we've seen all the messages we want
                 ops.timeout(duration_s + self.timeout_s),  # default timeout after duration is exceeded
-            ).subscribe(observer=put_values_into_collection_array,
+            ).subscribe(observer=put_values,
                         on_completed=handle_completed_collection)
 
         # Save the resulting disposable for later reference.
@@ -521,12 +894,10 @@ class MotionMasterWrapper:
         local_collection_topic['request_id'] = unique_message_id
         msg.request.start_monitoring_device_parameter_values.topic = topic_name
         msg.request.start_monitoring_device_parameter_values.interval = sampling_period_us
-        get_device_parameter_values = msg.request.start_monitoring_device_parameter_values.get_device_parameter_values
-        get_device_parameter_values.device_address = device_address
-        for index, subindex in parameter_list:
-            parameter = get_device_parameter_values.parameters.add()
-            parameter.index = index
-            parameter.subindex = subindex
+        add_parameters(msg.request.start_monitoring_device_parameter_values)
+        # Kept to start the monitoring again after a reconnect.
+        local_collection_topic['start_message'] = msg
+        local_collection_topic['is_active'] = True
         self.send_to_motion_master(msg)
 
     def stop_collection(self, topic_name: str):
@@ -553,6 +924,8 @@ class MotionMasterWrapper:
             logger.warning("{} not inside collection".format(topic_name))
             return False
         local_collection_topic['disposable'].dispose()
+        _flush_collection(local_collection_topic)
+        local_collection_topic['is_active'] = False
         # Stop the monitoring service on the Motion Master.
         # TODO: I really wish there was a better way of triggering this message from the observer.
         msg = MotionMasterMessage()
@@ -2,8 +2,10 @@ from motion_master_wrapper import MotionMasterWrapper
 
 from typing import Any, List, Tuple, Dict
 from enum import Enum, unique
+from contextlib import contextmanager
 import time
 import logging
+import numpy as np
 
 logger = logging.getLogger(__name__)
 
@@ -105,6 +107,25 @@ class Controlword:
         self.value &= ~bits_in_word
         return self.value
 
+    def apply(self, set_bits: int = 0, clear_bits: int = 0) -> int:
+        """
+        Clear and set several bits in one step, so no intermediate controlword exists.
+
+        Parameters
+        ----------
+        set_bits : int
+            Bits to set
+        clear_bits : int
+            Bits to clear, before setting
+
+        Returns
+        -------
+        int
+            The new controlword
+        """
+        self.value = (self.value & ~clear_bits & 0xffff) | set_bits
+        return self.value
+
     def _bit_manipulator(self, bit: int, set_bit: bool = True):
         """
         Changes bit depending on set_bit.
@@ -622,6 +643,22 @@ class Statusword:
         homing_error_bit = 0b0010000000000000
         return self._compare(sw, homing_error_bit, homing_error_bit)
 
+    def is_set_point_acknowledged(self, sw=None) -> bool:
+        """Is the set-point acknowledge bit set? (Bit 12, Profile Position Mode)
+
+        Parameters
+        ----------
+        sw : int
+            Statusword. Will update the internal value.
+
+        Returns
+        -------
+        bool
+            True if the drive took the new set-point and can't buffer another one yet
+        """
+        set_point_acknowledge_bit = (1 << 12)
+        return self._compare(sw, set_point_acknowledge_bit, set_point_acknowledge_bit)
+
     def is_speed_zero(self, sw=None) -> bool:
         """
         Check, if bit 12 is set. (operation mode specific)
@@ -664,6 +701,104 @@ class Statusword:
                 self.update(sw)
                 return m.replace('is_', '')
 
+    # Bulk decoding of captured statuswords. The state codes index STATES, -1 is a statusword that matches no state.
+    STATES = ('state_not_ready_to_switch_on', 'state_switch_on_disabled', 'state_ready_to_switch_on',
+              'state_switched_on', 'state_operation_enabled', 'state_quick_stop_active',
+              'state_fault_reaction_active', 'state_fault')
+    _state_table = None
+
+    @staticmethod
+    def _get_state_table() -> np.ndarray:
+        """State code for each value of the 7 state bits, from the single-value `is_state_*()` methods."""
+        if Statusword._state_table is None:
+            table = np.full(128, -1, dtype=np.int8)
+            for bits in range(128):
+                for code, state in enumerate(Statusword.STATES):
+                    if getattr(Statusword(bits), 'is_' + state)():
+                        table[bits] = code
+            Statusword._state_table = table
+        return Statusword._state_table
+
+    @staticmethod
+    def decode_states(sw: np.ndarray) -> np.ndarray:
+        """
+        Return the state code of every statusword in an array, see STATES.
+
+        Parameters
+        ----------
+        sw : np.ndarray
+            Statuswords, any integer type
+
+        Returns
+        -------
+        np.ndarray
+            int8 state codes, -1 where no state matches
+        """
+        return Statusword._get_state_table()[np.asarray(sw) & 0x7F]
+
+    @staticmethod
+    def decode(sw: np.ndarray) -> Dict[str, np.ndarray]:
+        """
+        Decode an array of statuswords in one call.
+
+        Parameters
+        ----------
+        sw : np.ndarray
+            Statuswords, any integer type
+
+        Returns
+        -------
+        Dict[str, np.ndarray]
+            'state': state codes as `decode_states()`, 'fault' and 'warning': bool masks of the fault and warning
+            bits, 'target_reached': bool mask of bit 10, 'transitions': indices where the state differs from the
+            one before
+        """
+        sw = np.asarray(sw)
+        states = Statusword.decode_states(sw)
+        return {'state': states,
+                'fault': (sw & 0b0000000000001000) != 0,
+                'warning': (sw & 0b0000000010000000) != 0,
+                'target_reached': (sw & 0b0000010000000000) != 0,
+                'transitions': Statusword.state_transitions(states)}
+
+    @staticmethod
+    def state_transitions(states: np.ndarray) -> np.ndarray:
+        """Return the indices where the state code differs from the one before."""
+        states = np.asarray(states)
+        return np.flatnonzero(states[1:] != states[:-1]) + 1
+
+    @staticmethod
+    def state_intervals(sw: np.ndarray, time: np.ndarray = None) -> Dict[str, np.ndarray]:
+        """
+        Run-length summary of the states in an array of statuswords.
+
+        Parameters
+        ----------
+        sw : np.ndarray
+            Statuswords, any integer type
+        time : np.ndarray, optional
+            Timestamp of every statusword, to get the start time and duration of each interval
+
+        Returns
+        -------
+        Dict[str, np.ndarray]
+            'state': state code of each interval, 'start' and 'stop': index of the first sample and the one after
+            the last; with time also 'start_time' and 'duration' (until the first sample of the next interval, or
+            the last sample for the last interval)
+        """
+        states = Statusword.decode_states(sw)
+        if len(states) == 0:
+            start = stop = np.zeros(0, dtype=np.int64)
+        else:
+            start = np.concatenate(([0], Statusword.state_transitions(states)))
+            stop = np.append(start[1:], len(states))
+        intervals = {'state': states[start], 'start': start, 'stop': stop}
+        if time is not None:
+            time = np.asarray(time)
+            intervals['start_time'] = time[start]
+            intervals['duration'] = time[np.minimum(stop, len(states) - 1)] - time[start]
+        return intervals
+
 @unique
 class StateCommands(Enum):
     SHUTDOWN = 0x1
@@ -704,6 +839,7 @@ class StateControl:
     OD_STATUSWORD = (0x6041, 0)
     OD_OPERATIONMODE = (0x6060, 0)
     OD_OPERATIONMODEDISPLAY = (0x6061, 0)
+    OD_TARGET_POSITION = (0x607A, 0)
 
     TIMEOUT = 4  # s
     TIMEOUT_FIND_INDEX_PULL_BRAKE = 8 # s
@@ -736,6 +872,10 @@ class StateControl:
 
         self._fault_reset_counter = self.FAULT_RESET_TRY
 
+        # Nesting depth of controlword_transaction() and whether a write was held back in it.
+        self._cw_transaction = 0
+        self._cw_deferred = False
+
         logger.disabled = not log
 
     def _mmw_get_param(self, index: int, subindex: int) -> Any:
@@ -772,6 +912,17 @@ class StateControl:
         """
         self.mmw.set_device_parameter_value(self.dev_address, index, subindex, value)
 
+    def _mmw_set_params(self, parameters: List[Tuple[int, int, Any]]):
+        """
+        Set several parameters on device in one request, in the order of the list.
+
+        Parameters
+        ----------
+        parameters : List[Tuple[int, int, Any]]
+            Index, subindex and new value of each OD entry
+        """
+        self.mmw.set_device_parameter_values(self.dev_address, parameters)
+
     def _set_timeout(self, timeout: int):
         """
         (Re-)Set timeout.
@@ -822,9 +973,60 @@ class StateControl:
             Controlword value.
 
         """
+        if self._cw_transaction:
+            self._cw_deferred = True
+            return
         logger.debug("Controlword: {w:016b}, 0x{w:x}, {w}".format(w=int(self.cw)))
         self._mmw_set_param(*self.OD_CONTROLWORD, cw)
 
+    @contextmanager
+    def controlword_transaction(self):
+        """
+        Compose several controlword changes and send them as one write at the end of the block.
+
+        Inside the block the methods that change controlword bits only change the local controlword. Nested
+        transactions send once, at the end of the outermost. If the block raises, nothing is sent and the local
+        controlword is restored.
+
+        Usage
+        -----
+            with sc.controlword_transaction():
+                sc.change_set_point_now(False)
+                sc.change_on_set_point(False)
+                sc.new_setpoint()
+        """
+        start = int(self.cw)
+        self._cw_transaction += 1
+        try:
+            yield self.cw
+        except BaseException:
+            self._cw_transaction -= 1
+            self.cw.update(start)
+            if not self._cw_transaction:
+                self._cw_deferred = False
+            raise
+        self._cw_transaction -= 1
+        if not self._cw_transaction and self._cw_deferred:
+            self._cw_deferred = False
+            self._send_controlword(int(self.cw))
+
+    def _wait_statusword(self, condition, timeout: float, description: str):
+        """
+        Poll the statusword until the condition on it is true.
+
+        Raises
+        ------
+        ExceptionTimeout
+            If the condition isn't met within the timeout.
+        """
+        self._set_timeout(timeout)
+        while True:
+            self._update_statusword()
+            if condition(self.sw):
+                return
+            if time.time() > self.current_timeout:
+                raise ExceptionTimeout("Statusword 0x{:04x}: {} didn't happen.".format(int(self.sw), description))
+
     def set_op_mode(self, mode: OpModes):
         """
         Set operation mode on device.
@@ -1289,35 +1491,83 @@ class StateControl:
             If true, set bit, otherwise clear it
 
         """
-        self._send_controlword(self.cw.relative_position_mode(set_bit))
+        self._send_controlword(self.cw.change_on_set_point(set_bit))
 
     def pp_complete_next_position(self):
         """
         See first table row
         """
-        self.change_set_point_now(False)
-        self.change_on_set_point(False)
-        self.new_setpoint()
+        with self.controlword_transaction():
+            self.change_set_point_now(False)
+            self.change_on_set_point(False)
+            self.new_setpoint()
 
     def pp_start_next_position_now(self):
         """
         See second table row
         """
-        self.change_set_point_now()
-        self.new_setpoint()
+        with self.controlword_transaction():
+            self.change_set_point_now()
+            self.new_setpoint()
 
     def pp_finish_positioning_then_next(self):
         """
         See third table row
         """
-        self.change_on_set_point()
-        self.change_set_point_now(False)
-        self.new_setpoint()
+        with self.controlword_transaction():
+            self.change_on_set_point()
+            self.change_set_point_now(False)
+            self.new_setpoint()
 
     def pp_reset_bits(self):
         """
         Reset all position profile related bits
         """
-        self.change_on_set_point(False)
-        self.change_set_point_now(False)
-        self.new_setpoint(False)
+        with self.controlword_transaction():
+            self.change_on_set_point(False)
+            self.change_set_point_now(False)
+            self.new_setpoint(False)
+
+    def pp_stream(self, targets: List[int], change_set_point_now: bool = False, change_on_set_point: bool = False,
+                  timeout: float = None):
+        """
+        Send target positions back to back, pipelined with the set-point acknowledge handshake.
+
+        The next target is sent as soon as the drive has acknowledged the previous one and has room for another,
+        without waiting for target reached. Each target is written together with the new set-point bit in one
+        request. Returns when the drive has acknowledged the last target, use `is_target_reached()` to wait for the
+        end of the motion. The op mode must be PROFILE_POSITION and the drive in operation enabled.
+
+        Parameters
+        ----------
+        targets : List[int]
+            Target positions, absolute or relative depending on `relative_position_mode()`
+        change_set_point_now : bool
+            Bit 5, see the table above
+        change_on_set_point : bool
+            Bit 9, see the table above
+        timeout : float
+            Seconds to wait for each handshake step, TIMEOUT if None
+
+        Raises
+        ------
+        ExceptionTimeout
+            If the drive doesn't acknowledge a target in time.
+        """
+        if timeout is None:
+            timeout = self.TIMEOUT
+        mode_bits = (self.cw.PP_CHANGE_SET_POINT_NOW if change_set_point_now else 0) | \
+                    (self.cw.PP_CHANGE_ON_SET_POINT if change_on_set_point else 0)
+        if int(self.cw) & self.cw.PP_NEW_SETPOINT:
+            # Every target needs a rising edge of the new set-point bit.
+            self._send_controlword(self.cw.new_setpoint(False))
+        for target in targets:
+            # The drive clears the acknowledge when it can buffer the next set-point.
+            self._wait_statusword(lambda sw: not sw.is_set_point_acknowledged(), timeout, "set-point buffer free")
+            self.cw.apply(self.cw.PP_NEW_SETPOINT | mode_bits,
+                          self.cw.PP_NEW_SETPOINT | self.cw.PP_CHANGE_SET_POINT_NOW | self.cw.PP_CHANGE_ON_SET_POINT)
+            logger.debug("Target {}, controlword 0x{:x}".format(target, int(self.cw)))
+            self._mmw_set_params([(*self.OD_TARGET_POSITION, target), (*self.OD_CONTROLWORD, int(self.cw))])
+            self._wait_statusword(lambda sw: sw.is_set_point_acknowledged(), timeout,
+                                  "set-point {} acknowledged".format(target))
+            self._send_controlword(self.cw.new_setpoint(False))